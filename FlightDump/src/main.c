@@ -0,0 +1,222 @@
+/*
+ * Main for FlightDump.
+ *
+ * Prints out the last records of a flight recorder
+ * file, written by a program that called
+ * setFlightRecorderOn(), oldest first and laid out
+ * as setDebugPrintsOnToFile() would have written
+ * them.  The file can be read while the program is
+ * running or after it has died.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rob_system.h>
+
+/*
+ * MANIFEST CONSTANTS
+ */
+
+/* The number of bytes on each line of a hex dump */
+#define HEX_DUMP_BYTES_PER_LINE 8
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+static FlightRecorderHeader gFileHeader;
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Print the time of a record: the wall clock
+ * time, in seconds and microseconds, worked
+ * out from the clocks in the file header.
+ *
+ * pOutput  where to print.
+ * timeNs   the monotonic time of the record.
+ */
+static void printTime (FILE *pOutput, uint64_t timeNs)
+{
+    uint64_t realTimeNs = gFileHeader.realTimeNs + (timeNs - gFileHeader.monotonicTimeNs);
+
+    fprintf (pOutput, "%.10llu.%.6llu: ", (unsigned long long) (realTimeNs / 1000000000ULL), (unsigned long long) ((realTimeNs / 1000) % 1000000));
+}
+
+/*
+ * Compare the sequence numbers of two
+ * records, for qsort().
+ *
+ * pA  pointer to a pointer to one record.
+ * pB  pointer to a pointer to the other.
+ *
+ * @return  less than, equal to or greater
+ *          than zero as the first record
+ *          comes before, with or after the
+ *          second.
+ */
+static int compareRecords (const void *pA, const void *pB)
+{
+    const FlightRecord *pRecordA = *(const FlightRecord * const *) pA;
+    const FlightRecord *pRecordB = *(const FlightRecord * const *) pB;
+    int result = 0;
+
+    if (pRecordA->sequence < pRecordB->sequence)
+    {
+        result = -1;
+    }
+    else if (pRecordA->sequence > pRecordB->sequence)
+    {
+        result = 1;
+    }
+
+    return result;
+}
+
+/*
+ * Print a record, laid out as printDebug()
+ * or printHexDump() would have printed it.
+ *
+ * pOutput  where to print.
+ * pRecord  the record.
+ */
+static void printRecord (FILE *pOutput, const FlightRecord *pRecord)
+{
+    UInt8 line[HEX_DUMP_BYTES_PER_LINE];
+    UInt32 length = pRecord->length;
+    UInt32 i;
+
+    if (length > sizeof (pRecord->data))
+    {
+        length = sizeof (pRecord->data);
+    }
+
+    switch (pRecord->type)
+    {
+        case BINARY_LOG_TEXT:
+        {
+            printTime (pOutput, pRecord->timeNs);
+            fwrite (pRecord->data, 1, length, pOutput);
+        }
+        break;
+        case BINARY_LOG_HEX_DUMP:
+        {
+            printTime (pOutput, pRecord->timeNs);
+            fprintf (pOutput, "Printing at least %d bytes:\n", pRecord->size);
+            for (i = 0; i < length; i += HEX_DUMP_BYTES_PER_LINE)
+            {
+                memset (line, 0, sizeof (line));
+                memcpy (line, pRecord->data + i, (length - i < sizeof (line)) ? length - i : sizeof (line));
+                printTime (pOutput, pRecord->timeNs);
+                fprintf (pOutput, "0x%.8lx: 0x%.2x 0x%.2x 0x%.2x 0x%.2x : 0x%.2x 0x%.2x 0x%.2x 0x%.2x\n", i, line[0], line[1], line[2], line[3], line[4], line[5], line[6], line[7]);
+            }
+            if (pRecord->size > length)
+            {
+                printTime (pOutput, pRecord->timeNs);
+                fprintf (pOutput, "(%d more bytes not kept)\n", (int) (pRecord->size - length));
+            }
+        }
+        break;
+        default:
+        {
+            fprintf (pOutput, "!!! Unknown record type 0x%.2x !!!\n", pRecord->type);
+        }
+        break;
+    }
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Entry point
+ */
+int main (int argc, char **argv)
+{
+    FILE *pInput;
+    FlightRecord *pRecords = PNULL;
+    FlightRecord **ppSorted = PNULL;
+    UInt32 numWritten = 0;
+    UInt32 numToPrint = 0;
+    UInt32 x;
+    Bool success = false;
+
+    if ((argc < 2) || (argc > 3))
+    {
+        fprintf (stderr, "Usage: %s flight_recorder_file [number_of_records]\n", argv[0]);
+    }
+    else
+    {
+        pInput = fopen (argv[1], "rb");
+        if (pInput == PNULL)
+        {
+            fprintf (stderr, "Couldn't open %s.\n", argv[1]);
+        }
+        else
+        {
+            if ((fread (&gFileHeader, sizeof (gFileHeader), 1, pInput) != 1) ||
+                (memcmp (gFileHeader.magic, FLIGHT_RECORDER_MAGIC, sizeof (gFileHeader.magic)) != 0) ||
+                (gFileHeader.recordLength != sizeof (FlightRecord)))
+            {
+                fprintf (stderr, "%s isn't a flight recorder file.\n", argv[1]);
+            }
+            else
+            {
+                pRecords = malloc (gFileHeader.numRecords * sizeof (FlightRecord));
+                ppSorted = malloc (gFileHeader.numRecords * sizeof (FlightRecord *));
+                if ((pRecords == PNULL) || (ppSorted == PNULL))
+                {
+                    fprintf (stderr, "Not enough memory for %u records.\n", gFileHeader.numRecords);
+                }
+                else if (fread (pRecords, sizeof (FlightRecord), gFileHeader.numRecords, pInput) != gFileHeader.numRecords)
+                {
+                    fprintf (stderr, "%s is too short.\n", argv[1]);
+                }
+                else
+                {
+                    success = true;
+
+                    /* Records still being written when the file was read, or when the program died, are left out */
+                    for (x = 0; x < gFileHeader.numRecords; x++)
+                    {
+                        if (pRecords[x].sequence != 0)
+                        {
+                            ppSorted[numWritten] = &(pRecords[x]);
+                            numWritten++;
+                        }
+                    }
+                    qsort (ppSorted, numWritten, sizeof (ppSorted[0]), compareRecords);
+
+                    numToPrint = numWritten;
+                    if (argc > 2)
+                    {
+                        numToPrint = strtoul (argv[2], PNULL, 10);
+                        if (numToPrint > numWritten)
+                        {
+                            numToPrint = numWritten;
+                        }
+                    }
+
+                    printf ("%lu record(s) ever written, %lu kept, the last %lu follow.\n", (unsigned long) gFileHeader.nextSequence, numWritten, numToPrint);
+                    for (x = numWritten - numToPrint; x < numWritten; x++)
+                    {
+                        if ((x > numWritten - numToPrint) && (ppSorted[x]->sequence != ppSorted[x - 1]->sequence + 1))
+                        {
+                            printf ("!!! %lu record(s) missing, part written !!!\n", (unsigned long) (ppSorted[x]->sequence - ppSorted[x - 1]->sequence - 1));
+                        }
+                        printRecord (stdout, ppSorted[x]);
+                    }
+                }
+                free (ppSorted);
+                free (pRecords);
+            }
+            fclose (pInput);
+        }
+    }
+
+    return success ? 0 : -1;
+}
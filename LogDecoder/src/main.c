@@ -0,0 +1,408 @@
+/*
+ * Main for LogDecoder.
+ *
+ * Turns a binary debug log, written by a program
+ * that called setDebugPrintsOnToBinaryFile(), back
+ * into text, laid out as setDebugPrintsOnToFile()
+ * would have written it.  Built for and run on the
+ * machine that the logs are read on, not the Pi.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rob_system.h>
+
+/*
+ * MANIFEST CONSTANTS
+ */
+
+/* Format IDs are UInt16s */
+#define MAX_NUM_FORMATS 0x10000
+
+/* The longest conversion specification, e.g. "%-38s" */
+#define MAX_SPECIFICATION_LENGTH 32
+
+/* The number of bytes on each line of a hex dump */
+#define HEX_DUMP_BYTES_PER_LINE 8
+
+/*
+ * TYPES
+ */
+
+/* A format, as given in a format record */
+typedef struct DecoderFormatTag
+{
+    Char *pFormat;     /* PNULL if there's been no format record for it */
+    UInt8 numArgs;
+    UInt8 argType[BINARY_LOG_MAX_ARGS];
+} DecoderFormat;
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+static DecoderFormat gFormat[MAX_NUM_FORMATS];
+static UInt8 gRecordData[0x10000];
+static BinaryLogFileHeader gFileHeader;
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Print the time of a record: the wall clock
+ * time, in seconds and nanoseconds, worked out
+ * from the clocks in the file header.
+ *
+ * pOutput  where to print.
+ * timeNs   the monotonic time of the record.
+ */
+static void printTime (FILE *pOutput, uint64_t timeNs)
+{
+    uint64_t realTimeNs = gFileHeader.realTimeNs + (timeNs - gFileHeader.monotonicTimeNs);
+
+    fprintf (pOutput, "%.10llu.%.9llu: ", (unsigned long long) (realTimeNs / 1000000000ULL), (unsigned long long) (realTimeNs % 1000000000ULL));
+}
+
+/*
+ * Keep a format from a format record.
+ *
+ * formatId  the ID of the format.
+ * pData     the body of the record.
+ * length    the length of the body.
+ *
+ * @return   true if successful, otherwise false.
+ */
+static Bool keepFormat (UInt16 formatId, const UInt8 *pData, UInt16 length)
+{
+    DecoderFormat *pFormat = &(gFormat[formatId]);
+    UInt32 formatLength;
+    Bool success = false;
+
+    if ((length > 0) && (pData[0] <= BINARY_LOG_MAX_ARGS) && (length >= 1 + pData[0]))
+    {
+        free (pFormat->pFormat);
+        pFormat->numArgs = pData[0];
+        memcpy (pFormat->argType, &(pData[1]), pFormat->numArgs);
+        formatLength = length - 1 - pFormat->numArgs;
+        pFormat->pFormat = malloc (formatLength + 1);
+        if (pFormat->pFormat != PNULL)
+        {
+            memcpy (pFormat->pFormat, &(pData[1 + pFormat->numArgs]), formatLength);
+            pFormat->pFormat[formatLength] = 0;
+            success = true;
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Print one argument of a print record with
+ * the conversion specification from its format.
+ *
+ * pOutput         where to print.
+ * pSpecification  the conversion specification.
+ * argType         the type of the argument.
+ * ppData          pointer to where the argument is
+ *                 in the record, moved on past it.
+ * pEnd            the end of the record.
+ *
+ * @return         true if the argument was there,
+ *                 otherwise false.
+ */
+static Bool printArg (FILE *pOutput, const Char *pSpecification, UInt8 argType, const UInt8 **ppData, const UInt8 *pEnd)
+{
+    const UInt8 *pData = *ppData;
+    uint64_t value;
+    double real;
+    UInt16 length;
+    Char *pString;
+    Bool success = false;
+
+    if (argType == BINARY_LOG_ARG_STRING)
+    {
+        if (pData + sizeof (length) <= pEnd)
+        {
+            memcpy (&length, pData, sizeof (length));
+            pData += sizeof (length);
+            if (pData + length <= pEnd)
+            {
+                pString = malloc (length + 1);
+                if (pString != PNULL)
+                {
+                    memcpy (pString, pData, length);
+                    pString[length] = 0;
+                    fprintf (pOutput, pSpecification, pString);
+                    free (pString);
+                    pData += length;
+                    success = true;
+                }
+            }
+        }
+    }
+    else if (pData + sizeof (value) <= pEnd)
+    {
+        memcpy (&value, pData, sizeof (value));
+        pData += sizeof (value);
+        success = true;
+        switch (argType)
+        {
+            case BINARY_LOG_ARG_INT:
+            {
+                fprintf (pOutput, pSpecification, (int) value);
+            }
+            break;
+            case BINARY_LOG_ARG_UNSIGNED_INT:
+            {
+                fprintf (pOutput, pSpecification, (unsigned int) value);
+            }
+            break;
+            case BINARY_LOG_ARG_LONG:
+            {
+                fprintf (pOutput, pSpecification, (long) value);
+            }
+            break;
+            case BINARY_LOG_ARG_UNSIGNED_LONG:
+            {
+                fprintf (pOutput, pSpecification, (unsigned long) value);
+            }
+            break;
+            case BINARY_LOG_ARG_LONG_LONG:
+            {
+                fprintf (pOutput, pSpecification, (unsigned long long) value);
+            }
+            break;
+            case BINARY_LOG_ARG_DOUBLE:
+            {
+                memcpy (&real, &value, sizeof (real));
+                fprintf (pOutput, pSpecification, real);
+            }
+            break;
+            case BINARY_LOG_ARG_POINTER:
+            {
+                fprintf (pOutput, pSpecification, (void *) (uintptr_t) value);
+            }
+            break;
+            default:
+            {
+                success = false;
+            }
+            break;
+        }
+    }
+
+    *ppData = pData;
+
+    return success;
+}
+
+/*
+ * Print a print record using its format.
+ *
+ * pOutput  where to print.
+ * pFormat  the format.
+ * pData    the body of the record.
+ * length   the length of the body.
+ */
+static void printPrint (FILE *pOutput, const DecoderFormat *pFormat, const UInt8 *pData, UInt16 length)
+{
+    const Char *pChar = pFormat->pFormat;
+    const UInt8 *pEnd = pData + length;
+    Char specification[MAX_SPECIFICATION_LENGTH];
+    Char *pSize;
+    UInt32 specificationLength;
+    UInt32 argIndex = 0;
+    Bool success = true;
+
+    while (success && (*pChar != 0))
+    {
+        if (*pChar != '%')
+        {
+            fputc (*pChar, pOutput);
+            pChar++;
+        }
+        else
+        {
+            specificationLength = 1 + strspn (pChar + 1, "-+ #0123456789.hlz");
+            if (pChar[specificationLength] == '%')
+            {
+                fputc ('%', pOutput);
+            }
+            else if ((pChar[specificationLength] != 0) && (specificationLength < sizeof (specification) - 1) && (argIndex < pFormat->numArgs))
+            {
+                memcpy (specification, pChar, specificationLength + 1);
+                specification[specificationLength + 1] = 0;
+                /* A size_t on the Pi is the size of a long there, which needn't be true here */
+                for (pSize = strchr (specification, 'z'); pSize != PNULL; pSize = strchr (pSize, 'z'))
+                {
+                    *pSize = 'l';
+                }
+                success = printArg (pOutput, specification, pFormat->argType[argIndex], &pData, pEnd);
+                argIndex++;
+            }
+            else
+            {
+                success = false;
+            }
+            if (success)
+            {
+                pChar += specificationLength + 1;
+            }
+        }
+    }
+
+    if (!success)
+    {
+        fprintf (pOutput, "!!! Couldn't decode the rest of this print, format \"%s\" !!!\n", pFormat->pFormat);
+    }
+}
+
+/*
+ * Print a hex dump record, laid out as
+ * printHexDump() would have printed it.
+ *
+ * pOutput  where to print.
+ * timeNs   the time of the record.
+ * pData    the body of the record.
+ * length   the length of the body.
+ */
+static void printHexDumpRecord (FILE *pOutput, uint64_t timeNs, const UInt8 *pData, UInt16 length)
+{
+    uint64_t address;
+    UInt16 size;
+    UInt8 line[HEX_DUMP_BYTES_PER_LINE];
+    UInt32 numBytes;
+    UInt32 i;
+
+    if (length >= sizeof (address) + sizeof (size))
+    {
+        memcpy (&address, pData, sizeof (address));
+        memcpy (&size, pData + sizeof (address), sizeof (size));
+        pData += sizeof (address) + sizeof (size);
+        numBytes = length - sizeof (address) - sizeof (size);
+
+        printTime (pOutput, timeNs);
+        fprintf (pOutput, "Printing at least %d bytes:\n", size);
+        for (i = 0; i < numBytes; i += HEX_DUMP_BYTES_PER_LINE)
+        {
+            memset (line, 0, sizeof (line));
+            memcpy (line, pData + i, (numBytes - i < sizeof (line)) ? numBytes - i : sizeof (line));
+            printTime (pOutput, timeNs);
+            fprintf (pOutput, "0x%.8llx: 0x%.2x 0x%.2x 0x%.2x 0x%.2x : 0x%.2x 0x%.2x 0x%.2x 0x%.2x\n", (unsigned long long) (address + i), line[0], line[1], line[2], line[3], line[4], line[5], line[6], line[7]);
+        }
+        if (size > numBytes)
+        {
+            printTime (pOutput, timeNs);
+            fprintf (pOutput, "(%d more bytes not kept)\n", (int) (size - numBytes));
+        }
+    }
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Entry point
+ */
+int main (int argc, char **argv)
+{
+    FILE *pInput;
+    FILE *pOutput = stdout;
+    BinaryLogRecordHeader header;
+    Bool success = false;
+
+    if ((argc < 2) || (argc > 3))
+    {
+        fprintf (stderr, "Usage: %s binary_log_file [text_output_file]\n", argv[0]);
+    }
+    else
+    {
+        pInput = fopen (argv[1], "rb");
+        if (pInput == PNULL)
+        {
+            fprintf (stderr, "Couldn't open %s.\n", argv[1]);
+        }
+        else
+        {
+            if (argc > 2)
+            {
+                pOutput = fopen (argv[2], "w");
+            }
+            if (pOutput == PNULL)
+            {
+                fprintf (stderr, "Couldn't open %s.\n", argv[2]);
+            }
+            else if ((fread (&gFileHeader, sizeof (gFileHeader), 1, pInput) != 1) || (memcmp (gFileHeader.magic, BINARY_LOG_MAGIC, sizeof (gFileHeader.magic)) != 0))
+            {
+                fprintf (stderr, "%s isn't a binary debug log.\n", argv[1]);
+            }
+            else
+            {
+                success = true;
+                while (success && (fread (&header, sizeof (header), 1, pInput) == 1))
+                {
+                    if (fread (gRecordData, 1, header.length, pInput) != header.length)
+                    {
+                        fprintf (pOutput, "!!! The log ends part way through a record !!!\n");
+                        success = false;
+                    }
+                    else
+                    {
+                        switch (header.type)
+                        {
+                            case BINARY_LOG_FORMAT:
+                            {
+                                if (!keepFormat (header.formatId, gRecordData, header.length))
+                                {
+                                    fprintf (pOutput, "!!! Bad format record for format ID %d !!!\n", header.formatId);
+                                }
+                            }
+                            break;
+                            case BINARY_LOG_PRINT:
+                            {
+                                printTime (pOutput, header.timeNs);
+                                if (gFormat[header.formatId].pFormat != PNULL)
+                                {
+                                    printPrint (pOutput, &(gFormat[header.formatId]), gRecordData, header.length);
+                                }
+                                else
+                                {
+                                    fprintf (pOutput, "!!! Print with unknown format ID %d !!!\n", header.formatId);
+                                }
+                            }
+                            break;
+                            case BINARY_LOG_TEXT:
+                            {
+                                printTime (pOutput, header.timeNs);
+                                fwrite (gRecordData, 1, header.length, pOutput);
+                            }
+                            break;
+                            case BINARY_LOG_HEX_DUMP:
+                            {
+                                printHexDumpRecord (pOutput, header.timeNs, gRecordData, header.length);
+                            }
+                            break;
+                            default:
+                            {
+                                /* The length is known, so skip it */
+                                fprintf (pOutput, "!!! Unknown record type 0x%.2x !!!\n", header.type);
+                            }
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if ((pOutput != PNULL) && (pOutput != stdout))
+            {
+                fclose (pOutput);
+            }
+            fclose (pInput);
+        }
+    }
+
+    return success ? 0 : -1;
+}
@@ -6,6 +6,14 @@
  * MANIFEST CONSTANTS
  */
 
+/* The most messages that can be sent in one go with
+ * runMessagingClientBatch(): each needs a request ID */
+#define MESSAGING_CLIENT_MAX_BATCH_SIZE 0xFFFF
+
+/* The most requests started with startMessagingClientRequest()
+ * that can be waiting for their responses at once */
+#define MESSAGING_CLIENT_MAX_STARTED_REQUESTS 32
+
 /*
  * TYPES
  */
@@ -20,11 +28,68 @@ typedef enum ClientReturnCodeTag
     CLIENT_ERR_FAILED_TO_CREATE_SOCKET = -4,
     CLIENT_ERR_SEND_MESSAGE_IS_PNULL = -5,
     CLIENT_ERR_MESSAGE_FROM_SERVER_INCOMPLETE_OR_TOO_LONG = -6,
-    CLIENT_ERR_FAILED_ON_RECV = -7
+    CLIENT_ERR_FAILED_ON_RECV = -7,
+    CLIENT_ERR_UNEXPECTED_RESPONSE = -8,
+    CLIENT_ERR_TOO_MANY_REQUESTS = -9
 } ClientReturnCode;
 
+/* The ways of reaching a server on the same machine */
+typedef enum MessagingLocalTransportTag
+{
+    MESSAGING_LOCAL_TRANSPORT_TCP,
+    MESSAGING_LOCAL_TRANSPORT_UNIX,
+    MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY
+} MessagingLocalTransport;
+
+/* A pair of message buffers for one exchange with a
+ * server, see getMessagingClientMsgs() */
+typedef struct MessagingClientMsgsTag
+{
+    Msg sendMsg;
+    Msg receivedMsg;
+} MessagingClientMsgs;
+
+/* A message to send with runMessagingClientBatch() and
+ * where to put the response */
+typedef struct MessagingClientExchangeTag
+{
+    Msg *pSendMsg;
+    Msg *pReceivedMsg;     /* PNULL if no response is expected */
+} MessagingClientExchange;
+
+/* Where to put the response to a message sent with
+ * runMessagingClientLarge() */
+typedef struct MessagingClientLargeResponseTag
+{
+    MsgType msgType;
+    void *pBody;
+    UInt32 maxBodyLength;  /* the room there is at pBody */
+    UInt32 bodyLength;     /* filled in with the length of the body received */
+} MessagingClientLargeResponse;
+
+/* Called with the response to a request started with
+ * startMessagingClientRequest(): pReceivedMsg is only valid
+ * during the call and is PNULL unless returnCode is
+ * CLIENT_SUCCESS */
+typedef void (*MessagingClientCallback) (ClientReturnCode returnCode, Msg *pReceivedMsg, void *pContext);
+
 /*
  * FUNCTION PROTOTYPES
  */
 
-ClientReturnCode runMessagingClient (UInt16 serverPort, Char *pIpAddress, Msg *pSendMsg, Msg *pReceivedMsg);
\ No newline at end of file
+ClientReturnCode runMessagingClient (UInt16 serverPort, Char *pIpAddress, Msg *pSendMsg, Msg *pReceivedMsg);
+ClientReturnCode runMessagingClientBatch (UInt16 serverPort, Char *pIpAddress, MessagingClientExchange *pExchanges, UInt32 numExchanges);
+void setMessagingClientConnectionPoolingOn (void);
+void setMessagingClientConnectionPoolingOff (void);
+void setMessagingClientLocalTransport (MessagingLocalTransport transport);
+void closeMessagingClientConnections (void);
+MessagingClientMsgs *getMessagingClientMsgs (void);
+ClientReturnCode startMessagingClientRequest (UInt16 serverPort, Char *pIpAddress, Msg *pSendMsg, MessagingClientCallback pCallback, void *pContext);
+SInt32 getMessagingClientPollFd (void);
+UInt32 pollMessagingClientRequests (SInt32 timeoutMs);
+ClientReturnCode sendMessagingClientDatagram (UInt16 serverPort, Char *pIpAddress, Msg *pSendMsg);
+ClientReturnCode trySendMessagingClientDatagram (UInt16 serverPort, Msg **ppSendMsgs, UInt32 numMsgs);
+ClientReturnCode runMessagingClientLarge (UInt16 serverPort, Char *pIpAddress, MsgType msgType, const void *pSendBody, UInt32 sendBodyLength, MessagingClientLargeResponse *pResponse);
+ClientReturnCode getMessagingServerStats (UInt16 serverPort, Char *pIpAddress, MsgType msgType, MessagingMsgTypeStats *pStats);
+ClientReturnCode subscribeMessagingServerTopic (UInt16 serverPort, Char *pIpAddress, MessagingTopic topic, UInt16 subscriberPort, UInt32 minIntervalMs, UInt32 maxIntervalMs);
+ClientReturnCode unsubscribeMessagingServerTopic (UInt16 serverPort, Char *pIpAddress, MessagingTopic topic, UInt16 subscriberPort);
\ No newline at end of file
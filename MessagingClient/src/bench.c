@@ -0,0 +1,671 @@
+/*
+ * bench.c
+ * Throughput and latency benchmark for the messaging
+ * client and server libraries over loopback and shared
+ * memory: an echo server (the test server) and a number
+ * of client threads, or processes, which each send
+ * messages one after the other, for a sweep of message
+ * lengths up to MAX_MSG_LENGTH.  For each transport and
+ * length it reports msgs/s, round trip p50/p99/p999, CPU
+ * time per message (client plus server) and system calls
+ * per message (client plus server).  Counting system
+ * calls needs the raw_syscalls tracepoint, so tracefs
+ * and root (or perf_event_paranoid -1); without them
+ * that column is n/a.  Needs no Pi hardware.
+ *
+ * Usage: bench_client [-n msgs] [-c clients] [-p] [-w]
+ *   -n  the number of messages each client sends for
+ *       each length (default DEFAULT_NUM_MSGS).
+ *   -c  the number of clients (default 1, at most
+ *       MAX_NUM_CLIENTS).
+ *   -p  run the clients as processes rather than threads.
+ *   -w  have the echo server handle messages on worker
+ *       threads.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <unistd.h> /* for fork */
+#include <sys/types.h> /* for pid_t */
+#include <sys/wait.h> /* for wait */
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <signal.h> /* for kill */
+#include <pthread.h>
+#include <linux/perf_event.h>
+#include <rob_system.h>
+#include <messaging_server.h>
+#include <messaging_client.h>
+
+/*
+ * MANIFEST CONSTANTS
+ */
+
+#define SERVER_EXE "./test_server"
+#define SERVER_PORT_STRING "5001"
+#define DEFAULT_NUM_MSGS 10000
+#define BENCH_MSG_BODY_LENGTH 16
+
+/* The most clients: beyond MAX_NUM_POOLED_CONNECTIONS (16) in the
+ * messaging client, clients that are threads connect per message */
+#define MAX_NUM_CLIENTS 64
+
+/* Where to find the ID of the tracepoint hit on entry to every system call */
+#define SYSCALL_TRACEPOINT_ID_FILE "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id"
+#define SYSCALL_TRACEPOINT_ID_FILE_OLD "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+
+/*
+ * TYPES
+ */
+
+/* A way of reaching the echo server */
+typedef struct BenchTransportTag
+{
+    const Char *pName;
+    MessagingLocalTransport transport;
+    Bool isPooled;
+} BenchTransport;
+
+/* What one client does and how it went */
+typedef struct BenchClientTag
+{
+    UInt16 serverPort;
+    MsgLength msgLength;
+    UInt32 numMsgs;
+    double *pTimes;           /* room for numMsgs round trip times, in microseconds */
+    Bool success;
+} BenchClient;
+
+/* The resources used by the clients and the server */
+typedef struct BenchUsageTag
+{
+    double cpuUs;
+    uint64_t numSyscalls;
+} BenchUsage;
+
+/*
+ * EXTERN
+ */
+
+extern int errno;
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+/* The transports compared */
+static const BenchTransport gTransports[] =
+{
+    {"TCP, connection per message", MESSAGING_LOCAL_TRANSPORT_TCP, false},
+    {"TCP, pooled connection", MESSAGING_LOCAL_TRANSPORT_TCP, true},
+    {"Unix, connection per message", MESSAGING_LOCAL_TRANSPORT_UNIX, false},
+    {"Unix, pooled connection", MESSAGING_LOCAL_TRANSPORT_UNIX, true},
+    {"Shared memory, connection per message", MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY, false},
+    {"Shared memory, pooled connection", MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY, true}
+};
+
+/* The message lengths swept through */
+static const MsgLength gMsgLengths[] = {MIN_MSG_LENGTH, 16, 64, 128, MAX_MSG_LENGTH};
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Get a monotonic time in microseconds.
+ *
+ * @return  the time in microseconds.
+ */
+static double getTimeMicroSeconds (void)
+{
+    struct timespec time;
+
+    clock_gettime (CLOCK_MONOTONIC, &time);
+
+    return ((double) time.tv_sec * 1000000) + ((double) time.tv_nsec / 1000);
+}
+
+/*
+ * Compare two round trip times for qsort().
+ *
+ * pTime1  pointer to the first time.
+ * pTime2  pointer to the second time.
+ *
+ * @return less than, equal to or greater than
+ *         zero as the first time is less than,
+ *         equal to or greater than the second.
+ */
+static int compareTimes (const void *pTime1, const void *pTime2)
+{
+    double time1 = *(const double *) pTime1;
+    double time2 = *(const double *) pTime2;
+
+    return (time1 > time2) - (time1 < time2);
+}
+
+/*
+ * Start counting the system calls made by a process,
+ * and by the threads and processes it starts from now
+ * on.
+ *
+ * pid     the process, 0 for this one.
+ *
+ * @return  the counter or -1 if system calls can't
+ *          be counted.
+ */
+static SInt32 openSyscallCounter (pid_t pid)
+{
+    SInt32 counter = -1;
+    struct perf_event_attr attr;
+    FILE *pFile;
+    unsigned long long id;
+
+    pFile = fopen (SYSCALL_TRACEPOINT_ID_FILE, "r");
+    if (pFile == PNULL)
+    {
+        pFile = fopen (SYSCALL_TRACEPOINT_ID_FILE_OLD, "r");
+    }
+    if (pFile != PNULL)
+    {
+        if (fscanf (pFile, "%llu", &id) == 1)
+        {
+            memset (&attr, 0, sizeof (attr));
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof (attr);
+            attr.config = id;
+            attr.inherit = 1;
+            counter = syscall (SYS_perf_event_open, &attr, pid, -1, -1, 0);
+        }
+        fclose (pFile);
+    }
+
+    return counter;
+}
+
+/*
+ * Read a system call counter.
+ *
+ * counter  the counter, may be -1.
+ *
+ * @return  the count, 0 if there is no counter.
+ */
+static uint64_t readSyscallCounter (SInt32 counter)
+{
+    uint64_t count = 0;
+
+    if ((counter >= 0) && (read (counter, &count, sizeof (count)) != sizeof (count)))
+    {
+        count = 0;
+    }
+
+    return count;
+}
+
+/*
+ * Get the CPU time used by another process so far.
+ *
+ * pid      the process.
+ *
+ * @return  the CPU time, user plus system, in
+ *          microseconds (with the resolution of
+ *          a clock tick).
+ */
+static double getProcessCpuUs (pid_t pid)
+{
+    double cpuUs = 0;
+    Char fileName[32];
+    FILE *pFile;
+    unsigned long userTicks;
+    unsigned long systemTicks;
+
+    snprintf (fileName, sizeof (fileName), "/proc/%d/stat", pid);
+    pFile = fopen (fileName, "r");
+    if (pFile != PNULL)
+    {
+        /* utime and stime are the 14th and 15th fields, after a command name that has no spaces in it here */
+        if (fscanf (pFile, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &userTicks, &systemTicks) == 2)
+        {
+            cpuUs = (double) (userTicks + systemTicks) * 1000000 / sysconf (_SC_CLK_TCK);
+        }
+        fclose (pFile);
+    }
+
+    return cpuUs;
+}
+
+/*
+ * Get the CPU time used by this process, and by the
+ * child processes it has waited for, so far.
+ *
+ * @return  the CPU time, user plus system, in
+ *          microseconds.
+ */
+static double getOwnCpuUs (void)
+{
+    struct rusage self;
+    struct rusage children;
+
+    getrusage (RUSAGE_SELF, &self);
+    getrusage (RUSAGE_CHILDREN, &children);
+
+    return ((double) (self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec + children.ru_stime.tv_sec) * 1000000) +
+           self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec + children.ru_stime.tv_usec;
+}
+
+/*
+ * Get the resources used so far by this process and
+ * its children and by the echo server.
+ *
+ * serverPID      the echo server.
+ * clientCounter  the system call counter for this
+ *                process.
+ * serverCounter  the system call counter for the
+ *                echo server.
+ * pUsage         a place to put the usage.
+ */
+static void getUsage (pid_t serverPID, SInt32 clientCounter, SInt32 serverCounter, BenchUsage *pUsage)
+{
+    pUsage->cpuUs = getOwnCpuUs() + getProcessCpuUs (serverPID);
+    pUsage->numSyscalls = readSyscallCounter (clientCounter) + readSyscallCounter (serverCounter);
+}
+
+/*
+ * Send a client's messages to the echo server, one
+ * after the other, timing the round trip of each.
+ *
+ * pClient  the client.
+ */
+static void runClient (BenchClient *pClient)
+{
+    Msg sendMsg;
+    Msg receivedMsg;
+    UInt32 x;
+    double startTime;
+
+    sendMsg.msgType = 0;
+    sendMsg.msgLength = pClient->msgLength;
+    memset (sendMsg.msgBody, 0x55, pClient->msgLength - SIZE_OF_MSG_TYPE);
+
+    pClient->success = true;
+    for (x = 0; (x < pClient->numMsgs) && pClient->success; x++)
+    {
+        startTime = getTimeMicroSeconds();
+        if ((runMessagingClient (pClient->serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS) && (receivedMsg.msgLength == sendMsg.msgLength))
+        {
+            pClient->pTimes[x] = getTimeMicroSeconds() - startTime;
+        }
+        else
+        {
+            pClient->success = false;
+            printProgress ("Message %d of length %d failed.\n", x, pClient->msgLength);
+        }
+    }
+}
+
+/*
+ * A client thread.
+ *
+ * pParam  the client.
+ *
+ * @return PNULL.
+ */
+static void *clientThread (void *pParam)
+{
+    runClient ((BenchClient *) pParam);
+
+    return PNULL;
+}
+
+/*
+ * Run a number of clients at once, as threads or
+ * as processes, until they have all sent their
+ * messages.
+ *
+ * pClients       the clients, in memory shared with
+ *                child processes if useProcesses.
+ * numClients     the number of clients.
+ * useProcesses   true to run each client as a process.
+ *
+ * @return        true if all the clients succeeded.
+ */
+static Bool runClients (BenchClient *pClients, UInt32 numClients, Bool useProcesses)
+{
+    Bool success = true;
+    pthread_t threads[MAX_NUM_CLIENTS];
+    pid_t clientPIDs[MAX_NUM_CLIENTS];
+    Bool clientStarted[MAX_NUM_CLIENTS];
+    UInt32 x;
+
+    /* Child processes mustn't share the parent's pooled connections */
+    if (useProcesses)
+    {
+        closeMessagingClientConnections();
+    }
+
+    for (x = 0; x < numClients; x++)
+    {
+        if (useProcesses)
+        {
+            clientPIDs[x] = fork();
+            if (clientPIDs[x] == 0)
+            {
+                runClient (&(pClients[x]));
+                closeMessagingClientConnections();
+                _exit (0);
+            }
+            clientStarted[x] = (clientPIDs[x] > 0);
+        }
+        else
+        {
+            clientStarted[x] = (pthread_create (&(threads[x]), PNULL, clientThread, &(pClients[x])) == 0);
+        }
+        if (!clientStarted[x])
+        {
+            success = false;
+            printProgress ("Couldn't start client %d, err: %s\n", x, strerror (errno));
+        }
+    }
+
+    for (x = 0; x < numClients; x++)
+    {
+        if (clientStarted[x])
+        {
+            if (useProcesses)
+            {
+                waitpid (clientPIDs[x], PNULL, 0);
+            }
+            else
+            {
+                pthread_join (threads[x], PNULL);
+            }
+            success = success && pClients[x].success;
+        }
+    }
+
+    return success;
+}
+
+/*
+ * For each message length in the sweep, have a number
+ * of clients send messages to the echo server over one
+ * transport and print the throughput, the round trip
+ * times and the resources used per message.
+ *
+ * pTransport     the transport.
+ * serverPort     the port the echo server is on.
+ * serverPID      the echo server.
+ * numClients     the number of clients.
+ * numMsgs        the number of messages each client
+ *                sends for each length.
+ * useProcesses   true to run each client as a process.
+ *
+ * @return        true if all the messages were echoed.
+ */
+static Bool runSweepBench (const BenchTransport *pTransport, UInt16 serverPort, pid_t serverPID, UInt32 numClients, UInt32 numMsgs, Bool useProcesses)
+{
+    Bool success = true;
+    BenchClient *pClients;
+    double *pTimes;
+    UInt32 totalNumMsgs = numClients * numMsgs;
+    UInt32 clientsSize = sizeof (BenchClient) * numClients;
+    UInt32 timesSize = sizeof (double) * totalNumMsgs;
+    SInt32 clientCounter;
+    SInt32 serverCounter;
+    BenchUsage usageBefore;
+    BenchUsage usageAfter;
+    Char syscallsPerMsg[16];
+    double startTime;
+    double totalTime;
+    UInt32 x;
+    UInt32 y;
+
+    setMessagingClientLocalTransport (pTransport->transport);
+    if (pTransport->isPooled)
+    {
+        setMessagingClientConnectionPoolingOn();
+    }
+    else
+    {
+        setMessagingClientConnectionPoolingOff();
+    }
+
+    /* Shared with the child processes if the clients are processes */
+    pClients = mmap (PNULL, clientsSize + timesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    clientCounter = openSyscallCounter (0);
+    serverCounter = openSyscallCounter (serverPID);
+
+    if ((pClients != MAP_FAILED) && (totalNumMsgs > 0))
+    {
+        pTimes = (double *) ((UInt8 *) pClients + clientsSize);
+        for (x = 0; (x < sizeof (gMsgLengths) / sizeof (gMsgLengths[0])) && success; x++)
+        {
+            for (y = 0; y < numClients; y++)
+            {
+                pClients[y].serverPort = serverPort;
+                pClients[y].msgLength = gMsgLengths[x];
+                pClients[y].numMsgs = numMsgs;
+                pClients[y].pTimes = pTimes + (y * numMsgs);
+                pClients[y].success = false;
+            }
+
+            getUsage (serverPID, clientCounter, serverCounter, &usageBefore);
+            startTime = getTimeMicroSeconds();
+            success = runClients (pClients, numClients, useProcesses);
+            totalTime = getTimeMicroSeconds() - startTime;
+            getUsage (serverPID, clientCounter, serverCounter, &usageAfter);
+
+            if (success)
+            {
+                snprintf (syscallsPerMsg, sizeof (syscallsPerMsg), "n/a");
+                if ((clientCounter >= 0) && (serverCounter >= 0))
+                {
+                    snprintf (syscallsPerMsg, sizeof (syscallsPerMsg), "%.1f", (double) (usageAfter.numSyscalls - usageBefore.numSyscalls) / totalNumMsgs);
+                }
+                qsort (pTimes, totalNumMsgs, sizeof (double), compareTimes);
+                printProgress ("%-38s %5d %7d %10.0f %9.1f %9.1f %9.1f %11.2f %13s\n",
+                               pTransport->pName, gMsgLengths[x] + SIZE_OF_MSG_LENGTH, numClients, totalNumMsgs * 1000000 / totalTime,
+                               pTimes[(totalNumMsgs - 1) * 50 / 100], pTimes[(totalNumMsgs - 1) * 99 / 100], pTimes[(totalNumMsgs - 1) * 999 / 1000],
+                               (usageAfter.cpuUs - usageBefore.cpuUs) / totalNumMsgs, syscallsPerMsg);
+            }
+        }
+    }
+    else
+    {
+        success = false;
+        printProgress ("%s: couldn't get memory for %d times.\n", pTransport->pName, totalNumMsgs);
+    }
+
+    if (serverCounter >= 0)
+    {
+        close (serverCounter);
+    }
+    if (clientCounter >= 0)
+    {
+        close (clientCounter);
+    }
+    if (pClients != MAP_FAILED)
+    {
+        munmap (pClients, clientsSize + timesSize);
+    }
+
+    return success;
+}
+
+/*
+ * Send a number of messages to the echo server in
+ * batches, as many at a time as may be in flight,
+ * and print the number of messages per second.
+ *
+ * pName        a name for this run.
+ * serverPort   the port the echo server is on.
+ * numMsgs      the number of messages to send.
+ *
+ * @return      true if all the messages were echoed.
+ */
+static Bool runBatchBench (const Char *pName, UInt16 serverPort, UInt32 numMsgs)
+{
+    Bool success = true;
+    Msg sendMsg;
+    Msg receivedMsg[MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+    MessagingClientExchange exchanges[MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+    UInt32 x;
+    UInt32 numThisTime;
+    double startTime;
+
+    sendMsg.msgType = 0;
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + BENCH_MSG_BODY_LENGTH;
+    memset (sendMsg.msgBody, 0x55, BENCH_MSG_BODY_LENGTH);
+    for (x = 0; x < MESSAGING_MAX_REQUESTS_IN_FLIGHT; x++)
+    {
+        exchanges[x].pSendMsg = &sendMsg;
+        exchanges[x].pReceivedMsg = &(receivedMsg[x]);
+    }
+
+    startTime = getTimeMicroSeconds();
+    for (x = 0; (x < numMsgs) && success; x += numThisTime)
+    {
+        numThisTime = numMsgs - x;
+        if (numThisTime > MESSAGING_MAX_REQUESTS_IN_FLIGHT)
+        {
+            numThisTime = MESSAGING_MAX_REQUESTS_IN_FLIGHT;
+        }
+        if (runMessagingClientBatch (serverPort, PNULL, exchanges, numThisTime) != CLIENT_SUCCESS)
+        {
+            success = false;
+            printProgress ("%s: batch starting with message %d failed.\n", pName, x);
+        }
+    }
+
+    if (success && (numMsgs > 0))
+    {
+        printProgress ("%-38s %8d msgs, %8.0f msgs/s in batches of %d.\n", pName, numMsgs,
+                       numMsgs * 1000000 / (getTimeMicroSeconds() - startTime), MESSAGING_MAX_REQUESTS_IN_FLIGHT);
+    }
+
+    return success;
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Entry point
+ */
+int main (int argc, char **argv)
+{
+    Bool success = false;
+    pid_t serverPID;
+    UInt16 serverPort;
+    UInt32 numMsgs = DEFAULT_NUM_MSGS;
+    UInt32 numClients = 1;
+    Bool useProcesses = false;
+    Bool serverHasWorkers = false;
+    Msg stopMsg;
+    SInt32 option;
+    UInt32 x;
+
+    setProgressPrintsOn();
+
+    while ((option = getopt (argc, argv, "n:c:pw")) >= 0)
+    {
+        switch (option)
+        {
+            case 'n':
+            {
+                numMsgs = atoi (optarg);
+            }
+            break;
+            case 'c':
+            {
+                numClients = atoi (optarg);
+            }
+            break;
+            case 'p':
+            {
+                useProcesses = true;
+            }
+            break;
+            case 'w':
+            {
+                serverHasWorkers = true;
+            }
+            break;
+            default:
+            {
+                printProgress ("Usage: %s [-n msgs] [-c clients] [-p] [-w]\n", argv[0]);
+                exit (-1);
+            }
+            break;
+        }
+    }
+    if (numClients < 1)
+    {
+        numClients = 1;
+    }
+    if (numClients > MAX_NUM_CLIENTS)
+    {
+        numClients = MAX_NUM_CLIENTS;
+    }
+
+    printProgress ("Messaging throughput and round trip latency over loopback and shared memory (make sure that %s is present 'cos we'll be running it).\n", SERVER_EXE);
+
+    serverPort = atoi (SERVER_PORT_STRING);
+
+    serverPID = fork();
+    if (serverPID == 0)
+    {
+        static char *argv1[] = {SERVER_EXE, SERVER_PORT_STRING, PNULL, PNULL};
+
+        if (serverHasWorkers)
+        {
+            argv1[2] = "workers";
+        }
+        execv (SERVER_EXE, argv1);
+        printProgress ("Couldn't launch %s, err: %s\n", SERVER_EXE, strerror (errno));
+        exit (-1);
+    }
+    else if (serverPID > 0)
+    {
+        /* Wait for the server to start */
+        usleep (SERVER_START_DELAY_PI_US);
+
+        if (kill (serverPID, 0) == 0)
+        {
+            printProgress ("%d client %s, %d messages each per length, server %s worker threads; times in us, CPU and system calls are client plus server.\n",
+                           numClients, useProcesses ? "process(es)" : "thread(s)", numMsgs, serverHasWorkers ? "with" : "without");
+            printProgress ("%-38s %5s %7s %10s %9s %9s %9s %11s %13s\n", "Transport", "Bytes", "Clients", "msgs/s", "p50", "p99", "p999", "CPU us/msg", "syscalls/msg");
+            success = true;
+            for (x = 0; (x < sizeof (gTransports) / sizeof (gTransports[0])) && success; x++)
+            {
+                success = runSweepBench (&(gTransports[x]), serverPort, serverPID, numClients, numMsgs, useProcesses);
+            }
+
+            setMessagingClientConnectionPoolingOn();
+            for (x = 0; (x < sizeof (gTransports) / sizeof (gTransports[0])) && success; x++)
+            {
+                if (gTransports[x].isPooled)
+                {
+                    setMessagingClientLocalTransport (gTransports[x].transport);
+                    success = runBatchBench (gTransports[x].pName, serverPort, numMsgs);
+                }
+            }
+
+            /* A zero length message causes the echo server to exit */
+            stopMsg.msgLength = 0;
+            runMessagingClient (serverPort, PNULL, &stopMsg, PNULL);
+            waitpid (serverPID, 0, 0);
+        }
+        else
+        {
+            printProgress ("Server process failed to start.\n");
+        }
+    }
+
+    return success ? 0 : -1;
+}
\ No newline at end of file
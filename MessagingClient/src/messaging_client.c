@@ -3,35 +3,1501 @@
  * Generic messaging client, talks to generic messaging server.
  */
 
+#define _GNU_SOURCE /* for memfd_create() */
+
 #include <stdio.h>
 #include <sys/socket.h>
+#include <sys/types.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <rob_system.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
 
 /*
- * EXTERN
+ * MANIFEST CONSTANTS
+ */
+
+/* The number of connections to servers that are kept open
+ * between messages; if more are needed at any one time
+ * (e.g. lots of threads talking to the same server) the
+ * extra connections are made and closed per message as
+ * before */
+#define MAX_NUM_POOLED_CONNECTIONS 16
+
+/* The IP address used if none is given */
+#define LOCAL_IP_ADDRESS_STRING "127.0.0.1"
+
+/* The longest to wait for the server to say there is room for
+ * a message in the shared memory of a connection before looking
+ * again, in case the wake-up went astray */
+#define SHARED_MEMORY_FULL_WAIT_MS 100
+
+/* The number of connections that can be open for requests
+ * started with startMessagingClientRequest() */
+#define MAX_NUM_ASYNC_CONNECTIONS 16
+
+/*
+ * TYPES
+ */
+
+/* A connection to a server, kept open between messages
+ * if it is in the pool */
+typedef struct PooledConnectionTag
+{
+    Bool inUse;            /* true if this entry holds an open socket */
+    Bool busy;             /* true while a message exchange is in progress on the socket */
+    pid_t pid;             /* the process that opened the socket */
+    UInt16 serverPort;
+    in_addr_t ipAddress;
+    SInt32 socket;
+    Bool isTagged;         /* true if messages on the socket carry request IDs */
+    MessagingSharedMemory *pSharedMemory; /* PNULL unless messages are carried in shared memory */
+    SInt32 toServerFd;     /* with shared memory, the eventfd to write to to wake the server */
+    SInt32 toClientFd;     /* with shared memory, the eventfd the server writes to to wake us */
+} PooledConnection;
+
+/* A connection to a server for requests started with
+ * startMessagingClientRequest(), kept open between them.
+ * Unless its messages carry request IDs only one request
+ * at a time can be waiting on it */
+typedef struct AsyncConnectionTag
+{
+    PooledConnection connection; /* connection.inUse is true if this entry holds an open socket */
+    UInt32 numOutstanding;       /* the number of requests waiting for a response on it */
+    UInt16 rxLength;             /* the number of bytes in rxBuffer */
+    UInt8 rxBuffer[sizeof (MessagingTaggedMsg) * MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+} AsyncConnection;
+
+/* A request started with startMessagingClientRequest()
+ * that is waiting for its response */
+typedef struct AsyncRequestTag
+{
+    Bool inUse;
+    AsyncConnection *pConnection;
+    MessagingClientCallback pCallback;
+    void *pContext;
+} AsyncRequest;
+
+/*
+ * EXTERN
+ */
+
+extern int errno;
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+/* The pool of open connections, shared by all threads in the process */
+static PooledConnection gConnectionPool[MAX_NUM_POOLED_CONNECTIONS];
+/* Mutex to protect the pool */
+static pthread_mutex_t gConnectionPoolLock = PTHREAD_MUTEX_INITIALIZER;
+/* Whether connections are kept open between messages */
+static Bool gConnectionPoolingIsOn = true;
+/* How to reach servers on this machine */
+static MessagingLocalTransport gLocalTransport = MESSAGING_LOCAL_TRANSPORT_UNIX;
+/* Message buffers for each thread to borrow, see getMessagingClientMsgs() */
+static __thread MessagingClientMsgs gClientMsgs;
+/* Connections and requests for startMessagingClientRequest(),
+ * only to be used from one thread, and the epoll instance
+ * that watches the connections */
+static AsyncConnection gAsyncConnection[MAX_NUM_ASYNC_CONNECTIONS];
+static AsyncRequest gAsyncRequest[MESSAGING_CLIENT_MAX_STARTED_REQUESTS];
+static UInt32 gNumAsyncRequests = 0;
+static SInt32 gAsyncEpollFd = -1;
+/* The socket that sendMessagingClientDatagram() sends from,
+ * shared by all threads, created under gConnectionPoolLock */
+static SInt32 gDatagramSocket = -1;
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Close a connection to a server, including
+ * any shared memory that goes with it.
+ *
+ * pConnection  the connection.
+ */
+static void closeConnection (PooledConnection *pConnection)
+{
+    close (pConnection->socket);
+    pConnection->socket = -1;
+    if (pConnection->pSharedMemory != PNULL)
+    {
+        munmap (pConnection->pSharedMemory, sizeof (MessagingSharedMemory));
+        pConnection->pSharedMemory = PNULL;
+    }
+    if (pConnection->toServerFd >= 0)
+    {
+        close (pConnection->toServerFd);
+        pConnection->toServerFd = -1;
+    }
+    if (pConnection->toClientFd >= 0)
+    {
+        close (pConnection->toClientFd);
+        pConnection->toClientFd = -1;
+    }
+}
+
+/*
+ * Check if a connection that has been sitting in the
+ * pool has been closed by the server (e.g. because
+ * the server has been restarted).  The server never
+ * sends anything unsolicited so if there is anything
+ * to read, or the connection has gone, it is stale.
+ *
+ * serverSocket  the socket to check.
+ *
+ * @return       true if the connection should not be used.
+ */
+static Bool connectionIsStale (SInt32 serverSocket)
+{
+    Bool isStale = true;
+    UInt8 buffer;
+
+    if ((recv (serverSocket, &buffer, sizeof (buffer), MSG_PEEK | MSG_DONTWAIT) < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+    {
+        isStale = false;
+    }
+
+    return isStale;
+}
+
+/*
+ * Get an idle open connection to the given server
+ * from the pool, throwing away any stale ones.
+ *
+ * serverPort  the port number of the server.
+ * ipAddress   the IP address of the server.
+ *
+ * @return     a pointer to the pool entry, marked as
+ *             busy, or PNULL if there isn't one.
+ */
+static PooledConnection * acquirePooledConnection (UInt16 serverPort, in_addr_t ipAddress)
+{
+    PooledConnection *pConnection = PNULL;
+    UInt32 x;
+    pid_t pid = getpid();
+
+    pthread_mutex_lock (&gConnectionPoolLock);
+
+    for (x = 0; (x < MAX_NUM_POOLED_CONNECTIONS) && (pConnection == PNULL); x++)
+    {
+        PooledConnection *pEntry = &(gConnectionPool[x]);
+
+        if (pEntry->inUse && !pEntry->busy)
+        {
+            if (pEntry->pid != pid)
+            {
+                /* Inherited from our parent across a fork(), it's not ours to use */
+                closeConnection (pEntry);
+                pEntry->inUse = false;
+            }
+            else if ((pEntry->serverPort == serverPort) && (pEntry->ipAddress == ipAddress))
+            {
+                if (connectionIsStale (pEntry->socket))
+                {
+                    printDebug ("Messaging Client %d: pooled socket %d is stale, closing it.\n", serverPort, pEntry->socket);
+                    closeConnection (pEntry);
+                    pEntry->inUse = false;
+                }
+                else
+                {
+                    pEntry->busy = true;
+                    pConnection = pEntry;
+                }
+            }
+        }
+    }
+
+    pthread_mutex_unlock (&gConnectionPoolLock);
+
+    return pConnection;
+}
+
+/*
+ * Put a newly opened connection into the pool.
+ *
+ * serverPort      the port number of the server.
+ * ipAddress       the IP address of the server.
+ * pNewConnection  the connection.
+ *
+ * @return         a pointer to the pool entry, marked as
+ *                 busy, or PNULL if the pool is full.
+ */
+static PooledConnection * addPooledConnection (UInt16 serverPort, in_addr_t ipAddress, PooledConnection *pNewConnection)
+{
+    PooledConnection *pConnection = PNULL;
+    UInt32 x;
+
+    pthread_mutex_lock (&gConnectionPoolLock);
+
+    for (x = 0; (x < MAX_NUM_POOLED_CONNECTIONS) && (pConnection == PNULL); x++)
+    {
+        if (!gConnectionPool[x].inUse)
+        {
+            pConnection = &(gConnectionPool[x]);
+            *pConnection = *pNewConnection;
+            pConnection->inUse = true;
+            pConnection->busy = true;
+            pConnection->pid = getpid();
+            pConnection->serverPort = serverPort;
+            pConnection->ipAddress = ipAddress;
+        }
+    }
+
+    pthread_mutex_unlock (&gConnectionPoolLock);
+
+    return pConnection;
+}
+
+/*
+ * Give a connection back to the pool.
+ *
+ * pConnection  the pool entry.
+ * keepOpen     if true the connection is left open
+ *              for the next message, otherwise it
+ *              is closed and the entry freed.
+ */
+static void releasePooledConnection (PooledConnection *pConnection, Bool keepOpen)
+{
+    pthread_mutex_lock (&gConnectionPoolLock);
+
+    if (!keepOpen)
+    {
+        closeConnection (pConnection);
+        pConnection->inUse = false;
+    }
+    pConnection->busy = false;
+
+    pthread_mutex_unlock (&gConnectionPoolLock);
+}
+
+/*
+ * Open a connection to a server on this machine
+ * through one of its Unix domain sockets.
+ *
+ * serverPort    the port number of the server.
+ * pNameFormat   the format of the socket name.
+ *
+ * @return       the connected socket or -1 on failure.
+ */
+static SInt32 openUnixConnection (UInt16 serverPort, const Char *pNameFormat)
+{
+    SInt32 serverSocket;
+    SockAddrUn messagingServer;
+
+    serverSocket = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (serverSocket >= 0)
+    {
+        memset (&messagingServer, 0, sizeof (messagingServer));
+        messagingServer.sun_family = AF_UNIX;
+        /* sun_path[0] is left as zero, the name is in the abstract namespace */
+        snprintf (&(messagingServer.sun_path[1]), sizeof (messagingServer.sun_path) - 1, pNameFormat, serverPort);
+
+        if (connect (serverSocket, (SockAddr *) &messagingServer, sizeof (messagingServer)) >= 0)
+        {
+            printDebug ("Messaging Client %d: connected to server on Unix domain socket %d (%s).\n", serverPort, serverSocket, pNameFormat);
+        }
+        else
+        {
+            printDebug ("Messaging Client %d: couldn't connect on Unix domain socket %s (%s).\n", serverPort, pNameFormat, strerror (errno));
+            close (serverSocket);
+            serverSocket = -1;
+        }
+    }
+
+    return serverSocket;
+}
+
+/*
+ * Open a connection to a server on this machine that
+ * carries messages in shared memory: create the shared
+ * memory and the eventfds that go with it and hand them
+ * to the server.
+ *
+ * serverPort   the port number of the server.
+ * pConnection  the connection to fill in.
+ *
+ * @return      true if successful, otherwise false
+ *              and nothing is left open.
+ */
+static Bool openSharedMemoryConnection (UInt16 serverPort, PooledConnection *pConnection)
+{
+    Bool success = false;
+    SInt32 memoryFd;
+    UInt8 handshake = 0;
+    int fds[MESSAGING_SHARED_MEMORY_NUM_FDS];
+    struct iovec ioVector;
+    struct msghdr msgHeader;
+    struct cmsghdr *pControlMsg;
+    union
+    {
+        struct cmsghdr header;
+        UInt8 buffer[CMSG_SPACE (sizeof (fds))];
+    } control;
+    void *pSharedMemory = MAP_FAILED;
+
+    pConnection->toServerFd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+    pConnection->toClientFd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+    memoryFd = memfd_create ("RoboOne.messaging", MFD_CLOEXEC);
+    if ((memoryFd >= 0) && (ftruncate (memoryFd, sizeof (MessagingSharedMemory)) == 0))
+    {
+        pSharedMemory = mmap (PNULL, sizeof (MessagingSharedMemory), PROT_READ | PROT_WRITE, MAP_SHARED, memoryFd, 0);
+    }
+
+    if ((pConnection->toServerFd >= 0) && (pConnection->toClientFd >= 0) && (pSharedMemory != MAP_FAILED))
+    {
+        pConnection->pSharedMemory = (MessagingSharedMemory *) pSharedMemory;
+        /* The server starts off waiting for something to do */
+        pConnection->pSharedMemory->toServer.consumerWaiting = true;
+
+        pConnection->socket = openUnixConnection (serverPort, MESSAGING_SHARED_MEMORY_SOCKET_NAME_FORMAT);
+        if (pConnection->socket >= 0)
+        {
+            fds[0] = memoryFd;
+            fds[1] = pConnection->toServerFd;
+            fds[2] = pConnection->toClientFd;
+
+            ioVector.iov_base = &handshake;
+            ioVector.iov_len = sizeof (handshake);
+            memset (&msgHeader, 0, sizeof (msgHeader));
+            msgHeader.msg_iov = &ioVector;
+            msgHeader.msg_iovlen = 1;
+            msgHeader.msg_control = control.buffer;
+            msgHeader.msg_controllen = sizeof (control.buffer);
+            pControlMsg = CMSG_FIRSTHDR (&msgHeader);
+            pControlMsg->cmsg_level = SOL_SOCKET;
+            pControlMsg->cmsg_type = SCM_RIGHTS;
+            pControlMsg->cmsg_len = CMSG_LEN (sizeof (fds));
+            memcpy (CMSG_DATA (pControlMsg), fds, sizeof (fds));
+
+            /* The server sends back a single byte once it has taken over the shared memory */
+            if ((sendmsg (pConnection->socket, &msgHeader, MSG_NOSIGNAL) == sizeof (handshake)) &&
+                (recv (pConnection->socket, &handshake, sizeof (handshake), 0) == sizeof (handshake)))
+            {
+                success = true;
+                printDebug ("Messaging Client %d: using shared memory with socket %d.\n", serverPort, pConnection->socket);
+            }
+        }
+    }
+    else
+    {
+        if (pSharedMemory != MAP_FAILED)
+        {
+            munmap (pSharedMemory, sizeof (MessagingSharedMemory));
+        }
+    }
+
+    /* The server has its own handle on the shared memory now */
+    if (memoryFd >= 0)
+    {
+        close (memoryFd);
+    }
+
+    if (!success)
+    {
+        printDebug ("Messaging Client %d: couldn't set up shared memory (%s), will use a socket.\n", serverPort, strerror (errno));
+        closeConnection (pConnection);
+    }
+
+    return success;
+}
+
+/*
+ * Open a connection to a server.  If the server is
+ * on this machine shared memory, or its Unix domain
+ * socket, is used, depending on the local transport
+ * that has been set, falling back to the Unix domain
+ * socket and then to TCP if the server doesn't offer
+ * them.  Of its Unix domain sockets, the one on which
+ * messages carry request IDs is preferred.
+ *
+ * serverPort  the port number of the server.
+ * ipAddress   the IP address of the server.
+ * transport   how to reach a server on this machine.
+ * pConnection the connection to fill in.
+ * pReturnCode place to put the return code if
+ *             there is a failure.
+ *
+ * @return     true if successful, otherwise false.
+ */
+static Bool openConnection (UInt16 serverPort, in_addr_t ipAddress, MessagingLocalTransport transport, PooledConnection *pConnection, ClientReturnCode *pReturnCode)
+{
+    SInt32 serverSocket = -1;
+    SockAddrIn messagingServer;
+
+    memset (pConnection, 0, sizeof (*pConnection));
+    pConnection->socket = -1;
+    pConnection->toServerFd = -1;
+    pConnection->toClientFd = -1;
+
+    if (ipAddress == htonl (INADDR_LOOPBACK))
+    {
+        if ((transport == MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY) && openSharedMemoryConnection (serverPort, pConnection))
+        {
+            serverSocket = pConnection->socket;
+        }
+        else if (transport != MESSAGING_LOCAL_TRANSPORT_TCP)
+        {
+            /* Use the socket on which messages carry request IDs if the
+             * server has one (servers from before there was one don't) */
+            serverSocket = openUnixConnection (serverPort, MESSAGING_TAGGED_SOCKET_NAME_FORMAT);
+            if (serverSocket >= 0)
+            {
+                pConnection->isTagged = true;
+            }
+            else
+            {
+                serverSocket = openUnixConnection (serverPort, MESSAGING_UNIX_SOCKET_NAME_FORMAT);
+            }
+        }
+    }
+
+    if (serverSocket < 0)
+    {
+        /* Create the TCP socket */
+        serverSocket = socket (PF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (serverSocket >= 0)
+        {
+            printDebug ("Messaging Client %d: created socket %d.\n", serverPort, serverSocket);
+
+            /* Construct the server sockaddr_in structure */
+            memset (&messagingServer, 0, sizeof (messagingServer));
+            messagingServer.sin_family = AF_INET;          /* Internet/IP */
+            messagingServer.sin_addr.s_addr = ipAddress;   /* IP address */
+            messagingServer.sin_port = htons (serverPort); /* server port */
+
+            /* Establish connection */
+            if (connect (serverSocket, (SockAddr *) &messagingServer, sizeof (messagingServer)) >= 0)
+            {
+                printDebug ("Messaging Client %d: connected to server on socket %d.\n", serverPort, serverSocket);
+            }
+            else
+            {
+                *pReturnCode = CLIENT_ERR_FAILED_TO_CONNECT_TO_SERVER;
+                fprintf (stderr, "Failed to connect to server on port %d, error: %s.\n", serverPort, strerror (errno));
+                close (serverSocket);
+                serverSocket = -1;
+            }
+        }
+        else
+        {
+            *pReturnCode = CLIENT_ERR_FAILED_TO_CREATE_SOCKET;
+            fprintf (stderr, "Failed to create socket on port %d, error: %s.\n", serverPort, strerror (errno));
+        }
+    }
+
+    pConnection->socket = serverSocket;
+
+    return (serverSocket >= 0);
+}
+
+/*
+ * Receive exactly the given number of bytes from a socket.
+ *
+ * serverSocket  the socket to receive from.
+ * pBuffer       where to put the bytes.
+ * length        the number of bytes to receive.
+ *
+ * @return       the number of bytes received, which will
+ *               be less than length if the server closed
+ *               the connection or there was an error.
+ */
+static UInt32 recvAll (SInt32 serverSocket, UInt8 *pBuffer, UInt32 length)
+{
+    UInt32 rawReceivedLength = 0;
+    SInt32 rawBytesReceived = 1;
+
+    while ((rawReceivedLength < length) && (rawBytesReceived > 0))
+    {
+        rawBytesReceived = recv (serverSocket, pBuffer + rawReceivedLength, length - rawReceivedLength, 0);
+        if (rawBytesReceived > 0)
+        {
+            rawReceivedLength += rawBytesReceived;
+        }
+        else
+        {
+            if ((rawBytesReceived < 0) && (errno == EINTR))
+            {
+                rawBytesReceived = 1; /* Just try again */
+            }
+        }
+    }
+
+    return rawReceivedLength;
+}
+
+/*
+ * Send exactly the given number of bytes on a socket.
+ *
+ * serverSocket  the socket to send on.
+ * pBuffer       the bytes.
+ * length        the number of bytes to send.
+ *
+ * @return       true if they were all sent, otherwise
+ *               false.
+ */
+static Bool sendAll (SInt32 serverSocket, const UInt8 *pBuffer, UInt32 length)
+{
+    UInt32 rawSentLength = 0;
+    SInt32 rawBytesSent = 1;
+
+    while ((rawSentLength < length) && (rawBytesSent > 0))
+    {
+        rawBytesSent = send (serverSocket, pBuffer + rawSentLength, length - rawSentLength, MSG_NOSIGNAL);
+        if (rawBytesSent > 0)
+        {
+            rawSentLength += rawBytesSent;
+        }
+        else
+        {
+            if ((rawBytesSent < 0) && (errno == EINTR))
+            {
+                rawBytesSent = 1; /* Just try again */
+            }
+        }
+    }
+
+    return (rawSentLength == length);
+}
+
+/*
+ * Put a response into the place for it in a batch of
+ * exchanges, found from its request ID.
+ *
+ * pExchanges     the exchanges.
+ * numSent        the number of messages in pExchanges
+ *                that have been sent so far.
+ * requestId      the request ID of the response.
+ * pRawMsg        the response, starting with its length.
+ * rawMsgLength   the length of the response, including
+ *                the length indicator.
+ *
+ * @return        client return code: an error if the
+ *                request ID doesn't belong to a message
+ *                that is waiting for a response.
+ */
+static ClientReturnCode takeResponse (MessagingClientExchange *pExchanges, UInt32 numSent, MsgRequestId requestId, const UInt8 *pRawMsg, UInt16 rawMsgLength)
+{
+    ClientReturnCode returnCode = CLIENT_SUCCESS;
+
+    if ((requestId != MESSAGING_NO_RESPONSE_REQUEST_ID) && (requestId <= numSent) && (pExchanges[requestId - 1].pReceivedMsg != PNULL))
+    {
+        memcpy (pExchanges[requestId - 1].pReceivedMsg, pRawMsg, rawMsgLength);
+    }
+    else
+    {
+        returnCode = CLIENT_ERR_UNEXPECTED_RESPONSE;
+        fprintf (stderr, "Response from server with unexpected request ID %d (%ld messages sent).\n", requestId, numSent);
+    }
+
+    return returnCode;
+}
+
+/*
+ * Put messages into the shared memory of a connection,
+ * as many at a time as may be outstanding, and collect
+ * the responses, which may come back in any order.
+ *
+ * pConnection       the connection.
+ * serverPort        the port number of the server (for debug).
+ * pExchanges        the messages to send and where to put
+ *                   the responses.
+ * numExchanges      the number of entries in pExchanges.
+ * pWorthRetrying    set to true if the failure was such
+ *                   that the server did not get as far as
+ *                   replying, i.e. the connection had gone.
+ *
+ * @return      client return code.
+ */
+static ClientReturnCode exchangeSharedMemoryMsgs (PooledConnection *pConnection, UInt16 serverPort, MessagingClientExchange *pExchanges, UInt32 numExchanges, Bool *pWorthRetrying)
+{
+    ClientReturnCode returnCode = CLIENT_SUCCESS;
+    MessagingRing *pToServer = &(pConnection->pSharedMemory->toServer);
+    MessagingRing *pToClient = &(pConnection->pSharedMemory->toClient);
+    Bool serverIsGone = false;
+    Bool wakeServer;
+    UInt32 numSent = 0;
+    UInt32 numOutstanding = 0;
+    UInt32 numReceived = 0;
+    struct pollfd pollFds[2];
+    eventfd_t count;
+    MessagingRingSlot *pSlot;
+
+    *pWorthRetrying = false;
+
+    while ((returnCode == CLIENT_SUCCESS) && ((numSent < numExchanges) || (numOutstanding > 0)))
+    {
+        /* Put in as many messages as there is room for, the
+         * server throws away the responses we're not going
+         * to wait for */
+        wakeServer = false;
+        while ((numSent < numExchanges) && (numOutstanding < MESSAGING_MAX_REQUESTS_IN_FLIGHT) && ((pSlot = nextSlotInRing (pToServer)) != PNULL))
+        {
+            pSlot->requestId = MESSAGING_NO_RESPONSE_REQUEST_ID;
+            if (pExchanges[numSent].pReceivedMsg != PNULL)
+            {
+                pSlot->requestId = (MsgRequestId) (numSent + 1);
+                numOutstanding++;
+            }
+            memcpy (&(pSlot->msg), pExchanges[numSent].pSendMsg, pExchanges[numSent].pSendMsg->msgLength + SIZE_OF_MSG_LENGTH);
+            wakeServer = sendMsgInRing (pToServer) || wakeServer;
+            numSent++;
+        }
+        if (wakeServer)
+        {
+            eventfd_write (pConnection->toServerFd, 1);
+        }
+        printDebug ("Messaging Client %d: %ld message(s) in shared memory for server on socket %d, %ld outstanding.\n", serverPort, numSent, pConnection->socket, numOutstanding);
+
+        if (numOutstanding > 0)
+        {
+            /* Wait for a response, or for the server to close the socket */
+            while (((pSlot = nextMsgInRing (pToClient)) == PNULL) && !serverIsGone)
+            {
+                if (!waitForMsgInRing (pToClient))
+                {
+                    pollFds[0].fd = pConnection->toClientFd;
+                    pollFds[0].events = POLLIN;
+                    pollFds[1].fd = pConnection->socket;
+                    pollFds[1].events = POLLIN;
+                    if (poll (pollFds, 2, -1) > 0)
+                    {
+                        if (pollFds[0].revents & POLLIN)
+                        {
+                            eventfd_read (pConnection->toClientFd, &count);
+                        }
+                        if (pollFds[1].revents != 0)
+                        {
+                            serverIsGone = true;
+                        }
+                    }
+                }
+            }
+            __atomic_store_n (&(pToClient->consumerWaiting), false, __ATOMIC_RELAXED);
+
+            /* Take all the responses that are there */
+            while ((returnCode == CLIENT_SUCCESS) && (pSlot != PNULL))
+            {
+                returnCode = takeResponse (pExchanges, numSent, pSlot->requestId, (UInt8 *) &(pSlot->msg), pSlot->msg.msgLength + SIZE_OF_MSG_LENGTH);
+                doneWithMsgInRing (pToClient);
+                numOutstanding--;
+                numReceived++;
+                pSlot = nextMsgInRing (pToClient);
+            }
+
+            if ((returnCode == CLIENT_SUCCESS) && serverIsGone)
+            {
+                returnCode = CLIENT_ERR_FAILED_ON_RECV;
+                *pWorthRetrying = (numReceived == 0);
+                fprintf (stderr, "Connection closed by server on port %d before %ld response(s) were received.\n", serverPort, numOutstanding);
+            }
+        }
+        else if (numSent < numExchanges)
+        {
+            /* The server is behind, give it a nudge and wait for it
+             * to say there is room, or for it to close the socket */
+            eventfd_write (pConnection->toServerFd, 1);
+            if (!waitForSlotInRing (pToServer))
+            {
+                pollFds[0].fd = pConnection->toClientFd;
+                pollFds[0].events = POLLIN;
+                pollFds[1].fd = pConnection->socket;
+                pollFds[1].events = POLLIN;
+                if (poll (pollFds, 2, SHARED_MEMORY_FULL_WAIT_MS) > 0)
+                {
+                    if (pollFds[0].revents & POLLIN)
+                    {
+                        eventfd_read (pConnection->toClientFd, &count);
+                    }
+                    if (pollFds[1].revents != 0)
+                    {
+                        serverIsGone = true;
+                    }
+                }
+            }
+            __atomic_store_n (&(pToServer->producerWaiting), false, __ATOMIC_RELAXED);
+            if (serverIsGone)
+            {
+                returnCode = CLIENT_ERR_COULDNT_SEND_WHOLE_MESSAGE_TO_SERVER;
+                *pWorthRetrying = (numReceived == 0);
+                fprintf (stderr, "Couldn't put %d byte message in shared memory for server on port %d, it has gone.\n", pExchanges[numSent].pSendMsg->msgLength + SIZE_OF_MSG_LENGTH, serverPort);
+            }
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Send messages on a connected socket on which they
+ * carry request IDs, as many at a time as may be
+ * outstanding, and collect the responses, which may
+ * come back in any order.
+ *
+ * serverSocket      the connected socket.
+ * serverPort        the port number of the server (for debug).
+ * pExchanges        the messages to send and where to put
+ *                   the responses.
+ * numExchanges      the number of entries in pExchanges.
+ * pWorthRetrying    set to true if the failure was such
+ *                   that the server did not get as far as
+ *                   replying, i.e. the connection had gone.
+ *
+ * @return      client return code.
+ */
+static ClientReturnCode exchangeTaggedMsgs (SInt32 serverSocket, UInt16 serverPort, MessagingClientExchange *pExchanges, UInt32 numExchanges, Bool *pWorthRetrying)
+{
+    ClientReturnCode returnCode = CLIENT_SUCCESS;
+    UInt8 txBuffer[sizeof (MessagingTaggedMsg) * MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+    UInt8 rxBuffer[sizeof (MessagingTaggedMsg) * MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+    UInt16 txLength;
+    UInt16 rxLength = 0;
+    UInt16 rxOffset;
+    UInt16 rawMsgLength;
+    UInt32 numSent = 0;
+    UInt32 numOutstanding = 0;
+    UInt32 numReceived = 0;
+    UInt32 numThisTime;
+    SInt32 rawBytesReceived;
+    MsgRequestId requestId;
+
+    *pWorthRetrying = false;
+
+    while ((returnCode == CLIENT_SUCCESS) && ((numSent < numExchanges) || (numOutstanding > 0)))
+    {
+        /* Send as many messages as may be outstanding in one go */
+        txLength = 0;
+        for (numThisTime = 0; (numSent < numExchanges) && (numOutstanding < MESSAGING_MAX_REQUESTS_IN_FLIGHT) && (numThisTime < MESSAGING_MAX_REQUESTS_IN_FLIGHT); numThisTime++)
+        {
+            requestId = MESSAGING_NO_RESPONSE_REQUEST_ID;
+            if (pExchanges[numSent].pReceivedMsg != PNULL)
+            {
+                requestId = (MsgRequestId) (numSent + 1);
+                numOutstanding++;
+            }
+            rawMsgLength = pExchanges[numSent].pSendMsg->msgLength + SIZE_OF_MSG_LENGTH;
+            memcpy (txBuffer + txLength, &requestId, sizeof (requestId));
+            memcpy (txBuffer + txLength + sizeof (requestId), pExchanges[numSent].pSendMsg, rawMsgLength);
+            txLength += sizeof (requestId) + rawMsgLength;
+            numSent++;
+        }
+
+        if (txLength > 0)
+        {
+            if (send (serverSocket, txBuffer, txLength, MSG_NOSIGNAL) == txLength)
+            {
+                printDebug ("Messaging Client %d: sent %ld message(s), %d bytes, to server on socket %d.\n", serverPort, numThisTime, txLength, serverSocket);
+            }
+            else
+            {
+                returnCode = CLIENT_ERR_COULDNT_SEND_WHOLE_MESSAGE_TO_SERVER;
+                *pWorthRetrying = (numReceived == 0);
+                fprintf (stderr, "Couldn't send whole %d bytes of messages to server, error: %s.\n", txLength, strerror (errno));
+            }
+        }
+
+        if ((returnCode == CLIENT_SUCCESS) && (numOutstanding > 0))
+        {
+            rawBytesReceived = recv (serverSocket, rxBuffer + rxLength, sizeof (rxBuffer) - rxLength, 0);
+            if (rawBytesReceived > 0)
+            {
+                rxLength += rawBytesReceived;
+
+                /* Deal with whatever whole responses have arrived */
+                rxOffset = 0;
+                while ((returnCode == CLIENT_SUCCESS) && (rxLength - rxOffset >= sizeof (requestId) + SIZE_OF_MSG_LENGTH) &&
+                       (rxLength - rxOffset >= (rawMsgLength = rxBuffer[rxOffset + sizeof (requestId)] + SIZE_OF_MSG_LENGTH) + sizeof (requestId)))
+                {
+                    memcpy (&requestId, rxBuffer + rxOffset, sizeof (requestId));
+                    returnCode = takeResponse (pExchanges, numSent, requestId, rxBuffer + rxOffset + sizeof (requestId), rawMsgLength);
+                    rxOffset += sizeof (requestId) + rawMsgLength;
+                    numOutstanding--;
+                    numReceived++;
+                }
+                rxLength -= rxOffset;
+                memmove (rxBuffer, rxBuffer + rxOffset, rxLength);
+                printDebug ("Messaging Client %d: received %ld response(s) from server on socket %d, %ld outstanding.\n", serverPort, numReceived, serverSocket, numOutstanding);
+            }
+            else if ((rawBytesReceived == 0) || (errno != EINTR))
+            {
+                if (rxLength == 0)
+                {
+                    returnCode = CLIENT_ERR_FAILED_ON_RECV;
+                    *pWorthRetrying = (numReceived == 0);
+                    fprintf (stderr, "Connection closed by server on port %d before %ld response(s) were received, error: %s.\n", serverPort, numOutstanding, strerror (errno));
+                }
+                else
+                {
+                    returnCode = CLIENT_ERR_MESSAGE_FROM_SERVER_INCOMPLETE_OR_TOO_LONG;
+                    fprintf (stderr, "Message from server incomplete (%d bytes received), error: %s.\n", rxLength, strerror (errno));
+                }
+            }
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Send a message on a connected socket and, optionally,
+ * wait for the response.
+ *
+ * serverSocket      the connected socket.
+ * serverPort        the port number of the server (for debug).
+ * pSendMsg          the message to send.
+ * pReceivedMsg      the response received from the server,
+ *                   may be PNULL, in which case no response
+ *                   from the server is expected.
+ * pWorthRetrying    set to true if the failure was such
+ *                   that the server did not get as far as
+ *                   replying, i.e. the connection had gone.
+ *
+ * @return      client return code.
+ */
+static ClientReturnCode exchangeMsgs (SInt32 serverSocket, UInt16 serverPort, Msg *pSendMsg, Msg *pReceivedMsg, Bool *pWorthRetrying)
+{
+    ClientReturnCode returnCode = CLIENT_SUCCESS;
+    UInt16 rawSendLength;
+
+    *pWorthRetrying = false;
+
+    /* Send the message to the server */
+    rawSendLength = pSendMsg->msgLength + SIZE_OF_MSG_LENGTH;
+    if (send (serverSocket, pSendMsg, rawSendLength, MSG_NOSIGNAL) == rawSendLength)
+    {
+        printDebug ("Messaging Client %d: sent %d bytes to server on socket %d.\n", serverPort, rawSendLength, serverSocket);
+        if (pReceivedMsg != PNULL)
+        {
+            UInt16 rawReceivedLength;
+
+            /* Receive the length indicator first and then the rest of the response */
+            rawReceivedLength = recvAll (serverSocket, &(pReceivedMsg->msgLength), SIZE_OF_MSG_LENGTH);
+            if (rawReceivedLength == SIZE_OF_MSG_LENGTH)
+            {
+                rawReceivedLength += recvAll (serverSocket, (UInt8 *) pReceivedMsg + SIZE_OF_MSG_LENGTH, pReceivedMsg->msgLength);
+            }
+
+            if (rawReceivedLength == 0)
+            {
+                returnCode = CLIENT_ERR_FAILED_ON_RECV;
+                *pWorthRetrying = true;
+                fprintf (stderr, "Connection closed by server on port %d before a response was received, error: %s.\n", serverPort, strerror (errno));
+            }
+            else if (rawReceivedLength != pReceivedMsg->msgLength + SIZE_OF_MSG_LENGTH)
+            {
+                returnCode = CLIENT_ERR_MESSAGE_FROM_SERVER_INCOMPLETE_OR_TOO_LONG;
+                fprintf (stderr, "Message from server incomplete or too long (%d bytes received, %d bytes needed), error: %s.\n", rawReceivedLength, pReceivedMsg->msgLength + SIZE_OF_MSG_LENGTH, strerror (errno));
+            }
+            else
+            {
+                printDebug ("Messaging Client %d: received %d bytes from server on socket %d.\n", serverPort, rawReceivedLength, serverSocket);
+            }
+        }
+        else
+        {
+            printDebug ("Messaging Client %d: not waiting for a response.\n", serverPort);
+        }
+    }
+    else
+    {
+        returnCode = CLIENT_ERR_COULDNT_SEND_WHOLE_MESSAGE_TO_SERVER;
+        *pWorthRetrying = true;
+        fprintf (stderr, "Couldn't send whole %d byte message to server, error: %s.\n", rawSendLength, strerror (errno));
+    }
+
+    return returnCode;
+}
+
+/*
+ * Close a connection used for requests started with
+ * startMessagingClientRequest().
+ *
+ * pConnection  the connection.
+ */
+static void closeAsyncConnection (AsyncConnection *pConnection)
+{
+    /* Closing the socket also removes it from the epoll set */
+    closeConnection (&(pConnection->connection));
+    pConnection->connection.inUse = false;
+    pConnection->numOutstanding = 0;
+    pConnection->rxLength = 0;
+}
+
+/*
+ * Get a connection on which to start a request,
+ * one already open to the server if it can take
+ * another request, otherwise a new one.  Servers
+ * on this machine are reached through their Unix
+ * domain sockets, even if shared memory is the
+ * local transport, so that responses can be waited
+ * for with epoll.
+ *
+ * serverPort   the port number of the server.
+ * ipAddress    the IP address of the server.
+ * pIsReused    set to true if the connection was
+ *              already open.
+ * pReturnCode  place to put the return code if there
+ *              is a failure.
+ *
+ * @return      the connection or PNULL if there isn't
+ *              one.
+ */
+static AsyncConnection *getAsyncConnection (UInt16 serverPort, in_addr_t ipAddress, Bool *pIsReused, ClientReturnCode *pReturnCode)
+{
+    AsyncConnection *pConnection = PNULL;
+    AsyncConnection *pFree = PNULL;
+    PooledConnection *pEntry;
+    MessagingLocalTransport transport = gLocalTransport;
+    struct epoll_event event;
+    UInt32 x;
+
+    for (x = 0; (x < MAX_NUM_ASYNC_CONNECTIONS) && (pConnection == PNULL); x++)
+    {
+        pEntry = &(gAsyncConnection[x].connection);
+        if (!pEntry->inUse)
+        {
+            if (pFree == PNULL)
+            {
+                pFree = &(gAsyncConnection[x]);
+            }
+        }
+        else if ((pEntry->serverPort == serverPort) && (pEntry->ipAddress == ipAddress) &&
+                 ((gAsyncConnection[x].numOutstanding == 0) || (pEntry->isTagged && (gAsyncConnection[x].numOutstanding < MESSAGING_MAX_REQUESTS_IN_FLIGHT))))
+        {
+            pConnection = &(gAsyncConnection[x]);
+            *pIsReused = true;
+        }
+    }
+
+    if ((pConnection == PNULL) && (pFree != PNULL))
+    {
+        if (transport == MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY)
+        {
+            transport = MESSAGING_LOCAL_TRANSPORT_UNIX;
+        }
+        if (openConnection (serverPort, ipAddress, transport, &(pFree->connection), pReturnCode))
+        {
+            pFree->connection.inUse = true;
+            pFree->connection.pid = getpid();
+            pFree->connection.serverPort = serverPort;
+            pFree->connection.ipAddress = ipAddress;
+            pFree->numOutstanding = 0;
+            pFree->rxLength = 0;
+
+            memset (&event, 0, sizeof (event));
+            event.events = EPOLLIN;
+            event.data.ptr = pFree;
+            if (epoll_ctl (gAsyncEpollFd, EPOLL_CTL_ADD, pFree->connection.socket, &event) >= 0)
+            {
+                pConnection = pFree;
+                *pIsReused = false;
+            }
+            else
+            {
+                *pReturnCode = CLIENT_ERR_GENERAL_FAILURE;
+                fprintf (stderr, "Failed to add socket %ld to epoll for server on port %d, error: %s.\n", pFree->connection.socket, serverPort, strerror (errno));
+                closeAsyncConnection (pFree);
+            }
+        }
+    }
+    else if (pConnection == PNULL)
+    {
+        *pReturnCode = CLIENT_ERR_TOO_MANY_REQUESTS;
+        fprintf (stderr, "No connection free for a request to server on port %d.\n", serverPort);
+    }
+
+    return pConnection;
+}
+
+/*
+ * Finish with a request started with
+ * startMessagingClientRequest() and call its callback.
+ *
+ * pRequest      the request.
+ * returnCode    how it went.
+ * pReceivedMsg  the response, PNULL if there isn't one.
+ */
+static void finishAsyncRequest (AsyncRequest *pRequest, ClientReturnCode returnCode, Msg *pReceivedMsg)
+{
+    MessagingClientCallback pCallback = pRequest->pCallback;
+    void *pContext = pRequest->pContext;
+
+    /* Free the request first so that the callback can start another */
+    pRequest->inUse = false;
+    pRequest->pConnection->numOutstanding--;
+    gNumAsyncRequests--;
+
+    resumeDebug();
+    pCallback (returnCode, pReceivedMsg, pContext);
+    suspendDebug();
+}
+
+/*
+ * Close a connection used for requests started with
+ * startMessagingClientRequest() that has failed and
+ * fail the requests that were waiting on it.
+ *
+ * pConnection  the connection.
+ * returnCode   the return code to fail them with.
+ */
+static void failAsyncConnection (AsyncConnection *pConnection, ClientReturnCode returnCode)
+{
+    UInt32 x;
+
+    printDebug ("Messaging Client %d: closing socket %d with %ld request(s) waiting.\n", pConnection->connection.serverPort, pConnection->connection.socket, pConnection->numOutstanding);
+    closeAsyncConnection (pConnection);
+    for (x = 0; x < MESSAGING_CLIENT_MAX_STARTED_REQUESTS; x++)
+    {
+        if (gAsyncRequest[x].inUse && (gAsyncRequest[x].pConnection == pConnection))
+        {
+            pConnection->numOutstanding++; /* So that finishAsyncRequest() can take it off again */
+            finishAsyncRequest (&(gAsyncRequest[x]), returnCode, PNULL);
+        }
+    }
+}
+
+/*
+ * Receive whatever has arrived on a connection used
+ * for requests started with startMessagingClientRequest()
+ * and pass on the responses.  They are all taken out
+ * before any callback is called, so that it can do
+ * what it likes with the connection.
+ *
+ * pConnection  the connection.
+ */
+static void serviceAsyncConnection (AsyncConnection *pConnection)
+{
+    ClientReturnCode returnCode = CLIENT_SUCCESS;
+    AsyncRequest *pResponseRequest[MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+    Msg responseMsg[MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+    UInt32 numResponses = 0;
+    UInt16 rxOffset = 0;
+    UInt16 rawMsgLength;
+    UInt16 headerLength = 0;
+    MsgRequestId requestId = MESSAGING_NO_RESPONSE_REQUEST_ID;
+    SInt32 rawBytesReceived;
+    SInt32 socket = pConnection->connection.socket;
+    AsyncRequest *pRequest;
+    UInt32 x;
+
+    if (pConnection->connection.isTagged)
+    {
+        headerLength = sizeof (requestId);
+    }
+
+    rawBytesReceived = recv (pConnection->connection.socket, pConnection->rxBuffer + pConnection->rxLength, sizeof (pConnection->rxBuffer) - pConnection->rxLength, MSG_DONTWAIT);
+    if (rawBytesReceived > 0)
+    {
+        pConnection->rxLength += rawBytesReceived;
+        while ((returnCode == CLIENT_SUCCESS) && (pConnection->rxLength - rxOffset >= headerLength + SIZE_OF_MSG_LENGTH) &&
+               (pConnection->rxLength - rxOffset >= (rawMsgLength = pConnection->rxBuffer[rxOffset + headerLength] + SIZE_OF_MSG_LENGTH) + headerLength))
+        {
+            /* Find the request the response is for: from its request ID
+             * or, if there aren't any, the one request on the connection */
+            pRequest = PNULL;
+            memcpy (&requestId, pConnection->rxBuffer + rxOffset, headerLength);
+            for (x = 0; (x < MESSAGING_CLIENT_MAX_STARTED_REQUESTS) && (pRequest == PNULL); x++)
+            {
+                if (gAsyncRequest[x].inUse && (gAsyncRequest[x].pConnection == pConnection) &&
+                    ((headerLength == 0) || (requestId == x + 1)))
+                {
+                    pRequest = &(gAsyncRequest[x]);
+                }
+            }
+            for (x = 0; (x < numResponses) && (pRequest != PNULL); x++)
+            {
+                if (pResponseRequest[x] == pRequest)
+                {
+                    pRequest = PNULL;
+                }
+            }
+
+            if (pRequest != PNULL)
+            {
+                pResponseRequest[numResponses] = pRequest;
+                memcpy (&(responseMsg[numResponses]), pConnection->rxBuffer + rxOffset + headerLength, rawMsgLength);
+                numResponses++;
+                rxOffset += headerLength + rawMsgLength;
+            }
+            else
+            {
+                returnCode = CLIENT_ERR_UNEXPECTED_RESPONSE;
+                fprintf (stderr, "Response from server on port %d with unexpected request ID %d.\n", pConnection->connection.serverPort, requestId);
+            }
+        }
+        pConnection->rxLength -= rxOffset;
+        memmove (pConnection->rxBuffer, pConnection->rxBuffer + rxOffset, pConnection->rxLength);
+    }
+    else if ((rawBytesReceived == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+    {
+        returnCode = CLIENT_ERR_FAILED_ON_RECV;
+    }
+
+    for (x = 0; x < numResponses; x++)
+    {
+        finishAsyncRequest (pResponseRequest[x], CLIENT_SUCCESS, &(responseMsg[x]));
+    }
+
+    /* Checking that the connection is still the one it was, in case a callback closed it */
+    if ((returnCode != CLIENT_SUCCESS) && pConnection->connection.inUse && (pConnection->connection.socket == socket))
+    {
+        failAsyncConnection (pConnection, returnCode);
+    }
+}
+
+/*
+ * Ask a server to send updates of a topic that it
+ * publishes, or to stop doing so, see MessagingSubscribeReq.
+ *
+ * serverPort       the port number of the server.
+ * pIpAddressToUse  the IP address of the server.
+ * pRequest         the request.
+ *
+ * @return          client return code.
+ */
+static ClientReturnCode sendSubscribeRequest (UInt16 serverPort, Char *pIpAddressToUse, MessagingSubscribeReq *pRequest)
+{
+    ClientReturnCode returnCode;
+    Msg sendMsg;
+    Msg receivedMsg;
+    Bool success = false;
+
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (*pRequest);
+    sendMsg.msgType = MESSAGING_SUBSCRIBE_MSG_TYPE;
+    memcpy (&(sendMsg.msgBody[0]), pRequest, sizeof (*pRequest));
+    receivedMsg.msgLength = 0;
+
+    returnCode = runMessagingClient (serverPort, pIpAddressToUse, &sendMsg, &receivedMsg);
+    if (returnCode == CLIENT_SUCCESS)
+    {
+        if ((receivedMsg.msgType == MESSAGING_SUBSCRIBE_MSG_TYPE) && (receivedMsg.msgLength == SIZE_OF_MSG_TYPE + sizeof (success)))
+        {
+            memcpy (&success, &(receivedMsg.msgBody[0]), sizeof (success));
+        }
+        if (!success)
+        {
+            returnCode = CLIENT_ERR_UNEXPECTED_RESPONSE;
+            fprintf (stderr, "Server on port %d didn't do as asked with topic %d (response type %d, length %d).\n", serverPort, pRequest->topic, receivedMsg.msgType, receivedMsg.msgLength);
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Switch on keeping connections to servers open
+ * between messages (the default).
+ */
+void setMessagingClientConnectionPoolingOn (void)
+{
+    gConnectionPoolingIsOn = true;
+}
+
+/*
+ * Switch off keeping connections to servers open
+ * between messages, closing any that are idle.
+ */
+void setMessagingClientConnectionPoolingOff (void)
+{
+    gConnectionPoolingIsOn = false;
+    closeMessagingClientConnections();
+}
+
+/*
+ * Set how servers on this machine are reached:
+ * through their Unix domain sockets (the default),
+ * over TCP or with messages carried in shared memory,
+ * which avoids copying them through the kernel and,
+ * while the server is busy, avoids system calls
+ * altogether.  A shared memory connection takes a
+ * few kbytes of memory so it is best kept for the
+ * busiest paths, with connection pooling on.  Idle
+ * connections are closed so that the change takes
+ * effect on the next message.
+ *
+ * transport  the transport to use.
+ */
+void setMessagingClientLocalTransport (MessagingLocalTransport transport)
+{
+    gLocalTransport = transport;
+    closeMessagingClientConnections();
+}
+
+/*
+ * Close all of the idle connections that this
+ * process has open to servers.
+ */
+void closeMessagingClientConnections (void)
+{
+    UInt32 x;
+
+    pthread_mutex_lock (&gConnectionPoolLock);
+
+    for (x = 0; x < MAX_NUM_POOLED_CONNECTIONS; x++)
+    {
+        if (gConnectionPool[x].inUse && !gConnectionPool[x].busy)
+        {
+            closeConnection (&(gConnectionPool[x]));
+            gConnectionPool[x].inUse = false;
+        }
+    }
+
+    pthread_mutex_unlock (&gConnectionPoolLock);
+}
+
+/*
+ * Get this thread's pair of message buffers, so
+ * that building a message to send, and receiving
+ * the response, doesn't need any memory to be
+ * allocated.  Each thread has its own pair so no
+ * locking is needed but the buffers are shared by
+ * everything in the thread that talks to a server:
+ * finish with them before calling anything else
+ * that might send a message.
+ *
+ * @return  pointer to the message buffers.
+ */
+MessagingClientMsgs *getMessagingClientMsgs (void)
+{
+    return &gClientMsgs;
+}
+
+/*
+ * Get the file descriptor that becomes readable
+ * when there is something for
+ * pollMessagingClientRequests() to do, so that it
+ * can be waited for in an event loop along with
+ * other things, e.g. a server's with
+ * addMessagingServerPollFd().
+ *
+ * @return  the file descriptor, -1 if there
+ *          isn't one.
+ */
+SInt32 getMessagingClientPollFd (void)
+{
+    if (gAsyncEpollFd < 0)
+    {
+        gAsyncEpollFd = epoll_create1 (EPOLL_CLOEXEC);
+        if (gAsyncEpollFd < 0)
+        {
+            fprintf (stderr, "Failed to create epoll instance for messaging client, error: %s.\n", strerror (errno));
+        }
+    }
+
+    return gAsyncEpollFd;
+}
+
+/*
+ * Start sending a message to the server without
+ * waiting for the response: the callback is called
+ * with the response from pollMessagingClientRequests()
+ * later, or from here if something goes wrong with
+ * a connection that other requests were waiting on.
+ * Up to MESSAGING_CLIENT_MAX_STARTED_REQUESTS may be
+ * waiting at once, to any number of servers, and the
+ * responses come back in whatever order the servers
+ * send them.  Servers on this machine are reached
+ * through their Unix domain sockets, where up to
+ * MESSAGING_MAX_REQUESTS_IN_FLIGHT requests share a
+ * connection, other servers over TCP, one request per
+ * connection.  The connections are kept open for next
+ * time.  This and pollMessagingClientRequests() must
+ * only be called from one thread.
+ *
+ * serverPort      the port number to use.
+ * pIpAddressToUse pointer to a null terminated
+ *                 string representing the IP address
+ *                 to use.  May be PNULL, in which
+ *                 case 127.0.0.1 is used.
+ * pSendMsg        the message to send, which may be
+ *                 re-used as soon as this returns.
+ * pCallback       the function to call with the
+ *                 response.
+ * pContext        passed to pCallback.
+ *
+ * @return      client return code; if it isn't
+ *              CLIENT_SUCCESS the callback will not
+ *              be called.
  */
+ClientReturnCode startMessagingClientRequest (UInt16 serverPort, Char *pIpAddressToUse, Msg *pSendMsg, MessagingClientCallback pCallback, void *pContext)
+{
+    ClientReturnCode returnCode = CLIENT_SUCCESS;
+    Char *pIpAddress = LOCAL_IP_ADDRESS_STRING;
+    in_addr_t ipAddress;
+    AsyncRequest *pRequest = PNULL;
+    AsyncConnection *pConnection;
+    UInt8 txBuffer[sizeof (MessagingTaggedMsg)];
+    UInt16 txLength;
+    MsgRequestId requestId;
+    Bool isReused = false;
+    Bool worthRetrying = true;
+    UInt32 attempt;
+    UInt32 x;
 
-extern int errno;
+    suspendDebug();
+    if (pSendMsg == PNULL)
+    {
+        returnCode = CLIENT_ERR_SEND_MESSAGE_IS_PNULL;
+        fprintf (stderr, "Send message is PNULL.\n");
+    }
+    else if (getMessagingClientPollFd() < 0)
+    {
+        returnCode = CLIENT_ERR_GENERAL_FAILURE;
+    }
+    else
+    {
+        for (x = 0; (x < MESSAGING_CLIENT_MAX_STARTED_REQUESTS) && (pRequest == PNULL); x++)
+        {
+            if (!gAsyncRequest[x].inUse)
+            {
+                /* Taken now, with no connection, in case a callback
+                 * below starts another request */
+                pRequest = &(gAsyncRequest[x]);
+                pRequest->inUse = true;
+                pRequest->pConnection = PNULL;
+                requestId = (MsgRequestId) (x + 1);
+            }
+        }
+        if (pRequest == PNULL)
+        {
+            returnCode = CLIENT_ERR_TOO_MANY_REQUESTS;
+            fprintf (stderr, "Already %d requests waiting for responses.\n", MESSAGING_CLIENT_MAX_STARTED_REQUESTS);
+        }
+    }
+
+    if (returnCode == CLIENT_SUCCESS)
+    {
+        if (pIpAddressToUse != PNULL)
+        {
+           pIpAddress = pIpAddressToUse;
+        }
+        ipAddress = inet_addr (pIpAddress);
+
+        /* Only worth a second go if an open connection turned out to be dead */
+        for (attempt = 0; (attempt < 2) && worthRetrying; attempt++)
+        {
+            worthRetrying = false;
+            pConnection = getAsyncConnection (serverPort, ipAddress, &isReused, &returnCode);
+            if (pConnection != PNULL)
+            {
+                txLength = 0;
+                if (pConnection->connection.isTagged)
+                {
+                    memcpy (txBuffer, &requestId, sizeof (requestId));
+                    txLength = sizeof (requestId);
+                }
+                memcpy (txBuffer + txLength, pSendMsg, pSendMsg->msgLength + SIZE_OF_MSG_LENGTH);
+                txLength += pSendMsg->msgLength + SIZE_OF_MSG_LENGTH;
+
+                if (send (pConnection->connection.socket, txBuffer, txLength, MSG_NOSIGNAL) == txLength)
+                {
+                    returnCode = CLIENT_SUCCESS;
+                    pRequest->pConnection = pConnection;
+                    pRequest->pCallback = pCallback;
+                    pRequest->pContext = pContext;
+                    pConnection->numOutstanding++;
+                    gNumAsyncRequests++;
+                    printDebug ("Messaging Client %d: started request %d on socket %d.\n", serverPort, requestId, pConnection->connection.socket);
+                }
+                else
+                {
+                    returnCode = CLIENT_ERR_COULDNT_SEND_WHOLE_MESSAGE_TO_SERVER;
+                    fprintf (stderr, "Couldn't send whole %d bytes of message to server, error: %s.\n", txLength, strerror (errno));
+                    if (isReused)
+                    {
+                        worthRetrying = true;
+                        failAsyncConnection (pConnection, CLIENT_ERR_FAILED_ON_RECV);
+                    }
+                    else
+                    {
+                        closeAsyncConnection (pConnection);
+                    }
+                }
+            }
+        }
+
+        if (returnCode != CLIENT_SUCCESS)
+        {
+            pRequest->inUse = false;
+        }
+    }
+    resumeDebug();
+
+    return returnCode;
+}
 
 /*
- * STATIC FUNCTIONS
+ * Deal with whatever responses have arrived for
+ * requests started with startMessagingClientRequest(),
+ * calling their callbacks, waiting for up to the
+ * given time for one if none have.  The callbacks
+ * may start more requests.
+ *
+ * timeoutMs  how long to wait for something to
+ *            arrive in milliseconds, 0 not to wait
+ *            at all, -1 to wait for ever.
+ *
+ * @return    the number of requests still waiting
+ *            for their responses.
  */
+UInt32 pollMessagingClientRequests (SInt32 timeoutMs)
+{
+    struct epoll_event events[MAX_NUM_ASYNC_CONNECTIONS];
+    AsyncConnection *pConnection;
+    SInt32 numEvents = 0;
+    SInt32 x;
+
+    suspendDebug();
+    if ((gAsyncEpollFd >= 0) && (gNumAsyncRequests > 0))
+    {
+        numEvents = epoll_wait (gAsyncEpollFd, events, MAX_NUM_ASYNC_CONNECTIONS, timeoutMs);
+    }
+    for (x = 0; x < numEvents; x++)
+    {
+        pConnection = (AsyncConnection *) events[x].data.ptr;
+        if (pConnection->connection.inUse)
+        {
+            serviceAsyncConnection (pConnection);
+        }
+    }
+    resumeDebug();
+
+    return gNumAsyncRequests;
+}
 
 /*
  * Send a message to the server.  This
- * function establishes a connection on the
- * given port and sends the message provided.
- * It waits for a response message if
- * pReceivedMsg is not PNULL.  Then it closes
- * the connection.
+ * function sends the message provided on a
+ * connection to the given port, reusing an
+ * open connection from a previous message if
+ * there is one.  It waits for a response
+ * message if pReceivedMsg is not PNULL.  The
+ * connection is then kept open for next time.
+ * If the server has been restarted since the
+ * connection was opened a new connection is
+ * made transparently.  Servers on this machine
+ * are reached through their Unix domain sockets,
+ * or shared memory, as set by
+ * setMessagingClientLocalTransport(), other servers
+ * over TCP.
  * 
  * serverPort      the port number to use.
  * pIpAddressToUse pointer to a null terminated
@@ -47,110 +1513,547 @@ extern int errno;
  * @return      client return code.
  */
 ClientReturnCode runMessagingClient (UInt16 serverPort, Char *pIpAddressToUse, Msg *pSendMsg, Msg *pReceivedMsg)
+{
+    ClientReturnCode returnCode;
+    MessagingClientExchange exchange;
+    TraceSpan span;
+
+    exchange.pSendMsg = pSendMsg;
+    exchange.pReceivedMsg = pReceivedMsg;
+
+    TRACE_SPAN_BEGIN (&span, "runMessagingClient", (pSendMsg != PNULL) ? pSendMsg->msgType : -1);
+    returnCode = runMessagingClientBatch (serverPort, pIpAddressToUse, &exchange, 1);
+    TRACE_SPAN_END (&span);
+
+    return returnCode;
+}
+
+/*
+ * Send a batch of messages to the server, as
+ * runMessagingClient() does for one, and collect
+ * the responses.  Where the messages carry request
+ * IDs, on the Unix domain socket of a server on this
+ * machine or in shared memory, they are sent without
+ * waiting for the responses, up to
+ * MESSAGING_MAX_REQUESTS_IN_FLIGHT at a time, and the
+ * server may handle them at the same time and respond
+ * in any order, so a batch takes little longer than
+ * its slowest message.  Otherwise they are sent one
+ * at a time.  Either way, the responses end up in
+ * the places given for them.
+ *
+ * serverPort      the port number to use.
+ * pIpAddressToUse pointer to a null terminated
+ *                 string representing the IP address
+ *                 to use.  May be PNULL, in which
+ *                 case 127.0.0.1 is used.
+ * pExchanges      the messages to send and where to
+ *                 put the responses; a pReceivedMsg
+ *                 may be PNULL, in which case no
+ *                 response is expected to that message.
+ * numExchanges    the number of entries in pExchanges,
+ *                 at most MESSAGING_CLIENT_MAX_BATCH_SIZE.
+ *
+ * @return      client return code, CLIENT_SUCCESS
+ *              only if all of the messages were
+ *              sent and all of the responses received.
+ */
+ClientReturnCode runMessagingClientBatch (UInt16 serverPort, Char *pIpAddressToUse, MessagingClientExchange *pExchanges, UInt32 numExchanges)
 {
     ClientReturnCode returnCode = CLIENT_SUCCESS;
-    UInt32 serverSocket;
-    SockAddrIn messagingServer;
-    UInt16 rawSendLength;
-    Char *pIpAddress = "127.0.0.1";
+    Char *pIpAddress = LOCAL_IP_ADDRESS_STRING;
+    in_addr_t ipAddress;
+    PooledConnection *pConnection;
+    PooledConnection *pPooledConnection;
+    PooledConnection newConnection;
+    Bool isPooled;
+    Bool isReused;
+    Bool worthRetrying = true;
+    UInt32 attempt;
+    UInt32 x;
+    Msg *pReceivedMsg;
+    Msg unwantedMsg;
+
+    ASSERT_PARAM (numExchanges <= MESSAGING_CLIENT_MAX_BATCH_SIZE, numExchanges);
 
     suspendDebug(); /* Switch the detail off 'cos it gets annoying */
-    if (pSendMsg != PNULL)
+    for (x = 0; (x < numExchanges) && (returnCode == CLIENT_SUCCESS); x++)
     {
-        /* Create the TCP socket */
-        serverSocket = socket (PF_INET, SOCK_STREAM, IPPROTO_TCP);
-        if (serverSocket >= 0)
+        if (pExchanges[x].pSendMsg == PNULL)
         {
-            printDebug ("Messaging Client %d: created socket %d.\n", serverPort, serverSocket);
+            returnCode = CLIENT_ERR_SEND_MESSAGE_IS_PNULL;
+            fprintf (stderr, "Send message is PNULL.\n");
+        }
+    }
+
+    if (returnCode == CLIENT_SUCCESS)
+    {
+        if (pIpAddressToUse != PNULL)
+        {
+           pIpAddress = pIpAddressToUse;
+        }
+        ipAddress = inet_addr (pIpAddress);
             
-            if (pIpAddressToUse != PNULL)
+        /* Only worth a second go if a pooled connection turned out to be dead */
+        for (attempt = 0; (attempt < 2) && worthRetrying; attempt++)
+        {
+            pConnection = PNULL;
+            isPooled = false;
+            isReused = false;
+            worthRetrying = false;
+
+            if (gConnectionPoolingIsOn && (attempt == 0))
             {
-               pIpAddress = pIpAddressToUse;            
+                pConnection = acquirePooledConnection (serverPort, ipAddress);
+                if (pConnection != PNULL)
+                {
+                    isPooled = true;
+                    isReused = true;
+                    printDebug ("Messaging Client %d: re-using socket %d.\n", serverPort, pConnection->socket);
+                }
             }
             
-            /* Construct the server sockaddr_in structure */
-            memset (&messagingServer, 0, sizeof (messagingServer)); 
-            messagingServer.sin_family = AF_INET;                      /* Internet/IP */
-            messagingServer.sin_addr.s_addr = inet_addr (pIpAddress); /* IP address */
-            messagingServer.sin_port = htons (serverPort);             /* server port */
+            if ((pConnection == PNULL) && openConnection (serverPort, ipAddress, gLocalTransport, &newConnection, &returnCode))
+            {
+                pConnection = &newConnection;
+                if (gConnectionPoolingIsOn)
+                {
+                    pPooledConnection = addPooledConnection (serverPort, ipAddress, &newConnection);
+                    if (pPooledConnection != PNULL)
+                    {
+                        pConnection = pPooledConnection;
+                        isPooled = true;
+                    }
+                }
+            }
             
-            /* Establish connection */
-            if (connect (serverSocket, (SockAddr *) &messagingServer, sizeof (messagingServer)) >= 0)
+            if (pConnection != PNULL)
             {
-                printDebug ("Messaging Client %d: connected to server on socket.\n", serverPort, serverSocket);
-                /* Send the message to the server */
-                rawSendLength = pSendMsg->msgLength + SIZE_OF_MSG_LENGTH;
-                if (send (serverSocket, pSendMsg, rawSendLength, 0) == rawSendLength)
+                if (pConnection->pSharedMemory != PNULL)
+                {
+                    returnCode = exchangeSharedMemoryMsgs (pConnection, serverPort, pExchanges, numExchanges, &worthRetrying);
+                }
+                else if (pConnection->isTagged)
+                {
+                    returnCode = exchangeTaggedMsgs (pConnection->socket, serverPort, pExchanges, numExchanges, &worthRetrying);
+                }
+                else
                 {
-                    printDebug ("Messaging Client %d: sent %d bytes to server on socket.\n", serverPort, rawSendLength, serverSocket);
-                    if (pReceivedMsg != PNULL)
+                    /* No request IDs, so one at a time; the server
+                     * responds to everything so, other than for the
+                     * last message, a response that is not wanted
+                     * has to be read and thrown away */
+                    returnCode = CLIENT_SUCCESS;
+                    for (x = 0; (x < numExchanges) && (returnCode == CLIENT_SUCCESS); x++)
                     {
-                        UInt16 rawReceivedLength = 0;
-                        SInt16 rawBytesReceived = 0;                        
-                        MsgLength *pReceivedMsgLength;
-                        
-                        pReceivedMsgLength = &(pReceivedMsg->msgLength);
-                        /* Set the message length to max to begin with */
-                        *pReceivedMsgLength = MAX_MSG_LENGTH;
-        
-                        /* Receive the response back from the server */
-                        while ((rawReceivedLength < *pReceivedMsgLength + SIZE_OF_MSG_LENGTH) && (rawReceivedLength < MAX_MSG_LENGTH + SIZE_OF_MSG_LENGTH) && (rawBytesReceived >= 0) && *pReceivedMsgLength > 0)
+                        pReceivedMsg = pExchanges[x].pReceivedMsg;
+                        if ((pReceivedMsg == PNULL) && (x < numExchanges - 1))
                         {
-                            rawBytesReceived = recv (serverSocket, pReceivedMsg, *pReceivedMsgLength + SIZE_OF_MSG_LENGTH, 0);
-                            if (rawBytesReceived >= 0)
-                            {
-                                printDebug ("Messaging Client %d: received %d bytes from server so far.\n", serverPort, rawBytesReceived);
-                                rawReceivedLength += rawBytesReceived;
-                            }
-                            else
-                            {
-                                returnCode = CLIENT_ERR_FAILED_ON_RECV;
-                                fprintf (stderr, "Failure returned by recv() (value %d), error: %s.\n", rawBytesReceived, strerror (errno));
-                            }
+                            pReceivedMsg = &unwantedMsg;
                         }
-                        
-                        if (rawReceivedLength != *pReceivedMsgLength + SIZE_OF_MSG_LENGTH)
+                        returnCode = exchangeMsgs (pConnection->socket, serverPort, pExchanges[x].pSendMsg, pReceivedMsg, &worthRetrying);
+                    }
+                    worthRetrying = worthRetrying && (x == 1);
+                }
+                worthRetrying = worthRetrying && isReused;
+
+                if (isPooled)
+                {
+                    releasePooledConnection (pConnection, returnCode == CLIENT_SUCCESS);
+                }
+                else
+                {
+                    printDebug ("Messaging Client %d: closing socket %d.\n", serverPort, pConnection->socket);
+                    closeConnection (pConnection);
+                }
+            }
+        }
+    }
+    resumeDebug();
+
+    return returnCode;
+}
+
+/*
+ * Send messages that need no response to a server
+ * on this machine, back to back in a single datagram
+ * on its Unix domain datagram socket, without ever
+ * waiting: if they can't be sent straight away, because
+ * the server isn't there or has so many datagrams
+ * waiting that no more will fit, none are sent and it
+ * is up to the caller whether to try again later.
+ * The server handles them in order.
+ *
+ * serverPort  the port number to use.
+ * ppSendMsgs  the messages to send.
+ * numMsgs     the number of them, at most
+ *             MESSAGING_MAX_MSGS_PER_DATAGRAM.
+ *
+ * @return     CLIENT_SUCCESS if the messages were sent,
+ *             otherwise a client error code.
+ */
+ClientReturnCode trySendMessagingClientDatagram (UInt16 serverPort, Msg **ppSendMsgs, UInt32 numMsgs)
+{
+    ClientReturnCode returnCode = CLIENT_ERR_SEND_MESSAGE_IS_PNULL;
+    SInt32 datagramSocket;
+    SockAddrUn messagingServer;
+    struct iovec iov[MESSAGING_MAX_MSGS_PER_DATAGRAM];
+    struct msghdr datagram;
+    SInt32 rawSendLength = 0;
+    UInt32 x = 0;
+
+    suspendDebug(); /* Switch the detail off 'cos it gets annoying */
+    if ((ppSendMsgs != PNULL) && (numMsgs > 0) && (numMsgs <= MESSAGING_MAX_MSGS_PER_DATAGRAM))
+    {
+        for (x = 0; (x < numMsgs) && (ppSendMsgs[x] != PNULL); x++)
+        {
+            iov[x].iov_base = ppSendMsgs[x];
+            iov[x].iov_len = ppSendMsgs[x]->msgLength + SIZE_OF_MSG_LENGTH;
+            rawSendLength += iov[x].iov_len;
+        }
+    }
+    if ((rawSendLength > 0) && (x == numMsgs))
+    {
+        returnCode = CLIENT_ERR_FAILED_TO_CREATE_SOCKET;
+        pthread_mutex_lock (&gConnectionPoolLock);
+        if (gDatagramSocket < 0)
+        {
+            gDatagramSocket = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+            if (gDatagramSocket < 0)
+            {
+                fprintf (stderr, "Failed to create datagram socket, error: %s.\n", strerror (errno));
+            }
+        }
+        datagramSocket = gDatagramSocket;
+        pthread_mutex_unlock (&gConnectionPoolLock);
+
+        if (datagramSocket >= 0)
+        {
+            memset (&messagingServer, 0, sizeof (messagingServer));
+            messagingServer.sun_family = AF_UNIX;
+            /* sun_path[0] is left as zero, the name is in the abstract namespace */
+            snprintf (&(messagingServer.sun_path[1]), sizeof (messagingServer.sun_path) - 1, MESSAGING_DATAGRAM_SOCKET_NAME_FORMAT, serverPort);
+
+            memset (&datagram, 0, sizeof (datagram));
+            datagram.msg_name = &messagingServer;
+            datagram.msg_namelen = sizeof (messagingServer);
+            datagram.msg_iov = iov;
+            datagram.msg_iovlen = numMsgs;
+            if (sendmsg (datagramSocket, &datagram, MSG_DONTWAIT | MSG_NOSIGNAL) == rawSendLength)
+            {
+                returnCode = CLIENT_SUCCESS;
+                printDebug ("Messaging Client %d: sent %d byte datagram of %d message(s).\n", serverPort, rawSendLength, numMsgs);
+            }
+            else
+            {
+                returnCode = CLIENT_ERR_COULDNT_SEND_WHOLE_MESSAGE_TO_SERVER;
+                printDebug ("Messaging Client %d: couldn't send datagram (%s).\n", serverPort, strerror (errno));
+            }
+        }
+    }
+    resumeDebug();
+
+    return returnCode;
+}
+
+/*
+ * Send a message that needs no response to a server
+ * on this machine as a single datagram on its Unix
+ * domain datagram socket: one system call, with no
+ * connection to make or keep.  Where that can't be
+ * done, because the server is on another machine,
+ * doesn't have the datagram socket (e.g. it was built
+ * before there was one) or has so many datagrams
+ * waiting that no more will fit, the message is sent
+ * with runMessagingClient() instead.  Since datagrams
+ * don't wait in line with messages sent on connections,
+ * a datagram may be handled before, or after, a message
+ * sent earlier, or later, by other means.
+ *
+ * serverPort      the port number to use.
+ * pIpAddressToUse pointer to a null terminated
+ *                 string representing the IP address
+ *                 to use.  May be PNULL, in which
+ *                 case 127.0.0.1 is used.
+ * pSendMsg        the message to send.
+ *
+ * @return      client return code.
+ */
+ClientReturnCode sendMessagingClientDatagram (UInt16 serverPort, Char *pIpAddressToUse, Msg *pSendMsg)
+{
+    ClientReturnCode returnCode = CLIENT_ERR_GENERAL_FAILURE;
+    Char *pIpAddress = LOCAL_IP_ADDRESS_STRING;
+
+    if (pIpAddressToUse != PNULL)
+    {
+       pIpAddress = pIpAddressToUse;
+    }
+
+    if ((pSendMsg != PNULL) && (inet_addr (pIpAddress) == htonl (INADDR_LOOPBACK)))
+    {
+        /* Don't wait if the server is behind: send it the slow way instead */
+        returnCode = trySendMessagingClientDatagram (serverPort, &pSendMsg, 1);
+    }
+
+    if (returnCode != CLIENT_SUCCESS)
+    {
+        returnCode = runMessagingClient (serverPort, pIpAddressToUse, pSendMsg, PNULL);
+    }
+
+    return returnCode;
+}
+
+/*
+ * Send a message whose body may be too long for a
+ * Msg, up to MAX_LARGE_MSG_BODY_LENGTH bytes, to a
+ * server on this machine, framed with a LargeMsgHeader
+ * on the server's Unix domain socket for such messages,
+ * and wait for the response if pResponse is not PNULL.
+ * The response may be as long too.  A connection is
+ * made for each message, the cost of which is small
+ * beside that of moving a long body.  Where the server
+ * is on another machine, or doesn't have the socket for
+ * such messages (e.g. it was built before there was
+ * one), a message whose body fits in a Msg is sent with
+ * runMessagingClient() instead, otherwise it can't be
+ * sent at all.
+ *
+ * serverPort       the port number to use.
+ * pIpAddressToUse  pointer to a null terminated
+ *                  string representing the IP address
+ *                  to use.  May be PNULL, in which
+ *                  case 127.0.0.1 is used.
+ * msgType          the type of the message to send.
+ * pSendBody        the body of the message to send,
+ *                  may be PNULL if sendBodyLength is 0.
+ * sendBodyLength   the length of the body.
+ * pResponse        where to put the response, may be
+ *                  PNULL, in which case no response
+ *                  from the server is expected.
+ *
+ * @return      client return code, an error if the
+ *              response is longer than
+ *              pResponse->maxBodyLength.
+ */
+ClientReturnCode runMessagingClientLarge (UInt16 serverPort, Char *pIpAddressToUse, MsgType msgType, const void *pSendBody, UInt32 sendBodyLength, MessagingClientLargeResponse *pResponse)
+{
+    ClientReturnCode returnCode = CLIENT_SUCCESS;
+    Char *pIpAddress = LOCAL_IP_ADDRESS_STRING;
+    SInt32 serverSocket = -1;
+    LargeMsgHeader header;
+    Bool isSentAsMsg = false;
+    Msg sendMsg;
+    Msg receivedMsg;
+
+    ASSERT_PARAM (sendBodyLength <= MAX_LARGE_MSG_BODY_LENGTH, sendBodyLength);
+
+    suspendDebug(); /* Switch the detail off 'cos it gets annoying */
+    if ((pSendBody == PNULL) && (sendBodyLength > 0))
+    {
+        returnCode = CLIENT_ERR_SEND_MESSAGE_IS_PNULL;
+        fprintf (stderr, "Send message body is PNULL.\n");
+    }
+    else
+    {
+        if (pIpAddressToUse != PNULL)
+        {
+           pIpAddress = pIpAddressToUse;
+        }
+        if (inet_addr (pIpAddress) == htonl (INADDR_LOOPBACK))
+        {
+            serverSocket = openUnixConnection (serverPort, MESSAGING_LARGE_MSG_SOCKET_NAME_FORMAT);
+        }
+
+        if (serverSocket >= 0)
+        {
+            header.version = MESSAGING_LARGE_MSG_VERSION;
+            header.msgType = msgType;
+            header.bodyLength = sendBodyLength;
+            if (sendAll (serverSocket, (UInt8 *) &header, sizeof (header)) && sendAll (serverSocket, (const UInt8 *) pSendBody, sendBodyLength))
+            {
+                printDebug ("Messaging Client %d: sent message with %ld byte body on socket %d.\n", serverPort, sendBodyLength, serverSocket);
+                if (pResponse != PNULL)
+                {
+                    if ((recvAll (serverSocket, (UInt8 *) &header, sizeof (header)) == sizeof (header)) && (header.version == MESSAGING_LARGE_MSG_VERSION))
+                    {
+                        pResponse->msgType = header.msgType;
+                        pResponse->bodyLength = header.bodyLength;
+                        if (header.bodyLength > pResponse->maxBodyLength)
                         {
                             returnCode = CLIENT_ERR_MESSAGE_FROM_SERVER_INCOMPLETE_OR_TOO_LONG;
-                            fprintf (stderr, "Message from server incomplete or too long (%d bytes received, %d bytes needed), error: %s.\n", rawReceivedLength, *pReceivedMsgLength + SIZE_OF_MSG_LENGTH, strerror (errno));
+                            fprintf (stderr, "Response from server has a %ld byte body, room for %ld.\n", header.bodyLength, pResponse->maxBodyLength);
                         }
-                        else
+                        else if (recvAll (serverSocket, (UInt8 *) pResponse->pBody, header.bodyLength) != header.bodyLength)
                         {
-                            printDebug ("Messaging Client %d: received %d bytes from server on socket.\n", serverPort, rawReceivedLength, serverSocket);
+                            returnCode = CLIENT_ERR_MESSAGE_FROM_SERVER_INCOMPLETE_OR_TOO_LONG;
+                            fprintf (stderr, "Response from server incomplete.\n");
                         }
                     }
                     else
                     {
-                        printDebug ("Messaging Client %d: not waiting for a response.\n", serverPort);                        
+                        returnCode = CLIENT_ERR_FAILED_ON_RECV;
+                        fprintf (stderr, "Failed to receive response header from server, error: %s.\n", strerror (errno));
                     }
                 }
-                else
-                {
-                    returnCode = CLIENT_ERR_COULDNT_SEND_WHOLE_MESSAGE_TO_SERVER;
-                    fprintf (stderr, "Couldn't send whole %d byte message to server, error: %s.\n", rawSendLength, strerror (errno));
-                }
             }
             else
             {
-                returnCode = CLIENT_ERR_FAILED_TO_CONNECT_TO_SERVER;
-                fprintf (stderr, "Failed to connect to server on port %d, error: %s.\n", serverPort, strerror (errno));                           
+                returnCode = CLIENT_ERR_COULDNT_SEND_WHOLE_MESSAGE_TO_SERVER;
+                fprintf (stderr, "Couldn't send whole message with %ld byte body to server, error: %s.\n", sendBodyLength, strerror (errno));
             }
-            
             close (serverSocket);
-            printDebug ("Messaging Client %d: closed socket.\n", serverPort, serverSocket);
+        }
+        else if (sendBodyLength <= MAX_MSG_BODY_LENGTH)
+        {
+            /* Done below, since runMessagingClient() switches debug back on */
+            isSentAsMsg = true;
         }
         else
         {
-            returnCode = CLIENT_ERR_FAILED_TO_CREATE_SOCKET;
-            fprintf (stderr, "Failed to create socket %ld on port %d, error: %s.\n", serverSocket, serverPort, strerror (errno));        
+            returnCode = CLIENT_ERR_FAILED_TO_CONNECT_TO_SERVER;
+            fprintf (stderr, "Server on port %d can't take a message with a %ld byte body.\n", serverPort, sendBodyLength);
         }
     }
-    else
+    resumeDebug();
+
+    if (isSentAsMsg)
     {
-        returnCode = CLIENT_ERR_SEND_MESSAGE_IS_PNULL;
-        fprintf (stderr, "Send message is PNULL.\n");   
+        sendMsg.msgLength = SIZE_OF_MSG_TYPE + sendBodyLength;
+        sendMsg.msgType = msgType;
+        if (pSendBody != PNULL)
+        {
+            memcpy (&(sendMsg.msgBody[0]), pSendBody, sendBodyLength);
+        }
+        if (pResponse != PNULL)
+        {
+            receivedMsg.msgLength = 0;
+            returnCode = runMessagingClient (serverPort, pIpAddressToUse, &sendMsg, &receivedMsg);
+            if ((returnCode == CLIENT_SUCCESS) && (receivedMsg.msgLength >= SIZE_OF_MSG_TYPE))
+            {
+                pResponse->msgType = receivedMsg.msgType;
+                pResponse->bodyLength = receivedMsg.msgLength - SIZE_OF_MSG_TYPE;
+                if (pResponse->bodyLength <= pResponse->maxBodyLength)
+                {
+                    memcpy (pResponse->pBody, &(receivedMsg.msgBody[0]), pResponse->bodyLength);
+                }
+                else
+                {
+                    returnCode = CLIENT_ERR_MESSAGE_FROM_SERVER_INCOMPLETE_OR_TOO_LONG;
+                    fprintf (stderr, "Response from server has a %ld byte body, room for %ld.\n", pResponse->bodyLength, pResponse->maxBodyLength);
+                }
+            }
+        }
+        else
+        {
+            returnCode = runMessagingClient (serverPort, pIpAddressToUse, &sendMsg, PNULL);
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Ask a server what it has counted of the messages of
+ * one type that it has handled since it started, see
+ * MESSAGING_STATS_MSG_TYPE.  To go through all the types
+ * that have been handled start with type 0 and carry on
+ * with the nextMsgType of each until it is
+ * MESSAGING_STATS_NO_NEXT_MSG_TYPE.
+ *
+ * serverPort       the port number of the server.
+ * pIpAddressToUse  the IP address of the server.
+ * msgType          the message type.
+ * pStats           a place to put the stats.
+ *
+ * @return          client return code.
+ */
+ClientReturnCode getMessagingServerStats (UInt16 serverPort, Char *pIpAddressToUse, MsgType msgType, MessagingMsgTypeStats *pStats)
+{
+    ClientReturnCode returnCode;
+    Msg sendMsg;
+    Msg receivedMsg;
+
+    ASSERT_PARAM (pStats != PNULL, (unsigned long) pStats);
+
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (msgType);
+    sendMsg.msgType = MESSAGING_STATS_MSG_TYPE;
+    sendMsg.msgBody[0] = msgType;
+    receivedMsg.msgLength = 0;
+
+    returnCode = runMessagingClient (serverPort, pIpAddressToUse, &sendMsg, &receivedMsg);
+    if (returnCode == CLIENT_SUCCESS)
+    {
+        if ((receivedMsg.msgType == MESSAGING_STATS_MSG_TYPE) && (receivedMsg.msgLength == SIZE_OF_MSG_TYPE + sizeof (*pStats)))
+        {
+            memcpy (pStats, &(receivedMsg.msgBody[0]), sizeof (*pStats));
+        }
+        else
+        {
+            returnCode = CLIENT_ERR_UNEXPECTED_RESPONSE;
+            fprintf (stderr, "Server on port %d didn't answer a stats request (response type %d, length %d).\n", serverPort, receivedMsg.msgType, receivedMsg.msgLength);
+        }
     }
-    resumeDebug();
 
     return returnCode;
+}
+
+/*
+ * Ask a server to send updates of a topic that it
+ * publishes, as datagrams, to the server on this
+ * machine that is on subscriberPort, which will
+ * pass them to its MessagingServerPublicationHandler.
+ * An update is sent when the value of the topic
+ * changes, but no sooner than minIntervalMs after
+ * the last one, and, if maxIntervalMs is not 0,
+ * when maxIntervalMs has passed since the last one.
+ * The value the topic has now is sent straight away.
+ * Subscribing again changes the intervals.  The
+ * subscription lasts until unsubscribed or until an
+ * update can't be sent because the subscriber has gone.
+ *
+ * serverPort       the port number of the server.
+ * pIpAddressToUse  the IP address of the server,
+ *                  which must be on this machine.
+ * topic            the topic.
+ * subscriberPort   the port number of the subscriber.
+ * minIntervalMs    the shortest time between updates.
+ * maxIntervalMs    the longest time between updates,
+ *                  0 for no updates without a change.
+ *
+ * @return          client return code.
+ */
+ClientReturnCode subscribeMessagingServerTopic (UInt16 serverPort, Char *pIpAddressToUse, MessagingTopic topic, UInt16 subscriberPort, UInt32 minIntervalMs, UInt32 maxIntervalMs)
+{
+    MessagingSubscribeReq request;
+
+    request.subscriberPort = subscriberPort;
+    request.topic = topic;
+    request.subscribe = true;
+    request.minIntervalMs = minIntervalMs;
+    request.maxIntervalMs = maxIntervalMs;
+
+    return sendSubscribeRequest (serverPort, pIpAddressToUse, &request);
+}
+
+/*
+ * Ask a server to stop sending updates of a topic
+ * to the server on subscriberPort.
+ *
+ * serverPort       the port number of the server.
+ * pIpAddressToUse  the IP address of the server.
+ * topic            the topic.
+ * subscriberPort   the port number of the subscriber.
+ *
+ * @return          client return code.
+ */
+ClientReturnCode unsubscribeMessagingServerTopic (UInt16 serverPort, Char *pIpAddressToUse, MessagingTopic topic, UInt16 subscriberPort)
+{
+    MessagingSubscribeReq request;
+
+    memset (&request, 0, sizeof (request));
+    request.subscriberPort = subscriberPort;
+    request.topic = topic;
+    request.subscribe = false;
+
+    return sendSubscribeRequest (serverPort, pIpAddressToUse, &request);
 }
\ No newline at end of file
@@ -12,8 +12,10 @@
 #include <unistd.h> /* for fork */
 #include <sys/types.h> /* for pid_t */
 #include <sys/wait.h> /* for wait */
+#include <signal.h> /* for kill */
 #include <unistd.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <rob_system.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
@@ -25,11 +27,126 @@
 #define SERVER_EXE "./test_server"
 #define SERVER_PORT_STRING "5000"
 
+/* The number of clients that send a message all at the same time */
+#define NUM_SIMULTANEOUS_CLIENTS 250
+
+/* The stack size of each simultaneous client thread, kept
+ * small so that there's room for lots of them on a Pi */
+#define CLIENT_THREAD_STACK_SIZE (128 * 1024)
+
+/* The length of the message the slow client sends in pieces */
+#define SLOW_CLIENT_MSG_LENGTH 10
+
+/* The message type that the test server is slow to
+ * respond to (see MessagingServer/src/test.c) */
+#define TEST_SLOW_MSG_TYPE 0x80
+#define TEST_SLOW_MSG_DELAY_US 500000L
+
+/* How long to wait for a slow message to get to the server */
+#define SLOW_MSG_START_DELAY_US 100000L
+
+/* The message type that, sent with no body, gets back the
+ * number of calls the test server has made to malloc()
+ * (see MessagingServer/src/test.c) */
+#define TEST_MALLOC_COUNT_MSG_TYPE 0x81
+
+/* The number of messages sent while checking that nothing is allocated */
+#define NUM_NO_ALLOCATION_MSGS 1000
+/* ...and the body lengths of those messages go up to this, over and over */
+#define NO_ALLOCATION_MSGS_MAX_BODY_LENGTH 128
+
+/* The number of messages sent in a batch, more than can be in flight at once */
+#define NUM_BATCH_MSGS 20
+/* ...the one of those that is slow to handle... */
+#define BATCH_SLOW_MSG_INDEX 2
+/* ...and the one of those whose response is not waited for */
+#define BATCH_NO_RESPONSE_MSG_INDEX 5
+
+/* The message type whose response the test server defers,
+ * giving it from its event loop after a delay (see
+ * MessagingServer/src/test.c) */
+#define TEST_DEFERRED_MSG_TYPE 0x82
+
+/* The message type that the test server counts if it has a
+ * body, responding with the count if it hasn't (see
+ * MessagingServer/src/test.c) */
+#define TEST_COUNTED_MSG_TYPE 0x83
+
+/* The number of messages sent as datagrams... */
+#define NUM_DATAGRAM_MSGS 100
+/* ...and how long to wait for the server to have handled them */
+#define DATAGRAM_MSGS_WAIT_US 1000000L
+#define DATAGRAM_MSGS_POLL_INTERVAL_US 10000L
+
+/* The length of the body of a message too long for a Msg
+ * that is sent to the test server, which responds with a body
+ * as long; the byte at a given offset of each, as checked by
+ * the test server (see MessagingServer/src/test.c) */
+#define LARGE_MSG_BODY_LENGTH 100000
+#define LARGE_MSG_BYTE(oFFSET) ((UInt8) ((oFFSET) * 13))
+#define LARGE_RESPONSE_BYTE(oFFSET) ((UInt8) ((oFFSET) * 7))
+#define TEST_LARGE_MSG_TYPE 0x84
+
+/* An address of this machine that isn't 127.0.0.1, so the
+ * messaging client takes it for another machine */
+#define OTHER_LOOPBACK_IP_ADDRESS_STRING "127.0.0.2"
+
+/* The number of requests started at once without waiting
+ * for the responses, more than share one connection... */
+#define NUM_ASYNC_MSGS 12
+/* ...and every this many of them is one that is deferred */
+#define ASYNC_DEFERRED_MSG_INTERVAL 3
+
+/* The type of the messages sent, and counted by the server,
+ * while checking the stats it keeps and how many are sent */
+#define TEST_STATS_MSG_TYPE 0x85
+#define NUM_STATS_MSGS 10
+
+/* The message type that, sent with a topic and a value, has the
+ * test server publish the value and, sent with just a topic, gets
+ * back the number of updates the test server has received of the
+ * topic and the last value (see MessagingServer/src/test.c)... */
+#define TEST_PUBLISHED_MSG_TYPE 0x86
+/* ...the topic used... */
+#define TEST_TOPIC 3
+/* ...the interval between updates that is asked for
+ * when checking that they are not sent more often... */
+#define TEST_TOPIC_LONG_INTERVAL_MS 10000
+/* ...and that is asked for when checking that they are
+ * sent, changed or not, at least that often */
+#define TEST_TOPIC_SHORT_INTERVAL_MS 100
+
+/*
+ * TYPES
+ */
+
+/* A request started by testAsync() and what became of it */
+typedef struct TestAsyncRequestTag
+{
+    Msg sendMsg;
+    Bool done;
+    Bool success;
+    UInt32 order;       /* the number of responses that came before this one */
+} TestAsyncRequest;
+
 /*
  * EXTERN
  */
 
 extern int errno;
+extern void *__real_malloc (size_t size);
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+/* The number of calls to malloc() */
+static UInt32 gMallocCount = 0;
+/* The number of responses to requests started by testAsync() */
+static UInt32 gNumAsyncResponses = 0;
+/* The body of a message too long for a Msg and of the response to it */
+static UInt8 gLargeMsgBody[LARGE_MSG_BODY_LENGTH];
+static UInt8 gLargeResponseBody[LARGE_MSG_BODY_LENGTH];
 
 /*
  * STATIC FUNCTIONS
@@ -85,10 +202,897 @@ static Bool checkReceivedMsgContents (Msg *pSendMsg, Msg *pReceivedMsg)
     return success;
 }
 
+/*
+ * Pretend to be a slow client: send the start of a
+ * message on a connection of our own and then check that
+ * the server still answers other clients before sending
+ * the rest and getting our own answer.
+ *
+ * serverPort   the port the echo server is on.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testSlowClient (UInt16 serverPort)
+{
+    Bool success = false;
+    SInt32 slowSocket;
+    SockAddrIn messagingServer;
+    Msg slowMsg;
+    Msg sendMsg;
+    Msg receivedMsg;
+    UInt32 rawReceivedLength = 0;
+    SInt32 rawBytesReceived = 1;
+    UInt32 x;
+
+    slowMsg.msgLength = SLOW_CLIENT_MSG_LENGTH;
+    slowMsg.msgType = 0x5A;
+    for (x = 0; x < SLOW_CLIENT_MSG_LENGTH - SIZE_OF_MSG_TYPE; x++)
+    {
+        slowMsg.msgBody[x] = 0xA5 - x;
+    }
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + 1;
+    sendMsg.msgType = 0x11;
+    sendMsg.msgBody[0] = 0x22;
+
+    slowSocket = socket (PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (slowSocket >= 0)
+    {
+        memset (&messagingServer, 0, sizeof (messagingServer));
+        messagingServer.sin_family = AF_INET;
+        messagingServer.sin_addr.s_addr = inet_addr ("127.0.0.1");
+        messagingServer.sin_port = htons (serverPort);
+
+        if ((connect (slowSocket, (SockAddr *) &messagingServer, sizeof (messagingServer)) >= 0) &&
+            (send (slowSocket, &slowMsg, SIZE_OF_MSG_LENGTH + SIZE_OF_MSG_TYPE, 0) == SIZE_OF_MSG_LENGTH + SIZE_OF_MSG_TYPE))
+        {
+            /* The server has half a message from us, it should still talk to others */
+            if ((runMessagingClient (serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS) && checkReceivedMsgContents (&sendMsg, &receivedMsg))
+            {
+                /* Now send the rest of our message and get the answer */
+                if (send (slowSocket, (UInt8 *) &slowMsg + SIZE_OF_MSG_LENGTH + SIZE_OF_MSG_TYPE, SLOW_CLIENT_MSG_LENGTH - SIZE_OF_MSG_TYPE, 0) == SLOW_CLIENT_MSG_LENGTH - SIZE_OF_MSG_TYPE)
+                {
+                    while ((rawReceivedLength < SLOW_CLIENT_MSG_LENGTH + SIZE_OF_MSG_LENGTH) && (rawBytesReceived > 0))
+                    {
+                        rawBytesReceived = recv (slowSocket, (UInt8 *) &receivedMsg + rawReceivedLength, SLOW_CLIENT_MSG_LENGTH + SIZE_OF_MSG_LENGTH - rawReceivedLength, 0);
+                        if (rawBytesReceived > 0)
+                        {
+                            rawReceivedLength += rawBytesReceived;
+                        }
+                    }
+                    if (rawReceivedLength == SLOW_CLIENT_MSG_LENGTH + SIZE_OF_MSG_LENGTH)
+                    {
+                        success = checkReceivedMsgContents (&slowMsg, &receivedMsg);
+                    }
+                }
+            }
+            else
+            {
+                printDebug ("Server didn't answer another client while a slow client was sending.\n");
+            }
+        }
+
+        close (slowSocket);
+    }
+
+    if (!success)
+    {
+        printDebug ("Slow client test failed.\n");
+    }
+
+    return success;
+}
+
+/*
+ * A thread that sends a single message to the echo
+ * server and checks the response.
+ *
+ * pParam   a pointer to the Msg to send, the
+ *          first byte of the body being set to
+ *          PNULL if the test fails.
+ *
+ * @return  PNULL.
+ */
+static void *simultaneousClientThread (void *pParam)
+{
+    Msg *pSendMsg = (Msg *) pParam;
+    Msg receivedMsg;
+    UInt16 serverPort;
+
+    serverPort = atoi (SERVER_PORT_STRING);
+
+    if ((runMessagingClient (serverPort, PNULL, pSendMsg, &receivedMsg) != CLIENT_SUCCESS) || !checkReceivedMsgContents (pSendMsg, &receivedMsg))
+    {
+        pSendMsg->msgLength = 0;
+    }
+
+    return PNULL;
+}
+
+/*
+ * Send lots of messages at once from lots of
+ * clients, each on its own thread, and check that
+ * they all get the right response.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testSimultaneousClients (void)
+{
+    Bool success = true;
+    pthread_attr_t attr;
+    pthread_t threads[NUM_SIMULTANEOUS_CLIENTS];
+    Bool threadStarted[NUM_SIMULTANEOUS_CLIENTS];
+    Msg *pSendMsgs;
+    UInt32 x;
+
+    pSendMsgs = malloc (sizeof (Msg) * NUM_SIMULTANEOUS_CLIENTS);
+    if (pSendMsgs != PNULL)
+    {
+        pthread_attr_init (&attr);
+        pthread_attr_setstacksize (&attr, CLIENT_THREAD_STACK_SIZE);
+
+        for (x = 0; x < NUM_SIMULTANEOUS_CLIENTS; x++)
+        {
+            pSendMsgs[x].msgLength = SIZE_OF_MSG_TYPE + sizeof (x);
+            pSendMsgs[x].msgType = (MsgType) x;
+            memcpy (pSendMsgs[x].msgBody, &x, sizeof (x));
+            threadStarted[x] = (pthread_create (&threads[x], &attr, simultaneousClientThread, &pSendMsgs[x]) == 0);
+            if (!threadStarted[x])
+            {
+                success = false;
+                printDebug ("Failed to start simultaneous client thread %d, error: %s.\n", x, strerror (errno));
+            }
+        }
+
+        for (x = 0; x < NUM_SIMULTANEOUS_CLIENTS; x++)
+        {
+            if (threadStarted[x])
+            {
+                pthread_join (threads[x], PNULL);
+                if (pSendMsgs[x].msgLength == 0)
+                {
+                    success = false;
+                    printDebug ("Simultaneous client %d failed.\n", x);
+                }
+            }
+        }
+
+        pthread_attr_destroy (&attr);
+        free (pSendMsgs);
+    }
+    else
+    {
+        success = false;
+        printDebug ("Failed to get memory for simultaneous client messages.\n");
+    }
+
+    return success;
+}
+
+/*
+ * A thread that sends a message the test server
+ * is slow to handle and checks the response.
+ *
+ * pParam   a pointer to a Bool that is set to
+ *          true when the response has been received
+ *          correctly.
+ *
+ * @return  PNULL.
+ */
+static void *slowMsgThread (void *pParam)
+{
+    volatile Bool *pSuccess = (volatile Bool *) pParam;
+    Msg sendMsg;
+    Msg receivedMsg;
+    UInt16 serverPort;
+
+    serverPort = atoi (SERVER_PORT_STRING);
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + 1;
+    sendMsg.msgType = TEST_SLOW_MSG_TYPE;
+    sendMsg.msgBody[0] = 0x33;
+
+    if ((runMessagingClient (serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS) && checkReceivedMsgContents (&sendMsg, &receivedMsg))
+    {
+        *pSuccess = true;
+    }
+
+    return PNULL;
+}
+
+/*
+ * Check that, with the test server using worker
+ * threads, a message that is slow to handle does not
+ * hold up another message.
+ *
+ * serverPort   the port the echo server is on.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testSlowMsg (UInt16 serverPort)
+{
+    Bool success = false;
+    volatile Bool slowMsgSuccess = false;
+    pthread_t thread;
+    Msg sendMsg;
+    Msg receivedMsg;
+
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + 1;
+    sendMsg.msgType = TEST_SLOW_MSG_TYPE + 1;
+    sendMsg.msgBody[0] = 0x44;
+
+    if (pthread_create (&thread, PNULL, slowMsgThread, (void *) &slowMsgSuccess) == 0)
+    {
+        usleep (SLOW_MSG_START_DELAY_US);
+        if ((runMessagingClient (serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS) && checkReceivedMsgContents (&sendMsg, &receivedMsg))
+        {
+            if (!slowMsgSuccess)
+            {
+                success = true;
+            }
+            else
+            {
+                printDebug ("Message was held up by a slow message.\n");
+            }
+        }
+        pthread_join (thread, PNULL);
+        if (!slowMsgSuccess)
+        {
+            success = false;
+            printDebug ("Slow message failed.\n");
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Check that messages of all lengths get through
+ * when carried in shared memory, including when
+ * the responses to lots of messages are not waited
+ * for, then run the tests with lots of clients and
+ * with a slow message over shared memory.
+ *
+ * serverPort   the port the echo server is on.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testSharedMemory (UInt16 serverPort)
+{
+    Bool success = true;
+    Msg sendMsg;
+    Msg receivedMsg;
+    UInt32 i;
+    UInt32 x;
+
+    setMessagingClientLocalTransport (MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY);
+
+    for (i = MIN_MSG_LENGTH; (i <= MAX_MSG_LENGTH) && success; i++)
+    {
+        sendMsg.msgLength = (MsgLength) i;
+        sendMsg.msgType = (MsgType) i;
+        for (x = 0; x < i - SIZE_OF_MSG_TYPE; x++)
+        {
+            sendMsg.msgBody[x] = (UInt8) (x + i);
+        }
+
+        /* Every so often fill the shared memory up with messages whose
+         * responses are not waited for, these should be thrown away */
+        if (i % 50 == 0)
+        {
+            for (x = 0; (x < MESSAGING_RING_NUM_SLOTS * 3) && success; x++)
+            {
+                success = (runMessagingClient (serverPort, PNULL, &sendMsg, PNULL) == CLIENT_SUCCESS);
+            }
+        }
+
+        if (success)
+        {
+            success = (runMessagingClient (serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS) && checkReceivedMsgContents (&sendMsg, &receivedMsg);
+        }
+    }
+
+    if (!success)
+    {
+        printDebug ("Shared memory message of length %d failed.\n", i);
+    }
+
+    success = success && testSimultaneousClients() && testSlowMsg (serverPort);
+
+    setMessagingClientLocalTransport (MESSAGING_LOCAL_TRANSPORT_UNIX);
+
+    return success;
+}
+
+/*
+ * Get one of the counts that the test server keeps:
+ * the number of calls it has made to malloc() or the
+ * number of messages it has counted.
+ *
+ * serverPort   the port the echo server is on.
+ * msgType      the message type that asks for the
+ *              count.
+ * pCount       a place to put the count.
+ *
+ * @return      true if the count was got, otherwise
+ *              false.
+ */
+static Bool getServerCount (UInt16 serverPort, MsgType msgType, UInt32 *pCount)
+{
+    Bool success = false;
+    MessagingClientMsgs *pMsgs = getMessagingClientMsgs();
+
+    pMsgs->sendMsg.msgLength = SIZE_OF_MSG_TYPE;
+    pMsgs->sendMsg.msgType = msgType;
+    if ((runMessagingClient (serverPort, PNULL, &(pMsgs->sendMsg), &(pMsgs->receivedMsg)) == CLIENT_SUCCESS) &&
+        (pMsgs->receivedMsg.msgLength == SIZE_OF_MSG_TYPE + sizeof (*pCount)))
+    {
+        memcpy (pCount, &(pMsgs->receivedMsg.msgBody[0]), sizeof (*pCount));
+        success = true;
+    }
+
+    return success;
+}
+
+/*
+ * Check that, once a connection is open, sending
+ * messages from the buffers that the messaging
+ * client lends out doesn't allocate any memory in
+ * the client or in the server.
+ *
+ * serverPort   the port the echo server is on.
+ * transport    the way to reach the server.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testNoAllocations (UInt16 serverPort, MessagingLocalTransport transport)
+{
+    Bool success;
+    MessagingClientMsgs *pMsgs = getMessagingClientMsgs();
+    UInt32 clientMallocCount = 0;
+    UInt32 serverMallocCountBefore = 0;
+    UInt32 serverMallocCountAfter = 0;
+    UInt32 x;
+
+    setMessagingClientLocalTransport (transport);
+
+    /* The first message opens the connection, which may allocate */
+    success = getServerCount (serverPort, TEST_MALLOC_COUNT_MSG_TYPE, &serverMallocCountBefore);
+    clientMallocCount = __atomic_load_n (&gMallocCount, __ATOMIC_RELAXED);
+
+    for (x = 0; (x < NUM_NO_ALLOCATION_MSGS) && success; x++)
+    {
+        pMsgs->sendMsg.msgLength = SIZE_OF_MSG_TYPE + (x % NO_ALLOCATION_MSGS_MAX_BODY_LENGTH);
+        pMsgs->sendMsg.msgType = 0;
+        memset (&(pMsgs->sendMsg.msgBody[0]), (UInt8) x, x % NO_ALLOCATION_MSGS_MAX_BODY_LENGTH);
+        success = (runMessagingClient (serverPort, PNULL, &(pMsgs->sendMsg), &(pMsgs->receivedMsg)) == CLIENT_SUCCESS) &&
+                  checkReceivedMsgContents (&(pMsgs->sendMsg), &(pMsgs->receivedMsg));
+    }
+
+    if (success)
+    {
+        success = getServerCount (serverPort, TEST_MALLOC_COUNT_MSG_TYPE, &serverMallocCountAfter);
+        clientMallocCount = __atomic_load_n (&gMallocCount, __ATOMIC_RELAXED) - clientMallocCount;
+        if (success && ((clientMallocCount != 0) || (serverMallocCountAfter != serverMallocCountBefore)))
+        {
+            success = false;
+            printDebug ("%ld mallocs in the client and %ld in the server for %d messages.\n", clientMallocCount, serverMallocCountAfter - serverMallocCountBefore, NUM_NO_ALLOCATION_MSGS);
+        }
+    }
+    else
+    {
+        printDebug ("Message %ld failed while counting mallocs.\n", x);
+    }
+
+    setMessagingClientLocalTransport (MESSAGING_LOCAL_TRANSPORT_UNIX);
+
+    return success;
+}
+
+/*
+ * Check that a batch of messages, including one
+ * that is slow to handle and one whose response is
+ * not waited for, gets the right responses back in
+ * the right places, whether the responses come back
+ * in order or not.
+ *
+ * serverPort   the port the echo server is on.
+ * transport    the way to reach the server.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testBatch (UInt16 serverPort, MessagingLocalTransport transport)
+{
+    Bool success;
+    Msg sendMsg[NUM_BATCH_MSGS];
+    Msg receivedMsg[NUM_BATCH_MSGS];
+    MessagingClientExchange exchanges[NUM_BATCH_MSGS];
+    UInt32 x;
+
+    setMessagingClientLocalTransport (transport);
+
+    for (x = 0; x < NUM_BATCH_MSGS; x++)
+    {
+        sendMsg[x].msgLength = SIZE_OF_MSG_TYPE + 1 + x;
+        sendMsg[x].msgType = (MsgType) x;
+        memset (&(sendMsg[x].msgBody[0]), (UInt8) (x + 1), 1 + x);
+        memset (&(receivedMsg[x]), 0, sizeof (receivedMsg[x]));
+        exchanges[x].pSendMsg = &(sendMsg[x]);
+        exchanges[x].pReceivedMsg = &(receivedMsg[x]);
+    }
+    sendMsg[BATCH_SLOW_MSG_INDEX].msgType = TEST_SLOW_MSG_TYPE;
+    exchanges[BATCH_NO_RESPONSE_MSG_INDEX].pReceivedMsg = PNULL;
+
+    success = (runMessagingClientBatch (serverPort, PNULL, exchanges, NUM_BATCH_MSGS) == CLIENT_SUCCESS);
+
+    for (x = 0; (x < NUM_BATCH_MSGS) && success; x++)
+    {
+        if (x != BATCH_NO_RESPONSE_MSG_INDEX)
+        {
+            success = checkReceivedMsgContents (&(sendMsg[x]), &(receivedMsg[x]));
+        }
+        else
+        {
+            success = (receivedMsg[x].msgLength == 0);
+        }
+        if (!success)
+        {
+            printDebug ("Response to message %ld of batch is wrong.\n", x);
+        }
+    }
+
+    setMessagingClientLocalTransport (MESSAGING_LOCAL_TRANSPORT_UNIX);
+
+    return success;
+}
+
+/*
+ * Called with the response to a request started
+ * by testAsync().
+ *
+ * returnCode    how the request went.
+ * pReceivedMsg  the response.
+ * pContext      the TestAsyncRequest.
+ */
+static void asyncCallback (ClientReturnCode returnCode, Msg *pReceivedMsg, void *pContext)
+{
+    TestAsyncRequest *pRequest = (TestAsyncRequest *) pContext;
+
+    pRequest->success = (returnCode == CLIENT_SUCCESS) && !pRequest->done && checkReceivedMsgContents (&(pRequest->sendMsg), pReceivedMsg);
+    pRequest->done = true;
+    pRequest->order = gNumAsyncResponses;
+    gNumAsyncResponses++;
+}
+
+/*
+ * Check that requests started without waiting for
+ * the responses all complete, with the right
+ * responses, and that those whose responses the
+ * server defers don't hold up the others.
+ *
+ * serverPort   the port the echo server is on.
+ * transport    the way to reach the server.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testAsync (UInt16 serverPort, MessagingLocalTransport transport)
+{
+    Bool success = true;
+    TestAsyncRequest request[NUM_ASYNC_MSGS];
+    UInt32 numNotDeferred = 0;
+    UInt32 x;
+
+    setMessagingClientLocalTransport (transport);
+    gNumAsyncResponses = 0;
+
+    for (x = 0; (x < NUM_ASYNC_MSGS) && success; x++)
+    {
+        memset (&(request[x]), 0, sizeof (request[x]));
+        request[x].sendMsg.msgLength = SIZE_OF_MSG_TYPE + 1 + x;
+        request[x].sendMsg.msgType = (MsgType) x;
+        if (x % ASYNC_DEFERRED_MSG_INTERVAL == 0)
+        {
+            request[x].sendMsg.msgType = TEST_DEFERRED_MSG_TYPE;
+        }
+        else
+        {
+            numNotDeferred++;
+        }
+        memset (&(request[x].sendMsg.msgBody[0]), (UInt8) (x + 1), 1 + x);
+        success = (startMessagingClientRequest (serverPort, PNULL, &(request[x].sendMsg), asyncCallback, &(request[x])) == CLIENT_SUCCESS);
+    }
+
+    while (pollMessagingClientRequests (-1) > 0)
+    {
+        /* Nothing to do but wait */
+    }
+
+    for (x = 0; (x < NUM_ASYNC_MSGS) && success; x++)
+    {
+        success = request[x].done && request[x].success;
+        if (success && (request[x].sendMsg.msgType == TEST_DEFERRED_MSG_TYPE))
+        {
+            success = (request[x].order >= numNotDeferred);
+        }
+        if (!success)
+        {
+            printDebug ("Started request %ld went wrong (done %d, success %d, order %ld).\n", x, request[x].done, request[x].success, request[x].order);
+        }
+    }
+
+    setMessagingClientLocalTransport (MESSAGING_LOCAL_TRANSPORT_UNIX);
+
+    return success;
+}
+
+/*
+ * Check that messages sent as datagrams, which
+ * get no response, all get to the server.  They
+ * may be handled after a message sent on a
+ * connection afterwards, so the count the server
+ * keeps of them is asked for until it is right.
+ *
+ * serverPort   the port the echo server is on.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testDatagrams (UInt16 serverPort)
+{
+    Bool success;
+    Msg sendMsg;
+    UInt32 countBefore;
+    UInt32 countAfter = 0;
+    UInt32 waitedUs;
+    UInt32 x;
+
+    success = getServerCount (serverPort, TEST_COUNTED_MSG_TYPE, &countBefore);
+
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + 1;
+    sendMsg.msgType = TEST_COUNTED_MSG_TYPE;
+    for (x = 0; (x < NUM_DATAGRAM_MSGS) && success; x++)
+    {
+        sendMsg.msgBody[0] = (UInt8) x;
+        success = (sendMessagingClientDatagram (serverPort, PNULL, &sendMsg) == CLIENT_SUCCESS);
+    }
+
+    for (waitedUs = 0; success && (countAfter != countBefore + NUM_DATAGRAM_MSGS) && (waitedUs < DATAGRAM_MSGS_WAIT_US); waitedUs += DATAGRAM_MSGS_POLL_INTERVAL_US)
+    {
+        success = getServerCount (serverPort, TEST_COUNTED_MSG_TYPE, &countAfter);
+        if (countAfter != countBefore + NUM_DATAGRAM_MSGS)
+        {
+            usleep (DATAGRAM_MSGS_POLL_INTERVAL_US);
+        }
+    }
+
+    if (countAfter != countBefore + NUM_DATAGRAM_MSGS)
+    {
+        success = false;
+        printDebug ("Server counted %ld of the %d datagram messages.\n", countAfter - countBefore, NUM_DATAGRAM_MSGS);
+    }
+
+    return success;
+}
+
+/*
+ * Check that messages framed with a LargeMsgHeader
+ * get the right responses: one short enough for a
+ * Msg, which the test server echoes, one too long,
+ * which the test server checks as it arrives and
+ * responds to at length, and the same again with
+ * too little room for the response.  Then, at an
+ * address that looks like another machine, so that
+ * the framing can't be used, check that the short
+ * one still gets through and the long one is refused.
+ *
+ * serverPort   the port the echo server is on.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testLargeMsgs (UInt16 serverPort)
+{
+    Bool success;
+    MessagingClientLargeResponse response;
+    UInt32 x;
+
+    for (x = 0; x < LARGE_MSG_BODY_LENGTH; x++)
+    {
+        gLargeMsgBody[x] = LARGE_MSG_BYTE (x);
+    }
+
+    response.pBody = gLargeResponseBody;
+    response.maxBodyLength = sizeof (gLargeResponseBody);
+    success = (runMessagingClientLarge (serverPort, PNULL, 0x01, gLargeMsgBody, SLOW_CLIENT_MSG_LENGTH, &response) == CLIENT_SUCCESS) &&
+              (response.msgType == 0x01) && (response.bodyLength == SLOW_CLIENT_MSG_LENGTH) &&
+              (memcmp (gLargeResponseBody, gLargeMsgBody, SLOW_CLIENT_MSG_LENGTH) == 0);
+    if (!success)
+    {
+        printDebug ("Short message framed as a large one went wrong.\n");
+    }
+
+    if (success)
+    {
+        memset (gLargeResponseBody, 0, sizeof (gLargeResponseBody));
+        success = (runMessagingClientLarge (serverPort, PNULL, TEST_LARGE_MSG_TYPE, gLargeMsgBody, LARGE_MSG_BODY_LENGTH, &response) == CLIENT_SUCCESS) &&
+                  (response.msgType == TEST_LARGE_MSG_TYPE) && (response.bodyLength == LARGE_MSG_BODY_LENGTH);
+        for (x = 0; (x < LARGE_MSG_BODY_LENGTH) && success; x++)
+        {
+            success = (gLargeResponseBody[x] == LARGE_RESPONSE_BYTE (x));
+        }
+        if (!success)
+        {
+            printDebug ("Large message went wrong (type 0x%x, body length %ld).\n", response.msgType, response.bodyLength);
+        }
+    }
+
+    if (success)
+    {
+        response.maxBodyLength = LARGE_MSG_BODY_LENGTH - 1;
+        success = (runMessagingClientLarge (serverPort, PNULL, TEST_LARGE_MSG_TYPE, gLargeMsgBody, LARGE_MSG_BODY_LENGTH, &response) == CLIENT_ERR_MESSAGE_FROM_SERVER_INCOMPLETE_OR_TOO_LONG);
+        if (!success)
+        {
+            printDebug ("Large response too long for the room given wasn't spotted.\n");
+        }
+    }
+
+    if (success)
+    {
+        response.maxBodyLength = sizeof (gLargeResponseBody);
+        success = (runMessagingClientLarge (serverPort, OTHER_LOOPBACK_IP_ADDRESS_STRING, 0x01, gLargeMsgBody, SLOW_CLIENT_MSG_LENGTH, &response) == CLIENT_SUCCESS) &&
+                  (response.msgType == 0x01) && (response.bodyLength == SLOW_CLIENT_MSG_LENGTH) &&
+                  (memcmp (gLargeResponseBody, gLargeMsgBody, SLOW_CLIENT_MSG_LENGTH) == 0) &&
+                  (runMessagingClientLarge (serverPort, OTHER_LOOPBACK_IP_ADDRESS_STRING, TEST_LARGE_MSG_TYPE, gLargeMsgBody, LARGE_MSG_BODY_LENGTH, &response) == CLIENT_ERR_FAILED_TO_CONNECT_TO_SERVER);
+        if (!success)
+        {
+            printDebug ("Falling back to a Msg for another machine went wrong.\n");
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Check that the stats a server keeps of one
+ * message type hang together.
+ *
+ * pStats  the stats.
+ *
+ * @return  true if they do, otherwise false.
+ */
+static Bool checkStats (MessagingMsgTypeStats *pStats)
+{
+    Bool success;
+
+    success = (pStats->wait.p50Ns <= pStats->wait.p99Ns) && (pStats->wait.p99Ns <= pStats->wait.maxNs) &&
+              (pStats->handle.p50Ns <= pStats->handle.p99Ns) && (pStats->handle.p99Ns <= pStats->handle.maxNs) &&
+              (pStats->respond.p50Ns <= pStats->respond.p99Ns) && (pStats->respond.p99Ns <= pStats->respond.maxNs) &&
+              (pStats->numErrors <= pStats->count) && ((pStats->nextMsgType > pStats->msgType) || (pStats->nextMsgType == MESSAGING_STATS_NO_NEXT_MSG_TYPE));
+    if (!success)
+    {
+        printDebug ("Stats for message type 0x%x don't add up.\n", pStats->msgType);
+    }
+
+    return success;
+}
+
+/*
+ * Check the stats the server keeps for each message
+ * type: that messages of a type are counted, with their
+ * bytes, that the time the slow messages took to handle
+ * shows, that going from one message type to the next
+ * gets to all of them and that the server carries on
+ * after writing its stats out on SIGUSR1.
+ *
+ * serverPort   the port the echo server is on.
+ * serverPID    the process ID of the echo server.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testStats (UInt16 serverPort, pid_t serverPID)
+{
+    Bool success;
+    Bool foundStatsMsgType = false;
+    MessagingMsgTypeStats statsBefore;
+    MessagingMsgTypeStats stats;
+    Msg sendMsg;
+    Msg receivedMsg;
+    UInt32 numMsgTypes;
+    UInt32 x;
+
+    success = (getMessagingServerStats (serverPort, PNULL, TEST_STATS_MSG_TYPE, &statsBefore) == CLIENT_SUCCESS) && checkStats (&statsBefore);
+
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (x);
+    sendMsg.msgType = TEST_STATS_MSG_TYPE;
+    for (x = 0; (x < NUM_STATS_MSGS) && success; x++)
+    {
+        memcpy (sendMsg.msgBody, &x, sizeof (x));
+        success = (runMessagingClient (serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS) && checkReceivedMsgContents (&sendMsg, &receivedMsg);
+    }
+
+    if (success)
+    {
+        success = (getMessagingServerStats (serverPort, PNULL, TEST_STATS_MSG_TYPE, &stats) == CLIENT_SUCCESS) && checkStats (&stats) &&
+                  (stats.msgType == TEST_STATS_MSG_TYPE) && (stats.count == statsBefore.count + NUM_STATS_MSGS) && (stats.numErrors == statsBefore.numErrors) &&
+                  (stats.numBytesIn == statsBefore.numBytesIn + (NUM_STATS_MSGS * (sendMsg.msgLength + SIZE_OF_MSG_LENGTH))) &&
+                  (stats.numBytesOut == statsBefore.numBytesOut + (NUM_STATS_MSGS * (sendMsg.msgLength + SIZE_OF_MSG_LENGTH)));
+        if (!success)
+        {
+            printDebug ("Server counted %ld messages (%ld bytes in, %ld out) of type 0x%x, expected %ld more than %ld.\n",
+                        stats.count, stats.numBytesIn, stats.numBytesOut, TEST_STATS_MSG_TYPE, NUM_STATS_MSGS, statsBefore.count);
+        }
+    }
+
+    if (success)
+    {
+        success = (getMessagingServerStats (serverPort, PNULL, TEST_SLOW_MSG_TYPE, &stats) == CLIENT_SUCCESS) && checkStats (&stats) &&
+                  (stats.count > 0) && (stats.handle.maxNs >= TEST_SLOW_MSG_DELAY_US * 1000);
+        if (!success)
+        {
+            printDebug ("Server's longest time handling a slow message was %ld ns.\n", stats.handle.maxNs);
+        }
+    }
+
+    stats.nextMsgType = 0;
+    for (numMsgTypes = 0; success && (stats.nextMsgType != MESSAGING_STATS_NO_NEXT_MSG_TYPE); numMsgTypes++)
+    {
+        success = (numMsgTypes < (1 << (sizeof (MsgType) * 8))) && (getMessagingServerStats (serverPort, PNULL, (MsgType) stats.nextMsgType, &stats) == CLIENT_SUCCESS) &&
+                  checkStats (&stats);
+        if (stats.msgType == TEST_STATS_MSG_TYPE)
+        {
+            foundStatsMsgType = true;
+        }
+    }
+    if (success && !foundStatsMsgType)
+    {
+        success = false;
+        printDebug ("Going through the stats of each message type didn't get to type 0x%x.\n", TEST_STATS_MSG_TYPE);
+    }
+
+    if (success)
+    {
+        success = (kill (serverPID, SIGUSR1) == 0) && (usleep (SLOW_MSG_START_DELAY_US) == 0) &&
+                  (getMessagingServerStats (serverPort, PNULL, TEST_STATS_MSG_TYPE, &stats) == CLIENT_SUCCESS);
+        if (!success)
+        {
+            printDebug ("Server didn't carry on after being asked to write out its stats.\n");
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Have the test server publish a value of TEST_TOPIC.
+ *
+ * serverPort   the port the echo server is on.
+ * value        the value.
+ *
+ * @return      true if the value was published,
+ *              otherwise false.
+ */
+static Bool publishTestTopic (UInt16 serverPort, UInt32 value)
+{
+    Msg sendMsg;
+    Msg receivedMsg;
+
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (MessagingTopic) + sizeof (value);
+    sendMsg.msgType = TEST_PUBLISHED_MSG_TYPE;
+    sendMsg.msgBody[0] = TEST_TOPIC;
+    memcpy (&(sendMsg.msgBody[sizeof (MessagingTopic)]), &value, sizeof (value));
+
+    return (runMessagingClient (serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS);
+}
+
+/*
+ * Wait for the test server to have received a given
+ * number of updates of TEST_TOPIC, then check that the
+ * last one has the given value.  Updates travel as
+ * datagrams, so may arrive after the response to the
+ * message that caused them, hence the wait.
+ *
+ * serverPort      the port the echo server is on.
+ * numPublications the number of updates to wait for.
+ * value           the value the last should have.
+ *
+ * @return         true if the updates arrived, and
+ *                 no more, otherwise false.
+ */
+static Bool waitForTestTopic (UInt16 serverPort, UInt32 numPublications, UInt32 value)
+{
+    Bool success = true;
+    Msg sendMsg;
+    Msg receivedMsg;
+    UInt32 count = 0;
+    UInt32 lastValue = 0;
+    UInt32 waitedUs;
+
+    sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (MessagingTopic);
+    sendMsg.msgType = TEST_PUBLISHED_MSG_TYPE;
+    sendMsg.msgBody[0] = TEST_TOPIC;
+    for (waitedUs = 0; success && (count < numPublications) && (waitedUs < DATAGRAM_MSGS_WAIT_US); waitedUs += DATAGRAM_MSGS_POLL_INTERVAL_US)
+    {
+        success = (runMessagingClient (serverPort, PNULL, &sendMsg, &receivedMsg) == CLIENT_SUCCESS) &&
+                  (receivedMsg.msgLength == SIZE_OF_MSG_TYPE + sizeof (count) + sizeof (lastValue));
+        if (success)
+        {
+            memcpy (&count, &(receivedMsg.msgBody[0]), sizeof (count));
+            memcpy (&lastValue, &(receivedMsg.msgBody[sizeof (count)]), sizeof (lastValue));
+            if (count < numPublications)
+            {
+                usleep (DATAGRAM_MSGS_POLL_INTERVAL_US);
+            }
+        }
+    }
+
+    if ((count != numPublications) || (lastValue != value))
+    {
+        success = false;
+        printDebug ("Server received %ld updates of topic %d, last %ld, expected %ld, last %ld.\n", count, TEST_TOPIC, lastValue, numPublications, value);
+    }
+
+    return success;
+}
+
+/*
+ * Check subscribing to a topic, with the test server
+ * subscribing to a topic that it publishes itself: that
+ * the value the topic has is sent when subscribing, that
+ * an update is sent when it changes but not when it
+ * doesn't, that updates aren't sent more often than
+ * asked and are sent, even without a change, as often
+ * as asked and that they stop on unsubscribing.
+ *
+ * serverPort   the port the echo server is on.
+ *
+ * @return      true if the test passed, otherwise false.
+ */
+static Bool testSubscribe (UInt16 serverPort)
+{
+    Bool success;
+
+    /* The value the topic has is sent straight away */
+    success = publishTestTopic (serverPort, 1) &&
+              (subscribeMessagingServerTopic (serverPort, PNULL, TEST_TOPIC, serverPort, 0, 0) == CLIENT_SUCCESS) &&
+              waitForTestTopic (serverPort, 1, 1);
+
+    /* An unchanged value is not sent again, a changed one is */
+    success = success && publishTestTopic (serverPort, 1) && publishTestTopic (serverPort, 2) &&
+              waitForTestTopic (serverPort, 2, 2);
+
+    /* Not more often than asked: the change is held back */
+    success = success && (subscribeMessagingServerTopic (serverPort, PNULL, TEST_TOPIC, serverPort, TEST_TOPIC_LONG_INTERVAL_MS, 0) == CLIENT_SUCCESS) &&
+              waitForTestTopic (serverPort, 3, 2) && publishTestTopic (serverPort, 3) && (usleep (SLOW_MSG_START_DELAY_US) == 0) &&
+              waitForTestTopic (serverPort, 3, 2);
+
+    /* At least as often as asked, changed or not */
+    success = success && (subscribeMessagingServerTopic (serverPort, PNULL, TEST_TOPIC, serverPort, 0, TEST_TOPIC_SHORT_INTERVAL_MS) == CLIENT_SUCCESS) &&
+              waitForTestTopic (serverPort, 4, 3) && (usleep (TEST_TOPIC_SHORT_INTERVAL_MS * 1000) == 0) && publishTestTopic (serverPort, 3) &&
+              waitForTestTopic (serverPort, 5, 3);
+
+    /* And no more after unsubscribing */
+    success = success && (unsubscribeMessagingServerTopic (serverPort, PNULL, TEST_TOPIC, serverPort) == CLIENT_SUCCESS) &&
+              publishTestTopic (serverPort, 4) && (usleep (SLOW_MSG_START_DELAY_US) == 0) && waitForTestTopic (serverPort, 5, 3);
+
+    return success;
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
 
+/*
+ * Count the calls to malloc(): the test client
+ * is linked with --wrap=malloc so that they all
+ * come here.
+ *
+ * size   the number of bytes to allocate.
+ *
+ * @return  pointer to the allocated memory.
+ */
+void *__wrap_malloc (size_t size)
+{
+    __atomic_add_fetch (&gMallocCount, 1, __ATOMIC_RELAXED);
+
+    return __real_malloc (size);
+}
+
 /*
  * Entry point
  */
@@ -112,7 +1116,7 @@ int main (int argc, char **argv)
     if (serverPID == 0)
     {
         /* Start OneWire server process on port oneWireServerPort */
-        static char *argv[]={SERVER_EXE, SERVER_PORT_STRING, PNULL};
+        static char *argv[]={SERVER_EXE, SERVER_PORT_STRING, "workers", PNULL};
         
         execv (SERVER_EXE, argv);
         printDebug ("Couldn't launch %s, err: %s\n", SERVER_EXE, strerror (errno));
@@ -133,6 +1137,27 @@ int main (int argc, char **argv)
         /* Check that it is running (looks strange but it is the standard method apparently) */
         if (kill (serverPID, 0) == 0)
         {
+            /* Check that a client sending a message slowly doesn't
+             * hold up the others, that lots of clients at once
+             * are all dealt with, that a message that is slow
+             * to handle doesn't hold up the others, that all
+             * of that works with messages in shared memory, that,
+             * either way, messages don't allocate memory, that
+             * batches of messages get the right responses and that
+             * requests started without waiting for the responses
+             * complete, those the server defers after the others,
+             * that messages sent as datagrams get there, that
+             * messages too long for a Msg get through and that
+             * the server keeps stats of the messages and sends
+             * updates of the topics subscribed to */
+            success = testSlowClient (oneWireServerPort) && testSimultaneousClients() && testSlowMsg (oneWireServerPort) && testSharedMemory (oneWireServerPort) &&
+                      testNoAllocations (oneWireServerPort, MESSAGING_LOCAL_TRANSPORT_UNIX) && testNoAllocations (oneWireServerPort, MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY) &&
+                      testBatch (oneWireServerPort, MESSAGING_LOCAL_TRANSPORT_UNIX) && testBatch (oneWireServerPort, MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY) &&
+                      testBatch (oneWireServerPort, MESSAGING_LOCAL_TRANSPORT_TCP) &&
+                      testAsync (oneWireServerPort, MESSAGING_LOCAL_TRANSPORT_UNIX) && testAsync (oneWireServerPort, MESSAGING_LOCAL_TRANSPORT_TCP) &&
+                      testDatagrams (oneWireServerPort) && testLargeMsgs (oneWireServerPort) && testStats (oneWireServerPort, serverPID) &&
+                      testSubscribe (oneWireServerPort);
+
             pSendMsg = malloc (sizeof (Msg));
             
             if (pSendMsg != PNULL)
@@ -18,9 +18,117 @@
 #define MAX_MSG_BODY_LENGTH       MAX_MSG_LENGTH - OFFSET_TO_MSG_BODY
 #define MIN_MSG_LENGTH            SIZE_OF_MSG_TYPE
 
+/* Servers also listen on a Unix domain socket in the abstract namespace
+ * with this name, where %d is the server's port number, for use by clients
+ * on the same machine */
+#define MESSAGING_UNIX_SOCKET_NAME_FORMAT "RoboOne.messaging.%d"
+
+/* Servers also listen on a second Unix domain socket, named in the same way,
+ * on which clients on the same machine can hand over a shared memory segment
+ * to carry their messages instead of the socket, see MessagingSharedMemory */
+#define MESSAGING_SHARED_MEMORY_SOCKET_NAME_FORMAT "RoboOne.messaging.shm.%d"
+
+/* Servers also listen on a third Unix domain socket, named in the same way,
+ * on which every message, in both directions, is preceded by a request ID
+ * (see MessagingTaggedMsg) so that a client can have several messages
+ * outstanding at once and the server can respond out of order */
+#define MESSAGING_TAGGED_SOCKET_NAME_FORMAT "RoboOne.messaging.tagged.%d"
+
+/* Servers also receive datagrams on a Unix domain socket, named in the same
+ * way, each of which is a message that needs no response, or up to
+ * MESSAGING_MAX_MSGS_PER_DATAGRAM of them back to back: a client can send
+ * them with a single system call and no connection, see
+ * sendMessagingClientDatagram() */
+#define MESSAGING_DATAGRAM_SOCKET_NAME_FORMAT "RoboOne.messaging.dgram.%d"
+
+/* Servers also listen on a Unix domain socket, named in the same way, on
+ * which every message, in both directions, is framed with a LargeMsgHeader
+ * rather than a one byte length, so that its body can be up to
+ * MAX_LARGE_MSG_BODY_LENGTH bytes, see runMessagingClientLarge() */
+#define MESSAGING_LARGE_MSG_SOCKET_NAME_FORMAT "RoboOne.messaging.large.%d"
+
+/* The version of the framing in a LargeMsgHeader */
+#define MESSAGING_LARGE_MSG_VERSION 1
+
+/* The longest body of a message framed with a LargeMsgHeader */
+#define MAX_LARGE_MSG_BODY_LENGTH (16 * 1024 * 1024)
+
+/* The request ID meaning that the client does not want the response */
+#define MESSAGING_NO_RESPONSE_REQUEST_ID 0
+
+/* The most messages that a client may have outstanding on a connection
+ * that carries request IDs, and so the most that the server will handle
+ * at the same time for that connection */
+#define MESSAGING_MAX_REQUESTS_IN_FLIGHT 8
+
+/* The most messages that may be sent back to back in one datagram */
+#define MESSAGING_MAX_MSGS_PER_DATAGRAM MESSAGING_MAX_REQUESTS_IN_FLIGHT
+
+/* The number of messages that each direction of a shared memory connection can hold */
+#define MESSAGING_RING_NUM_SLOTS  16
+
+/* The things written by the producer and consumer of a shared memory ring are kept
+ * this far apart so that they aren't fighting over the same cache line */
+#define MESSAGING_CACHE_LINE_SIZE 64
+
+/* The number of file descriptors handed over with the shared memory: the
+ * segment, the eventfd for the server and the eventfd for the client */
+#define MESSAGING_SHARED_MEMORY_NUM_FDS 3
+
+/* The most file descriptors that can be added to a server's
+ * event loop with addMessagingServerPollFd() */
+#define MESSAGING_SERVER_MAX_POLL_FDS 4
+
+/* Message types from this one up are reserved for the messaging
+ * server itself, whatever the server, and are never passed to
+ * serverHandleMsg(): the message types of an application must
+ * all be below it, see setMessagingServerMsgNames() */
+#define MESSAGING_FIRST_RESERVED_MSG_TYPE 0xFD
+
+/* A message of this type with a one byte body, a message type, is
+ * answered by every server itself, without being passed to
+ * serverHandleMsg(), with the MessagingMsgTypeStats for that
+ * message type, see getMessagingServerStats() */
+#define MESSAGING_STATS_MSG_TYPE 0xFF
+
+/* The nextMsgType of a MessagingMsgTypeStats when no message
+ * of a later type has been handled */
+#define MESSAGING_STATS_NO_NEXT_MSG_TYPE 0x100
+
+/* A message of this type with a MessagingSubscribeReq as its body
+ * is answered by every server itself, without being passed to
+ * serverHandleMsg(), with a one byte body, true if the server
+ * has done as asked, see subscribeMessagingServerTopic() */
+#define MESSAGING_SUBSCRIBE_MSG_TYPE 0xFE
+
+/* A datagram of this type, with a MessagingPublicationHeader and
+ * then the value of the topic as its body, carries an update
+ * from a server to a subscriber's server; it is passed to the
+ * subscriber's MessagingServerPublicationHandler, not to
+ * serverHandleMsg(), see publishMessagingServerTopic() */
+#define MESSAGING_PUBLICATION_MSG_TYPE 0xFD
+
+/* The number of topics that a server can publish, numbered from 0 */
+#define MESSAGING_MAX_NUM_TOPICS 32
+
+/* The most subscriptions that a server can hold, across all topics */
+#define MESSAGING_MAX_NUM_SUBSCRIPTIONS 32
+
+/* The longest value of a topic */
+#define MESSAGING_MAX_PUBLICATION_LENGTH (MAX_MSG_LENGTH - SIZE_OF_MSG_TYPE - sizeof (MessagingPublicationHeader))
+
 /* Suggested delay of 100 ms to allow the server to start on a Pi before accessing it */
 #define SERVER_START_DELAY_PI_US  100000L
 
+/* The environment variable that gives a server launched with
+ * spawnMessagingServer() the file descriptor on which to say
+ * that it is ready, see waitMessagingServersReady() */
+#define MESSAGING_SERVER_READY_FD_ENV "MESSAGING_SERVER_READY_FD"
+
+/* Suggested time to wait for servers launched with
+ * spawnMessagingServer() to become ready */
+#define MESSAGING_SERVER_READY_TIMEOUT_MS 10000
+
 /*
  * TYPES
  */
@@ -28,6 +136,7 @@
 /* These just to make things neater */
 typedef struct sockaddr_in SockAddrIn;
 typedef struct sockaddr SockAddr;
+typedef struct sockaddr_un SockAddrUn;
 
 /* The return codes from the messaging server */
 typedef enum ServerReturnCodeTag
@@ -68,13 +177,192 @@ typedef struct MsgTag
     UInt8 msgBody[MAX_MSG_BODY_LENGTH];  /* The data for this message type */
 } Msg;
 
+/* Identifies a message on a connection that carries request IDs:
+ * the response to a message carries the same request ID as the message.
+ * Being only used with servers on the same machine it is sent in the
+ * machine's byte order */
+typedef UInt16 MsgRequestId;
+
+/* A message with its request ID, as sent in both directions on the
+ * socket named by MESSAGING_TAGGED_SOCKET_NAME_FORMAT and as carried
+ * in shared memory.  The request ID is chosen by the client, any value
+ * but MESSAGING_NO_RESPONSE_REQUEST_ID meaning that it wants the response */
+typedef struct MessagingTaggedMsgTag
+{
+    MsgRequestId requestId;
+    Msg msg;
+} MessagingTaggedMsg;
+
+/* The start of a message on the socket named by
+ * MESSAGING_LARGE_MSG_SOCKET_NAME_FORMAT, followed by bodyLength
+ * bytes of body.  A message with a body of no more than
+ * MAX_MSG_BODY_LENGTH bytes means the same as the Msg with the
+ * same type and body.  Being only used with servers on the same
+ * machine it is sent in the machine's byte order */
+typedef struct LargeMsgHeaderTag
+{
+    UInt8 version;                       /* MESSAGING_LARGE_MSG_VERSION */
+    MsgType msgType;
+    UInt32 bodyLength;
+} LargeMsgHeader;
+
+/* How long messages of one type have taken over one stage of
+ * being handled, in nanoseconds.  The times are counted in a
+ * histogram with a bucket for each power of two, so p50 and
+ * p99 are the top of the bucket they fall in */
+typedef struct MessagingLatencyStatsTag
+{
+    UInt32 p50Ns;
+    UInt32 p99Ns;
+    UInt32 maxNs;
+} MessagingLatencyStats;
+
+/* What a server has counted of the messages of one type since
+ * it started: the body of the response to a message of type
+ * MESSAGING_STATS_MSG_TYPE */
+typedef struct MessagingMsgTypeStatsTag
+{
+    MsgType msgType;
+    UInt16 nextMsgType;                  /* the next type of message that has been handled, to ask about next,
+                                          * MESSAGING_STATS_NO_NEXT_MSG_TYPE if there isn't one */
+    UInt32 count;                        /* the number of messages handled */
+    UInt32 numErrors;                    /* the number for which a failure return code came back */
+    UInt32 numBytesIn;                   /* the bytes received, including the length indicators */
+    UInt32 numBytesOut;                  /* the bytes of response, including the length indicators */
+    MessagingLatencyStats wait;          /* from a message being taken from the client to it being handled */
+    MessagingLatencyStats handle;        /* in serverHandleMsg() */
+    MessagingLatencyStats respond;       /* from serverHandleMsg() returning to the response being queued for the client */
+} MessagingMsgTypeStats;
+
+/* Something that a server publishes, the meaning of
+ * which is up to the application, less than
+ * MESSAGING_MAX_NUM_TOPICS */
+typedef UInt8 MessagingTopic;
+
+/* The body of a message of type MESSAGING_SUBSCRIBE_MSG_TYPE: ask
+ * a server to send updates of a topic, as datagrams, to the server
+ * on subscriberPort on the same machine, or to stop doing so.  An
+ * update is sent when the value of the topic changes, but no sooner
+ * than minIntervalMs after the last one, and when maxIntervalMs has
+ * passed since the last one, if maxIntervalMs is not 0, even if it
+ * hasn't changed.  The value the topic has, if it has been published,
+ * is sent straight away */
+typedef struct MessagingSubscribeReqTag
+{
+    UInt16 subscriberPort;
+    MessagingTopic topic;
+    Bool subscribe;                      /* false to stop the updates */
+    UInt32 minIntervalMs;
+    UInt32 maxIntervalMs;
+} MessagingSubscribeReq;
+
+/* The start of the body of a message of type MESSAGING_PUBLICATION_MSG_TYPE,
+ * followed by the value of the topic */
+typedef struct MessagingPublicationHeaderTag
+{
+    UInt16 publisherPort;                /* the port of the server that sent the update */
+    MessagingTopic topic;
+} MessagingPublicationHeader;
+
 #pragma pack(pop) /* End of packing */
 
+/* A message in a shared memory ring */
+typedef MessagingTaggedMsg MessagingRingSlot;
+
+/* One direction of a shared memory connection: a lock-free ring of
+ * messages with a single producer and a single consumer.  head and
+ * tail count the messages ever put in and taken out, each is only
+ * written by one side.  The consumer sets consumerWaiting before
+ * it waits to be woken by the producer through an eventfd, so that
+ * the producer can skip the wake-up while the consumer is busy, and
+ * the producer likewise sets producerWaiting before it waits for
+ * the consumer to make room in a full ring */
+typedef struct MessagingRingTag
+{
+    UInt32 head;                                     /* written by the producer */
+    UInt32 producerWaiting;                          /* written by the producer */
+    UInt8 headPadding[MESSAGING_CACHE_LINE_SIZE - (sizeof (UInt32) * 2)];
+    UInt32 tail;                                     /* written by the consumer */
+    UInt32 consumerWaiting;                          /* written by the consumer */
+    UInt8 tailPadding[MESSAGING_CACHE_LINE_SIZE - (sizeof (UInt32) * 2)];
+    MessagingRingSlot slot[MESSAGING_RING_NUM_SLOTS];
+} MessagingRing;
+
+/* The shared memory of a connection between a client and a server
+ * on the same machine.  The client creates it, and an eventfd for
+ * each direction, and hands them to the server over the socket
+ * named by MESSAGING_SHARED_MEMORY_SOCKET_NAME_FORMAT, which the
+ * server acknowledges by sending back a single byte.  After that
+ * the socket is only kept open so that each side can tell if the
+ * other has gone */
+typedef struct MessagingSharedMemoryTag
+{
+    MessagingRing toServer;
+    MessagingRing toClient;
+} MessagingSharedMemory;
+
+/* Called on the server thread when a file descriptor added to
+ * the server's event loop with addMessagingServerPollFd() is readable */
+typedef void (*MessagingServerPollHandler) (void);
+
+/* The response to a message with a body too long for a Msg,
+ * see MessagingServerLargeMsgHandler */
+typedef struct MessagingServerLargeResponseTag
+{
+    Bool isToBeSent;                     /* false, unless set to true by the handler */
+    MsgType msgType;
+    const void *pBody;                   /* copied before the handler returns */
+    UInt32 bodyLength;                   /* at most MAX_LARGE_MSG_BODY_LENGTH */
+} MessagingServerLargeResponse;
+
+/* Called on the server thread with each piece of the body of a
+ * message that is too long for a Msg, in order, as it arrives,
+ * so that the body never has to be held in one piece.  When the
+ * last piece has been passed (offset + chunkLength == bodyLength)
+ * the handler may fill in pResponse, which is otherwise ignored.
+ * Returns a server return code, as serverHandleMsg() does, a
+ * failure one dropping the client connection */
+typedef ServerReturnCode (*MessagingServerLargeMsgHandler) (MsgType msgType, UInt32 bodyLength, UInt32 offset, const UInt8 *pChunk, UInt32 chunkLength, MessagingServerLargeResponse *pResponse);
+
+/* The response to a message that serverHandleMsg() has put off,
+ * see deferMessagingServerResponse() */
+typedef struct ServerJobTag *MessagingServerDeferredResponse;
+
+/* Called on the server thread with each update of a topic
+ * that this server has subscribed to: pData, which is only
+ * valid during the call, holds dataLength bytes of the
+ * value of the topic, as published by the server on
+ * publisherPort, see setMessagingServerPublicationHandler() */
+typedef void (*MessagingServerPublicationHandler) (UInt16 publisherPort, MessagingTopic topic, const UInt8 *pData, UInt32 dataLength);
+
 /*
  * FUNCTION PROTOTYPES
  */
 
 ServerReturnCode runMessagingServer (UInt16 serverPort);
+void setMessagingServerWorkerThreads (UInt32 numWorkerThreads, const Bool *pMsgTypeIsConcurrent, UInt32 numMsgTypes);
+Bool addMessagingServerPollFd (SInt32 fd, MessagingServerPollHandler pHandler);
+Bool handleMessagingServerLocalMsg (Msg *pMsg);
+void setMessagingServerLargeMsgHandler (MessagingServerLargeMsgHandler pHandler);
+MessagingServerDeferredResponse deferMessagingServerResponse (void);
+void completeMessagingServerResponse (MessagingServerDeferredResponse deferredResponse, Msg *pSendMsg);
+void setMessagingServerMsgNames (Char **ppMsgNames, UInt32 numMsgNames);
+void publishMessagingServerTopic (MessagingTopic topic, const void *pData, UInt32 dataLength);
+Bool isMessagingServerTopicSubscribed (MessagingTopic topic);
+void setMessagingServerPublicationHandler (MessagingServerPublicationHandler pHandler);
+
+/* Launching servers, also in the messaging client library for programs
+ * that run no server of their own, see messaging_spawn.c */
+SInt32 spawnMessagingServer (Char *pExe, Char *pPortString, SInt32 *pReadyFd);
+Bool waitMessagingServersReady (SInt32 *pReadyFds, UInt32 numReadyFds, UInt32 timeoutMs);
+
+/* Shared memory rings, also used by the messaging client, see messaging_ring.c */
+MessagingRingSlot *nextMsgInRing (MessagingRing *pRing);
+Bool doneWithMsgInRing (MessagingRing *pRing);
+Bool waitForMsgInRing (MessagingRing *pRing);
+MessagingRingSlot *nextSlotInRing (MessagingRing *pRing);
+Bool sendMsgInRing (MessagingRing *pRing);
+Bool waitForSlotInRing (MessagingRing *pRing);
 
 /*
  * EXTERNS: must be provided by the user of this library
@@ -82,7 +370,11 @@ ServerReturnCode runMessagingServer (UInt16 serverPort);
 
 /* Handle a received message and, optionally, provide
  * a response message. If the response message is not
- * required, just leave pSendMsg alone.
+ * required, just leave pSendMsg alone.  If the response
+ * can't be given yet, call deferMessagingServerResponse()
+ * and give it later.  If worker threads are switched on
+ * this is called from those threads, see
+ * setMessagingServerWorkerThreads().
  * 
  * pReceivedMsg   a pointer to the buffer containing the
  *                incoming message.
@@ -0,0 +1,126 @@
+/*
+ * messaging_ring.c
+ * The lock-free rings in the shared memory of a connection
+ * between a messaging client and a messaging server on the
+ * same machine, used by both.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <rob_system.h>
+#include <messaging_server.h>
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Get the next message to be taken out of a shared
+ * memory ring.
+ *
+ * pRing   the ring.
+ *
+ * @return the slot holding the message, which stays in
+ *         the ring until doneWithMsgInRing() is called,
+ *         or PNULL if the ring is empty.
+ */
+MessagingRingSlot *nextMsgInRing (MessagingRing *pRing)
+{
+    MessagingRingSlot *pSlot = PNULL;
+
+    if (__atomic_load_n (&(pRing->head), __ATOMIC_ACQUIRE) != pRing->tail)
+    {
+        pSlot = &(pRing->slot[pRing->tail % MESSAGING_RING_NUM_SLOTS]);
+    }
+
+    return pSlot;
+}
+
+/*
+ * Take the message got with nextMsgInRing() out of
+ * a shared memory ring.
+ *
+ * pRing   the ring.
+ *
+ * @return true if the producer is waiting for room
+ *         and so needs to be woken up.
+ */
+Bool doneWithMsgInRing (MessagingRing *pRing)
+{
+    __atomic_store_n (&(pRing->tail), pRing->tail + 1, __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n (&(pRing->producerWaiting), __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Note that the consumer of a shared memory ring is
+ * about to wait to be woken by the producer, checking
+ * that a message hasn't been put in in the meantime.
+ *
+ * pRing   the ring.
+ *
+ * @return true if there is a message in the ring after
+ *         all, in which case don't wait.
+ */
+Bool waitForMsgInRing (MessagingRing *pRing)
+{
+    __atomic_store_n (&(pRing->consumerWaiting), true, __ATOMIC_SEQ_CST);
+
+    return (__atomic_load_n (&(pRing->head), __ATOMIC_SEQ_CST) != pRing->tail);
+}
+
+/*
+ * Get the next free slot in a shared memory ring.
+ *
+ * pRing   the ring.
+ *
+ * @return the slot to put a message in, which is not
+ *         seen by the consumer until sendMsgInRing() is
+ *         called, or PNULL if the ring is full.
+ */
+MessagingRingSlot *nextSlotInRing (MessagingRing *pRing)
+{
+    MessagingRingSlot *pSlot = PNULL;
+
+    if (pRing->head - __atomic_load_n (&(pRing->tail), __ATOMIC_ACQUIRE) < MESSAGING_RING_NUM_SLOTS)
+    {
+        pSlot = &(pRing->slot[pRing->head % MESSAGING_RING_NUM_SLOTS]);
+    }
+
+    return pSlot;
+}
+
+/*
+ * Pass the message put in the slot got with
+ * nextSlotInRing() to the consumer of a shared
+ * memory ring.
+ *
+ * pRing   the ring.
+ *
+ * @return true if the consumer is waiting and so
+ *         needs to be woken up.
+ */
+Bool sendMsgInRing (MessagingRing *pRing)
+{
+    __atomic_store_n (&(pRing->head), pRing->head + 1, __ATOMIC_SEQ_CST);
+
+    return __atomic_load_n (&(pRing->consumerWaiting), __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Note that the producer of a shared memory ring is
+ * about to wait to be woken by the consumer because
+ * the ring is full, checking that room hasn't been
+ * made in the meantime.
+ *
+ * pRing   the ring.
+ *
+ * @return true if there is room in the ring after
+ *         all, in which case don't wait.
+ */
+Bool waitForSlotInRing (MessagingRing *pRing)
+{
+    __atomic_store_n (&(pRing->producerWaiting), true, __ATOMIC_SEQ_CST);
+
+    return (pRing->head - __atomic_load_n (&(pRing->tail), __ATOMIC_SEQ_CST) < MESSAGING_RING_NUM_SLOTS);
+}
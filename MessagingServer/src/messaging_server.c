@@ -10,6 +10,17 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <rob_system.h>
 #include <messaging_server.h>
@@ -18,121 +29,2814 @@
  * MANIFEST CONSTANTS
  */
 
-/* Max connection requests */
-#define MAXPENDING  5
+/* Max connection requests: as many as the system will allow so that a burst
+ * of clients all connecting at once is queued rather than refused */
+#define MAXPENDING  SOMAXCONN
 
+/* The maximum number of events to deal with from one call to epoll_wait() */
+#define MAX_NUM_EPOLL_EVENTS 32
+
+/* The size of the receive and transmit buffers of a client connection:
+ * room for a whole message more than a client may have outstanding so
+ * that a message which arrives in pieces, or a few which arrive together,
+ * can be dealt with without blocking */
+#define CONNECTION_BUFFER_SIZE (sizeof (MessagingTaggedMsg) * (MESSAGING_MAX_REQUESTS_IN_FLIGHT + 1))
+
+/* How long to wait for the last response to drain when the server is exiting */
+#define EXIT_SEND_TIMEOUT_MS 1000
+
+/* The number of possible message types */
+#define NUM_MSG_TYPES (1 << (sizeof (MsgType) * 8))
+
+/* The number of buckets in each latency histogram: bucket n
+ * counts the times from 2^n to 2^(n + 1) - 1 nanoseconds (bucket
+ * 0 also counting zero), the last bucket taking anything longer */
+#define STATS_NUM_BUCKETS 32
+
+/* The signal on which the message stats are written to stderr */
+#define STATS_DUMP_SIGNAL SIGUSR1
+
+/*
+ * TYPES
+ */
+
+/* The types of socket monitored by the server */
+typedef enum ServerSocketTypeTag
+{
+    SERVER_SOCKET_LISTENING,                /* a socket the server is listening on */
+    SERVER_SOCKET_CLIENT,                   /* a client connection */
+    SERVER_SOCKET_SHARED_MEMORY_LISTENING,  /* the socket the server is listening on for shared memory clients */
+    SERVER_SOCKET_SHARED_MEMORY_CLIENT,     /* a client connection that carries messages in shared memory */
+    SERVER_SOCKET_TAGGED_LISTENING,         /* the socket the server is listening on for clients that send request IDs */
+    SERVER_SOCKET_TAGGED_CLIENT,            /* a client connection on which messages carry request IDs */
+    SERVER_SOCKET_DATAGRAM,                 /* the socket on which messages that need no response arrive as datagrams */
+    SERVER_SOCKET_LARGE_MSG_LISTENING,      /* the socket the server is listening on for clients that frame messages with a LargeMsgHeader */
+    SERVER_SOCKET_LARGE_MSG_CLIENT,         /* a client connection on which messages are framed with a LargeMsgHeader */
+    SERVER_SOCKET_JOBS_DONE,                /* the eventfd the worker threads signal when they've handled a message */
+    SERVER_SOCKET_STATS_DUMP,               /* the eventfd signalled when STATS_DUMP_SIGNAL arrives */
+    SERVER_SOCKET_POLL_FD                   /* a file descriptor added by the user of this library, see addMessagingServerPollFd() */
+} ServerSocketType;
+
+/* A message being handled, by a worker thread or by the server
+ * thread, or whose response has been deferred */
+typedef struct ServerJobTag
+{
+    struct ServerJobTag *pNext;
+    struct ServerConnectionTag *pConnection;         /* the client connection the message came from */
+    Bool inFlight;                                   /* true from when the message is taken until its response is queued */
+    Bool isWithWorkers;                              /* true until the server thread has had the job back from the worker threads */
+    Bool isDeferred;                                 /* true while the response is deferred, see deferMessagingServerResponse() */
+    MsgRequestId requestId;                          /* the request ID of the message, if the connection carries them */
+    ServerReturnCode returnCode;                     /* what serverHandleMsg() returned */
+    uint64_t takenNs;                                /* when the message was taken from the client, see getMonotonicNs() */
+    uint64_t handleStartNs;                          /* when serverHandleMsg() was called... */
+    uint64_t handleEndNs;                            /* ...and when it returned */
+    Msg receivedMsg;
+    Msg sendMsg;
+} ServerJob;
+
+/* The stages of handling a message that are timed */
+typedef enum StatsStageTag
+{
+    STATS_STAGE_WAIT,                                /* from being taken from the client to serverHandleMsg() being called */
+    STATS_STAGE_HANDLE,                              /* in serverHandleMsg() */
+    STATS_STAGE_RESPOND,                             /* from serverHandleMsg() returning to the response being queued */
+    NUM_STATS_STAGES
+} StatsStage;
+
+/* What is counted for each type of message, only ever
+ * written on the server thread */
+typedef struct MsgTypeStatsTag
+{
+    UInt32 count;
+    UInt32 numErrors;
+    UInt32 numBytesIn;
+    UInt32 numBytesOut;
+    UInt32 maxNs[NUM_STATS_STAGES];
+    UInt32 histogram[NUM_STATS_STAGES][STATS_NUM_BUCKETS];
+} MsgTypeStats;
+
+/* A subscriber to a topic, see MessagingSubscribeReq */
+typedef struct SubscriptionTag
+{
+    Bool isInUse;
+    Bool isPending;                                  /* true if there is a change that hasn't been sent yet */
+    MessagingTopic topic;
+    UInt16 subscriberPort;
+    UInt32 minIntervalMs;
+    UInt32 maxIntervalMs;
+    uint64_t lastSentNs;                             /* when the last update was sent, 0 if none has been */
+} Subscription;
+
+/* The last value published of a topic */
+typedef struct PublishedTopicTag
+{
+    Bool isPublished;                                /* false until the topic has been published */
+    UInt32 dataLength;
+    UInt8 data[MESSAGING_MAX_PUBLICATION_LENGTH];
+} PublishedTopic;
+
+/* A queue of jobs */
+typedef struct ServerJobQueueTag
+{
+    ServerJob *pFirst;
+    ServerJob *pLast;
+} ServerJobQueue;
+
+/* The worker threads that handle messages when the user of
+ * this library has asked for them: one thread for the messages
+ * that must be handled one at a time, in the order they arrive,
+ * and the rest for the messages that may be handled at the same
+ * time as any other */
+typedef struct ServerWorkersTag
+{
+    pthread_mutex_t lock;                            /* protects everything below */
+    pthread_cond_t serialJobAvailable;
+    pthread_cond_t concurrentJobAvailable;
+    ServerJobQueue serialJobs;
+    ServerJobQueue concurrentJobs;
+    ServerJobQueue doneJobs;
+    Bool exiting;
+    SInt32 doneFd;                                   /* eventfd written to when a job is added to doneJobs */
+    UInt32 numThreads;                               /* the number of threads in pThreads that are running */
+    pthread_t *pThreads;
+} ServerWorkers;
+
+/* A socket being monitored by the server: one of the
+ * sockets the server is listening on, a client connection
+ * or the worker thread eventfd.  Client connections are never
+ * blocked on: each keeps whatever it has received of the next
+ * message and whatever is left to send of the last response,
+ * so that one slow client cannot hold up the others.  A job is
+ * kept for each message that may be with the worker threads at
+ * once: just one unless the connection carries request IDs, in
+ * which case the responses go back in whatever order the jobs
+ * are done.  Once a
+ * shared memory client has handed over its shared memory the
+ * eventfd it writes to is waited on instead of the socket,
+ * the socket only being watched for the client going */
+typedef struct ServerConnectionTag
+{
+    ServerSocketType type;
+    SInt32 socket;
+    UInt32 epollEvents;                              /* the events currently being waited for on the socket (or toServerFd), 0 if not being waited on */
+    UInt32 numJobsInFlight;                          /* the number of jobs that are with the worker threads or deferred */
+    Bool isGone;                                     /* true if the client has gone while jobs were with the worker threads */
+    UInt16 rxLength;                                 /* the number of bytes in rxBuffer */
+    UInt32 txLength;                                 /* the number of bytes in txBuffer, or pLargeTxBuffer */
+    UInt32 txOffset;                                 /* the number of bytes of txBuffer, or pLargeTxBuffer, already sent */
+    UInt8 *pLargeTxBuffer;                           /* a response too long for txBuffer, PNULL if there isn't one */
+    Bool isInLargeMsg;                               /* for a client that frames messages with a LargeMsgHeader, true once largeMsgHeader has been received */
+    LargeMsgHeader largeMsgHeader;                   /* ...the header of the message being received... */
+    UInt32 largeMsgOffset;                           /* ...how much of its body has been dealt with... */
+    uint64_t largeMsgStartNs;                        /* ...when its header was taken... */
+    uint64_t largeMsgHandleNs;                       /* ...and how long the large message handler has taken over it */
+    MessagingSharedMemory *pSharedMemory;            /* for a shared memory client, PNULL until the client has handed it over */
+    SInt32 toServerFd;                               /* for a shared memory client, the eventfd the client writes to when it has put messages in */
+    SInt32 toClientFd;                               /* for a shared memory client, the eventfd to write to when a response has been put in */
+    MessagingServerPollHandler pPollHandler;         /* for a file descriptor added with addMessagingServerPollFd(), what to call */
+    struct ServerTag *pServer;
+    struct ServerConnectionTag *pNext;
+    struct ServerConnectionTag *pPrevious;
+    ServerJob job[MESSAGING_MAX_REQUESTS_IN_FLIGHT];
+    UInt8 rxBuffer[CONNECTION_BUFFER_SIZE];
+    UInt8 txBuffer[CONNECTION_BUFFER_SIZE];
+} ServerConnection;
+
+/* The state of a running server */
+typedef struct ServerTag
+{
+    UInt16 serverPort;
+    SInt32 epollFd;
+    ServerConnection *pConnections;                  /* a list of all the sockets being monitored */
+    ServerWorkers *pWorkers;                         /* PNULL if messages are handled by the server thread */
+    ServerReturnCode completionReturnCode;           /* anything other than SERVER_SUCCESS_KEEP_RUNNING that came of completing a deferred response or of a local message */
+} Server;
+
+/*
+ * EXTERN
+ */
+
+extern int errno;
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+/* Worker thread configuration, see setMessagingServerWorkerThreads() */
+static UInt32 gNumWorkerThreads = 0;
+static const Bool *pgMsgTypeIsConcurrent = PNULL;
+static UInt32 gNumMsgTypes = 0;
+
+/* File descriptors to add to the event loop, see addMessagingServerPollFd() */
+static SInt32 gPollFd[MESSAGING_SERVER_MAX_POLL_FDS];
+static MessagingServerPollHandler gpPollHandler[MESSAGING_SERVER_MAX_POLL_FDS];
+static UInt32 gNumPollFds = 0;
+/* The connection of the file descriptor whose handler is being
+ * called, see handleMessagingServerLocalMsg() */
+static ServerConnection *pgPollConnection = PNULL;
+
+/* What handles messages too long for a Msg, see setMessagingServerLargeMsgHandler() */
+static MessagingServerLargeMsgHandler gpLargeMsgHandler;
+static Bool gLargeMsgHandlerIsSet = false;
+
+/* The job whose message serverHandleMsg() is handling on this thread */
+static __thread ServerJob *gpCurrentJob = PNULL;
+
+/* What has been counted for each type of message */
+static MsgTypeStats gMsgTypeStats[NUM_MSG_TYPES];
+
+/* The names of the message types, see setMessagingServerMsgNames() */
+static Char **ppgMsgNames = PNULL;
+static UInt32 gNumMsgNames = 0;
+
+/* The eventfd that the STATS_DUMP_SIGNAL handler writes to, -1 if none */
+static volatile SInt32 gStatsDumpFd = -1;
+
+/* The subscriptions to the topics this server publishes, the
+ * last value of each topic, the port that updates are said to
+ * come from and the socket they are sent on, -1 until the first
+ * is sent, all protected by gPublishLock since topics may be
+ * published from worker threads */
+static Subscription gSubscription[MESSAGING_MAX_NUM_SUBSCRIPTIONS];
+static PublishedTopic gPublishedTopic[MESSAGING_MAX_NUM_TOPICS];
+static UInt16 gPublisherPort = 0;
+static SInt32 gPublishSocket = -1;
+static pthread_mutex_t gPublishLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* What handles updates of the topics this server subscribes to,
+ * see setMessagingServerPublicationHandler() */
+static MessagingServerPublicationHandler gpPublicationHandler;
+static Bool gPublicationHandlerIsSet = false;
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Set a socket to be non-blocking.
+ *
+ * socket  the socket.
+ *
+ * @return true if successful, otherwise false.
+ */
+static Bool setNonBlocking (SInt32 socket)
+{
+    Bool success = false;
+    SInt32 flags;
+
+    flags = fcntl (socket, F_GETFL, 0);
+    if ((flags >= 0) && (fcntl (socket, F_SETFL, flags | O_NONBLOCK) >= 0))
+    {
+        success = true;
+    }
+
+    return success;
+}
+
+/*
+ * Add a socket to the list of those being monitored
+ * by the server.
+ *
+ * pServer      the server.
+ * socket       the socket, which must be non-blocking.
+ * type         the type of socket.
+ *
+ * @return      a pointer to the new entry in the list
+ *              or PNULL if it could not be added.
+ */
+static ServerConnection *addServerConnection (Server *pServer, SInt32 socket, ServerSocketType type)
+{
+    ServerConnection *pConnection;
+    struct epoll_event event;
+    UInt32 x;
+
+    pConnection = malloc (sizeof (ServerConnection));
+    if (pConnection != PNULL)
+    {
+        pConnection->type = type;
+        pConnection->socket = socket;
+        pConnection->epollEvents = EPOLLIN;
+        pConnection->numJobsInFlight = 0;
+        pConnection->isGone = false;
+        pConnection->rxLength = 0;
+        pConnection->txLength = 0;
+        pConnection->txOffset = 0;
+        pConnection->pLargeTxBuffer = PNULL;
+        pConnection->isInLargeMsg = false;
+        pConnection->pSharedMemory = PNULL;
+        pConnection->toServerFd = -1;
+        pConnection->toClientFd = -1;
+        pConnection->pServer = pServer;
+        for (x = 0; x < MESSAGING_MAX_REQUESTS_IN_FLIGHT; x++)
+        {
+            pConnection->job[x].pConnection = pConnection;
+            pConnection->job[x].inFlight = false;
+            pConnection->job[x].isWithWorkers = false;
+            pConnection->job[x].isDeferred = false;
+        }
+
+        memset (&event, 0, sizeof (event));
+        event.events = pConnection->epollEvents;
+        event.data.ptr = pConnection;
+        if (epoll_ctl (pServer->epollFd, EPOLL_CTL_ADD, socket, &event) >= 0)
+        {
+            pConnection->pPrevious = PNULL;
+            pConnection->pNext = pServer->pConnections;
+            if (pServer->pConnections != PNULL)
+            {
+                pServer->pConnections->pPrevious = pConnection;
+            }
+            pServer->pConnections = pConnection;
+        }
+        else
+        {
+            fprintf (stderr, "Failed to add socket %ld to epoll on port %d, error: %s.\n", socket, pServer->serverPort, strerror (errno));
+            free (pConnection);
+            pConnection = PNULL;
+        }
+    }
+    else
+    {
+        fprintf (stderr, "Failed to get memory (%d bytes) for a connection.\n", sizeof (ServerConnection));
+    }
+
+    return pConnection;
+}
+
+/*
+ * Close a socket that is being monitored by the server
+ * and remove it from the list.
+ *
+ * pServer      the server.
+ * pConnection  the entry in the list.
+ */
+static void closeServerConnection (Server *pServer, ServerConnection *pConnection)
+{
+    /* Closing the socket also removes it from the epoll set; a file
+     * descriptor added by the user of this library is theirs to close */
+    if (pConnection->type != SERVER_SOCKET_POLL_FD)
+    {
+        close (pConnection->socket);
+        printDebug ("Messaging Server %d: closed socket %d.\n", pServer->serverPort, pConnection->socket);
+    }
+    else
+    {
+        epoll_ctl (pServer->epollFd, EPOLL_CTL_DEL, pConnection->socket, PNULL);
+    }
+
+    if (pConnection->pSharedMemory != PNULL)
+    {
+        munmap (pConnection->pSharedMemory, sizeof (MessagingSharedMemory));
+    }
+    free (pConnection->pLargeTxBuffer);
+    if (pConnection->toServerFd >= 0)
+    {
+        /* The client has this eventfd open too, so closing it
+         * would not take it out of the epoll set */
+        epoll_ctl (pServer->epollFd, EPOLL_CTL_DEL, pConnection->toServerFd, PNULL);
+        close (pConnection->toServerFd);
+    }
+    if (pConnection->toClientFd >= 0)
+    {
+        close (pConnection->toClientFd);
+    }
+
+    if (pConnection->pPrevious != PNULL)
+    {
+        pConnection->pPrevious->pNext = pConnection->pNext;
+    }
+    else
+    {
+        pServer->pConnections = pConnection->pNext;
+    }
+    if (pConnection->pNext != PNULL)
+    {
+        pConnection->pNext->pPrevious = pConnection->pPrevious;
+    }
+
+    free (pConnection);
+}
+
+/*
+ * Check whether the messages on a client connection
+ * carry request IDs, which they do for shared memory
+ * clients as well as for those on the tagged socket.
+ *
+ * pConnection  the client connection.
+ *
+ * @return      true if the messages carry request IDs.
+ */
+static Bool connectionIsTagged (ServerConnection *pConnection)
+{
+    return (pConnection->type == SERVER_SOCKET_TAGGED_CLIENT) || (pConnection->type == SERVER_SOCKET_SHARED_MEMORY_CLIENT);
+}
+
+/*
+ * Check whether another message from a client can be
+ * handled: there must be a job free for it and room to
+ * queue its response, as well as the responses of the
+ * jobs that are already with the worker threads.
+ *
+ * pConnection  the client connection.
+ *
+ * @return      true if another message can be handled.
+ */
+static Bool connectionCanTakeMsg (ServerConnection *pConnection)
+{
+    UInt32 maxNumJobs = 1;
+    UInt32 numResponsesRoomFor;
+    MessagingRing *pToClient;
+
+    if (connectionIsTagged (pConnection) || (pConnection->type == SERVER_SOCKET_DATAGRAM) || (pConnection->type == SERVER_SOCKET_POLL_FD))
+    {
+        maxNumJobs = MESSAGING_MAX_REQUESTS_IN_FLIGHT;
+    }
+
+    if (pConnection->pSharedMemory != PNULL)
+    {
+        pToClient = &(pConnection->pSharedMemory->toClient);
+        numResponsesRoomFor = MESSAGING_RING_NUM_SLOTS - (pToClient->head - __atomic_load_n (&(pToClient->tail), __ATOMIC_ACQUIRE));
+    }
+    else if (pConnection->pLargeTxBuffer != PNULL)
+    {
+        numResponsesRoomFor = 0;
+    }
+    else if (connectionIsTagged (pConnection))
+    {
+        numResponsesRoomFor = (sizeof (pConnection->txBuffer) - pConnection->txLength) / sizeof (MessagingTaggedMsg);
+    }
+    else
+    {
+        numResponsesRoomFor = (sizeof (pConnection->txBuffer) - pConnection->txLength) / sizeof (Msg);
+    }
+
+    return (pConnection->numJobsInFlight < maxNumJobs) && (numResponsesRoomFor > pConnection->numJobsInFlight);
+}
+
+/*
+ * Set the events waited for on a client connection:
+ * while there is a response waiting to go out stop
+ * reading from the client and wait for room to send
+ * instead, while messages from the client are with
+ * the worker threads and no more can be taken (or the
+ * client has gone) wait for nothing, otherwise wait
+ * for something to read.
+ * For a shared memory client it is the eventfd that the
+ * client writes to that is waited on, the socket being
+ * left alone unless the client has gone.
+ *
+ * pServer      the server.
+ * pConnection  the client connection.
+ *
+ * @return      true if successful, otherwise false.
+ */
+static Bool updateConnectionEvents (Server *pServer, ServerConnection *pConnection)
+{
+    Bool success = true;
+    UInt32 epollEvents = EPOLLIN;
+    SInt32 operation = EPOLL_CTL_MOD;
+    SInt32 fd = pConnection->socket;
+    struct epoll_event event;
+
+    if (pConnection->pSharedMemory != PNULL)
+    {
+        fd = pConnection->toServerFd;
+    }
+
+    if (pConnection->isGone)
+    {
+        epollEvents = 0;
+        if (pConnection->pSharedMemory != PNULL)
+        {
+            /* Stop being told that the client has gone */
+            epoll_ctl (pServer->epollFd, EPOLL_CTL_DEL, pConnection->socket, PNULL);
+        }
+    }
+    else if (pConnection->txLength > 0)
+    {
+        epollEvents = EPOLLOUT;
+    }
+    else if ((pConnection->numJobsInFlight > 0) && !connectionCanTakeMsg (pConnection))
+    {
+        epollEvents = 0;
+    }
+
+    if (epollEvents != pConnection->epollEvents)
+    {
+        /* Hang-ups are always reported, so a socket that needs
+         * nothing doing to it is taken out of the epoll set */
+        if (epollEvents == 0)
+        {
+            operation = EPOLL_CTL_DEL;
+        }
+        else if (pConnection->epollEvents == 0)
+        {
+            operation = EPOLL_CTL_ADD;
+        }
+
+        memset (&event, 0, sizeof (event));
+        event.events = epollEvents;
+        event.data.ptr = pConnection;
+        if (epoll_ctl (pServer->epollFd, operation, fd, &event) >= 0)
+        {
+            pConnection->epollEvents = epollEvents;
+        }
+        else
+        {
+            success = false;
+            fprintf (stderr, "Failed to modify epoll events for socket %ld on port %d, error: %s.\n", fd, pServer->serverPort, strerror (errno));
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Send as much of the queued response(s) on a client
+ * connection as the socket will take.
+ *
+ * pConnection  the client connection.
+ * waitMs       how long to wait for the socket to
+ *              take it all; 0 to not wait.
+ *
+ * @return      true if successful (even if not everything
+ *              could be sent), false if the connection
+ *              has failed.
+ */
+static Bool flushConnection (ServerConnection *pConnection, UInt32 waitMs)
+{
+    Bool success = true;
+    SInt32 rawBytesSent;
+    struct pollfd pollFd;
+    UInt8 *pTxBuffer = pConnection->txBuffer;
+
+    if (pConnection->pLargeTxBuffer != PNULL)
+    {
+        pTxBuffer = pConnection->pLargeTxBuffer;
+    }
+
+    while (success && (pConnection->txOffset < pConnection->txLength))
+    {
+        rawBytesSent = send (pConnection->socket, pTxBuffer + pConnection->txOffset, pConnection->txLength - pConnection->txOffset, MSG_NOSIGNAL);
+        if (rawBytesSent > 0)
+        {
+            pConnection->txOffset += rawBytesSent;
+        }
+        else
+        {
+            if ((rawBytesSent < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+            {
+                pollFd.fd = pConnection->socket;
+                pollFd.events = POLLOUT;
+                if ((waitMs == 0) || (poll (&pollFd, 1, waitMs) <= 0))
+                {
+                    break;
+                }
+            }
+            else if ((rawBytesSent == 0) || (errno != EINTR))
+            {
+                success = false;
+                fprintf (stderr, "Failed to send response to client (%ld bytes), error: %s.\n", pConnection->txLength - pConnection->txOffset, strerror (errno));
+            }
+        }
+    }
+
+    /* Free a large response once it has all gone, otherwise
+     * move anything left to the start of the buffer */
+    if (pConnection->pLargeTxBuffer != PNULL)
+    {
+        if (pConnection->txOffset == pConnection->txLength)
+        {
+            free (pConnection->pLargeTxBuffer);
+            pConnection->pLargeTxBuffer = PNULL;
+            pConnection->txLength = 0;
+            pConnection->txOffset = 0;
+        }
+    }
+    else if (pConnection->txOffset > 0)
+    {
+        pConnection->txLength -= pConnection->txOffset;
+        memmove (pConnection->txBuffer, pConnection->txBuffer + pConnection->txOffset, pConnection->txLength);
+        pConnection->txOffset = 0;
+    }
+
+    return success;
+}
+
+/*
+ * Queue the response to a message, if there is one,
+ * for sending on a client connection, or put it straight
+ * into the shared memory of a shared memory client, with
+ * the request ID of the message if the connection carries
+ * them, or framed with a LargeMsgHeader if the connection
+ * is framed that way.  The response is thrown away if the
+ * client doesn't want it.  There must be room.
+ *
+ * pConnection  the client connection.
+ * pJob         the job holding the handled message
+ *              and its response.
+ */
+static void queueResponse (ServerConnection *pConnection, ServerJob *pJob)
+{
+    UInt16 rawSendLength;
+    LargeMsgHeader header;
+    MessagingRingSlot *pSlot;
+    Msg *pSendMsg = &(pJob->sendMsg);
+
+    if (((pJob->returnCode == SERVER_EXIT_NORMALLY) || (pJob->returnCode == SERVER_SUCCESS_KEEP_RUNNING)) && (pSendMsg->msgLength > 0) &&
+        (pConnection->type != SERVER_SOCKET_DATAGRAM) && (pConnection->type != SERVER_SOCKET_POLL_FD) && (!connectionIsTagged (pConnection) || (pJob->requestId != MESSAGING_NO_RESPONSE_REQUEST_ID)))
+    {
+        rawSendLength = pSendMsg->msgLength + SIZE_OF_MSG_LENGTH;
+        ASSERT_PARAM (rawSendLength <= MAX_MSG_LENGTH + SIZE_OF_MSG_LENGTH, rawSendLength);
+
+        if (pConnection->pSharedMemory != PNULL)
+        {
+            pSlot = nextSlotInRing (&(pConnection->pSharedMemory->toClient));
+            ASSERT_PARAM (pSlot != PNULL, pConnection->pSharedMemory->toClient.head);
+
+            pSlot->requestId = pJob->requestId;
+            memcpy (&(pSlot->msg), pSendMsg, rawSendLength);
+            if (sendMsgInRing (&(pConnection->pSharedMemory->toClient)))
+            {
+                eventfd_write (pConnection->toClientFd, 1);
+            }
+        }
+        else if (pConnection->type == SERVER_SOCKET_LARGE_MSG_CLIENT)
+        {
+            ASSERT_PARAM (pConnection->txLength + sizeof (LargeMsgHeader) + rawSendLength <= sizeof (pConnection->txBuffer), pConnection->txLength);
+
+            header.version = MESSAGING_LARGE_MSG_VERSION;
+            header.msgType = pSendMsg->msgType;
+            header.bodyLength = pSendMsg->msgLength - SIZE_OF_MSG_TYPE;
+            memcpy (pConnection->txBuffer + pConnection->txLength, &header, sizeof (header));
+            memcpy (pConnection->txBuffer + pConnection->txLength + sizeof (header), &(pSendMsg->msgBody[0]), header.bodyLength);
+            pConnection->txLength += sizeof (header) + header.bodyLength;
+        }
+        else
+        {
+            if (connectionIsTagged (pConnection))
+            {
+                ASSERT_PARAM (pConnection->txLength + sizeof (pJob->requestId) + rawSendLength <= sizeof (pConnection->txBuffer), pConnection->txLength);
+
+                memcpy (pConnection->txBuffer + pConnection->txLength, &(pJob->requestId), sizeof (pJob->requestId));
+                pConnection->txLength += sizeof (pJob->requestId);
+            }
+            ASSERT_PARAM (pConnection->txLength + rawSendLength <= sizeof (pConnection->txBuffer), pConnection->txLength);
+
+            memcpy (pConnection->txBuffer + pConnection->txLength, pSendMsg, rawSendLength);
+            pConnection->txLength += rawSendLength;
+        }
+    }
+}
+
+/*
+ * Add a job to the end of a queue.
+ *
+ * pQueue  the queue.
+ * pJob    the job.
+ */
+static void queueJob (ServerJobQueue *pQueue, ServerJob *pJob)
+{
+    pJob->pNext = PNULL;
+    if (pQueue->pLast != PNULL)
+    {
+        pQueue->pLast->pNext = pJob;
+    }
+    else
+    {
+        pQueue->pFirst = pJob;
+    }
+    pQueue->pLast = pJob;
+}
+
+/*
+ * Take the job from the front of a queue.
+ *
+ * pQueue  the queue.
+ *
+ * @return the job or PNULL if the queue is empty.
+ */
+static ServerJob *dequeueJob (ServerJobQueue *pQueue)
+{
+    ServerJob *pJob = pQueue->pFirst;
+
+    if (pJob != PNULL)
+    {
+        pQueue->pFirst = pJob->pNext;
+        if (pQueue->pFirst == PNULL)
+        {
+            pQueue->pLast = PNULL;
+        }
+    }
+
+    return pJob;
+}
+
+/*
+ * Call the external function to handle the message
+ * in a job and, optionally, create a response, which
+ * it may defer.
+ *
+ * pJob  the job.
+ */
+static void callHandler (ServerJob *pJob)
+{
+    TraceSpan span;
+
+    pJob->sendMsg.msgLength = 0; /* Set the response message to zero length before calling the handler */
+    pJob->isDeferred = false;
+    gpCurrentJob = pJob;
+    TRACE_SPAN_BEGIN (&span, "serverHandleMsg", pJob->receivedMsg.msgType);
+    pJob->handleStartNs = getMonotonicNs();
+    pJob->returnCode = serverHandleMsg (&(pJob->receivedMsg), &(pJob->sendMsg));
+    pJob->handleEndNs = getMonotonicNs();
+    TRACE_SPAN_END (&span);
+    gpCurrentJob = PNULL;
+}
+
+/*
+ * The body of a worker thread: handle the jobs on a
+ * queue until told to exit, putting each one on the
+ * done queue afterwards and waking up the server.
+ *
+ * pWorkers        the worker threads.
+ * pQueue          the queue this thread takes jobs from.
+ * pJobAvailable   the condition signalled when a job
+ *                 is added to pQueue.
+ */
+static void runWorker (ServerWorkers *pWorkers, ServerJobQueue *pQueue, pthread_cond_t *pJobAvailable)
+{
+    ServerJob *pJob;
+
+    pthread_mutex_lock (&(pWorkers->lock));
+    while (!pWorkers->exiting)
+    {
+        pJob = dequeueJob (pQueue);
+        if (pJob != PNULL)
+        {
+            pthread_mutex_unlock (&(pWorkers->lock));
+
+            callHandler (pJob);
+
+            pthread_mutex_lock (&(pWorkers->lock));
+            queueJob (&(pWorkers->doneJobs), pJob);
+            eventfd_write (pWorkers->doneFd, 1);
+        }
+        else
+        {
+            pthread_cond_wait (pJobAvailable, &(pWorkers->lock));
+        }
+    }
+    pthread_mutex_unlock (&(pWorkers->lock));
+}
+
+/*
+ * The worker thread for messages that must be
+ * handled one at a time, in order.
+ *
+ * pParam  the worker threads.
+ *
+ * @return PNULL.
+ */
+static void *serialWorkerThread (void *pParam)
+{
+    ServerWorkers *pWorkers = (ServerWorkers *) pParam;
+
+    runWorker (pWorkers, &(pWorkers->serialJobs), &(pWorkers->serialJobAvailable));
+
+    return PNULL;
+}
+
+/*
+ * A worker thread for messages that may be
+ * handled at the same time as any other.
+ *
+ * pParam  the worker threads.
+ *
+ * @return PNULL.
+ */
+static void *concurrentWorkerThread (void *pParam)
+{
+    ServerWorkers *pWorkers = (ServerWorkers *) pParam;
+
+    runWorker (pWorkers, &(pWorkers->concurrentJobs), &(pWorkers->concurrentJobAvailable));
+
+    return PNULL;
+}
+
+/*
+ * Stop the worker threads, waiting for any that
+ * are handling a message to finish, and free them.
+ *
+ * pWorkers  the worker threads.
+ */
+static void stopWorkers (ServerWorkers *pWorkers)
+{
+    UInt32 x;
+
+    pthread_mutex_lock (&(pWorkers->lock));
+    pWorkers->exiting = true;
+    pthread_cond_broadcast (&(pWorkers->serialJobAvailable));
+    pthread_cond_broadcast (&(pWorkers->concurrentJobAvailable));
+    pthread_mutex_unlock (&(pWorkers->lock));
+
+    for (x = 0; x < pWorkers->numThreads; x++)
+    {
+        pthread_join (pWorkers->pThreads[x], PNULL);
+    }
+
+    pthread_cond_destroy (&(pWorkers->concurrentJobAvailable));
+    pthread_cond_destroy (&(pWorkers->serialJobAvailable));
+    pthread_mutex_destroy (&(pWorkers->lock));
+    free (pWorkers->pThreads);
+    free (pWorkers);
+}
+
+/*
+ * Start the worker threads: the serial one plus
+ * gNumWorkerThreads concurrent ones.  The eventfd
+ * they use to wake the server is added to the
+ * server's sockets.
+ *
+ * pServer  the server.
+ *
+ * @return  the worker threads or PNULL if they
+ *          could not be started.
+ */
+static ServerWorkers *startWorkers (Server *pServer)
+{
+    ServerWorkers *pWorkers;
+    Bool success = false;
+    UInt32 x;
+
+    pWorkers = malloc (sizeof (ServerWorkers));
+    if (pWorkers != PNULL)
+    {
+        memset (pWorkers, 0, sizeof (*pWorkers));
+        pthread_mutex_init (&(pWorkers->lock), PNULL);
+        pthread_cond_init (&(pWorkers->serialJobAvailable), PNULL);
+        pthread_cond_init (&(pWorkers->concurrentJobAvailable), PNULL);
+        pWorkers->pThreads = malloc (sizeof (pthread_t) * (gNumWorkerThreads + 1));
+        pWorkers->doneFd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+        if ((pWorkers->pThreads != PNULL) && (pWorkers->doneFd >= 0))
+        {
+            if (addServerConnection (pServer, pWorkers->doneFd, SERVER_SOCKET_JOBS_DONE) != PNULL)
+            {
+                success = true;
+                for (x = 0; (x < gNumWorkerThreads + 1) && success; x++)
+                {
+                    if (pthread_create (&(pWorkers->pThreads[x]), PNULL, (x == 0) ? serialWorkerThread : concurrentWorkerThread, pWorkers) == 0)
+                    {
+                        pWorkers->numThreads++;
+                    }
+                    else
+                    {
+                        success = false;
+                    }
+                }
+            }
+            else
+            {
+                close (pWorkers->doneFd);
+            }
+        }
+
+        if (!success)
+        {
+            fprintf (stderr, "Failed to start worker threads on port %d, error: %s.\n", pServer->serverPort, strerror (errno));
+            stopWorkers (pWorkers);
+            pWorkers = PNULL;
+        }
+    }
+
+    return pWorkers;
+}
+
+/*
+ * Pass the message in one of a client connection's
+ * jobs, which must be in flight, to the worker threads.
+ *
+ * pWorkers     the worker threads.
+ * pJob         the job.
+ */
+static void dispatchJob (ServerWorkers *pWorkers, ServerJob *pJob)
+{
+    Bool isConcurrent = false;
+    MsgType msgType = pJob->receivedMsg.msgType;
+
+    if ((pJob->receivedMsg.msgLength >= SIZE_OF_MSG_TYPE) && (pgMsgTypeIsConcurrent != PNULL) && (msgType < gNumMsgTypes))
+    {
+        isConcurrent = pgMsgTypeIsConcurrent[msgType];
+    }
+
+    pJob->isWithWorkers = true;
+
+    pthread_mutex_lock (&(pWorkers->lock));
+    if (isConcurrent)
+    {
+        queueJob (&(pWorkers->concurrentJobs), pJob);
+        pthread_cond_signal (&(pWorkers->concurrentJobAvailable));
+    }
+    else
+    {
+        queueJob (&(pWorkers->serialJobs), pJob);
+        pthread_cond_signal (&(pWorkers->serialJobAvailable));
+    }
+    pthread_mutex_unlock (&(pWorkers->lock));
+}
+
+/*
+ * Count a time taken over one stage of handling a
+ * message of one type.
+ *
+ * pStats  the stats for the message type.
+ * stage   the stage.
+ * timeNs  the time taken in nanoseconds.
+ */
+static void recordLatency (MsgTypeStats *pStats, StatsStage stage, uint64_t timeNs)
+{
+    UInt32 bucket = 0;
+
+    if (timeNs > UINT32_MAX)
+    {
+        timeNs = UINT32_MAX;
+    }
+    while ((bucket < STATS_NUM_BUCKETS - 1) && ((timeNs >> (bucket + 1)) > 0))
+    {
+        bucket++;
+    }
+
+    pStats->histogram[stage][bucket]++;
+    if (timeNs > pStats->maxNs[stage])
+    {
+        pStats->maxNs[stage] = (UInt32) timeNs;
+    }
+}
+
+/*
+ * Count a message that has been handled.  Must
+ * be called on the server thread.
+ *
+ * msgType     the type of the message.
+ * returnCode  what came back from handling it.
+ * bytesIn     the length of the message.
+ * bytesOut    the length of the response.
+ * waitNs      the time it waited to be handled...
+ * handleNs    ...the time taken to handle it...
+ * respondNs   ...and the time from then until the
+ *             response was queued, all in nanoseconds.
+ */
+static void recordMsgStats (MsgType msgType, ServerReturnCode returnCode, UInt32 bytesIn, UInt32 bytesOut, uint64_t waitNs, uint64_t handleNs, uint64_t respondNs)
+{
+    MsgTypeStats *pStats = &(gMsgTypeStats[msgType]);
+
+    pStats->count++;
+    if (returnCode < 0)
+    {
+        pStats->numErrors++;
+    }
+    pStats->numBytesIn += bytesIn;
+    pStats->numBytesOut += bytesOut;
+    recordLatency (pStats, STATS_STAGE_WAIT, waitNs);
+    recordLatency (pStats, STATS_STAGE_HANDLE, handleNs);
+    recordLatency (pStats, STATS_STAGE_RESPOND, respondNs);
+}
+
+/*
+ * Count the message in a job whose response is
+ * about to be queued.  Must be called on the server
+ * thread.
+ *
+ * pJob  the job.
+ */
+static void recordJobStats (ServerJob *pJob)
+{
+    UInt32 bytesOut = 0;
+
+    if (((pJob->returnCode == SERVER_EXIT_NORMALLY) || (pJob->returnCode == SERVER_SUCCESS_KEEP_RUNNING)) && (pJob->sendMsg.msgLength > 0))
+    {
+        bytesOut = pJob->sendMsg.msgLength + SIZE_OF_MSG_LENGTH;
+    }
+
+    /* The zero length message has no type but is counted as type 0 */
+    recordMsgStats ((pJob->receivedMsg.msgLength >= SIZE_OF_MSG_TYPE) ? pJob->receivedMsg.msgType : 0, pJob->returnCode,
+                    pJob->receivedMsg.msgLength + SIZE_OF_MSG_LENGTH, bytesOut, pJob->handleStartNs - pJob->takenNs,
+                    pJob->handleEndNs - pJob->handleStartNs, getMonotonicNs() - pJob->handleEndNs);
+}
+
+/*
+ * Work out a percentile of the times taken over one
+ * stage of handling messages of one type from its
+ * histogram.
+ *
+ * pStats      the stats for the message type.
+ * stage       the stage.
+ * percentile  the percentile.
+ *
+ * @return     the top of the bucket the percentile
+ *             falls in, or the longest time if that
+ *             is less, in nanoseconds.
+ */
+static UInt32 getPercentileNs (const MsgTypeStats *pStats, StatsStage stage, UInt32 percentile)
+{
+    uint64_t target = (((uint64_t) pStats->count * percentile) + 99) / 100;
+    uint64_t total = pStats->histogram[stage][0];
+    UInt32 bucket = 0;
+    UInt32 timeNs = 0;
+
+    if (target > 0)
+    {
+        while ((total < target) && (bucket < STATS_NUM_BUCKETS - 1))
+        {
+            bucket++;
+            total += pStats->histogram[stage][bucket];
+        }
+        timeNs = (UInt32) (((uint64_t) 2 << bucket) - 1);
+        if (timeNs > pStats->maxNs[stage])
+        {
+            timeNs = pStats->maxNs[stage];
+        }
+    }
+
+    return timeNs;
+}
+
+/*
+ * Get the latency stats for one stage of handling
+ * messages of one type.
+ *
+ * pStats     the stats for the message type.
+ * stage      the stage.
+ * pLatency   a place to put the latency stats.
+ */
+static void getLatencyStats (const MsgTypeStats *pStats, StatsStage stage, MessagingLatencyStats *pLatency)
+{
+    pLatency->p50Ns = getPercentileNs (pStats, stage, 50);
+    pLatency->p99Ns = getPercentileNs (pStats, stage, 99);
+    pLatency->maxNs = pStats->maxNs[stage];
+}
+
+/*
+ * Get what has been counted for one type of message
+ * in the form it is sent to clients.
+ *
+ * msgType  the message type.
+ * pStats   a place to put the stats.
+ */
+static void getMsgTypeStats (MsgType msgType, MessagingMsgTypeStats *pStats)
+{
+    const MsgTypeStats *pMsgTypeStats = &(gMsgTypeStats[msgType]);
+    UInt32 x;
+
+    pStats->msgType = msgType;
+    pStats->nextMsgType = MESSAGING_STATS_NO_NEXT_MSG_TYPE;
+    for (x = msgType + 1; (x < NUM_MSG_TYPES) && (pStats->nextMsgType == MESSAGING_STATS_NO_NEXT_MSG_TYPE); x++)
+    {
+        if (gMsgTypeStats[x].count > 0)
+        {
+            pStats->nextMsgType = (UInt16) x;
+        }
+    }
+    pStats->count = pMsgTypeStats->count;
+    pStats->numErrors = pMsgTypeStats->numErrors;
+    pStats->numBytesIn = pMsgTypeStats->numBytesIn;
+    pStats->numBytesOut = pMsgTypeStats->numBytesOut;
+    getLatencyStats (pMsgTypeStats, STATS_STAGE_WAIT, &(pStats->wait));
+    getLatencyStats (pMsgTypeStats, STATS_STAGE_HANDLE, &(pStats->handle));
+    getLatencyStats (pMsgTypeStats, STATS_STAGE_RESPOND, &(pStats->respond));
+}
+
+/*
+ * Check whether a message is asking for the stats
+ * of a message type, which the server answers itself.
+ *
+ * pMsg    the message.
+ *
+ * @return true if it's a stats request.
+ */
+static Bool isStatsRequest (const Msg *pMsg)
+{
+    return (pMsg->msgLength == SIZE_OF_MSG_TYPE + sizeof (MsgType)) && (pMsg->msgType == MESSAGING_STATS_MSG_TYPE);
+}
+
+/*
+ * Answer a stats request in a job, in place of
+ * serverHandleMsg(), with the stats of the message
+ * type it asks about.
+ *
+ * pJob  the job.
+ */
+static void answerStatsRequest (ServerJob *pJob)
+{
+    MessagingMsgTypeStats stats;
+
+    pJob->handleStartNs = getMonotonicNs();
+    getMsgTypeStats (pJob->receivedMsg.msgBody[0], &stats);
+    pJob->sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (stats);
+    pJob->sendMsg.msgType = MESSAGING_STATS_MSG_TYPE;
+    memcpy (&(pJob->sendMsg.msgBody[0]), &stats, sizeof (stats));
+    pJob->isDeferred = false;
+    pJob->returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    pJob->handleEndNs = getMonotonicNs();
+}
+
+/*
+ * Send the last published value of a topic to a
+ * subscriber, as a datagram, without waiting.  If
+ * the subscriber is behind the update is left
+ * pending, to go with the next publication of the
+ * topic; if the subscriber has gone the subscription
+ * is dropped.  gPublishLock must be held.
+ *
+ * pSubscription  the subscription.
+ * nowNs          the time now, see getMonotonicNs().
+ */
+static void sendPublication (Subscription *pSubscription, uint64_t nowNs)
+{
+    PublishedTopic *pTopic = &(gPublishedTopic[pSubscription->topic]);
+    MessagingPublicationHeader header;
+    SockAddrUn subscriber;
+    Msg sendMsg;
+    SInt32 rawSendLength;
+
+    if (gPublishSocket < 0)
+    {
+        gPublishSocket = socket (AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (gPublishSocket < 0)
+        {
+            fprintf (stderr, "Failed to create socket to publish topics from port %d, error: %s.\n", gPublisherPort, strerror (errno));
+        }
+    }
+
+    pSubscription->isPending = true;
+    if (gPublishSocket >= 0)
+    {
+        header.publisherPort = gPublisherPort;
+        header.topic = pSubscription->topic;
+        sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (header) + pTopic->dataLength;
+        sendMsg.msgType = MESSAGING_PUBLICATION_MSG_TYPE;
+        memcpy (&(sendMsg.msgBody[0]), &header, sizeof (header));
+        memcpy (&(sendMsg.msgBody[sizeof (header)]), pTopic->data, pTopic->dataLength);
+
+        memset (&subscriber, 0, sizeof (subscriber));
+        subscriber.sun_family = AF_UNIX;
+        /* sun_path[0] is left as zero, the name is in the abstract namespace */
+        snprintf (&(subscriber.sun_path[1]), sizeof (subscriber.sun_path) - 1, MESSAGING_DATAGRAM_SOCKET_NAME_FORMAT, pSubscription->subscriberPort);
+
+        rawSendLength = sendMsg.msgLength + SIZE_OF_MSG_LENGTH;
+        if (sendto (gPublishSocket, &sendMsg, rawSendLength, MSG_DONTWAIT | MSG_NOSIGNAL, (SockAddr *) &subscriber, sizeof (subscriber)) == rawSendLength)
+        {
+            pSubscription->isPending = false;
+            pSubscription->lastSentNs = nowNs;
+        }
+        else if ((errno == ECONNREFUSED) || (errno == ENOENT))
+        {
+            pSubscription->isInUse = false;
+            printDebug ("Messaging Server %d: subscriber on port %d to topic %d has gone.\n", gPublisherPort, pSubscription->subscriberPort, pSubscription->topic);
+        }
+    }
+}
+
+/*
+ * Check whether a message is asking to subscribe to,
+ * or unsubscribe from, a topic, which the server
+ * answers itself.
+ *
+ * pMsg    the message.
+ *
+ * @return true if it's a subscribe request.
+ */
+static Bool isSubscribeRequest (const Msg *pMsg)
+{
+    return (pMsg->msgLength == SIZE_OF_MSG_TYPE + sizeof (MessagingSubscribeReq)) && (pMsg->msgType == MESSAGING_SUBSCRIBE_MSG_TYPE);
+}
+
+/*
+ * Answer a subscribe request in a job, in place of
+ * serverHandleMsg(): add, change or remove the
+ * subscription and, for a new or changed one, send
+ * the subscriber the value the topic has now.
+ *
+ * pJob  the job.
+ */
+static void answerSubscribeRequest (ServerJob *pJob)
+{
+    MessagingSubscribeReq request;
+    Subscription *pSubscription = PNULL;
+    Bool success = false;
+    UInt32 x;
+
+    pJob->handleStartNs = getMonotonicNs();
+    memcpy (&request, &(pJob->receivedMsg.msgBody[0]), sizeof (request));
+
+    if (request.topic < MESSAGING_MAX_NUM_TOPICS)
+    {
+        pthread_mutex_lock (&gPublishLock);
+        /* Use the subscriber's existing subscription, or a free one */
+        for (x = 0; x < MESSAGING_MAX_NUM_SUBSCRIPTIONS; x++)
+        {
+            if (gSubscription[x].isInUse && (gSubscription[x].topic == request.topic) && (gSubscription[x].subscriberPort == request.subscriberPort))
+            {
+                pSubscription = &(gSubscription[x]);
+            }
+            else if (!gSubscription[x].isInUse && (pSubscription == PNULL) && request.subscribe)
+            {
+                pSubscription = &(gSubscription[x]);
+            }
+        }
+
+        if (!request.subscribe)
+        {
+            if (pSubscription != PNULL)
+            {
+                pSubscription->isInUse = false;
+            }
+            success = true;
+        }
+        else if (pSubscription != PNULL)
+        {
+            pSubscription->isInUse = true;
+            pSubscription->isPending = false;
+            pSubscription->topic = request.topic;
+            pSubscription->subscriberPort = request.subscriberPort;
+            pSubscription->minIntervalMs = request.minIntervalMs;
+            pSubscription->maxIntervalMs = request.maxIntervalMs;
+            pSubscription->lastSentNs = 0;
+            if (gPublishedTopic[request.topic].isPublished)
+            {
+                sendPublication (pSubscription, getMonotonicNs());
+            }
+            success = true;
+        }
+        pthread_mutex_unlock (&gPublishLock);
+    }
+
+    if (!success)
+    {
+        fprintf (stderr, "Messaging server on port %d couldn't subscribe port %d to topic %d.\n", gPublisherPort, request.subscriberPort, request.topic);
+    }
+
+    pJob->sendMsg.msgLength = SIZE_OF_MSG_TYPE + sizeof (success);
+    pJob->sendMsg.msgType = MESSAGING_SUBSCRIBE_MSG_TYPE;
+    memcpy (&(pJob->sendMsg.msgBody[0]), &success, sizeof (success));
+    pJob->isDeferred = false;
+    pJob->returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    pJob->handleEndNs = getMonotonicNs();
+}
+
+/*
+ * Check whether a datagram is an update of a topic
+ * that this server has subscribed to.
+ *
+ * pMsg    the message.
+ *
+ * @return true if it's a publication.
+ */
+static Bool isPublication (const Msg *pMsg)
+{
+    return (pMsg->msgLength >= SIZE_OF_MSG_TYPE + sizeof (MessagingPublicationHeader)) && (pMsg->msgType == MESSAGING_PUBLICATION_MSG_TYPE);
+}
+
+/*
+ * Pass an update of a topic that this server has
+ * subscribed to to the publication handler, if
+ * there is one, otherwise drop it.
+ *
+ * pMsg    the publication.
+ */
+static void handlePublication (const Msg *pMsg)
+{
+    MessagingPublicationHeader header;
+
+    memcpy (&header, &(pMsg->msgBody[0]), sizeof (header));
+    if (gPublicationHandlerIsSet)
+    {
+        resumeDebug();
+        gpPublicationHandler (header.publisherPort, header.topic, &(pMsg->msgBody[sizeof (header)]), pMsg->msgLength - SIZE_OF_MSG_TYPE - sizeof (header));
+        suspendDebug();
+    }
+    else
+    {
+        printDebug ("Messaging Server: update of topic %d from port %d with no publication handler, dropped.\n", header.topic, header.publisherPort);
+    }
+}
+
+/*
+ * Handle a message from a client: pass it to
+ * serverHandleMsg(), or to the worker threads, and
+ * queue any response, unless it is deferred.  A
+ * stats request or a subscribe request is answered here.  There
+ * must be room for the response and a free job (see
+ * connectionCanTakeMsg()).
+ *
+ * pServer       the server.
+ * pConnection   the client connection.
+ * pRawMsg       the message, starting with its length.
+ * rawMsgLength  the length of the message, including
+ *               the length indicator.
+ * requestId     the request ID of the message, if the
+ *               connection carries them.
+ *
+ * @return       a return code.
+ */
+static ServerReturnCode handleMsg (Server *pServer, ServerConnection *pConnection, const UInt8 *pRawMsg, UInt16 rawMsgLength, MsgRequestId requestId)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    ServerJob *pJob = &(pConnection->job[0]);
+
+    while ((pJob < &(pConnection->job[MESSAGING_MAX_REQUESTS_IN_FLIGHT])) && pJob->inFlight)
+    {
+        pJob++;
+    }
+    ASSERT_PARAM (pJob < &(pConnection->job[MESSAGING_MAX_REQUESTS_IN_FLIGHT]), pConnection->numJobsInFlight);
+
+    /* Copy the message out so that the handler gets a whole Msg of its own */
+    pJob->requestId = requestId;
+    memcpy (&(pJob->receivedMsg), pRawMsg, rawMsgLength);
+    pJob->takenNs = getMonotonicNs();
+    pJob->inFlight = true;
+    pConnection->numJobsInFlight++;
+
+    if (isStatsRequest (&(pJob->receivedMsg)))
+    {
+        answerStatsRequest (pJob);
+    }
+    else if (isSubscribeRequest (&(pJob->receivedMsg)))
+    {
+        answerSubscribeRequest (pJob);
+    }
+    else if (pServer->pWorkers != PNULL)
+    {
+        /* Hand the message to the worker threads, the response is queued when they're done */
+        dispatchJob (pServer->pWorkers, pJob);
+    }
+    else
+    {
+        resumeDebug();
+        callHandler (pJob);
+        suspendDebug();
+    }
+
+    if (!pJob->isWithWorkers)
+    {
+        returnCode = pJob->returnCode;
+        if (!pJob->isDeferred)
+        {
+            pJob->inFlight = false;
+            pConnection->numJobsInFlight--;
+            recordJobStats (pJob);
+            queueResponse (pConnection, pJob);
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Handle the whole messages that have been received
+ * on a client connection, in the order they arrived,
+ * passing each one to serverHandleMsg(), or to the
+ * worker threads, and queueing any response.  Handling
+ * stops if there is no room to queue another response
+ * or while as many messages as are allowed are with the
+ * worker threads, the rest being left in the receive
+ * buffer until later.
+ * 
+ * pServer         the server.
+ * pConnection     the client connection.
+ * pClientIsGone   set to true if the connection has
+ *                 failed.
+ *
+ * @return         a return code.
+ */
+static ServerReturnCode handleReceivedMsgs (Server *pServer, ServerConnection *pConnection, Bool *pClientIsGone)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    UInt16 rxOffset = 0;
+    UInt16 rawMsgLength;
+    UInt16 headerLength = 0;
+    MsgRequestId requestId = MESSAGING_NO_RESPONSE_REQUEST_ID;
+  
+    if (connectionIsTagged (pConnection))
+    {
+        headerLength = sizeof (requestId);
+    }
+
+    while ((returnCode == SERVER_SUCCESS_KEEP_RUNNING) && !*pClientIsGone &&
+           (pConnection->rxLength - rxOffset >= headerLength + SIZE_OF_MSG_LENGTH) &&
+           (pConnection->rxLength - rxOffset >= (rawMsgLength = pConnection->rxBuffer[rxOffset + headerLength] + SIZE_OF_MSG_LENGTH) + headerLength))
+    {
+        /* Make room for the response if necessary; if the client isn't
+         * taking its responses, leave the rest until it does */
+        if (!connectionCanTakeMsg (pConnection))
+        {
+            *pClientIsGone = !flushConnection (pConnection, 0);
+            if (!connectionCanTakeMsg (pConnection))
+            {
+                break;
+            }
+        }
+
+        memcpy (&requestId, pConnection->rxBuffer + rxOffset, headerLength);
+        returnCode = handleMsg (pServer, pConnection, pConnection->rxBuffer + rxOffset + headerLength, rawMsgLength, requestId);
+        rxOffset += headerLength + rawMsgLength;
+    }
+
+    /* Move anything that's left to the start of the buffer */
+    if (rxOffset > 0)
+    {
+        pConnection->rxLength -= rxOffset;
+        memmove (pConnection->rxBuffer, pConnection->rxBuffer + rxOffset, pConnection->rxLength);
+    }
+            
+    /* Send what we can, making sure that the last response
+     * goes out if the server is about to exit */
+    if (!*pClientIsGone)
+    {
+        *pClientIsGone = !flushConnection (pConnection, (returnCode == SERVER_EXIT_NORMALLY) ? EXIT_SEND_TIMEOUT_MS : 0);
+    }
+
+    return returnCode;
+}
+
+/*
+ * Queue the response given by the large message handler
+ * for sending on a client connection, which must have
+ * nothing else waiting to be sent, in a buffer of its
+ * own.
+ *
+ * pConnection  the client connection.
+ * pResponse    the response.
+ *
+ * @return      true if successful, false if there
+ *              wasn't the memory for it.
+ */
+static Bool queueLargeResponse (ServerConnection *pConnection, MessagingServerLargeResponse *pResponse)
+{
+    Bool success = false;
+    LargeMsgHeader header;
+
+    ASSERT_PARAM (pConnection->txLength == 0, pConnection->txLength);
+    ASSERT_PARAM (pResponse->bodyLength <= MAX_LARGE_MSG_BODY_LENGTH, pResponse->bodyLength);
+
+    pConnection->pLargeTxBuffer = malloc (sizeof (header) + pResponse->bodyLength);
+    if (pConnection->pLargeTxBuffer != PNULL)
+    {
+        header.version = MESSAGING_LARGE_MSG_VERSION;
+        header.msgType = pResponse->msgType;
+        header.bodyLength = pResponse->bodyLength;
+        memcpy (pConnection->pLargeTxBuffer, &header, sizeof (header));
+        memcpy (pConnection->pLargeTxBuffer + sizeof (header), pResponse->pBody, pResponse->bodyLength);
+        pConnection->txLength = sizeof (header) + pResponse->bodyLength;
+        pConnection->txOffset = 0;
+        success = true;
+    }
+    else
+    {
+        fprintf (stderr, "Failed to get memory (%ld bytes) for a large response.\n", sizeof (header) + pResponse->bodyLength);
+    }
+
+    return success;
+}
+
+/*
+ * Handle what has been received on a client connection
+ * on which messages are framed with a LargeMsgHeader.
+ * A message whose body would fit in a Msg is handled as
+ * one, as by handleReceivedMsgs(), once it has all
+ * arrived.  The body of a longer one is passed to the
+ * large message handler as it arrives, the piece that
+ * is in the receive buffer each time, so it is never
+ * held in one piece; that only starts once any message
+ * before it has been finished with and its response
+ * sent, so the responses go back in order.
+ *
+ * pServer         the server.
+ * pConnection     the client connection.
+ * pClientIsGone   set to true if the connection has
+ *                 failed.
+ *
+ * @return         a return code.
+ */
+static ServerReturnCode handleLargeMsgs (Server *pServer, ServerConnection *pConnection, Bool *pClientIsGone)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    LargeMsgHeader *pHeader = &(pConnection->largeMsgHeader);
+    MessagingServerLargeResponse response;
+    Msg msg;
+    UInt16 rxOffset = 0;
+    UInt32 chunkLength;
+    UInt32 responseLength;
+    uint64_t handleStartNs;
+    uint64_t handleEndNs;
+    Bool isProgressing = true;
+
+    while ((returnCode == SERVER_SUCCESS_KEEP_RUNNING) && !*pClientIsGone && isProgressing)
+    {
+        isProgressing = false;
+        if (!pConnection->isInLargeMsg)
+        {
+            if (pConnection->rxLength - rxOffset >= sizeof (LargeMsgHeader))
+            {
+                memcpy (pHeader, pConnection->rxBuffer + rxOffset, sizeof (LargeMsgHeader));
+                rxOffset += sizeof (LargeMsgHeader);
+                if ((pHeader->version == MESSAGING_LARGE_MSG_VERSION) && (pHeader->bodyLength <= MAX_LARGE_MSG_BODY_LENGTH) &&
+                    ((pHeader->bodyLength <= MAX_MSG_BODY_LENGTH) || gLargeMsgHandlerIsSet))
+                {
+                    pConnection->isInLargeMsg = true;
+                    pConnection->largeMsgOffset = 0;
+                    pConnection->largeMsgStartNs = getMonotonicNs();
+                    pConnection->largeMsgHandleNs = 0;
+                    isProgressing = true;
+                }
+                else
+                {
+                    returnCode = SERVER_ERR_MESSAGE_TOO_LARGE;
+                    fprintf (stderr, "Can't handle message with version %d, body length %ld, on port %d.\n", pHeader->version, pHeader->bodyLength, pServer->serverPort);
+                }
+            }
+        }
+        else if (pHeader->bodyLength <= MAX_MSG_BODY_LENGTH)
+        {
+            /* Short enough to be handled as a Msg, once it's all here */
+            if (pConnection->rxLength - rxOffset >= pHeader->bodyLength)
+            {
+                if (!connectionCanTakeMsg (pConnection))
+                {
+                    *pClientIsGone = !flushConnection (pConnection, 0);
+                }
+                if (!*pClientIsGone && connectionCanTakeMsg (pConnection))
+                {
+                    msg.msgLength = SIZE_OF_MSG_TYPE + pHeader->bodyLength;
+                    msg.msgType = pHeader->msgType;
+                    memcpy (&(msg.msgBody[0]), pConnection->rxBuffer + rxOffset, pHeader->bodyLength);
+                    rxOffset += pHeader->bodyLength;
+                    pConnection->isInLargeMsg = false;
+                    returnCode = handleMsg (pServer, pConnection, (UInt8 *) &msg, msg.msgLength + SIZE_OF_MSG_LENGTH, MESSAGING_NO_RESPONSE_REQUEST_ID);
+                    isProgressing = true;
+                }
+            }
+        }
+        else if ((pConnection->numJobsInFlight == 0) && (pConnection->rxLength > rxOffset))
+        {
+            if (pConnection->txLength > 0)
+            {
+                *pClientIsGone = !flushConnection (pConnection, 0);
+            }
+            if (!*pClientIsGone && (pConnection->txLength == 0))
+            {
+                chunkLength = pConnection->rxLength - rxOffset;
+                if (chunkLength > pHeader->bodyLength - pConnection->largeMsgOffset)
+                {
+                    chunkLength = pHeader->bodyLength - pConnection->largeMsgOffset;
+                }
+                response.isToBeSent = false;
+
+                handleStartNs = getMonotonicNs();
+                resumeDebug();
+                returnCode = gpLargeMsgHandler (pHeader->msgType, pHeader->bodyLength, pConnection->largeMsgOffset, pConnection->rxBuffer + rxOffset, chunkLength, &response);
+                suspendDebug();
+                handleEndNs = getMonotonicNs();
+                pConnection->largeMsgHandleNs += handleEndNs - handleStartNs;
+
+                rxOffset += chunkLength;
+                pConnection->largeMsgOffset += chunkLength;
+                isProgressing = true;
+                if (pConnection->largeMsgOffset == pHeader->bodyLength)
+                {
+                    pConnection->isInLargeMsg = false;
+                    responseLength = 0;
+                    if (((returnCode == SERVER_EXIT_NORMALLY) || (returnCode == SERVER_SUCCESS_KEEP_RUNNING)) && response.isToBeSent)
+                    {
+                        responseLength = sizeof (LargeMsgHeader) + response.bodyLength;
+                        if (!queueLargeResponse (pConnection, &response))
+                        {
+                            returnCode = SERVER_ERR_FAILED_TO_GET_MEMORY_FOR_RESPONSE;
+                        }
+                    }
+
+                    /* The time waited is the time spent waiting for the body to arrive */
+                    recordMsgStats (pHeader->msgType, returnCode, sizeof (LargeMsgHeader) + pHeader->bodyLength, responseLength,
+                                    handleEndNs - pConnection->largeMsgStartNs - pConnection->largeMsgHandleNs,
+                                    pConnection->largeMsgHandleNs, getMonotonicNs() - handleEndNs);
+                }
+            }
+        }
+    }
+
+    /* Move anything that's left to the start of the buffer */
+    if (rxOffset > 0)
+    {
+        pConnection->rxLength -= rxOffset;
+        memmove (pConnection->rxBuffer, pConnection->rxBuffer + rxOffset, pConnection->rxLength);
+    }
+
+    /* Send what we can, making sure that the last response
+     * goes out if the server is about to exit */
+    if (!*pClientIsGone)
+    {
+        *pClientIsGone = !flushConnection (pConnection, (returnCode == SERVER_EXIT_NORMALLY) ? EXIT_SEND_TIMEOUT_MS : 0);
+    }
+
+    return returnCode;
+}
+
+/*
+ * Handle the messages that a shared memory client has
+ * put into its shared memory, in the order they were
+ * put in, as handleReceivedMsgs() does for those received
+ * on a socket.  Handling stops if there is no room in the
+ * shared memory for another response or while as many
+ * messages as are allowed are with the worker threads.
+ * Otherwise, when there are no more messages, the client
+ * is asked to wake the server up when it puts the next
+ * one in.
+ *
+ * pServer         the server.
+ * pConnection     the client connection.
+ *
+ * @return         a return code.
+ */
+static ServerReturnCode handleSharedMemoryMsgs (Server *pServer, ServerConnection *pConnection)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    MessagingRing *pToServer = &(pConnection->pSharedMemory->toServer);
+    Bool isWaiting = false;
+    Bool wakeClient = false;
+    MessagingRingSlot *pSlot;
+
+    /* No need for wake-ups while we're at it */
+    __atomic_store_n (&(pToServer->consumerWaiting), false, __ATOMIC_RELAXED);
+
+    while ((returnCode == SERVER_SUCCESS_KEEP_RUNNING) && !isWaiting && connectionCanTakeMsg (pConnection))
+    {
+        pSlot = nextMsgInRing (pToServer);
+        if (pSlot != PNULL)
+        {
+            returnCode = handleMsg (pServer, pConnection, (UInt8 *) &(pSlot->msg), pSlot->msg.msgLength + SIZE_OF_MSG_LENGTH, pSlot->requestId);
+            wakeClient = doneWithMsgInRing (pToServer) || wakeClient;
+        }
+        else
+        {
+            isWaiting = !waitForMsgInRing (pToServer);
+        }
+    }
+
+    /* Let a client that found the ring full know there is room */
+    if (wakeClient)
+    {
+        eventfd_write (pConnection->toClientFd, 1);
+    }
+
+    /* If the client isn't taking its responses it will wake
+     * us up when it next puts a message in; if messages are
+     * with the worker threads we carry on when they're done */
+    if (!isWaiting && (pConnection->numJobsInFlight == 0))
+    {
+        waitForMsgInRing (pToServer);
+    }
+
+    return returnCode;
+}
+
+/*
+ * Receive the shared memory handed over by a shared
+ * memory client and start using it, telling the client
+ * so by sending back a single byte.
+ *
+ * pServer      the server.
+ * pConnection  the client connection.
+ *
+ * @return      true if successful (or if there was
+ *              nothing to receive yet), false if the
+ *              client should be disconnected.
+ */
+static Bool receiveSharedMemory (Server *pServer, ServerConnection *pConnection)
+{
+    Bool success = false;
+    UInt8 handshake;
+    SInt32 rawBytesReceived;
+    int fds[MESSAGING_SHARED_MEMORY_NUM_FDS];
+    UInt32 numFds = 0;
+    UInt32 x;
+    struct iovec ioVector;
+    struct msghdr msgHeader;
+    struct cmsghdr *pControlMsg;
+    union
+    {
+        struct cmsghdr header;
+        UInt8 buffer[CMSG_SPACE (sizeof (fds))];
+    } control;
+    struct stat status;
+    struct epoll_event event;
+    void *pSharedMemory = MAP_FAILED;
+
+    ioVector.iov_base = &handshake;
+    ioVector.iov_len = sizeof (handshake);
+    memset (&msgHeader, 0, sizeof (msgHeader));
+    msgHeader.msg_iov = &ioVector;
+    msgHeader.msg_iovlen = 1;
+    msgHeader.msg_control = control.buffer;
+    msgHeader.msg_controllen = sizeof (control.buffer);
+
+    rawBytesReceived = recvmsg (pConnection->socket, &msgHeader, MSG_CMSG_CLOEXEC);
+    if (rawBytesReceived > 0)
+    {
+        pControlMsg = CMSG_FIRSTHDR (&msgHeader);
+        if ((pControlMsg != PNULL) && (pControlMsg->cmsg_level == SOL_SOCKET) && (pControlMsg->cmsg_type == SCM_RIGHTS))
+        {
+            numFds = (pControlMsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+            memcpy (fds, CMSG_DATA (pControlMsg), numFds * sizeof (int));
+        }
+
+        if (numFds == MESSAGING_SHARED_MEMORY_NUM_FDS)
+        {
+            if ((fstat (fds[0], &status) == 0) && (status.st_size >= sizeof (MessagingSharedMemory)))
+            {
+                pSharedMemory = mmap (PNULL, sizeof (MessagingSharedMemory), PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+            }
+            close (fds[0]);
+            pConnection->toServerFd = fds[1];
+            pConnection->toClientFd = fds[2];
+
+            if ((pSharedMemory != MAP_FAILED) && setNonBlocking (pConnection->toServerFd))
+            {
+                pConnection->pSharedMemory = (MessagingSharedMemory *) pSharedMemory;
+
+                /* From now on messages arrive through the shared memory,
+                 * the socket is only watched for the client going */
+                memset (&event, 0, sizeof (event));
+                event.events = EPOLLRDHUP;
+                event.data.ptr = pConnection;
+                if ((epoll_ctl (pServer->epollFd, EPOLL_CTL_MOD, pConnection->socket, &event) >= 0) && (send (pConnection->socket, &handshake, sizeof (handshake), MSG_NOSIGNAL) == sizeof (handshake)))
+                {
+                    /* It's the eventfd that updateConnectionEvents() looks after now */
+                    pConnection->epollEvents = 0;
+                    success = true;
+                    printDebug ("Messaging Server %d: client on socket %d is using shared memory.\n", pServer->serverPort, pConnection->socket);
+                }
+            }
+            else
+            {
+                munmap (pSharedMemory, sizeof (MessagingSharedMemory));
+            }
+        }
+        else
+        {
+            for (x = 0; x < numFds; x++)
+            {
+                close (fds[x]);
+            }
+        }
+
+        if (!success)
+        {
+            fprintf (stderr, "Failed to set up shared memory for client on socket %ld, port %d, error: %s.\n", pConnection->socket, pServer->serverPort, strerror (errno));
+        }
+    }
+    else
+    {
+        if ((rawBytesReceived < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+        {
+            success = true;
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Handle an event on a shared memory client connection:
+ * take over the shared memory, if the client hasn't
+ * handed it over yet, or handle whatever messages the
+ * client has put in it.
+ *
+ * pServer         the server.
+ * pConnection     the client connection.
+ * epollEvents     the events that have occurred.
+ * pClientIsGone   set to true if the client has closed
+ *                 the connection or it has failed.
+ *
+ * @return         a return code.
+ */
+static ServerReturnCode serviceSharedMemoryConnection (Server *pServer, ServerConnection *pConnection, UInt32 epollEvents, Bool *pClientIsGone)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    eventfd_t count;
+
+    if (pConnection->pSharedMemory == PNULL)
+    {
+        *pClientIsGone = !receiveSharedMemory (pServer, pConnection);
+    }
+    else
+    {
+        /* Deal with any messages the client put in before it went */
+        eventfd_read (pConnection->toServerFd, &count);
+        returnCode = handleSharedMemoryMsgs (pServer, pConnection);
+        if (epollEvents & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+        {
+            *pClientIsGone = true;
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Handle an event on a client connection: send any
+ * queued response, receive whatever has arrived and
+ * handle any whole messages.
+ *
+ * pServer         the server.
+ * pConnection     the client connection.
+ * epollEvents     the events that have occurred.
+ * pClientIsGone   set to true if the client has closed
+ *                 the connection or it has failed.
+ *
+ * @return         a return code.
+ */
+static ServerReturnCode serviceConnection (Server *pServer, ServerConnection *pConnection, UInt32 epollEvents, Bool *pClientIsGone)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    SInt32 rawBytesReceived;
+
+    if (pConnection->txLength > 0)
+    {
+        *pClientIsGone = !flushConnection (pConnection, 0);
+    }
+    else
+    {
+        if ((epollEvents & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (pConnection->rxLength < sizeof (pConnection->rxBuffer)))
+        {
+            rawBytesReceived = recv (pConnection->socket, pConnection->rxBuffer + pConnection->rxLength, sizeof (pConnection->rxBuffer) - pConnection->rxLength, 0);
+            if (rawBytesReceived > 0)
+            {
+                pConnection->rxLength += rawBytesReceived;
+            }
+            else
+            {
+                if ((rawBytesReceived == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+                {
+                    /* The client has closed the connection (or it has failed), nothing more to do */
+                    *pClientIsGone = true;
+                    if (pConnection->rxLength > 0)
+                    {
+                        returnCode = SERVER_ERR_MESSAGE_FROM_CLIENT_INCOMPLETE_OR_TOO_LONG;
+                        fprintf (stderr, "Message from client incomplete (%d bytes received, %d bytes needed).\n", pConnection->rxLength, pConnection->rxBuffer[0] + SIZE_OF_MSG_LENGTH);
+                    }
+                }
+            }
+        }
+    }
+
+    /* Handle any whole messages, including those that were
+     * left waiting for a response to be sent */
+    if (!*pClientIsGone && (pConnection->txLength == 0))
+    {
+        if (pConnection->type == SERVER_SOCKET_LARGE_MSG_CLIENT)
+        {
+            returnCode = handleLargeMsgs (pServer, pConnection, pClientIsGone);
+        }
+        else
+        {
+            returnCode = handleReceivedMsgs (pServer, pConnection, pClientIsGone);
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Check that a datagram is one or more whole
+ * messages, back to back.
+ *
+ * pRawMsgs        the datagram.
+ * rawLength       its length.
+ *
+ * @return         the number of messages, 0 if it
+ *                 isn't whole messages.
+ */
+static UInt32 countMsgsInDatagram (const UInt8 *pRawMsgs, SInt32 rawLength)
+{
+    SInt32 offset = 0;
+    UInt32 numMsgs = 0;
+
+    while ((offset < rawLength) && (numMsgs <= MESSAGING_MAX_MSGS_PER_DATAGRAM))
+    {
+        offset += pRawMsgs[offset] + SIZE_OF_MSG_LENGTH;
+        numMsgs++;
+    }
+
+    if ((offset != rawLength) || (numMsgs > MESSAGING_MAX_MSGS_PER_DATAGRAM))
+    {
+        numMsgs = 0;
+    }
+
+    return numMsgs;
+}
+
+/*
+ * Handle the messages that have arrived as datagrams,
+ * each one passed to serverHandleMsg(), or to the worker
+ * threads, as if it had come on a connection with
+ * MESSAGING_NO_RESPONSE_REQUEST_ID, so any response is
+ * thrown away.  Only so many are taken at a time, so
+ * that a busy sender doesn't hold up other clients, and
+ * none while as many as are allowed are with the worker
+ * threads; the rest wait in the socket.  A datagram
+ * carrying several messages is handled as though they
+ * had arrived on a connection, so those that can't be
+ * handled yet wait in the receive buffer, and no more
+ * datagrams are taken until they have been.  A datagram
+ * that isn't whole messages is dropped.  An update of
+ * a topic that this server has subscribed to goes to the
+ * publication handler instead.
+ *
+ * pServer         the server.
+ * pConnection     the datagram socket.
+ *
+ * @return         a return code.
+ */
+static ServerReturnCode serviceDatagramSocket (Server *pServer, ServerConnection *pConnection)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    SInt32 rawBytesReceived = 0;
+    UInt32 numMsgs;
+    Bool clientIsGone = false;
+
+    for (numMsgs = 0; (returnCode == SERVER_SUCCESS_KEEP_RUNNING) && (rawBytesReceived >= 0) && (pConnection->rxLength == 0) &&
+                      (numMsgs < MESSAGING_MAX_REQUESTS_IN_FLIGHT) && connectionCanTakeMsg (pConnection); numMsgs++)
+    {
+        rawBytesReceived = recv (pConnection->socket, pConnection->rxBuffer, sizeof (pConnection->rxBuffer), MSG_DONTWAIT | MSG_TRUNC);
+        if ((rawBytesReceived >= SIZE_OF_MSG_LENGTH) && (rawBytesReceived == pConnection->rxBuffer[0] + SIZE_OF_MSG_LENGTH))
+        {
+            if (isPublication ((Msg *) pConnection->rxBuffer))
+            {
+                handlePublication ((Msg *) pConnection->rxBuffer);
+            }
+            else
+            {
+                returnCode = handleMsg (pServer, pConnection, pConnection->rxBuffer, (UInt16) rawBytesReceived, MESSAGING_NO_RESPONSE_REQUEST_ID);
+            }
+        }
+        else if ((rawBytesReceived > 0) && (rawBytesReceived <= (SInt32) sizeof (pConnection->rxBuffer)) &&
+                 (countMsgsInDatagram (pConnection->rxBuffer, rawBytesReceived) > 0))
+        {
+            pConnection->rxLength = (UInt16) rawBytesReceived;
+            returnCode = handleReceivedMsgs (pServer, pConnection, &clientIsGone);
+        }
+        else if (rawBytesReceived >= 0)
+        {
+            fprintf (stderr, "Datagram of %ld bytes on port %d isn't whole messages, dropped.\n", rawBytesReceived, pServer->serverPort);
+        }
+        else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        {
+            fprintf (stderr, "Failed to receive datagram on port %d, error: %s.\n", pServer->serverPort, strerror (errno));
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Tidy up after dealing with a client connection:
+ * close it if the client has gone or we've got into
+ * a muddle with it (the client can always reconnect),
+ * otherwise set the events to wait for on it.  A
+ * connection whose messages are with the worker threads
+ * is not closed until they have finished with them.
+ *
+ * pServer         the server.
+ * pConnection     the client connection.
+ * returnCode      the return code from dealing with it.
+ * clientIsGone    true if the connection has failed.
+ *
+ * @return         the return code to carry on with.
+ */
+static ServerReturnCode tidyConnection (Server *pServer, ServerConnection *pConnection, ServerReturnCode returnCode, Bool clientIsGone)
+{
+    if (!clientIsGone && (returnCode >= 0))
+    {
+        clientIsGone = !updateConnectionEvents (pServer, pConnection);
+    }
+
+    if (clientIsGone || (returnCode < 0))
+    {
+        if (pConnection->numJobsInFlight > 0)
+        {
+            pConnection->isGone = true;
+            updateConnectionEvents (pServer, pConnection);
+        }
+        else
+        {
+            closeServerConnection (pServer, pConnection);
+        }
+        if (returnCode < 0)
+        {
+            fprintf (stderr, "Messaging server on port %d dropped a client connection, returnCode %d.\n", pServer->serverPort, returnCode);
+            returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+        }
+    }
+
+    return returnCode;
+}
+
+/*
+ * Finish with a job whose message has been handled and
+ * whose response is ready: queue the response and carry
+ * on with whatever else has been received on the client
+ * connection.
+ *
+ * pServer  the server.
+ * pJob     the job.
+ *
+ * @return  a return code.
+ */
+static ServerReturnCode finishJob (Server *pServer, ServerJob *pJob)
+{
+    ServerReturnCode returnCode = pJob->returnCode;
+    ServerConnection *pConnection = pJob->pConnection;
+    Bool clientIsGone = pConnection->isGone;
+
+    pJob->inFlight = false;
+    pConnection->numJobsInFlight--;
+    recordJobStats (pJob);
+
+    if (!clientIsGone)
+    {
+        queueResponse (pConnection, pJob);
+        if (returnCode == SERVER_SUCCESS_KEEP_RUNNING)
+        {
+            if (pConnection->pSharedMemory != PNULL)
+            {
+                returnCode = handleSharedMemoryMsgs (pServer, pConnection);
+            }
+            else if (pConnection->type == SERVER_SOCKET_LARGE_MSG_CLIENT)
+            {
+                returnCode = handleLargeMsgs (pServer, pConnection, &clientIsGone);
+            }
+            else
+            {
+                returnCode = handleReceivedMsgs (pServer, pConnection, &clientIsGone);
+            }
+        }
+        else if (returnCode == SERVER_EXIT_NORMALLY)
+        {
+            flushConnection (pConnection, EXIT_SEND_TIMEOUT_MS);
+        }
+    }
+
+    if (pConnection->type == SERVER_SOCKET_POLL_FD)
+    {
+        /* A local message, see handleMessagingServerLocalMsg(),
+         * the file descriptor of which is never closed */
+        updateConnectionEvents (pServer, pConnection);
+    }
+    else
+    {
+        returnCode = tidyConnection (pServer, pConnection, returnCode, clientIsGone);
+    }
+
+    return returnCode;
+}
+
+/*
+ * Deal with the jobs the worker threads have done:
+ * finish with each one, unless its response has been
+ * deferred and is not yet complete.
+ *
+ * pServer  the server.
+ *
+ * @return  a return code.
+ */
+static ServerReturnCode handleDoneJobs (Server *pServer)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    ServerWorkers *pWorkers = pServer->pWorkers;
+    ServerJob *pJob;
+    ServerJob *pNextJob;
+    eventfd_t count;
+
+    eventfd_read (pWorkers->doneFd, &count);
+
+    pthread_mutex_lock (&(pWorkers->lock));
+    pJob = pWorkers->doneJobs.pFirst;
+    pWorkers->doneJobs.pFirst = PNULL;
+    pWorkers->doneJobs.pLast = PNULL;
+    pthread_mutex_unlock (&(pWorkers->lock));
+
+    while ((pJob != PNULL) && (returnCode == SERVER_SUCCESS_KEEP_RUNNING))
+    {
+        pNextJob = pJob->pNext;
+        pJob->isWithWorkers = false;
+        if (!pJob->isDeferred)
+        {
+            returnCode = finishJob (pServer, pJob);
+        }
+        pJob = pNextJob;
+    }
+
+    return returnCode;
+}
+
+/*
+ * Accept all the clients waiting to connect on
+ * a listening socket.
+ *
+ * pServer      the server.
+ * pListening   the listening socket.
+ *
+ * @return      a return code.
+ */
+static ServerReturnCode acceptClients (Server *pServer, ServerConnection *pListening)
+{
+    ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    SInt32 clientSocket;
+    ServerSocketType type = SERVER_SOCKET_CLIENT;
+    Bool done = false;
+
+    if (pListening->type == SERVER_SOCKET_SHARED_MEMORY_LISTENING)
+    {
+        type = SERVER_SOCKET_SHARED_MEMORY_CLIENT;
+    }
+    else if (pListening->type == SERVER_SOCKET_TAGGED_LISTENING)
+    {
+        type = SERVER_SOCKET_TAGGED_CLIENT;
+    }
+    else if (pListening->type == SERVER_SOCKET_LARGE_MSG_LISTENING)
+    {
+        type = SERVER_SOCKET_LARGE_MSG_CLIENT;
+    }
+
+    while (!done)
+    {
+        clientSocket = accept (pListening->socket, PNULL, PNULL);
+        if (clientSocket >= 0)
+        {
+            printDebug ("Messaging Server %d: a client connected on client socket %d.\n", pServer->serverPort, clientSocket);
+            if (!setNonBlocking (clientSocket) || (addServerConnection (pServer, clientSocket, type) == PNULL))
+            {
+                /* Can't deal with this one, the client will see the connection close */
+                fprintf (stderr, "Failed to set up client socket %ld on port %d, closing it.\n", clientSocket, pServer->serverPort);
+                close (clientSocket);
+            }
+        }
+        else
+        {
+            done = true;
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR) && (errno != ECONNABORTED) && (errno != EPROTO))
+            {
+                returnCode = SERVER_ERR_FAILED_TO_ACCEPT_CLIENT_CONNECTION;
+                fprintf (stderr, "Failed to accept client connection on socket %ld, port %d, error: %s.\n", pListening->socket, pServer->serverPort, strerror (errno));
+            }
+        }
+    }
+
+    return returnCode;
+}
 
 /*
- * EXTERN
+ * Write what has been counted for each type of message
+ * that has been handled to stderr, one line per type,
+ * with the times in microseconds.
+ *
+ * pServer  the server.
  */
+static void dumpStats (Server *pServer)
+{
+    MessagingMsgTypeStats stats;
+    Char unnamed[16];
+    Char *pName;
+    UInt32 x;
 
-extern int errno;
+    fprintf (stderr, "Messaging server on port %d, stats for each message type, times (wait, handle, respond) p50/p99/max in us:\n", pServer->serverPort);
+    for (x = 0; x < NUM_MSG_TYPES; x++)
+    {
+        if (gMsgTypeStats[x].count > 0)
+        {
+            getMsgTypeStats ((MsgType) x, &stats);
+            if ((x < gNumMsgNames) && (ppgMsgNames[x] != PNULL))
+            {
+                pName = ppgMsgNames[x];
+            }
+            else
+            {
+                snprintf (unnamed, sizeof (unnamed), "MSG_TYPE_%ld", x);
+                pName = unnamed;
+            }
+            fprintf (stderr, "%-45s count %ld, errors %ld, bytes in %ld, out %ld, wait %.1f/%.1f/%.1f, handle %.1f/%.1f/%.1f, respond %.1f/%.1f/%.1f\n",
+                     pName, stats.count, stats.numErrors, stats.numBytesIn, stats.numBytesOut,
+                     (double) stats.wait.p50Ns / 1000, (double) stats.wait.p99Ns / 1000, (double) stats.wait.maxNs / 1000,
+                     (double) stats.handle.p50Ns / 1000, (double) stats.handle.p99Ns / 1000, (double) stats.handle.maxNs / 1000,
+                     (double) stats.respond.p50Ns / 1000, (double) stats.respond.p99Ns / 1000, (double) stats.respond.maxNs / 1000);
+        }
+    }
+}
 
 /*
- * STATIC FUNCTIONS
+ * Handler for STATS_DUMP_SIGNAL: wake the server up
+ * to write out the stats, which can't be done from
+ * a signal handler.
+ *
+ * signalNumber  the signal.
  */
+static void statsDumpSignalHandler (int signalNumber)
+{
+    int savedErrno = errno;
+
+    if (gStatsDumpFd >= 0)
+    {
+        eventfd_write (gStatsDumpFd, 1);
+    }
+
+    errno = savedErrno;
+}
 
 /*
- * Handle the comms with the client. 
- * 
- * socket   the socket with which to communicate.
+ * Wait for something to happen on the listening sockets,
+ * on any of the client connections, from the worker
+ * threads or on the file descriptors added by the user
+ * of this library and deal with it.
  *
- * @return  a return code.
+ * pServer   the server.
+ *
+ * @return   a return code.
  */
-static ServerReturnCode handleSendReceive (UInt32 clientSocket)
+static ServerReturnCode serviceSockets (Server *pServer)
 {
     ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
-    Msg *pReceivedMsg;
-    MsgLength *pReceivedMsgLength = PNULL;
-    UInt16 rawReceivedLength = 0;
-  
-    pReceivedMsg = malloc (sizeof (Msg));
-    
-    if (pReceivedMsg != PNULL)
-    {
-        SInt16 rawBytesReceived;
-
-        /* Receive a message */
-        pReceivedMsgLength = &(pReceivedMsg->msgLength);
-        /* Set the received message length to max to begin with */
-        *pReceivedMsgLength = MAX_MSG_LENGTH;        
+    struct epoll_event events[MAX_NUM_EPOLL_EVENTS];
+    ServerConnection *pConnection;
+    Bool jobsAreDone = false;
+    SInt32 numEvents;
+    SInt32 x;
+    SInt32 y;
 
-        do
+    numEvents = epoll_wait (pServer->epollFd, events, MAX_NUM_EPOLL_EVENTS, -1);
+    if (numEvents >= 0)
+    {
+        /* A shared memory client is in the epoll set twice, its socket
+         * and its eventfd, so put the events for both together to
+         * deal with them in one go (it may be closed when they are) */
+        for (x = 0; x < numEvents; x++)
         {
-            rawBytesReceived = recv (clientSocket, pReceivedMsg, *pReceivedMsgLength + SIZE_OF_MSG_LENGTH, 0);
-            if (rawBytesReceived > 0)
+            for (y = x + 1; (events[x].data.ptr != PNULL) && (y < numEvents); y++)
             {
-                rawReceivedLength += rawBytesReceived;
+                if (events[y].data.ptr == events[x].data.ptr)
+                {
+                    events[x].events |= events[y].events;
+                    events[y].data.ptr = PNULL;
+                }
             }
         }
-        while ((rawReceivedLength != *pReceivedMsgLength + SIZE_OF_MSG_LENGTH) && (rawReceivedLength < MAX_MSG_LENGTH + SIZE_OF_MSG_LENGTH) && (rawBytesReceived >= 0) && *pReceivedMsgLength > 0);
-        
-        if (rawReceivedLength == *pReceivedMsgLength + SIZE_OF_MSG_LENGTH)
-        {
-            Msg *pSendMsg;
 
-            /* Create space for a message to send back */
-            pSendMsg = malloc (sizeof (Msg));
-            
-            if (pSendMsg != PNULL)
-            {
-                pSendMsg->msgLength = 0; /* Set the response message to zero length before calling the handler */
-                
-                /* Call the external function to handle the message and,
-                 * optionally, create a response */
-                returnCode = serverHandleMsg (pReceivedMsg, pSendMsg);
-                
-                /* Send the response if there is one */
-                if (((returnCode == SERVER_EXIT_NORMALLY) || (returnCode == SERVER_SUCCESS_KEEP_RUNNING)) && (pSendMsg->msgLength > 0))
+        for (x = 0; (x < numEvents) && (returnCode == SERVER_SUCCESS_KEEP_RUNNING); x++)
+        {
+            pConnection = (ServerConnection *) events[x].data.ptr;
+            if (pConnection != PNULL)
+            {
+                switch (pConnection->type)
                 {
-                    UInt16 rawSendLength;
-                    
-                    rawSendLength = pSendMsg->msgLength + SIZE_OF_MSG_LENGTH;
-                    ASSERT_PARAM (rawSendLength <= MAX_MSG_LENGTH, rawSendLength);
-                    
-                    if (send (clientSocket, pSendMsg, rawSendLength, 0) != rawSendLength)
+                    case SERVER_SOCKET_LISTENING:
+                    case SERVER_SOCKET_SHARED_MEMORY_LISTENING:
+                    case SERVER_SOCKET_TAGGED_LISTENING:
+                    case SERVER_SOCKET_LARGE_MSG_LISTENING:
+                    {
+                        returnCode = acceptClients (pServer, pConnection);
+                    }
+                    break;
+                    case SERVER_SOCKET_SHARED_MEMORY_CLIENT:
+                    {
+                        Bool clientIsGone = false;
+
+                        returnCode = serviceSharedMemoryConnection (pServer, pConnection, events[x].events, &clientIsGone);
+                        returnCode = tidyConnection (pServer, pConnection, returnCode, clientIsGone);
+                    }
+                    break;
+                    case SERVER_SOCKET_DATAGRAM:
+                    {
+                        /* Never closed, it only stops being read while it can't take any more */
+                        returnCode = serviceDatagramSocket (pServer, pConnection);
+                        updateConnectionEvents (pServer, pConnection);
+                    }
+                    break;
+                    case SERVER_SOCKET_JOBS_DONE:
                     {
-                        returnCode = SERVER_ERR_FAILED_TO_SEND_RESPONSE_TO_CLIENT;
-                        fprintf (stderr, "Failed to send response to client (%d bytes), error: %s.\n", rawSendLength, strerror (errno));
+                        /* Dealt with below */
+                        jobsAreDone = true;
                     }
+                    break;
+                    case SERVER_SOCKET_STATS_DUMP:
+                    {
+                        eventfd_t count;
+
+                        eventfd_read (pConnection->socket, &count);
+                        dumpStats (pServer);
+                    }
+                    break;
+                    case SERVER_SOCKET_POLL_FD:
+                    {
+                        /* Deferred responses may be completed in here, and
+                         * local messages handled; it stops being waited on
+                         * while it can't take any more local messages */
+                        pgPollConnection = pConnection;
+                        resumeDebug();
+                        pConnection->pPollHandler();
+                        suspendDebug();
+                        pgPollConnection = PNULL;
+                        updateConnectionEvents (pServer, pConnection);
+                        returnCode = pServer->completionReturnCode;
+                    }
+                    break;
+                    default:
+                    {
+                        Bool clientIsGone = false;
+
+                        returnCode = serviceConnection (pServer, pConnection, events[x].events, &clientIsGone);
+                        returnCode = tidyConnection (pServer, pConnection, returnCode, clientIsGone);
+                    }
+                    break;
                 }
-                
-                free (pSendMsg);
-            }
-            else
-            {
-                returnCode = SERVER_ERR_FAILED_TO_GET_MEMORY_FOR_RESPONSE;
-                fprintf (stderr, "Failed to get memory (%d bytes) for response.\n", sizeof (Msg));                    
             }
         }
-        else
+
+        /* Deal with the jobs done by the worker threads last as
+         * that may close client connections that have an event
+         * from this call of epoll_wait() */
+        if (jobsAreDone && (returnCode == SERVER_SUCCESS_KEEP_RUNNING))
         {
-            returnCode = SERVER_ERR_MESSAGE_FROM_CLIENT_INCOMPLETE_OR_TOO_LONG;
-            fprintf (stderr, "Message from client incomplete or too long (%d bytes received, %d bytes needed).\n", rawReceivedLength, *pReceivedMsgLength + SIZE_OF_MSG_LENGTH);        
+            returnCode = handleDoneJobs (pServer);
         }
-        
-        free (pReceivedMsg);
     }
     else
     {
-        returnCode = SERVER_ERR_FAILED_TO_GET_MEMORY_FOR_RECEPTION;
-        fprintf (stderr, "Failed to get memory (%d bytes) for reception.\n", sizeof (Msg));   
+        if (errno != EINTR)
+        {
+            returnCode = SERVER_ERR_GENERAL_FAILURE;
+            fprintf (stderr, "Failed to wait for events on port %d, error: %s.\n", pServer->serverPort, strerror (errno));
+        }
     }
 
     return returnCode;
 }
 
+/*
+ * Open a Unix domain socket that local clients use
+ * to reach this server, avoiding the TCP/IP stack.
+ * The socket is in the abstract namespace, so there is
+ * nothing to tidy up in the file system afterwards.
+ *
+ * serverPort    the port number of the server, used
+ *               to make the socket name.
+ * pNameFormat   the format of the socket name.
+ * socketType    SOCK_STREAM for a socket to listen on,
+ *               SOCK_DGRAM for one to receive datagrams on.
+ *
+ * @return       the socket or -1 if it could not be
+ *               opened, in which case local clients
+ *               will use TCP instead.
+ */
+static SInt32 openUnixServerSocket (UInt16 serverPort, const Char *pNameFormat, SInt32 socketType)
+{
+    SInt32 serverSocket;
+    SockAddrUn messagingServer;
+
+    serverSocket = socket (AF_UNIX, socketType | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (serverSocket >= 0)
+    {
+        memset (&messagingServer, 0, sizeof (messagingServer));
+        messagingServer.sun_family = AF_UNIX;
+        /* sun_path[0] is left as zero to put the name in the abstract namespace */
+        snprintf (&(messagingServer.sun_path[1]), sizeof (messagingServer.sun_path) - 1, pNameFormat, serverPort);
+
+        if ((bind (serverSocket, (SockAddr *) &messagingServer, sizeof (messagingServer)) >= 0) &&
+            ((socketType != SOCK_STREAM) || (listen (serverSocket, MAXPENDING) >= 0)))
+        {
+            printDebug ("Messaging Server %d: opened Unix domain socket %d (%s).\n", serverPort, serverSocket, pNameFormat);
+        }
+        else
+        {
+            fprintf (stderr, "Failed to open Unix domain socket for port %d (local clients will use TCP), error: %s.\n", serverPort, strerror (errno));
+            close (serverSocket);
+            serverSocket = -1;
+        }
+    }
+
+    return serverSocket;
+}
+
+/*
+ * If this process was launched with
+ * spawnMessagingServer(), tell the launcher that
+ * the server is ready to take messages.  Only the
+ * first server in the process does so.
+ *
+ * serverPort  the port number of the server.
+ */
+static void notifyMessagingServerReady (UInt16 serverPort)
+{
+    Char *pReadyFdString;
+    SInt32 readyFd;
+    UInt8 readyByte = true;
+
+    pReadyFdString = getenv (MESSAGING_SERVER_READY_FD_ENV);
+    if (pReadyFdString != PNULL)
+    {
+        readyFd = atoi (pReadyFdString);
+        unsetenv (MESSAGING_SERVER_READY_FD_ENV);
+        if (write (readyFd, &readyByte, sizeof (readyByte)) == sizeof (readyByte))
+        {
+            printDebug ("Messaging Server %d: told launcher it is ready on fd %ld.\n", serverPort, readyFd);
+        }
+        else
+        {
+            fprintf (stderr, "Messaging server on port %d couldn't say that it is ready on fd %ld, error: %s.\n", serverPort, readyFd, strerror (errno));
+        }
+        close (readyFd);
+    }
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
 
+/*
+ * Have messages handled on worker threads rather
+ * than on the thread that is running the server, so
+ * that a message which takes a long time to handle
+ * does not hold up the others.  Messages whose type
+ * is marked as concurrent in pMsgTypeIsConcurrent are
+ * handled by a pool of numWorkerThreads threads, at
+ * the same time as any other message, so serverHandleMsg()
+ * must be thread-safe for them.  All other messages
+ * are handled one at a time, in the order they arrive,
+ * by a thread of their own.  Must be called before
+ * runMessagingServer().
+ *
+ * numWorkerThreads      the number of threads for concurrent
+ *                       messages, 0 to switch worker threads
+ *                       off (the default), in which case all
+ *                       messages are handled on the server
+ *                       thread.
+ * pMsgTypeIsConcurrent  an array, indexed by message type,
+ *                       of true for the types that may be
+ *                       handled concurrently; may be PNULL,
+ *                       in which case no types are. The
+ *                       array must remain valid while the
+ *                       server is running.
+ * numMsgTypes           the number of entries in
+ *                       pMsgTypeIsConcurrent, message types
+ *                       beyond the end being handled one at
+ *                       a time.
+ */
+void setMessagingServerWorkerThreads (UInt32 numWorkerThreads, const Bool *pMsgTypeIsConcurrent, UInt32 numMsgTypes)
+{
+    gNumWorkerThreads = numWorkerThreads;
+    pgMsgTypeIsConcurrent = pMsgTypeIsConcurrent;
+    gNumMsgTypes = numMsgTypes;
+}
+
+/*
+ * Have messages whose bodies are too long for a Msg,
+ * which can arrive framed with a LargeMsgHeader, passed
+ * to pHandler, a piece at a time, on the server thread
+ * (worker threads or not).  Without a handler such
+ * messages are refused.  Messages framed that way
+ * whose bodies would fit in a Msg go to serverHandleMsg()
+ * as usual.  Must be called before runMessagingServer().
+ *
+ * pHandler  the function to call with each piece of
+ *           the body of a message.
+ */
+void setMessagingServerLargeMsgHandler (MessagingServerLargeMsgHandler pHandler)
+{
+    gpLargeMsgHandler = pHandler;
+    gLargeMsgHandlerIsSet = true;
+}
+
+/*
+ * Have the server watch a file descriptor of the caller's
+ * along with its sockets, calling pHandler on the server
+ * thread whenever it is readable (level-triggered, so the
+ * handler must read whatever made it so).  This is how a
+ * server drives things of its own, for instance requests
+ * to other servers started with
+ * startMessagingClientRequest(), from the same event loop
+ * that handles its messages, and so where it can complete
+ * responses it has deferred.  Must be called before
+ * runMessagingServer().
+ *
+ * fd        the file descriptor, which remains the
+ *           caller's to close after the server has
+ *           exited.
+ * pHandler  the function to call when fd is readable.
+ *
+ * @return   true if successful, false if fd isn't valid
+ *           or there are already
+ *           MESSAGING_SERVER_MAX_POLL_FDS.
+ */
+Bool addMessagingServerPollFd (SInt32 fd, MessagingServerPollHandler pHandler)
+{
+    Bool success = false;
+
+    if ((fd >= 0) && (gNumPollFds < MESSAGING_SERVER_MAX_POLL_FDS))
+    {
+        gPollFd[gNumPollFds] = fd;
+        gpPollHandler[gNumPollFds] = pHandler;
+        gNumPollFds++;
+        success = true;
+    }
+
+    return success;
+}
+
+/*
+ * Handle a message from within this process, for
+ * instance the expiry of a timer kept by the server
+ * itself, as though it had arrived in a datagram: it
+ * is passed to serverHandleMsg(), or to the worker
+ * threads, as for any other message of its type, and
+ * any response is thrown away.  May only be called
+ * from a MessagingServerPollHandler.  If as many
+ * messages as are allowed are with the worker threads
+ * the message isn't taken; the handler should keep it
+ * and leave its file descriptor readable, which isn't
+ * waited on again until the server can take more.
+ *
+ * pMsg     the message.
+ *
+ * @return  true if the message was taken, otherwise
+ *          false.
+ */
+Bool handleMessagingServerLocalMsg (Msg *pMsg)
+{
+    ServerConnection *pConnection = pgPollConnection;
+    ServerReturnCode returnCode;
+    Bool success = false;
+
+    ASSERT_PARAM (pConnection != PNULL, (unsigned long) pConnection);
+    ASSERT_PARAM (pMsg != PNULL, (unsigned long) pMsg);
+
+    suspendDebug();
+    if (connectionCanTakeMsg (pConnection))
+    {
+        returnCode = handleMsg (pConnection->pServer, pConnection, (UInt8 *) pMsg, pMsg->msgLength + SIZE_OF_MSG_LENGTH, MESSAGING_NO_RESPONSE_REQUEST_ID);
+        if (returnCode != SERVER_SUCCESS_KEEP_RUNNING)
+        {
+            pConnection->pServer->completionReturnCode = returnCode;
+        }
+        success = true;
+    }
+    resumeDebug();
+
+    return success;
+}
+
+/*
+ * Put off the response to the message that
+ * serverHandleMsg() is handling, for instance because
+ * it has to hear from another server first.  Must only
+ * be called from within serverHandleMsg(), which then
+ * leaves pSendMsg alone and returns as normal.  The
+ * response is given later, on the server thread, with
+ * completeMessagingServerResponse().  Until then the
+ * message counts as outstanding: a client that doesn't
+ * send request IDs gets no more of its messages
+ * handled, one that does can have up to
+ * MESSAGING_MAX_REQUESTS_IN_FLIGHT outstanding.
+ *
+ * @return  the deferred response, to be passed to
+ *          completeMessagingServerResponse().
+ */
+MessagingServerDeferredResponse deferMessagingServerResponse (void)
+{
+    ServerJob *pJob = gpCurrentJob;
+
+    ASSERT_PARAM (pJob != PNULL, (unsigned long) pJob);
+
+    pJob->isDeferred = true;
+
+    return pJob;
+}
+
+/*
+ * Give a response that was put off with
+ * deferMessagingServerResponse().  Must be called on
+ * the server thread from a handler added with
+ * addMessagingServerPollFd() (not from serverHandleMsg()).
+ * If the client has gone in the meantime the response
+ * is thrown away.
+ *
+ * deferredResponse  the deferred response.
+ * pSendMsg          the response; zero length if
+ *                   there isn't one after all.
+ */
+void completeMessagingServerResponse (MessagingServerDeferredResponse deferredResponse, Msg *pSendMsg)
+{
+    ServerJob *pJob = deferredResponse;
+    Server *pServer;
+    ServerReturnCode returnCode;
+
+    ASSERT_PARAM (pJob != PNULL, (unsigned long) pJob);
+    ASSERT_PARAM (pJob->isDeferred, pJob->requestId);
+    ASSERT_PARAM (pSendMsg != PNULL, (unsigned long) pSendMsg);
+
+    pServer = pJob->pConnection->pServer;
+
+    suspendDebug();
+    memcpy (&(pJob->sendMsg), pSendMsg, pSendMsg->msgLength + SIZE_OF_MSG_LENGTH);
+    pJob->isDeferred = false;
+
+    /* If it's still with the worker threads it is finished
+     * with when they hand it back, see handleDoneJobs() */
+    if (!pJob->isWithWorkers)
+    {
+        returnCode = finishJob (pServer, pJob);
+        if (returnCode != SERVER_SUCCESS_KEEP_RUNNING)
+        {
+            pServer->completionReturnCode = returnCode;
+        }
+    }
+    resumeDebug();
+}
+
+/*
+ * Give the names of the message types, for instance
+ * one of the pg*MessageNames[] tables, so that the
+ * stats written to stderr on STATS_DUMP_SIGNAL (SIGUSR1)
+ * can name them.  Message types without a name are
+ * given by number.  The message types must all be
+ * below MESSAGING_FIRST_RESERVED_MSG_TYPE.
+ *
+ * ppMsgNames   an array of names, indexed by message
+ *              type, which must remain valid while the
+ *              server is running.
+ * numMsgNames  the number of entries in ppMsgNames.
+ */
+void setMessagingServerMsgNames (Char **ppMsgNames, UInt32 numMsgNames)
+{
+    ASSERT_PARAM (numMsgNames <= MESSAGING_FIRST_RESERVED_MSG_TYPE, numMsgNames);
+
+    ppgMsgNames = ppMsgNames;
+    gNumMsgNames = numMsgNames;
+}
+
+/*
+ * Publish the value of a topic: store it and send it,
+ * as a datagram, to each server on this machine that
+ * has subscribed to the topic (see MessagingSubscribeReq)
+ * and is due an update.  An update that a subscriber
+ * isn't due yet, because it had one less than its
+ * minIntervalMs ago, is sent with a later publication
+ * of the topic, so topics should be published
+ * regularly, whether they have changed or not.  May be
+ * called from any thread, including from
+ * serverHandleMsg() on the worker threads, and
+ * never waits for a subscriber.
+ *
+ * topic       the topic, less than MESSAGING_MAX_NUM_TOPICS.
+ * pData       the value of the topic.
+ * dataLength  the length of the value, at most
+ *             MESSAGING_MAX_PUBLICATION_LENGTH.
+ */
+void publishMessagingServerTopic (MessagingTopic topic, const void *pData, UInt32 dataLength)
+{
+    PublishedTopic *pTopic;
+    Bool isChanged;
+    Bool isDue;
+    uint64_t nowNs;
+    uint64_t sinceLastSentNs;
+    UInt32 x;
+
+    ASSERT_PARAM (topic < MESSAGING_MAX_NUM_TOPICS, topic);
+    ASSERT_PARAM (dataLength <= MESSAGING_MAX_PUBLICATION_LENGTH, dataLength);
+    ASSERT_PARAM ((pData != PNULL) || (dataLength == 0), (unsigned long) pData);
+
+    suspendDebug();
+    pthread_mutex_lock (&gPublishLock);
+    pTopic = &(gPublishedTopic[topic]);
+    isChanged = !pTopic->isPublished || (pTopic->dataLength != dataLength) || (memcmp (pTopic->data, pData, dataLength) != 0);
+    if (isChanged)
+    {
+        memcpy (pTopic->data, pData, dataLength);
+        pTopic->dataLength = dataLength;
+        pTopic->isPublished = true;
+    }
+
+    nowNs = getMonotonicNs();
+    for (x = 0; x < MESSAGING_MAX_NUM_SUBSCRIPTIONS; x++)
+    {
+        if (gSubscription[x].isInUse && (gSubscription[x].topic == topic))
+        {
+            if (isChanged)
+            {
+                gSubscription[x].isPending = true;
+            }
+            sinceLastSentNs = nowNs - gSubscription[x].lastSentNs;
+            if (gSubscription[x].isPending)
+            {
+                isDue = (gSubscription[x].lastSentNs == 0) || (sinceLastSentNs >= (uint64_t) gSubscription[x].minIntervalMs * 1000000);
+            }
+            else
+            {
+                isDue = (gSubscription[x].maxIntervalMs > 0) && (sinceLastSentNs >= (uint64_t) gSubscription[x].maxIntervalMs * 1000000);
+            }
+            if (isDue)
+            {
+                sendPublication (&(gSubscription[x]), nowNs);
+            }
+        }
+    }
+    pthread_mutex_unlock (&gPublishLock);
+    resumeDebug();
+}
+
+/*
+ * Find out whether any server is subscribed to a
+ * topic, so that the work of finding out its value
+ * can be skipped if not.
+ *
+ * topic    the topic.
+ *
+ * @return  true if there is a subscriber to the topic.
+ */
+Bool isMessagingServerTopicSubscribed (MessagingTopic topic)
+{
+    Bool isSubscribed = false;
+    UInt32 x;
+
+    pthread_mutex_lock (&gPublishLock);
+    for (x = 0; x < MESSAGING_MAX_NUM_SUBSCRIPTIONS; x++)
+    {
+        if (gSubscription[x].isInUse && (gSubscription[x].topic == topic))
+        {
+            isSubscribed = true;
+        }
+    }
+    pthread_mutex_unlock (&gPublishLock);
+
+    return isSubscribed;
+}
+
+/*
+ * Set the function that is called with the updates
+ * of the topics that this server has subscribed to
+ * with subscribeMessagingServerTopic().  Without one
+ * they are dropped.  Must be called before
+ * runMessagingServer().
+ *
+ * pHandler  the handler.
+ */
+void setMessagingServerPublicationHandler (MessagingServerPublicationHandler pHandler)
+{
+    gpPublicationHandler = pHandler;
+    gPublicationHandlerIsSet = true;
+}
+
 /*
  * Entry point.  This function creates the messaging
  * server on port 'messagingServerPort' and listens for
  * connections.  When a connection is made it waits
- * for a message on that connection, passes it to
+ * for messages on that connection, passing each one to
  * the external handler 'messagingServerHandler()' for
- * treatment and then closes the connection once more.
+ * treatment.  Connections are kept open until the
+ * client closes them, so that a client can send many
+ * messages without the cost of connecting each time.
+ * As well as listening on the TCP port, the server
+ * listens on a Unix domain socket named after the port
+ * so that clients on the same machine can bypass the
+ * TCP/IP stack, on another through which they can
+ * hand over shared memory to carry their messages,
+ * bypassing sockets altogether, and on a third on which
+ * messages carry request IDs, so that a client can have
+ * several messages outstanding and the responses can
+ * come back out of order.  Messages that need no
+ * response can also be sent as datagrams, without a
+ * connection, to a fourth, and messages too long for
+ * a one byte length can be sent, framed with a
+ * LargeMsgHeader, on a fifth.  All sockets are non-blocking and are
+ * monitored with epoll, so any number of clients can be
+ * connected at once and a client that is slow to send
+ * a message, or to take the response, does not hold up
+ * the others.  Any file descriptors added with
+ * addMessagingServerPollFd() are monitored in the same
+ * way.  For each type of message the server counts
+ * the messages, failures and bytes and keeps histograms
+ * of how long the messages waited, were handled and
+ * took to be responded to; these are given to a client
+ * that sends a message of type MESSAGING_STATS_MSG_TYPE
+ * and written to stderr when the process gets SIGUSR1
+ * (the handler for which is only in place while the
+ * server is running).  The server also keeps the
+ * subscriptions of other servers to the topics that
+ * it publishes with publishMessagingServerTopic(),
+ * made with messages of type MESSAGING_SUBSCRIBE_MSG_TYPE,
+ * and passes the updates of the topics that it has
+ * subscribed to itself to its publication handler.
+ * When everything is listening, a server launched with
+ * spawnMessagingServer() says so to its launcher.
  * 
  * serverPort  the port number to use.
  * 
@@ -142,14 +2846,33 @@ ServerReturnCode runMessagingServer (UInt16 serverPort)
 {
     ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
     UInt32 serverSocketOptionValue = 1;
-    UInt32 serverSocket;
-    UInt32 clientSocket;
+    SInt32 serverSocket;
+    SInt32 unixServerSocket;
+    SInt32 sharedMemoryServerSocket;
+    SInt32 taggedServerSocket;
+    SInt32 datagramServerSocket;
+    SInt32 largeMsgServerSocket;
+    SInt32 statsDumpFd;
+    struct sigaction statsDumpAction;
+    struct sigaction oldStatsDumpAction;
+    Bool isDumpingStatsOnSignal = false;
     SockAddrIn messagingServer;
-    SockAddrIn messagingClient;
+    Server server;
+    ServerConnection *pConnection;
+    UInt32 x;
+
+    server.serverPort = serverPort;
+    server.pConnections = PNULL;
+    server.pWorkers = PNULL;
+    server.completionReturnCode = SERVER_SUCCESS_KEEP_RUNNING;
+
+    pthread_mutex_lock (&gPublishLock);
+    gPublisherPort = serverPort;
+    pthread_mutex_unlock (&gPublishLock);
 
     /* Create the TCP socket */
     suspendDebug(); /* Switch the detail off 'cos it gets annoying */
-    serverSocket = socket (PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    serverSocket = socket (PF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, IPPROTO_TCP);
     if (serverSocket >= 0)
     {
         printDebug ("Messaging Server %d: created socket %d.\n", serverPort, serverSocket);
@@ -173,31 +2896,122 @@ ServerReturnCode runMessagingServer (UInt16 serverPort)
                 if (listen (serverSocket, MAXPENDING) >= 0)
                 {
                     printDebug ("Messaging Server %d: listening on socket %d, maxpending %d.\n", serverPort, serverSocket, MAXPENDING);
-                    /* Run until error or exit */
-                    while (returnCode == SERVER_SUCCESS_KEEP_RUNNING)
+                    server.epollFd = epoll_create1 (EPOLL_CLOEXEC);
+                    if ((server.epollFd >= 0) && (addServerConnection (&server, serverSocket, SERVER_SOCKET_LISTENING) != PNULL))
                     {
-                        socklen_t clientLength = sizeof (messagingClient);
-                          
-                        /* Wait for a client to connect */
-                        if ((clientSocket = accept (serverSocket, (SockAddr *) &messagingClient, &clientLength)) >= 0)
-                        {
-                            printDebug ("Messaging Server %d: a client connected on client socket %d.\n", serverPort, clientSocket);
-                            /* fprintf (stdout, "Client connected: %s\n", inet_ntoa (messagingClient.sin_addr)); */
-                            
-                            /* Exchange messages */
-                            resumeDebug();
-                            returnCode = handleSendReceive (clientSocket);
-                            suspendDebug();
-                            
-                            /* Close the socket again */
-                            close (clientSocket);                    
-                            printDebug ("Messaging Server %d: closed client socket %d.\n", serverPort, clientSocket);
-                        }
-                        else
-                        {
-                            returnCode = SERVER_ERR_FAILED_TO_ACCEPT_CLIENT_CONNECTION;
-                            fprintf (stderr, "Failed to accept client connection on socket %ld, port %d, error: %s.\n", serverSocket, serverPort, strerror (errno));
+                        unixServerSocket = openUnixServerSocket (serverPort, MESSAGING_UNIX_SOCKET_NAME_FORMAT, SOCK_STREAM);
+                        if ((unixServerSocket >= 0) && (addServerConnection (&server, unixServerSocket, SERVER_SOCKET_LISTENING) == PNULL))
+                        {
+                            close (unixServerSocket);
+                        }
+                        sharedMemoryServerSocket = openUnixServerSocket (serverPort, MESSAGING_SHARED_MEMORY_SOCKET_NAME_FORMAT, SOCK_STREAM);
+                        if ((sharedMemoryServerSocket >= 0) && (addServerConnection (&server, sharedMemoryServerSocket, SERVER_SOCKET_SHARED_MEMORY_LISTENING) == PNULL))
+                        {
+                            close (sharedMemoryServerSocket);
+                        }
+                        taggedServerSocket = openUnixServerSocket (serverPort, MESSAGING_TAGGED_SOCKET_NAME_FORMAT, SOCK_STREAM);
+                        if ((taggedServerSocket >= 0) && (addServerConnection (&server, taggedServerSocket, SERVER_SOCKET_TAGGED_LISTENING) == PNULL))
+                        {
+                            close (taggedServerSocket);
+                        }
+                        datagramServerSocket = openUnixServerSocket (serverPort, MESSAGING_DATAGRAM_SOCKET_NAME_FORMAT, SOCK_DGRAM);
+                        if ((datagramServerSocket >= 0) && (addServerConnection (&server, datagramServerSocket, SERVER_SOCKET_DATAGRAM) == PNULL))
+                        {
+                            close (datagramServerSocket);
+                        }
+                        largeMsgServerSocket = openUnixServerSocket (serverPort, MESSAGING_LARGE_MSG_SOCKET_NAME_FORMAT, SOCK_STREAM);
+                        if ((largeMsgServerSocket >= 0) && (addServerConnection (&server, largeMsgServerSocket, SERVER_SOCKET_LARGE_MSG_LISTENING) == PNULL))
+                        {
+                            close (largeMsgServerSocket);
+                        }
+                        for (x = 0; (x < gNumPollFds) && (returnCode == SERVER_SUCCESS_KEEP_RUNNING); x++)
+                        {
+                            pConnection = addServerConnection (&server, gPollFd[x], SERVER_SOCKET_POLL_FD);
+                            if (pConnection != PNULL)
+                            {
+                                pConnection->pPollHandler = gpPollHandler[x];
+                            }
+                            else
+                            {
+                                returnCode = SERVER_ERR_GENERAL_FAILURE;
+                            }
+                        }
+
+                        statsDumpFd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+                        if ((statsDumpFd >= 0) && (addServerConnection (&server, statsDumpFd, SERVER_SOCKET_STATS_DUMP) != PNULL))
+                        {
+                            gStatsDumpFd = statsDumpFd;
+                            memset (&statsDumpAction, 0, sizeof (statsDumpAction));
+                            statsDumpAction.sa_handler = statsDumpSignalHandler;
+                            sigemptyset (&statsDumpAction.sa_mask);
+                            statsDumpAction.sa_flags = SA_RESTART;
+                            isDumpingStatsOnSignal = (sigaction (STATS_DUMP_SIGNAL, &statsDumpAction, &oldStatsDumpAction) == 0);
+                        }
+                        else if (statsDumpFd >= 0)
+                        {
+                            close (statsDumpFd);
+                        }
+                        if (!isDumpingStatsOnSignal)
+                        {
+                            fprintf (stderr, "Messaging server on port %d won't write out stats on SIGUSR1, error: %s.\n", serverPort, strerror (errno));
+                        }
+
+                        if (gNumWorkerThreads > 0)
+                        {
+                            server.pWorkers = startWorkers (&server);
+                            if (server.pWorkers == PNULL)
+                            {
+                                returnCode = SERVER_ERR_GENERAL_FAILURE;
+                            }
+                        }
+
+                        /* Everything is listening: let whoever launched us know */
+                        if (returnCode == SERVER_SUCCESS_KEEP_RUNNING)
+                        {
+                            notifyMessagingServerReady (serverPort);
+                        }
+
+                        /* Run until error or exit */
+                        while (returnCode == SERVER_SUCCESS_KEEP_RUNNING)
+                        {
+                            returnCode = serviceSockets (&server);
+                        }
+
+                        /* Let the worker threads finish what they're doing,
+                         * then close everything, including the listening sockets */
+                        if (server.pWorkers != PNULL)
+                        {
+                            stopWorkers (server.pWorkers);
+                        }
+                        if (isDumpingStatsOnSignal)
+                        {
+                            sigaction (STATS_DUMP_SIGNAL, &oldStatsDumpAction, PNULL);
+                        }
+                        gStatsDumpFd = -1;
+                        /* Subscriptions don't outlive the server */
+                        pthread_mutex_lock (&gPublishLock);
+                        memset (gSubscription, 0, sizeof (gSubscription));
+                        if (gPublishSocket >= 0)
+                        {
+                            close (gPublishSocket);
+                            gPublishSocket = -1;
+                        }
+                        pthread_mutex_unlock (&gPublishLock);
+                        while (server.pConnections != PNULL)
+                        {
+                            closeServerConnection (&server, server.pConnections);
                         }
+                        serverSocket = -1;
+                    }
+                    else
+                    {
+                        returnCode = SERVER_ERR_GENERAL_FAILURE;
+                        fprintf (stderr, "Failed to set up epoll on port %d, error: %s.\n", serverPort, strerror (errno));
+                    }
+
+                    if (server.epollFd >= 0)
+                    {
+                        close (server.epollFd);
                     }
                 }
                 else
@@ -217,6 +3031,11 @@ ServerReturnCode runMessagingServer (UInt16 serverPort)
             returnCode = SERVER_ERR_FAILED_TO_SET_SOCKET_OPTIONS;
             fprintf (stderr, "Failed to set socket %ld options, error: %s.\n", serverSocket, strerror (errno));            
         }
+
+        if (serverSocket >= 0)
+        {
+            close (serverSocket);
+        }
     }
     else
     {
@@ -226,4 +3045,4 @@ ServerReturnCode runMessagingServer (UInt16 serverPort)
     resumeDebug();
     
     return returnCode;
-}
\ No newline at end of file
+}
@@ -0,0 +1,198 @@
+/*
+ * messaging_spawn.c
+ * Launching the executables that run messaging servers
+ * and waiting for them to be ready to take messages,
+ * kept apart from the server itself so that a program
+ * which runs no server of its own can use them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <rob_system.h>
+#include <messaging_server.h>
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Launch an executable that runs a messaging server,
+ * giving it the port number as its only argument,
+ * along with the write end of a pipe on which the
+ * server says when it is ready to take messages (see
+ * MESSAGING_SERVER_READY_FD_ENV), so that the caller
+ * can wait for exactly that long with
+ * waitMessagingServersReady() rather than guessing.
+ *
+ * pExe         the executable to launch.
+ * pPortString  the port number for the server, as a
+ *              string.
+ * pReadyFd     a place to put the read end of the pipe,
+ *              to be given to waitMessagingServersReady();
+ *              -1 if the launch fails.
+ *
+ * @return      the process ID of the server or -1 if it
+ *              could not be launched.
+ */
+SInt32 spawnMessagingServer (Char *pExe, Char *pPortString, SInt32 *pReadyFd)
+{
+    SInt32 pid = -1;
+    int readyPipe[2];
+    Char readyFdString[16];
+    Char *argv[3];
+
+    ASSERT_PARAM (pExe != PNULL, (unsigned long) pExe);
+    ASSERT_PARAM (pPortString != PNULL, (unsigned long) pPortString);
+    ASSERT_PARAM (pReadyFd != PNULL, (unsigned long) pReadyFd);
+
+    *pReadyFd = -1;
+
+    /* Neither end is inherited by anything else that is launched */
+    if ((pipe (readyPipe) == 0) && (fcntl (readyPipe[0], F_SETFD, FD_CLOEXEC) == 0) && (fcntl (readyPipe[1], F_SETFD, FD_CLOEXEC) == 0))
+    {
+        argv[0] = pExe;
+        argv[1] = pPortString;
+        argv[2] = PNULL;
+        snprintf (readyFdString, sizeof (readyFdString), "%d", readyPipe[1]);
+
+        pid = fork();
+        if (pid == 0)
+        {
+            /* Child: keep the write end of the pipe for the server and tell it which it is */
+            close (readyPipe[0]);
+            if ((fcntl (readyPipe[1], F_SETFD, 0) == 0) && (setenv (MESSAGING_SERVER_READY_FD_ENV, readyFdString, true) == 0))
+            {
+                execv (pExe, argv);
+            }
+            fprintf (stderr, "Couldn't launch %s, error: %s.\n", pExe, strerror (errno));
+            _exit (EXIT_FAILURE);
+        }
+
+        close (readyPipe[1]);
+        if (pid > 0)
+        {
+            *pReadyFd = readyPipe[0];
+        }
+        else
+        {
+            fprintf (stderr, "Couldn't fork to launch %s, error: %s.\n", pExe, strerror (errno));
+            close (readyPipe[0]);
+        }
+    }
+    else
+    {
+        fprintf (stderr, "Couldn't make a pipe to launch %s, error: %s.\n", pExe, strerror (errno));
+    }
+
+    return pid;
+}
+
+/*
+ * Wait for servers launched with spawnMessagingServer()
+ * to be ready to take messages, all at once, so that
+ * they start up in parallel and the wait is as long as
+ * the slowest of them rather than the sum of them all.
+ * A server that exits before it is ready is noticed
+ * straight away.  The file descriptors are closed.
+ *
+ * pReadyFds    the read ends of the pipes given by
+ *              spawnMessagingServer().
+ * numReadyFds  the number of entries at pReadyFds.
+ * timeoutMs    the longest to wait for them all.
+ *
+ * @return      true if all of the servers are ready,
+ *              otherwise false.
+ */
+Bool waitMessagingServersReady (SInt32 *pReadyFds, UInt32 numReadyFds, UInt32 timeoutMs)
+{
+    Bool success = true;
+    struct pollfd *pPollFds;
+    struct timespec startTime;
+    struct timespec timeNow;
+    SInt32 remainingMs;
+    UInt32 numWaiting = numReadyFds;
+    UInt8 readyByte;
+    UInt32 x;
+
+    ASSERT_PARAM ((pReadyFds != PNULL) || (numReadyFds == 0), (unsigned long) pReadyFds);
+
+    pPollFds = malloc (sizeof (*pPollFds) * (numReadyFds + 1)); /* + 1 so that it is never zero */
+    if (pPollFds != PNULL)
+    {
+        for (x = 0; x < numReadyFds; x++)
+        {
+            pPollFds[x].fd = pReadyFds[x];
+            pPollFds[x].events = POLLIN;
+            pPollFds[x].revents = 0;
+            if (pReadyFds[x] < 0)
+            {
+                success = false;
+                numWaiting--;
+            }
+        }
+
+        clock_gettime (CLOCK_MONOTONIC, &startTime);
+        while (success && (numWaiting > 0))
+        {
+            clock_gettime (CLOCK_MONOTONIC, &timeNow);
+            remainingMs = (SInt32) timeoutMs - (SInt32) ((timeNow.tv_sec - startTime.tv_sec) * 1000 + (timeNow.tv_nsec - startTime.tv_nsec) / 1000000);
+            if (remainingMs <= 0)
+            {
+                success = false;
+                fprintf (stderr, "Timed out after %ld ms waiting for %ld server(s) to be ready.\n", timeoutMs, numWaiting);
+            }
+            else if (poll (pPollFds, numReadyFds, remainingMs) < 0)
+            {
+                if (errno != EINTR)
+                {
+                    success = false;
+                    fprintf (stderr, "Failed to wait for servers to be ready, error: %s.\n", strerror (errno));
+                }
+            }
+            else
+            {
+                for (x = 0; x < numReadyFds; x++)
+                {
+                    /* A negative fd is ignored by poll() */
+                    if ((pPollFds[x].fd >= 0) && (pPollFds[x].revents != 0))
+                    {
+                        if (read (pPollFds[x].fd, &readyByte, sizeof (readyByte)) != sizeof (readyByte))
+                        {
+                            /* The end of the pipe: the server went without being ready */
+                            success = false;
+                            fprintf (stderr, "A server exited before it was ready.\n");
+                        }
+                        close (pPollFds[x].fd);
+                        pPollFds[x].fd = -1;
+                        pReadyFds[x] = -1;
+                        numWaiting--;
+                    }
+                }
+            }
+        }
+
+        free (pPollFds);
+    }
+    else
+    {
+        success = false;
+    }
+
+    /* Tidy up any that didn't get as far */
+    for (x = 0; x < numReadyFds; x++)
+    {
+        if (pReadyFds[x] >= 0)
+        {
+            close (pReadyFds[x]);
+            pReadyFds[x] = -1;
+        }
+    }
+
+    return success;
+}
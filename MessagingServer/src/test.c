@@ -3,7 +3,26 @@
  * Stubs for messagingserver for testing.  Sending
  * in a zero length message will cause the server
  * to exit, otherwise messages will be echoed back
- * to the client.
+ * to the client.  Messages of type TEST_SLOW_MSG_TYPE
+ * are echoed back after a delay.  If "workers" is given
+ * after the port number the messages are handled on
+ * worker threads, all but TEST_SLOW_MSG_TYPE (and the
+ * zero length message) concurrently.  A message of type
+ * TEST_MALLOC_COUNT_MSG_TYPE with no body gets back the
+ * number of times that the server has called malloc().
+ * The response to a message of type TEST_DEFERRED_MSG_TYPE
+ * is deferred and given from the server's event loop
+ * after a delay.  Messages of type TEST_COUNTED_MSG_TYPE
+ * with a body are counted; one with no body gets back
+ * the count.  Messages too long for a Msg have their
+ * bodies checked, a piece at a time, against the
+ * pattern the test client sends and get back a long
+ * response with a pattern of its own.  A message of type
+ * TEST_PUBLISHED_MSG_TYPE with a topic and a four byte value
+ * publishes the value; the server passes the updates of the
+ * topics it subscribes to (to its own, in the test) to a
+ * handler which counts them, and one with just a topic gets
+ * back the count and the last value received.
  */
 
 #include <stdio.h>
@@ -12,18 +31,253 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/timerfd.h>
 #include <netinet/in.h>
 #include <rob_system.h>
 #include <messaging_server.h>
 
+/*
+ * MANIFEST CONSTANTS
+ */
+
+/* The message type that is echoed back slowly and how slowly */
+#define TEST_SLOW_MSG_TYPE 0x80
+#define TEST_SLOW_MSG_DELAY_US 500000L
+
+/* The message type that, sent with no body, is responded
+ * to with the number of calls the server has made to malloc() */
+#define TEST_MALLOC_COUNT_MSG_TYPE 0x81
+
+/* The message type whose response is deferred and how long for */
+#define TEST_DEFERRED_MSG_TYPE 0x82
+#define TEST_DEFERRED_MSG_DELAY_US 100000L
+
+/* The message type that, sent with a body, is counted and,
+ * sent with no body, is responded to with the count */
+#define TEST_COUNTED_MSG_TYPE 0x83
+
+/* The message type that publishes a topic, or asks what has
+ * been received of it */
+#define TEST_PUBLISHED_MSG_TYPE 0x86
+
+/* The response to a message too long for a Msg has the same
+ * length, up to this, and the same type if the body was right,
+ * otherwise TEST_LARGE_MSG_BAD_TYPE */
+#define TEST_MAX_LARGE_RESPONSE_LENGTH 100000
+#define TEST_LARGE_MSG_BAD_TYPE 0
+
+/* The byte at a given offset in the body of a message too long
+ * for a Msg, and in the response to it (see MessagingClient/src/test.c) */
+#define TEST_LARGE_MSG_BYTE(oFFSET) ((UInt8) ((oFFSET) * 13))
+#define TEST_LARGE_RESPONSE_BYTE(oFFSET) ((UInt8) ((oFFSET) * 7))
+
+/* The most responses that can be deferred at once, any
+ * more are responded to straight away */
+#define TEST_MAX_NUM_DEFERRED_MSGS 32
+
+/* The number of possible message types */
+#define NUM_MSG_TYPES (1 << (sizeof (MsgType) * 8))
+
+/* The number of worker threads for concurrent messages */
+#define NUM_WORKER_THREADS 4
+
+/*
+ * EXTERN
+ */
+
+extern void *__real_malloc (size_t size);
+
+/*
+ * TYPES
+ */
+
+/* A response that has been deferred */
+typedef struct TestDeferredMsgTag
+{
+    MessagingServerDeferredResponse deferredResponse;
+    Msg sendMsg;
+} TestDeferredMsg;
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+/* Which message types may be handled concurrently */
+static Bool gMsgTypeIsConcurrent[NUM_MSG_TYPES];
+/* The number of calls to malloc() */
+static UInt32 gMallocCount = 0;
+/* The number of TEST_COUNTED_MSG_TYPE messages with a body */
+static UInt32 gNumCountedMsgs = 0;
+/* The responses that have been deferred, the timer that goes
+ * off when they are due and a mutex to protect them, since
+ * they are deferred by the worker threads */
+static TestDeferredMsg gDeferredMsg[TEST_MAX_NUM_DEFERRED_MSGS];
+static UInt32 gNumDeferredMsgs = 0;
+static SInt32 gDeferredMsgTimerFd = -1;
+static pthread_mutex_t gDeferredMsgLock = PTHREAD_MUTEX_INITIALIZER;
+/* Whether the body of the message too long for a Msg that is
+ * being received is right so far, and the response to it */
+static Bool gLargeMsgIsRight;
+static UInt8 gLargeResponseBody[TEST_MAX_LARGE_RESPONSE_LENGTH];
+/* The number of updates received of each topic subscribed
+ * to and the last value of each, protected by a mutex since
+ * they are asked for by the worker threads */
+static UInt32 gNumPublications[MESSAGING_MAX_NUM_TOPICS];
+static UInt32 gLastPublication[MESSAGING_MAX_NUM_TOPICS];
+static pthread_mutex_t gPublicationLock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * STATIC FUNCTIONS
  */
 
+/*
+ * Called from the server's event loop when the
+ * deferred response timer goes off: give all of
+ * the deferred responses.  They are copied out
+ * first since giving them may cause more messages
+ * to be handled, and so deferred.
+ */
+static void deferredMsgTimerHandler (void)
+{
+    TestDeferredMsg deferredMsg[TEST_MAX_NUM_DEFERRED_MSGS];
+    UInt32 numDeferredMsgs;
+    uint64_t expirations;
+    UInt32 x;
+
+    read (gDeferredMsgTimerFd, &expirations, sizeof (expirations));
+
+    pthread_mutex_lock (&gDeferredMsgLock);
+    numDeferredMsgs = gNumDeferredMsgs;
+    memcpy (deferredMsg, gDeferredMsg, sizeof (deferredMsg[0]) * numDeferredMsgs);
+    gNumDeferredMsgs = 0;
+    pthread_mutex_unlock (&gDeferredMsgLock);
+
+    for (x = 0; x < numDeferredMsgs; x++)
+    {
+        completeMessagingServerResponse (deferredMsg[x].deferredResponse, &(deferredMsg[x].sendMsg));
+    }
+}
+
+/*
+ * Defer the response to a message, starting the
+ * deferred response timer if it isn't running.
+ *
+ * pSendMsg  the response to give later.
+ *
+ * @return   true if the response was deferred, false
+ *           if there are too many deferred already.
+ */
+static Bool deferResponse (Msg *pSendMsg)
+{
+    Bool success = false;
+    struct itimerspec timerValue;
+
+    pthread_mutex_lock (&gDeferredMsgLock);
+    if (gNumDeferredMsgs < TEST_MAX_NUM_DEFERRED_MSGS)
+    {
+        gDeferredMsg[gNumDeferredMsgs].deferredResponse = deferMessagingServerResponse();
+        memcpy (&(gDeferredMsg[gNumDeferredMsgs].sendMsg), pSendMsg, pSendMsg->msgLength + SIZE_OF_MSG_LENGTH);
+        if (gNumDeferredMsgs == 0)
+        {
+            memset (&timerValue, 0, sizeof (timerValue));
+            timerValue.it_value.tv_nsec = TEST_DEFERRED_MSG_DELAY_US * 1000;
+            timerfd_settime (gDeferredMsgTimerFd, 0, &timerValue, PNULL);
+        }
+        gNumDeferredMsgs++;
+        success = true;
+    }
+    pthread_mutex_unlock (&gDeferredMsgLock);
+
+    return success;
+}
+
+/*
+ * Called with each piece of the body of a message
+ * too long for a Msg: check it and, at the end,
+ * respond.
+ *
+ * msgType      the type of the message.
+ * bodyLength   the length of the whole body.
+ * offset       where this piece is in the body.
+ * pChunk       the piece.
+ * chunkLength  the length of the piece.
+ * pResponse    where to put the response.
+ *
+ * @return      server return code.
+ */
+static ServerReturnCode largeMsgHandler (MsgType msgType, UInt32 bodyLength, UInt32 offset, const UInt8 *pChunk, UInt32 chunkLength, MessagingServerLargeResponse *pResponse)
+{
+    UInt32 x;
+
+    if (offset == 0)
+    {
+        gLargeMsgIsRight = true;
+    }
+    for (x = 0; x < chunkLength; x++)
+    {
+        if (pChunk[x] != TEST_LARGE_MSG_BYTE (offset + x))
+        {
+            gLargeMsgIsRight = false;
+        }
+    }
+
+    if (offset + chunkLength == bodyLength)
+    {
+        pResponse->isToBeSent = true;
+        pResponse->msgType = gLargeMsgIsRight ? msgType : TEST_LARGE_MSG_BAD_TYPE;
+        pResponse->pBody = gLargeResponseBody;
+        pResponse->bodyLength = bodyLength;
+        if (pResponse->bodyLength > sizeof (gLargeResponseBody))
+        {
+            pResponse->bodyLength = sizeof (gLargeResponseBody);
+        }
+    }
+
+    return SERVER_SUCCESS_KEEP_RUNNING;
+}
+
+/*
+ * Called with each update of a topic subscribed to:
+ * count it and keep its value.
+ *
+ * publisherPort  the port of the server that sent it.
+ * topic          the topic.
+ * pData          the value.
+ * dataLength     the length of the value.
+ */
+static void publicationHandler (UInt16 publisherPort, MessagingTopic topic, const UInt8 *pData, UInt32 dataLength)
+{
+    pthread_mutex_lock (&gPublicationLock);
+    gNumPublications[topic]++;
+    if (dataLength == sizeof (gLastPublication[topic]))
+    {
+        memcpy (&(gLastPublication[topic]), pData, dataLength);
+    }
+    pthread_mutex_unlock (&gPublicationLock);
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
 
+/*
+ * Count the calls to malloc(): the test server
+ * is linked with --wrap=malloc so that they all
+ * come here.
+ *
+ * size   the number of bytes to allocate.
+ *
+ * @return  pointer to the allocated memory.
+ */
+void *__wrap_malloc (size_t size)
+{
+    __atomic_add_fetch (&gMallocCount, 1, __ATOMIC_RELAXED);
+
+    return __real_malloc (size);
+}
+
 /*
  * Entry point - start the messaging server,
  * listening on a socket.
@@ -32,16 +286,45 @@ int main (int argc, char **argv)
 {
     ServerReturnCode returnCode = SERVER_ERR_GENERAL_FAILURE;
     UInt16 serverPort;
+    UInt32 x;
 
     setDebugPrintsOn();
     setProgressPrintsOn();
 
-    if (argc == 2)
+    if ((argc == 2) || ((argc == 3) && (strcmp (argv[2], "workers") == 0)))
     {
         serverPort = atoi (argv[1]);
         printProgress ("Messaging server listening on port %d.\n", serverPort);
 
+        if (argc == 3)
+        {
+            for (x = 0; x < NUM_MSG_TYPES; x++)
+            {
+                gMsgTypeIsConcurrent[x] = (x != TEST_SLOW_MSG_TYPE) && (x != TEST_DEFERRED_MSG_TYPE);
+            }
+            setMessagingServerWorkerThreads (NUM_WORKER_THREADS, gMsgTypeIsConcurrent, NUM_MSG_TYPES);
+            printProgress ("Messaging server using %d worker threads.\n", NUM_WORKER_THREADS);
+        }
+
+        for (x = 0; x < sizeof (gLargeResponseBody); x++)
+        {
+            gLargeResponseBody[x] = TEST_LARGE_RESPONSE_BYTE (x);
+        }
+        setMessagingServerLargeMsgHandler (largeMsgHandler);
+        setMessagingServerPublicationHandler (publicationHandler);
+
+        gDeferredMsgTimerFd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (gDeferredMsgTimerFd >= 0)
+        {
+            addMessagingServerPollFd (gDeferredMsgTimerFd, deferredMsgTimerHandler);
+        }
+
         returnCode = runMessagingServer (serverPort);
+
+        if (gDeferredMsgTimerFd >= 0)
+        {
+            close (gDeferredMsgTimerFd);
+        }
         
         if (returnCode == SERVER_EXIT_NORMALLY)
         {
@@ -54,7 +337,7 @@ int main (int argc, char **argv)
     }    
     else
     {
-        printProgress ("Usage: %s portnumber\ne.g. %s 5000\n", argv[0], argv[0]);
+        printProgress ("Usage: %s portnumber [workers]\ne.g. %s 5000\n", argv[0], argv[0]);
     }
     
     return returnCode;
@@ -75,6 +358,7 @@ int main (int argc, char **argv)
 ServerReturnCode serverHandleMsg (Msg *pReceivedMsg, Msg *pSendMsg)
 {
     ServerReturnCode returnCode = SERVER_SUCCESS_KEEP_RUNNING;
+    UInt32 count;
     
     ASSERT_PARAM (pReceivedMsg != PNULL, (unsigned long) pReceivedMsg);
     ASSERT_PARAM (pSendMsg != PNULL, (unsigned long) pSendMsg);
@@ -86,9 +370,60 @@ ServerReturnCode serverHandleMsg (Msg *pReceivedMsg, Msg *pSendMsg)
         printProgress ("Message from clent was too large.\n");
     }
         
+    /* Take our time over slow messages */
+    if ((pReceivedMsg->msgLength >= SIZE_OF_MSG_TYPE) && (pReceivedMsg->msgType == TEST_SLOW_MSG_TYPE))
+    {
+        usleep (TEST_SLOW_MSG_DELAY_US);
+    }
+
     /* Now echo the received message back as a response */
     memcpy (pSendMsg, pReceivedMsg, pReceivedMsg->msgLength + SIZE_OF_MSG_LENGTH);
     
+    /* ...unless we're being asked how much we've allocated */
+    if ((pReceivedMsg->msgLength == SIZE_OF_MSG_TYPE) && (pReceivedMsg->msgType == TEST_MALLOC_COUNT_MSG_TYPE))
+    {
+        count = __atomic_load_n (&gMallocCount, __ATOMIC_RELAXED);
+        memcpy (&(pSendMsg->msgBody[0]), &count, sizeof (count));
+        pSendMsg->msgLength += sizeof (count);
+    }
+
+    /* ...or count those that are to be counted */
+    if ((pReceivedMsg->msgLength >= SIZE_OF_MSG_TYPE) && (pReceivedMsg->msgType == TEST_COUNTED_MSG_TYPE))
+    {
+        if (pReceivedMsg->msgLength > SIZE_OF_MSG_TYPE)
+        {
+            __atomic_add_fetch (&gNumCountedMsgs, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            count = __atomic_load_n (&gNumCountedMsgs, __ATOMIC_RELAXED);
+            memcpy (&(pSendMsg->msgBody[0]), &count, sizeof (count));
+            pSendMsg->msgLength += sizeof (count);
+        }
+    }
+
+    /* ...or publish what is to be published, or say what has been received */
+    if ((pReceivedMsg->msgLength == SIZE_OF_MSG_TYPE + sizeof (MessagingTopic) + sizeof (count)) && (pReceivedMsg->msgType == TEST_PUBLISHED_MSG_TYPE) &&
+        (pReceivedMsg->msgBody[0] < MESSAGING_MAX_NUM_TOPICS))
+    {
+        publishMessagingServerTopic (pReceivedMsg->msgBody[0], &(pReceivedMsg->msgBody[sizeof (MessagingTopic)]), sizeof (count));
+    }
+    if ((pReceivedMsg->msgLength == SIZE_OF_MSG_TYPE + sizeof (MessagingTopic)) && (pReceivedMsg->msgType == TEST_PUBLISHED_MSG_TYPE) &&
+        (pReceivedMsg->msgBody[0] < MESSAGING_MAX_NUM_TOPICS))
+    {
+        pthread_mutex_lock (&gPublicationLock);
+        memcpy (&(pSendMsg->msgBody[0]), &(gNumPublications[pReceivedMsg->msgBody[0]]), sizeof (count));
+        memcpy (&(pSendMsg->msgBody[sizeof (count)]), &(gLastPublication[pReceivedMsg->msgBody[0]]), sizeof (count));
+        pthread_mutex_unlock (&gPublicationLock);
+        pSendMsg->msgLength = SIZE_OF_MSG_TYPE + (sizeof (count) * 2);
+    }
+
+    /* ...or later for those that we defer */
+    if ((pReceivedMsg->msgLength >= SIZE_OF_MSG_TYPE) && (pReceivedMsg->msgType == TEST_DEFERRED_MSG_TYPE) && deferResponse (pSendMsg))
+    {
+        pSendMsg->msgLength = 0;
+    }
+
     if (pReceivedMsg->msgLength == 0)
     {
         returnCode = SERVER_EXIT_NORMALLY;   
@@ -14,6 +14,14 @@
 #include <one_wire.h>
 #include <messaging_server.h>
 #include <one_wire_server.h>
+#include <one_wire_msg_auto.h>
+
+/*
+ * EXTERN
+ */
+
+/* The names of the messages, for the stats the server keeps */
+extern Char *pgOneWireMessageNames[];
 
 /*
  * STATIC FUNCTIONS
@@ -40,6 +48,7 @@ int main (int argc, char **argv)
         oneWireServerPort = atoi (argv[1]);
         printProgress ("OneWireServer listening on port %d.\n", oneWireServerPort);
 
+        setMessagingServerMsgNames (pgOneWireMessageNames, MAX_NUM_ONE_WIRE_MSGS);
         returnCode = runMessagingServer (oneWireServerPort);
         
         if (returnCode == SERVER_EXIT_NORMALLY)
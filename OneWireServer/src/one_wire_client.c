@@ -70,6 +70,7 @@ Bool oneWireServerSendReceive (OneWireMsgType msgType, SInt32 portNumber, UInt8
 {
     ClientReturnCode returnCode;
     Bool success = false;
+    MessagingClientMsgs *pMsgs;
     Msg *pSendMsg;
     OneWireMsgHeader sendMsgHeader;
     UInt16 sendMsgBodyLength = 0;
@@ -81,71 +82,63 @@ Bool oneWireServerSendReceive (OneWireMsgType msgType, SInt32 portNumber, UInt8
     ASSERT_PARAM (((pSerialNumber != PNULL) || ((msgType == ONE_WIRE_SERVER_EXIT) || (msgType == ONE_WIRE_START_BUS) || (msgType == ONE_WIRE_STOP_BUS) || (msgType == ONE_WIRE_FIND_ALL_DEVICES))), (unsigned long) pSerialNumber);
     ASSERT_PARAM (specificsLength <= MAX_MSG_BODY_LENGTH - sizeof (sendMsgHeader), specificsLength);
 
-    pSendMsg = malloc (sizeof (Msg));
+    pMsgs = getMessagingClientMsgs();
+    pSendMsg = &(pMsgs->sendMsg);
+    pReceivedMsg = &(pMsgs->receivedMsg);
     
-    if (pSendMsg != PNULL)
+    /* Put in the bit before the body */
+    pSendMsg->msgLength = 0;
+    pSendMsg->msgType = msgType;
+    pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+
+    /* Put in the generic header at the start of the body */
+    memset (&sendMsgHeader, 0, sizeof (sendMsgHeader));
+    sendMsgHeader.portNumber = portNumber;
+    if (pSerialNumber != PNULL)
     {
-        pReceivedMsg = malloc (sizeof (Msg));
+        memcpy (&sendMsgHeader.serialNumber, pSerialNumber, sizeof (sendMsgHeader.serialNumber));
+    }
+    memcpy (&(pSendMsg->msgBody[0]), &sendMsgHeader, sizeof (sendMsgHeader));
+    sendMsgBodyLength += sizeof (sendMsgHeader);
         
-        if (pReceivedMsg != PNULL)
+    /* Put in the specifics */
+    if (pSendMsgSpecifics != PNULL)
+    {
+        memcpy (&pSendMsg->msgBody[0] + sendMsgBodyLength, pSendMsgSpecifics, specificsLength);
+        sendMsgBodyLength += specificsLength;
+    }
+    pSendMsg->msgLength += sendMsgBodyLength;
+
+    pReceivedMsg->msgLength = 0;
+
+    printDebug ("\nOW Client: sending message %s, length %d, hex dump:\n", pgOneWireMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
+    printHexDump ((UInt8 *) pSendMsg, pSendMsg->msgLength + 1);
+    returnCode = runMessagingClient ((SInt32) atoi (ONE_WIRE_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
+
+    printDebug ("OW Client: message system returnCode: %d\n", returnCode);
+    /* This code makes assumptions about packing (i.e. that it's '1' and that the
+     * Bool 'success' is at the start of the body) so be careful */
+    if (returnCode == CLIENT_SUCCESS && (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType)))
+    {
+        /* Check the Bool 'success' at the start of the message body */
+        receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
+        printDebug ("OW Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
+        if (receivedMsgBodyLength >= sizeof (Bool))
         {
-            /* Put in the bit before the body */
-            pSendMsg->msgLength = 0;
-            pSendMsg->msgType = msgType;
-            pSendMsg->msgLength += sizeof (pSendMsg->msgType);
-                        
-            /* Put in the generic header at the start of the body */
-            memset (&sendMsgHeader, 0, sizeof (sendMsgHeader));
-            sendMsgHeader.portNumber = portNumber;
-            if (pSerialNumber != PNULL)
-            {
-                memcpy (&sendMsgHeader.serialNumber, pSerialNumber, sizeof (sendMsgHeader.serialNumber));
-            }
-            memcpy (&(pSendMsg->msgBody[0]), &sendMsgHeader, sizeof (sendMsgHeader));
-            sendMsgBodyLength += sizeof (sendMsgHeader);
-            
-            /* Put in the specifics */
-            if (pSendMsgSpecifics != PNULL)
+            printDebug ("OW Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
+            if ((Bool) pReceivedMsg->msgBody[0])
             {
-                memcpy (&pSendMsg->msgBody[0] + sendMsgBodyLength, pSendMsgSpecifics, specificsLength);
-                sendMsgBodyLength += specificsLength;
-            }
-            pSendMsg->msgLength += sendMsgBodyLength;
-            
-            pReceivedMsg->msgLength = 0;
-    
-            printDebug ("\nOW Client: sending message %s, length %d, hex dump:\n", pgOneWireMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
-            printHexDump ((UInt8 *) pSendMsg, pSendMsg->msgLength + 1);
-            returnCode = runMessagingClient ((SInt32) atoi (ONE_WIRE_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
-                    
-            printDebug ("OW Client: message system returnCode: %d\n", returnCode);
-            /* This code makes assumptions about packing (i.e. that it's '1' and that the
-             * Bool 'success' is at the start of the body) so be careful */
-            if (returnCode == CLIENT_SUCCESS && (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType)))
-            { 
-                /* Check the Bool 'success' at the start of the message body */
-                receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
-                printDebug ("OW Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
-                if (receivedMsgBodyLength >= sizeof (Bool))
+                success = true;
+                printDebug ("OW Client: received message %s, hex dump:\n", pgOneWireMessageNames[pReceivedMsg->msgType]);
+                printHexDump ((UInt8 *) pReceivedMsg, pReceivedMsg->msgLength + 1);
+                        
+                if (pReceivedMsgSpecifics != PNULL)
                 {
-                    printDebug ("OW Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
-                    if ((Bool) pReceivedMsg->msgBody[0])
-                    {
-                        success = true;
-                        printDebug ("OW Client: received message %s, hex dump:\n", pgOneWireMessageNames[pReceivedMsg->msgType]);
-                        printHexDump ((UInt8 *) pReceivedMsg, pReceivedMsg->msgLength + 1);
-
-                        if (pReceivedMsgSpecifics != PNULL)
-                        {
-                            /* Copy out the bits beyond the success field for passing back */
-                            memcpy (pReceivedMsgSpecifics, &pReceivedMsg->msgBody[0] + sizeof (Bool), receivedMsgBodyLength - sizeof (Bool));
-                        }
-                    }
+                    /* Copy out the bits beyond the success field for passing back */
+                    memcpy (pReceivedMsgSpecifics, &pReceivedMsg->msgBody[0] + sizeof (Bool), receivedMsgBodyLength - sizeof (Bool));
                 }
             }
-            free (pReceivedMsg);
         }
-        free (pSendMsg);
     }
 
     return success;
@@ -11,12 +11,13 @@
 #include <unistd.h> /* for fork */
 #include <sys/types.h> /* for pid_t */
 #include <sys/wait.h> /* for wait */
+#include <signal.h> /* for kill */
 #include <pthread.h>
 #include <rob_system.h>
-#include <monitor.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
 #include <local_server.h>
+#include <monitor.h>
 #include <task_handler_types.h>
 #include <task_handler_server.h>
 #include <task_handler_msg_auto.h>
@@ -40,6 +41,37 @@
  * MANIFEST CONSTANTS
  */
 
+/* The number of servers in gServerList */
+#define NUM_ROBOONE_SERVERS (sizeof (gServerList) / sizeof (gServerList[0]))
+
+/*
+ * STATIC FUNCTION PROTOTYPES
+ */
+static Bool startTimerServer (void);
+static Bool stopTimerServer (void);
+static Bool startHardwareServer (void);
+static Bool stopHardwareServer (void);
+static Bool startTaskHandlerServer (void);
+static Bool stopTaskHandlerServer (void);
+static Bool startBatteryManagerServer (void);
+static Bool stopBatteryManagerServer (void);
+static Bool startStateMachineServer (void);
+static Bool stopStateMachineServer (void);
+
+/*
+ * TYPES
+ */
+
+/* A server that RoboOne launches and the functions
+ * that send it its start and stop messages */
+typedef struct RoboOneServerTag
+{
+    Char *pExe;
+    Char *pPortString;
+    Bool (*pStart) (void);
+    Bool (*pStop) (void);
+} RoboOneServer;
+
 /*
  * EXTERNS
  */
@@ -51,6 +83,14 @@ extern int errno;
 RoboOneGlobals gRoboOneGlobals;
 RoboOneSettings gSettings;
 
+/* The servers, in the order that they are started:
+ * each may use the ones before it when it starts */
+static const RoboOneServer gServerList[] = {{TIMER_SERVER_EXE, TIMER_SERVER_PORT_STRING, startTimerServer, stopTimerServer},
+                                            {HARDWARE_SERVER_EXE, HARDWARE_SERVER_PORT_STRING, startHardwareServer, stopHardwareServer},
+                                            {TASK_HANDLER_SERVER_EXE, TASK_HANDLER_SERVER_PORT_STRING, startTaskHandlerServer, stopTaskHandlerServer},
+                                            {BATTERY_MANAGER_SERVER_EXE, BATTERY_MANAGER_SERVER_PORT_STRING, startBatteryManagerServer, stopBatteryManagerServer},
+                                            {STATE_MACHINE_SERVER_EXE, STATE_MACHINE_SERVER_PORT_STRING, startStateMachineServer, stopStateMachineServer}};
+
 /*
  * STATIC FUNCTIONS
  */
@@ -69,6 +109,8 @@ void *localServer (void * serverPort)
     ServerReturnCode returnCode = SERVER_ERR_GENERAL_FAILURE;
 
     printProgress ("RO Server listening on port %d.\n", (SInt32) serverPort);
+    /* The Hardware Server publishes to us what the monitor displays */
+    setMessagingServerPublicationHandler (handleMonitorPublication);
     returnCode = runMessagingServer ((SInt32) serverPort);
     
     ASSERT_ALWAYS_PARAM (returnCode);
@@ -141,15 +183,15 @@ static Bool stopLocalServerThread (pthread_t *pLocalServerThread)
 }
 
 /*
- * Send a message to start the Hardware Server.
- *
- * batteriesOnly  if true, only setup the battery
- *                devices, otherwise setup the lot.
+ * Send a message to start the Hardware Server,
+ * setting up all of the devices.
  * 
  * @return true if successful, otherwise false.
  */
-static Bool startHardwareServer (Bool batteriesOnly)
+static Bool startHardwareServer (void)
 {
+    Bool batteriesOnly = false;
+
     return hardwareServerSendReceive (HARDWARE_SERVER_START, &batteriesOnly, sizeof (batteriesOnly), PNULL);
 }
 
@@ -412,196 +454,87 @@ static Bool parseParameters (int argc, char **argv)
 int main (int argc, char **argv)
 {
     Bool   success = false;
-    pid_t  hwServerPID;
-    pid_t  thServerPID;
-    pid_t  smServerPID;
-    pid_t  bmServerPID;
-    pid_t  tiServerPID;
+    SInt32 serverPID[NUM_ROBOONE_SERVERS];
+    SInt32 readyFd[NUM_ROBOONE_SERVERS];
+    UInt32 numServers = 0;
+    UInt32 numStarted = 0;
+    UInt32 x;
     pthread_t localServerThread;
     
     setDebugPrintsOnToFile ("roboone.log");
+    setFlightRecorderOn ("roboone.flt", FLIGHT_RECORDER_DEFAULT_NUM_RECORDS);
     setProgressPrintsOn();
 
+    /* The monitor reads from the hardware server many times a
+     * second, so carry messages to local servers in shared memory */
+    setMessagingClientLocalTransport (MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY);
+
     initGlobals();
     
     success = parseParameters (argc, argv);
     
     if (success)
     {
-        /* Spawn a child that will become the Timer server. */
-        tiServerPID = fork();
-        if (tiServerPID == 0)
-        {
-            /* Start Timer server process on a given port */
-            static char *argv1[] = {TIMER_SERVER_EXE, TIMER_SERVER_PORT_STRING, PNULL};
-            
-            execv (TIMER_SERVER_EXE, argv1);
-            printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", TIMER_SERVER_EXE, strerror (errno));
-        }
-        else
+        /* Launch all of the servers at once: they don't need each
+         * other until they are started, which happens below */
+        for (x = 0; (x < NUM_ROBOONE_SERVERS) && success; x++)
         {
-            if (tiServerPID < 0)
+            serverPID[x] = spawnMessagingServer (gServerList[x].pExe, gServerList[x].pPortString, &(readyFd[x]));
+            if (serverPID[x] > 0)
             {
-                printDebug ("!!! Couldn't fork to launch %s, err: %s. !!!\n", TIMER_SERVER_EXE, strerror (errno));
+                numServers++;
             }
             else
-            {   /* Parent process */
-                /* Wait for the server to start */
-                usleep (TIMER_SERVER_START_DELAY_PI_US);
-                /* Now setup the Timer server */
-                success = startTimerServer();
-
-                if (success)
-                {    
-                    /* Spawn a child that will become the Hardware server. */
-                    hwServerPID = fork();
-                    if (hwServerPID == 0)
-                    {
-                        /* Start Hardware server process on a given port */
-                        static char *argv1[] = {HARDWARE_SERVER_EXE, HARDWARE_SERVER_PORT_STRING, PNULL};
+            {
+                success = false;
+                printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", gServerList[x].pExe, strerror (errno));
+            }
+        }
+
+        /* Wait for them to be listening, which takes as long as the slowest of them */
+        if (!waitMessagingServersReady (&(readyFd[0]), numServers, MESSAGING_SERVER_READY_TIMEOUT_MS))
+        {
+            success = false;
+            printDebug ("!!! Not all of the servers became ready. !!!\n");
+        }
                         
-                        execv (HARDWARE_SERVER_EXE, argv1);
-                        printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", HARDWARE_SERVER_EXE, strerror (errno));
-                    }
-                    else
-                    {
-                        if (hwServerPID < 0)
-                        {
-                            printDebug ("!!! Couldn't fork to launch %s, err: %s. !!!\n", HARDWARE_SERVER_EXE, strerror (errno));
-                        }
-                        else
-                        {   /* Parent process */
-                            /* Wait for the server to start */
-                            usleep (HARDWARE_SERVER_START_DELAY_PI_US);
-                            /* Now setup the Hardware server */
-                            success = startHardwareServer (false);
+        /* Now set them up, in order, as each may use the ones before it */
+        for (x = 0; (x < numServers) && success; x++)
+        {
+            success = gServerList[x].pStart();
+            if (success)
+            {
+                numStarted++;
+            }
+        }
                 
-                            if (success)
-                            {
-                                /* Spawn a child that will become the Task Handler server. */
-                                thServerPID = fork();
-                                if (thServerPID == 0)
-                                {
-                                    /* Start Task Handler server process on a given port */
-                                    static char *argv2[] = {TASK_HANDLER_SERVER_EXE, TASK_HANDLER_SERVER_PORT_STRING, PNULL};
+        if (success)
+        {
+            /* Start the local server that listens out for task progress indications */
+            success = startLocalServerThread (&localServerThread, LOCAL_SERVER_PORT);
                                     
-                                    execv (TASK_HANDLER_SERVER_EXE, argv2);
-                                    printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", TASK_HANDLER_SERVER_EXE, strerror (errno));
-                                }
-                                else
-                                {
-                                    if (thServerPID < 0)
-                                    {
-                                        printDebug ("!!! Couldn't fork to launch %s, err: %s. !!!\n", TASK_HANDLER_SERVER_EXE, strerror (errno));
-                                    }
-                                    else
-                                    {   /* Parent process */
-                                        /* Wait for the server to start */
-                                        usleep (TASK_HANDLER_SERVER_START_DELAY_PI_US);
-                                        /* Now setup the Task Handler server */
-                                        success = startTaskHandlerServer();
+            if (success)
+            {
+                /* Finally, display the monitor to display things and generate events */
+                success = runMonitor (gRoboOneGlobals.roboOneSettings.pTerminal, gRoboOneGlobals.roboOneSettings.baudRate);
+            }
                     
-                                        if (success)
-                                        {
-                                            /* Spawn a child that will become the RoboOne Battery Manager server. */
-                                            bmServerPID = fork();
-                                            if (bmServerPID == 0)
-                                            {
-                                                /* Start Battery Manager server process */
-                                                static char *argv3[] = {BATTERY_MANAGER_SERVER_EXE, BATTERY_MANAGER_SERVER_PORT_STRING, PNULL};
+            /* Tidy up the local server now that we're done */
+            stopLocalServerThread (&localServerThread);
                                                   
-                                                execv (BATTERY_MANAGER_SERVER_EXE, argv3);
-                                                printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", BATTERY_MANAGER_SERVER_EXE, strerror (errno));
-                                            }
-                                            else
-                                            {
-                                                if (bmServerPID < 0)
-                                                {
-                                                    printDebug ("!!! Couldn't fork to launch %s, err: %s. !!!\n", BATTERY_MANAGER_SERVER_EXE, strerror (errno));
-                                                }
-                                                else
-                                                {   /* Parent process again */
-                                                    /* Wait for the server to start */
-                                                    usleep (BATTERY_MANAGER_SERVER_START_DELAY_PI_US);
-                                                    /* Now setup the Battery Manager server */
-                                                    success = startBatteryManagerServer();
+            printProgress ("\nDone.\n");
+        }
                                                             
-                                                    if (success)
-                                                    {
-                                                        /* Spawn a child that will become the RoboOne state machine. */
-                                                        smServerPID = fork();
-                                                        if (smServerPID == 0)
-                                                        {
-                                                            /* Start State Machine server process */
-                                                            static char *argv4[] = {STATE_MACHINE_SERVER_EXE, STATE_MACHINE_SERVER_PORT_STRING, PNULL};
-                                                              
-                                                            execv (STATE_MACHINE_SERVER_EXE, argv4);
-                                                            printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", STATE_MACHINE_SERVER_EXE, strerror (errno));
-                                                        }
-                                                        else
-                                                        {
-                                                            if (smServerPID < 0)
-                                                            {
-                                                                printDebug ("!!! Couldn't fork to launch %s, err: %s. !!!\n", STATE_MACHINE_SERVER_EXE, strerror (errno));
-                                                            }
-                                                            else
-                                                            {   /* Parent process again */
-                                                                /* Wait for the server to start */
-                                                                usleep (STATE_MACHINE_SERVER_START_DELAY_PI_US);
-                                                                /* Now setup the State Machine server */
-                                                                success = startStateMachineServer();
-                        
-                                                                if (success)
-                                                                {
-                                                                    /* Start the local server that listens out for task progress indications */
-                                                                    success = startLocalServerThread (&localServerThread, LOCAL_SERVER_PORT);
-                                                                    
-                                                                    if (success)
-                                                                    {
-                                                                        /* Finally, display the monitor to display things and generate events */
-                                                                        success = runMonitor (gRoboOneGlobals.roboOneSettings.pTerminal, gRoboOneGlobals.roboOneSettings.baudRate);                                                            
-                                                                    }
-                                                                    
-                                                                    /* Tidy up the local server now that we're done */
-                                                                    stopLocalServerThread (&localServerThread);
-                                                                   
-                                                                    printProgress ("\nDone.\n");
-                                                                    
-                                                                    
-                                                                }
-                                                                
-                                                                /* When done, tidy up the State Machine server */
-                                                                stopStateMachineServer();
-                                                                waitpid (smServerPID, 0, 0); /* wait for server to exit */
-                                                            }
-                                                        }                                            
-                                                    }
-                                                    
-                                                    /* When done, tidy up the Battery Manager server */
-                                                    stopBatteryManagerServer();
-                                                    waitpid (bmServerPID, 0, 0); /* wait for server to exit */
-                                                }                            
-                                            }                                
-                                        }
-                                        
-                                        /* When done, tidy up the Task Handler server*/
-                                        stopTaskHandlerServer();
-                                        waitpid (thServerPID, 0, 0); /* wait for server to exit */
-                                    }
-                                }                    
-                            }
-                            
-                            /* When done, shut down the Hardware server gracefully */
-                            stopHardwareServer();
-                            waitpid (hwServerPID, 0, 0); /* wait for server to exit */
-                        }
-                    }
-                }
-
-                /* When done, shut down the Timer server gracefully */
-                stopTimerServer();
-                waitpid (tiServerPID, 0, 0); /* wait for server to exit */
+        /* When done, shut the servers down gracefully, in reverse order;
+         * one that wasn't started, or won't take the stop, may not be
+         * serving at all and so is killed instead */
+        for (x = numServers; x > 0; x--)
+        {
+            if ((x > numStarted) || !gServerList[x - 1].pStop())
+            {
+                kill (serverPID[x - 1], SIGTERM);
             }
+            waitpid (serverPID[x - 1], 0, 0); /* wait for server to exit */
         }
     }
     
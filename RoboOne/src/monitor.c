@@ -8,9 +8,14 @@
 #include <termios.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 #include <rob_system.h>
 #include <curses.h> /* Has to be ahead of rob_system.h in the list as it fiddles with bool */
 #include <menu.h>
+#include <messaging_server.h>
+#include <local_server.h>
 #include <hardware_types.h>
 #include <hardware_server.h>
 #include <hardware_msg_auto.h>
@@ -26,6 +31,7 @@
 #include <battery_manager_msg_auto.h>
 #include <battery_manager_client.h>
 #include <main.h>
+#include <monitor.h>
 
 /*
  * MANIFEST CONSTANTS
@@ -91,6 +97,11 @@
 #define SLOW_UPDATE_BACKOFF   10
 #define SLOWER_UPDATE_BACKOFF 20
 
+/* The longest the dashboard waits for the Hardware Server
+ * to push a change before going round again anyway, so
+ * that keys are picked up and the Task Handler is ticked */
+#define MONITOR_REFRESH_INTERVAL_MS 100
+
 /*
  * STATIC FUNCTION PROTOTYPES
  */
@@ -133,6 +144,20 @@ typedef struct WindowInfoTag
     Bool enabled;
 } WindowInfo;
 
+/* The last of each topic that the Hardware Server has
+ * published to us, see handleMonitorPublication() */
+typedef struct MonitorTelemetryTag
+{
+    Bool battIsKnown[NUM_CHARGERS];
+    HardwareBattTelemetry batt[NUM_CHARGERS];
+    Bool relayStateIsKnown;
+    HardwareRelayState relayState;
+    Bool chargeStateIsKnown;
+    HardwareChargeState chargeState;
+    Bool mains12VIsKnown;
+    Bool mains12VIsPresent;
+} MonitorTelemetry;
+
 /*
  * EXTERNS
  */
@@ -153,6 +178,12 @@ WindowInfo gWindowList[] = {{"Output", {WIN_OUTPUT_HEIGHT, WIN_OUTPUT_WIDTH, WIN
 /* Must be in the same order as the enum ChargeState */
 Char * gChargeStrings[] = {" --- ", " Off ", " Grn ", "*Grn*", " Red ", "*Red*", "  6  ", " ??? ", " Nul ", " Bad "};
 WINDOW **gpOutputWindow = &(gWindowList[0].pWin);
+/* What the Hardware Server has told us, protected by gTelemetryLock,
+ * gTelemetryChanged being signalled when something new arrives */
+static MonitorTelemetry gTelemetry;
+static Bool gTelemetryIsChanged = false;
+static pthread_mutex_t gTelemetryLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gTelemetryChanged = PTHREAD_COND_INITIALIZER;
 
 /*
  * STATIC FUNCTIONS
@@ -294,6 +325,41 @@ static Char displayBatteryStatusHelper (BatteryStatus * pBatteryStatus)
     return statusChar;
 }
 
+/*
+ * Take a copy of what the Hardware Server has
+ * published to us.
+ *
+ * pTelemetry  where to put the copy.
+ */
+static void getTelemetryHelper (MonitorTelemetry *pTelemetry)
+{
+    ASSERT_PARAM (pTelemetry != PNULL, (unsigned long) pTelemetry);
+
+    pthread_mutex_lock (&gTelemetryLock);
+    memcpy (pTelemetry, &gTelemetry, sizeof (*pTelemetry));
+    pthread_mutex_unlock (&gTelemetryLock);
+}
+
+/*
+ * Fill in the battery data to send to the
+ * Battery Manager from what the Hardware
+ * Server has published about a battery.
+ *
+ * pBatteryData  the battery data to fill in.
+ * pTelemetry    what was published.
+ */
+static void batteryDataHelper (BatteryData *pBatteryData, HardwareBattTelemetry *pTelemetry)
+{
+    ASSERT_PARAM (pBatteryData != PNULL, (unsigned long) pBatteryData);
+    ASSERT_PARAM (pTelemetry != PNULL, (unsigned long) pTelemetry);
+
+    pBatteryData->current = pTelemetry->current;
+    pBatteryData->voltage = pTelemetry->voltage;
+    pBatteryData->remainingCapacity = pTelemetry->remainingCapacity;
+    pBatteryData->chargeDischarge = pTelemetry->chargeDischarge;
+    pBatteryData->temperature = pTelemetry->temperature;
+}
+
 /*
  * Init function for Rio window.
  * 
@@ -319,6 +385,7 @@ static void initRioWindow (WINDOW *pWin)
  */
 static Bool updateRioWindow (WINDOW *pWin, UInt8 count)
 {
+    MonitorTelemetry telemetry;
     BatteryData batteryData;
     BatteryStatus batteryStatus;
     UInt8 row = 0;
@@ -330,11 +397,10 @@ static Bool updateRioWindow (WINDOW *pWin, UInt8 count)
     memset (&batteryData, 0, sizeof (batteryData));
     memset (&batteryStatus, false, sizeof (batteryStatus));
 
-    success = hardwareServerSendReceive (HARDWARE_READ_RIO_BATT_CURRENT, PNULL, 0, &(batteryData.current));
-    if (success)
-    {
-        success = hardwareServerSendReceive (HARDWARE_READ_RIO_BATT_VOLTAGE, PNULL, 0, &(batteryData.voltage));
-    }
+    /* The Hardware Server publishes the battery to us, no need to ask */
+    getTelemetryHelper (&telemetry);
+    success = telemetry.battIsKnown[CHARGER_RIO];
+    batteryDataHelper (&batteryData, &(telemetry.batt[CHARGER_RIO]));
     wmove (pWin, row, col);
     if (success)
     {
@@ -345,15 +411,6 @@ static Bool updateRioWindow (WINDOW *pWin, UInt8 count)
 
     if (count % SLOW_UPDATE_BACKOFF == 0)
     {
-        success = hardwareServerSendReceive (HARDWARE_READ_RIO_REMAINING_CAPACITY, PNULL, 0, &(batteryData.remainingCapacity));
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_RIO_BATT_LIFETIME_CHARGE_DISCHARGE, PNULL, 0, &(batteryData.chargeDischarge));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_RIO_BATT_TEMPERATURE, PNULL, 0, &(batteryData.temperature));
-        }
         if (success)
         {
             success = batteryManagerServerSendReceive (BATTERY_MANAGER_DATA_RIO, &batteryData, sizeof (batteryData), &batteryStatus);
@@ -408,37 +465,26 @@ static void initOWindow (WINDOW *pWin)
  */
 static Bool updateOWindow (WINDOW *pWin, UInt8 count)
 {
+    MonitorTelemetry telemetry;
     BatteryData batteryData[3];
     BatteryStatus batteryStatus[3];
     UInt8 row = 0;
     UInt8 col = 0;
     Bool success;
+    UInt8 i;
 
     ASSERT_PARAM (pWin != PNULL, (unsigned long) pWin);
    
     memset (&(batteryData[0]), 0, sizeof (batteryData));
     memset (&(batteryStatus[0]), false, sizeof (batteryStatus));
 
-    success = hardwareServerSendReceive (HARDWARE_READ_O1_BATT_CURRENT, PNULL, 0, &(batteryData[0].current));
-    if (success)
-    {
-        success = hardwareServerSendReceive (HARDWARE_READ_O2_BATT_CURRENT, PNULL, 0, &(batteryData[1].current));
-    }
-    if (success)
-    {
-        success = hardwareServerSendReceive (HARDWARE_READ_O3_BATT_CURRENT, PNULL, 0, &(batteryData[2].current));
-    }
-    if (success)
+    /* The Hardware Server publishes the batteries to us, no need to ask */
+    getTelemetryHelper (&telemetry);
+    success = true;
+    for (i = 0; i < 3; i++)
     {
-        success = hardwareServerSendReceive (HARDWARE_READ_O1_BATT_VOLTAGE, PNULL, 0, &(batteryData[0].voltage));
-    }
-    if (success)
-    {
-        success = hardwareServerSendReceive (HARDWARE_READ_O2_BATT_VOLTAGE, PNULL, 0, &(batteryData[1].voltage));
-    }
-    if (success)
-    {
-        success = hardwareServerSendReceive (HARDWARE_READ_O3_BATT_VOLTAGE, PNULL, 0, &(batteryData[2].voltage));
+        success = success && telemetry.battIsKnown[CHARGER_O1 + i];
+        batteryDataHelper (&(batteryData[i]), &(telemetry.batt[CHARGER_O1 + i]));
     }
     wmove (pWin, row, col);
     if (success)
@@ -451,39 +497,6 @@ static Bool updateOWindow (WINDOW *pWin, UInt8 count)
     
     if (count % SLOWER_UPDATE_BACKOFF == 0)
     {
-        success = hardwareServerSendReceive (HARDWARE_READ_O1_REMAINING_CAPACITY, PNULL, 0, &(batteryData[0].remainingCapacity));
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O2_REMAINING_CAPACITY, PNULL, 0, &(batteryData[1].remainingCapacity));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O3_REMAINING_CAPACITY, PNULL, 0, &(batteryData[2].remainingCapacity));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O1_BATT_LIFETIME_CHARGE_DISCHARGE, PNULL, 0, &(batteryData[0].chargeDischarge));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O2_BATT_LIFETIME_CHARGE_DISCHARGE, PNULL, 0, &(batteryData[1].chargeDischarge));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O3_BATT_LIFETIME_CHARGE_DISCHARGE, PNULL, 0, &(batteryData[2].chargeDischarge));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O1_BATT_TEMPERATURE, PNULL, 0, &(batteryData[0].temperature));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O2_BATT_TEMPERATURE, PNULL, 0, &(batteryData[1].temperature));
-        }
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O3_BATT_TEMPERATURE, PNULL, 0, &(batteryData[2].temperature));
-        }
         if (success)
         {
             success = batteryManagerServerSendReceive (BATTERY_MANAGER_DATA_O1, &(batteryData[0]), sizeof (batteryData[0]), &(batteryStatus[0]));
@@ -548,17 +561,17 @@ static void initPowerWindow (WINDOW *pWin)
  */
 static Bool updatePowerWindow (WINDOW *pWin, UInt8 count)
 {
+    MonitorTelemetry telemetry;
     UInt8 row = 0;
     UInt8 col = 0;
-    Bool success;
-    Bool relaysEnabled;
     Bool mains12VPresent;
     static Bool previousMains12VPresent = false;
-    Bool is12V;
-    Bool isBatt;
 
     ASSERT_PARAM (pWin != PNULL, (unsigned long) pWin);
 
+    /* The Hardware Server publishes all this to us, no need to ask */
+    getTelemetryHelper (&telemetry);
+
     if (count % SLOW_UPDATE_BACKOFF == 0)
     {
         wmove (pWin, row, col);
@@ -570,9 +583,9 @@ static Bool updatePowerWindow (WINDOW *pWin, UInt8 count)
         wclrtoeol (pWin);
         
         /* First print the state of 12V power presence */
-        success = hardwareServerSendReceive (HARDWARE_READ_MAINS_12V, PNULL, 0, &mains12VPresent);
-        if (success)
+        if (telemetry.mains12VIsKnown)
         {
+            mains12VPresent = telemetry.mains12VIsPresent;
             if (mains12VPresent)
             {
                 wprintw (pWin, " present  ");
@@ -593,27 +606,8 @@ static Bool updatePowerWindow (WINDOW *pWin, UInt8 count)
         }
         
         /* Then print how each of the Pi and the Hindbrain are powered. */
-        success = hardwareServerSendReceive (HARDWARE_READ_ON_PCB_RELAYS_ENABLED, PNULL, 0, &relaysEnabled);
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_RIO_PWR_12V, PNULL, 0, &is12V);
-            if (success)
-            {
-                success = hardwareServerSendReceive (HARDWARE_READ_RIO_PWR_BATT, PNULL, 0, &isBatt);
-            }
-        }
-        displayPowerStatesHelper (pWin, success, relaysEnabled, is12V, isBatt);
-            
-        success = hardwareServerSendReceive (HARDWARE_READ_EXTERNAL_RELAYS_ENABLED, PNULL, 0, &relaysEnabled);
-        if (success)
-        {
-            success = hardwareServerSendReceive (HARDWARE_READ_O_PWR_12V, PNULL, 0, &is12V);
-            if (success)
-            {
-                success = hardwareServerSendReceive (HARDWARE_READ_O_PWR_BATT, PNULL, 0, &isBatt);
-            }
-        }
-        displayPowerStatesHelper (pWin, success, relaysEnabled, is12V, isBatt);
+        displayPowerStatesHelper (pWin, telemetry.relayStateIsKnown, telemetry.relayState.onPCBRelaysEnabled, telemetry.relayState.rioPwr12V, telemetry.relayState.rioPwrBatt);
+        displayPowerStatesHelper (pWin, telemetry.relayStateIsKnown, telemetry.relayState.externalRelaysEnabled, telemetry.relayState.oPwr12V, telemetry.relayState.oPwrBatt);
         row++;
     }
     else
@@ -653,32 +647,29 @@ static void initChgWindow (WINDOW *pWin)
  */
 static Bool updateChgWindow (WINDOW *pWin, UInt8 count)
 {
-    Bool success;
-    HardwareChargeState chargeState;
+    MonitorTelemetry telemetry;
     UInt8 row = 0;
     UInt8 col = 0;
     UInt8 i;
 
     ASSERT_PARAM (pWin != PNULL, (unsigned long) pWin);
 
-    memset (&chargeState.state, 0, sizeof (chargeState.state));
-    chargeState.flashDetectPossible = false;
-    
     wmove (pWin, row, col);
     wclrtoeol (pWin);        
     wprintw (pWin, "  Pi   O1   O2   O3");
     row++;
     
-    success = hardwareServerSendReceive (HARDWARE_READ_CHARGER_STATE, PNULL, 0, &chargeState);
+    /* The Hardware Server only publishes this when flashing could be detected */
+    getTelemetryHelper (&telemetry);
     
-    if (success && chargeState.flashDetectPossible)
+    if (telemetry.chargeStateIsKnown)
     {
         wmove (pWin, row, col);
         wclrtoeol (pWin);        
         for (i = 0; i < NUM_CHARGERS; i++)
         {
-            ASSERT_PARAM (chargeState.state[i] < (sizeof (gChargeStrings)/sizeof (Char *)), chargeState.state[i]);
-            wprintw (pWin, "%s", gChargeStrings[chargeState.state[i]]);
+            ASSERT_PARAM (telemetry.chargeState.state[i] < (sizeof (gChargeStrings)/sizeof (Char *)), telemetry.chargeState.state[i]);
+            wprintw (pWin, "%s", gChargeStrings[telemetry.chargeState.state[i]]);
         }
     }
     row++;
@@ -931,10 +922,109 @@ Bool setTerminalAttributes (UInt32 fd, UInt32 baudRate)
     return success;
 }
 
+/*
+ * Wait until the Hardware Server has published
+ * something new, or until MONITOR_REFRESH_INTERVAL_MS
+ * has passed.
+ */
+static void waitForTelemetry (void)
+{
+    struct timespec wakeTime;
+
+    /* The condition variable waits against the real time clock */
+    clock_gettime (CLOCK_REALTIME, &wakeTime);
+    wakeTime.tv_nsec += MONITOR_REFRESH_INTERVAL_MS * 1000000L;
+    if (wakeTime.tv_nsec >= 1000000000L)
+    {
+        wakeTime.tv_sec++;
+        wakeTime.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock (&gTelemetryLock);
+    while (!gTelemetryIsChanged && (pthread_cond_timedwait (&gTelemetryChanged, &gTelemetryLock, &wakeTime) != ETIMEDOUT))
+    {
+    }
+    gTelemetryIsChanged = false;
+    pthread_mutex_unlock (&gTelemetryLock);
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
 
+/*
+ * Handle a topic published by the Hardware Server
+ * to the local server, keeping it for the dashboard.
+ * Set with setMessagingServerPublicationHandler().
+ *
+ * publisherPort  the port of the Hardware Server.
+ * topic          the HardwareTopic published.
+ * pData          what was published.
+ * dataLength     the length of pData.
+ */
+void handleMonitorPublication (UInt16 publisherPort, MessagingTopic topic, const UInt8 *pData, UInt32 dataLength)
+{
+    ASSERT_PARAM (pData != PNULL, (unsigned long) pData);
+
+    pthread_mutex_lock (&gTelemetryLock);
+    switch (topic)
+    {
+        case HARDWARE_TOPIC_RIO_BATT:
+        case HARDWARE_TOPIC_O1_BATT:
+        case HARDWARE_TOPIC_O2_BATT:
+        case HARDWARE_TOPIC_O3_BATT:
+        {
+            if (dataLength == sizeof (gTelemetry.batt[0]))
+            {
+                memcpy (&(gTelemetry.batt[topic - HARDWARE_TOPIC_RIO_BATT]), pData, dataLength);
+                gTelemetry.battIsKnown[topic - HARDWARE_TOPIC_RIO_BATT] = true;
+                gTelemetryIsChanged = true;
+            }
+        }
+        break;
+        case HARDWARE_TOPIC_RELAYS:
+        {
+            if (dataLength == sizeof (gTelemetry.relayState))
+            {
+                memcpy (&(gTelemetry.relayState), pData, dataLength);
+                gTelemetry.relayStateIsKnown = true;
+                gTelemetryIsChanged = true;
+            }
+        }
+        break;
+        case HARDWARE_TOPIC_CHARGER_STATE:
+        {
+            if (dataLength == sizeof (gTelemetry.chargeState))
+            {
+                memcpy (&(gTelemetry.chargeState), pData, dataLength);
+                gTelemetry.chargeStateIsKnown = true;
+                gTelemetryIsChanged = true;
+            }
+        }
+        break;
+        case HARDWARE_TOPIC_MAINS_12V:
+        {
+            if (dataLength == sizeof (gTelemetry.mains12VIsPresent))
+            {
+                memcpy (&(gTelemetry.mains12VIsPresent), pData, dataLength);
+                gTelemetry.mains12VIsKnown = true;
+                gTelemetryIsChanged = true;
+            }
+        }
+        break;
+        default:
+        {
+            /* Not one of ours, ignore it */
+        }
+        break;
+    }
+    if (gTelemetryIsChanged)
+    {
+        pthread_cond_signal (&gTelemetryChanged);
+    }
+    pthread_mutex_unlock (&gTelemetryLock);
+}
+
 /*
  * Display a dashboard of useful information.
  * 
@@ -962,6 +1052,7 @@ Bool runMonitor (char *pTerminal, UInt32 baudRate)
     int fd = -1;
     FILE * pTtyOut = stdout;
     FILE * pTtyIn = stdin;
+    TraceSpan span;
 
     /* If we have been given terminal attributes, use them */
     if (pTerminal != NULL)
@@ -1040,9 +1131,24 @@ Bool runMonitor (char *pTerminal, UInt32 baudRate)
         
         if (success)
         {
+            /* Have the Hardware Server push what we display to the local
+             * server as it changes, rather than asking for it all the time */
+            pthread_mutex_lock (&gTelemetryLock);
+            memset (&gTelemetry, false, sizeof (gTelemetry));
+            gTelemetryIsChanged = false;
+            pthread_mutex_unlock (&gTelemetryLock);
+            for (i = 0; i < NUM_HARDWARE_TOPICS; i++)
+            {
+                if (!hardwareServerSubscribe ((HardwareTopic) i, LOCAL_SERVER_PORT, 0, 0))
+                {
+                    printDebug ("Monitor couldn't subscribe to hardware topic %d.\n", i);
+                }
+            }
+
             /* Now show stuff in the sub-windows */
             for (i = 0; !exitDashboard; i++) /* i is not meant to be in the condition here */
             {
+                TRACE_SPAN_BEGIN (&span, "monitor refresh", i);
                 for (x = 0; (x < (sizeof (gWindowList) / sizeof (gWindowList[0])) && !exitDashboard); x++)
                 {
                     if (gWindowList[x].enabled)
@@ -1055,6 +1161,13 @@ Bool runMonitor (char *pTerminal, UInt32 baudRate)
                     taskHandlerServerSendReceive (TASK_HANDLER_TICK, PNULL, 0);
                 }
                 doupdate();
+                TRACE_SPAN_END (&span);
+                waitForTelemetry();
+            }
+
+            for (i = 0; i < NUM_HARDWARE_TOPICS; i++)
+            {
+                hardwareServerUnsubscribe ((HardwareTopic) i, LOCAL_SERVER_PORT);
             }        
         }
         
@@ -2,4 +2,5 @@
  * Entry point for the monitor.
  */ 
 
+void handleMonitorPublication (UInt16 publisherPort, MessagingTopic topic, const UInt8 *pData, UInt32 dataLength);
 Bool runMonitor (char *pTerminal, UInt32 baudRate);
\ No newline at end of file
@@ -6,9 +6,6 @@
  * MANIFEST CONSTANTS
  */
 
-/* Suggested 1s delay before state machine server is ready */
-#define BATTERY_MANAGER_SERVER_START_DELAY_PI_US 1000000L
-
 /*
  * TYPES
  */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#define DEBUG_MODULE DEBUG_MODULE_CLIENT /* Before rob_system.h */
 #include <rob_system.h>
 #include <hardware_types.h>
 #include <messaging_server.h>
@@ -53,6 +54,7 @@ Bool batteryManagerServerSendReceive (BatteryManagerMsgType msgType, void *pSend
 {
     ClientReturnCode returnCode;
     Bool success = false;
+    MessagingClientMsgs *pMsgs;
     Msg *pSendMsg;
     Msg *pReceivedMsg;
     UInt16 receivedMsgBodyLength = 0;
@@ -60,58 +62,50 @@ Bool batteryManagerServerSendReceive (BatteryManagerMsgType msgType, void *pSend
     ASSERT_PARAM (msgType < MAX_NUM_BATTERY_MANAGER_MSGS, msgType);
     ASSERT_PARAM (sendMsgBodyLength <= MAX_MSG_BODY_LENGTH, sendMsgBodyLength);
 
-    pSendMsg = malloc (sizeof (*pSendMsg));
+    pMsgs = getMessagingClientMsgs();
+    pSendMsg = &(pMsgs->sendMsg);
+    pReceivedMsg = &(pMsgs->receivedMsg);
     
-    if (pSendMsg != PNULL)
+    /* Put in the bit before the body */
+    pSendMsg->msgLength = 0;
+    pSendMsg->msgType = msgType;
+    pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+
+    /* Put any stuff to send */
+    if (pSendMsgBody != PNULL)
     {
-        pReceivedMsg = malloc (sizeof (*pReceivedMsg));
+        memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
+    }
+    pSendMsg->msgLength += sendMsgBodyLength;
         
-        if (pReceivedMsg != PNULL)
+    pReceivedMsg->msgLength = 0;
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "BM Client: sending message %s, length %d, hex dump:\n", pgBatteryManagerMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
+    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pSendMsg, pSendMsg->msgLength + 1);
+    returnCode = runMessagingClient ((SInt32) atoi (BATTERY_MANAGER_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "BM Client: message system returnCode: %d\n", returnCode);
+    /* This code makes assumptions about packing (i.e. that it's '1' and that the
+     * Bool 'success' is at the start of the body) so be careful */
+    if (returnCode == CLIENT_SUCCESS && (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType)))
+    {
+        /* Check the Bool 'success' at the start of the message body */
+        receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "BM Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
+        DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pReceivedMsg, pReceivedMsg->msgLength + 1);
+        if (receivedMsgBodyLength >= sizeof (Bool))
         {
-            /* Put in the bit before the body */
-            pSendMsg->msgLength = 0;
-            pSendMsg->msgType = msgType;
-            pSendMsg->msgLength += sizeof (pSendMsg->msgType);
-                        
-            /* Put any stuff to send */
-            if (pSendMsgBody != PNULL)
+            DEBUG_PRINT (DEBUG_LEVEL_TRACE, "BM Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
+            if ((Bool) pReceivedMsg->msgBody[0])
             {
-                memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
-            }
-            pSendMsg->msgLength += sendMsgBodyLength;
-            
-            pReceivedMsg->msgLength = 0;
-    
-            printDebug ("BM Client: sending message %s, length %d, hex dump:\n", pgBatteryManagerMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
-            printHexDump (pSendMsg, pSendMsg->msgLength + 1);
-            returnCode = runMessagingClient ((SInt32) atoi (BATTERY_MANAGER_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
-                    
-            printDebug ("BM Client: message system returnCode: %d\n", returnCode);
-            /* This code makes assumptions about packing (i.e. that it's '1' and that the
-             * Bool 'success' is at the start of the body) so be careful */
-            if (returnCode == CLIENT_SUCCESS && (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType)))
-            { 
-                /* Check the Bool 'success' at the start of the message body */
-                receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
-                printDebug ("BM Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
-                printHexDump (pReceivedMsg, pReceivedMsg->msgLength + 1);
-                if (receivedMsgBodyLength >= sizeof (Bool))
+                success = true;
+                if (pReceivedMsgSpecifics != PNULL)
                 {
-                    printDebug ("BM Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
-                    if ((Bool) pReceivedMsg->msgBody[0])
-                    {
-                        success = true;
-                        if (pReceivedMsgSpecifics != PNULL)
-                        {
-                            /* Copy out the bits beyond the success field for passing back */
-                            memcpy (pReceivedMsgSpecifics, &pReceivedMsg->msgBody[0] + sizeof (Bool), receivedMsgBodyLength - sizeof (Bool));
-                        }
-                    }
+                    /* Copy out the bits beyond the success field for passing back */
+                    memcpy (pReceivedMsgSpecifics, &pReceivedMsg->msgBody[0] + sizeof (Bool), receivedMsgBodyLength - sizeof (Bool));
                 }
             }
-            free (pReceivedMsg);
         }
-        free (pSendMsg);
     }
 
     return success;
@@ -50,7 +50,11 @@
 #define MAX_LEN_HARDWARE_MSG_Q 20
 
 /* The time between messages that need to be offset */
-#define SEND_MSG_OFFSET_DURATION_DECISECONDS 20
+#define SEND_MSG_OFFSET_DURATION_MICROSECONDS 2000000L
+
+/* The ID of the periodic timer that offsets them, a local timer
+ * so that each expiry is handled here without any messaging */
+#define SEND_MSG_OFFSET_TIMER_ID 0
 
 /*
  * TYPES
@@ -82,7 +86,6 @@ BatteryContainerData gBatteryDataContainerO2;
 BatteryContainerData gBatteryDataContainerO3;
 HardwareMsgType gHardwareMsgQ [MAX_LEN_HARDWARE_MSG_Q];
 UInt8 gHardwareMsgQLen = 0;
-UInt16 gThisServerPort = 0;
 ShortMsg gTimerExpiryMsg;
 Bool gTimerRunning = false;
 
@@ -291,13 +294,21 @@ static void sendMsgOffset (HardwareMsgType hardwareMsgType)
     {
         printDebug ("Sending message 0x%x to HW immediately, (timer not running).\n", hardwareMsgType);
         /* If there's no timer running, don't bother to queue this
-         * one as there's nothing to offset it from, just send it */
-        hardwareServerSendReceive (hardwareMsgType, PNULL, 0, PNULL);
+         * one as there's nothing to offset it from, just send it,
+         * without holding everything up waiting for the response */
+        hardwareServerSendAsync (hardwareMsgType, PNULL, 0);
         
-        /* Start the offset timer, with the msg as the ID just for debug purposes */
-        printDebug ("Message offset timer started.\n");
-        sendStartTimer (SEND_MSG_OFFSET_DURATION_DECISECONDS, hardwareMsgType, gThisServerPort, &gTimerExpiryMsg);
-        gTimerRunning = true;
+        /* Start the offset timer, which keeps going until the queue is empty;
+         * if it won't start the next message is sent immediately too */
+        gTimerRunning = startLocalPeriodicTimer (SEND_MSG_OFFSET_DURATION_MICROSECONDS, SEND_MSG_OFFSET_TIMER_ID, &gTimerExpiryMsg);
+        if (gTimerRunning)
+        {
+            printDebug ("Message offset timer started.\n");
+        }
+        else
+        {
+            printDebug ("Message offset timer couldn't be started.\n");
+        }
     }
     else
     {
@@ -454,7 +465,6 @@ static UInt16 actionBatteryManagerServerStart (BatteryManagerServerStartCnf *pSe
     gAllFullyCharged = false;
     gAllInsufficientCharge = false;
     gHardwareMsgQLen = 0;
-    gThisServerPort = atoi (BATTERY_MANAGER_SERVER_PORT_STRING);
     gTimerRunning = false;
     
     memset (&gBatteryDataContainerRio, false, sizeof (gBatteryDataContainerRio));
@@ -623,24 +633,19 @@ static UInt16 actionBatteryManagerChargingPermitted (Bool isPermitted)
 static UInt16 actionBatteryManagerTimerExpiry (void)
 {
     printDebug ("Message offset timer expired.\n");
-    gTimerRunning = false;
     if (gHardwareMsgQLen > 0)
     {
-        /* Send the next thing in the queue */
-        hardwareServerSendReceive (gHardwareMsgQ[gHardwareMsgQLen - 1], PNULL, 0, PNULL);
+        /* Send the next thing in the queue, the timer carries on for the one after */
+        hardwareServerSendAsync (gHardwareMsgQ[gHardwareMsgQLen - 1], PNULL, 0);
         gHardwareMsgQLen--;
         printDebug ("Sending message 0x%x to HW, (%d in the queue).\n", gHardwareMsgQ[gHardwareMsgQLen], gHardwareMsgQLen);
-        if (gHardwareMsgQLen > 0)
-        {
-            printDebug ("Message offset timer restarted.\n");
-            /* If there's still something in the queue, set the timer off again */
-            sendStartTimer (SEND_MSG_OFFSET_DURATION_DECISECONDS, gHardwareMsgQ[gHardwareMsgQLen - 1], gThisServerPort, &gTimerExpiryMsg);
-            gTimerRunning = true;
-        }
     }
-    else
+    else if (gTimerRunning)
     {
-        printDebug ("No messages in the queue though.\n");
+        /* Nothing to offset from any more */
+        printDebug ("No messages in the queue, message offset timer stopped.\n");
+        stopLocalTimer (SEND_MSG_OFFSET_TIMER_ID);
+        gTimerRunning = false;
     }
     
     return 0;
@@ -8,15 +8,36 @@
 #include <string.h>
 #include <rob_system.h>
 #include <messaging_server.h>
+#include <messaging_client.h>
 #include <hardware_types.h>
+#include <timer_server.h>
+#include <timer_msg_auto.h>
+#include <timer_client.h>
 #include <battery_manager_server.h>
 #include <battery_manager_msg_auto.h>
 #include <battery_manager_client.h>
 
+/*
+ * EXTERN
+ */
+
+/* The names of the messages, for the stats the server keeps */
+extern Char *pgBatteryManagerMessageNames[];
+
 /*
  * STATIC FUNCTIONS
  */
 
+/*
+ * Called from the server's event loop when responses
+ * have arrived to messages sent without waiting for
+ * them, e.g. to the Hardware Server.
+ */
+static void clientPollHandler (void)
+{
+    pollMessagingClientRequests (0);
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
@@ -31,6 +52,7 @@ int main (int argc, char **argv)
     UInt16 batteryManagerServerPort;
 
     setDebugPrintsOnToFile ("roboonebatterymanager.log");
+    setFlightRecorderOn ("roboonebatterymanager.flt", FLIGHT_RECORDER_DEFAULT_NUM_RECORDS);
     setProgressPrintsOn();
 
     if (argc == 2)
@@ -39,7 +61,18 @@ int main (int argc, char **argv)
         batteryManagerServerPort = atoi (argv[1]);
         printProgress ("Battery manager server listening on port %d.\n", batteryManagerServerPort);
 
-        returnCode = runMessagingServer (batteryManagerServerPort);
+        /* Responses to messages sent without waiting for them are dealt with in
+         * the event loop, as are the expiries of the message offset timer, which is local */
+        if (addMessagingServerPollFd (getMessagingClientPollFd(), clientPollHandler) && startLocalTimers())
+        {
+            setMessagingServerMsgNames (pgBatteryManagerMessageNames, MAX_NUM_BATTERY_MANAGER_MSGS);
+            returnCode = runMessagingServer (batteryManagerServerPort);
+            stopLocalTimers();
+        }
+        else
+        {
+            printProgress ("Battery manager server couldn't set up its event loop.\n");
+        }
         
         if (returnCode == SERVER_EXIT_NORMALLY)
         {
@@ -6,14 +6,28 @@
  * MANIFEST CONSTANTS
  */
 
-/* Suggested 0.5s delay before state machine server is ready */
-#define HARDWARE_SERVER_START_DELAY_PI_US 500000L
+/* The most messages in a hardwareServerSendReceiveBatch() */
+#define HARDWARE_CLIENT_MAX_BATCH_SIZE 16
 
 /*
  * TYPES
  */
 
+/* A message for hardwareServerSendReceiveBatch(), the
+ * fields being as the parameters of hardwareServerSendReceive() */
+typedef struct HardwareServerRequestTag
+{
+    HardwareMsgType msgType;
+    void *pSendMsgBody;
+    UInt16 sendMsgBodyLength;
+    void *pReceivedMsgSpecifics;
+} HardwareServerRequest;
+
 /*
  * FUNCTION PROTOTYPES
  */
-Bool hardwareServerSendReceive (HardwareMsgType msgType, void *pSendMsgBody, UInt16 sendMsgBodyLength, void *pReceivedMsgSpecifics);
\ No newline at end of file
+Bool hardwareServerSendReceive (HardwareMsgType msgType, void *pSendMsgBody, UInt16 sendMsgBodyLength, void *pReceivedMsgSpecifics);
+Bool hardwareServerSendReceiveBatch (HardwareServerRequest *pRequests, UInt32 numRequests);
+Bool hardwareServerSendAsync (HardwareMsgType msgType, void *pSendMsgBody, UInt16 sendMsgBodyLength);
+Bool hardwareServerSubscribe (HardwareTopic topic, UInt16 subscriberPort, UInt32 minIntervalMs, UInt32 maxIntervalMs);
+Bool hardwareServerUnsubscribe (HardwareTopic topic, UInt16 subscriberPort);
\ No newline at end of file
@@ -5,29 +5,36 @@
 /* Macro for empty message member to keep the compiler happy */
 #define HARDWARE_EMPTY UInt8 nothing
 
+/* Values for whether a message may be handled at the same time as others */
+#define HARDWARE_SERIAL     false
+#define HARDWARE_CONCURRENT true
+
 /* The basic message macro, never used by itself but included her for completeness */
-#define HARDWARE_MSG_DEF(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER)
+#define HARDWARE_MSG_DEF(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT)
 
 /* Extract the message type from the list */
-#define HARDWARE_MSG_DEF_TYPE(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER) mSGtYPE,
+#define HARDWARE_MSG_DEF_TYPE(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT) mSGtYPE,
 
 /* Make a message name from the list */
-#define HARDWARE_MSG_DEF_NAME(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER) #mSGtYPE,
+#define HARDWARE_MSG_DEF_NAME(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT) #mSGtYPE,
+
+/* Make an array of whether each message may be handled concurrently from the list */
+#define HARDWARE_MSG_DEF_CONCURRENT(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT) cONCURRENT,
 
 /* Construct a full typedef for a REQ (incoming) message */
-#define MAKE_HARDWARE_MSG_STRUCT_REQ(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER) typedef struct mSGsTRUCT##ReqTag  \
-                                                                                                {                                 \
-                                                                                                    rEQmSGmEMBER;                 \
-                                                                                                } mSGsTRUCT##Req;
+#define MAKE_HARDWARE_MSG_STRUCT_REQ(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT) typedef struct mSGsTRUCT##ReqTag  \
+                                                                                                            {                                 \
+                                                                                                                rEQmSGmEMBER;                 \
+                                                                                                            } mSGsTRUCT##Req;
 
 /* Construct a full typedef for a CNF (outgoing) message with the standard success field at the start */
-#define MAKE_HARDWARE_MSG_STRUCT_CNF(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER) typedef struct mSGsTRUCT##CnfTag   \
-                                                                                                {                                  \
-                                                                                                    Bool success;                  \
-                                                                                                    cNFmSGmEMBER;                  \
-                                                                                                } mSGsTRUCT##Cnf;
+#define MAKE_HARDWARE_MSG_STRUCT_CNF(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT) typedef struct mSGsTRUCT##CnfTag   \
+                                                                                                            {                                  \
+                                                                                                                Bool success;                  \
+                                                                                                                cNFmSGmEMBER;                  \
+                                                                                                            } mSGsTRUCT##Cnf;
 
 /* Construct the members of the message unions */
-#define MAKE_HARDWARE_UNION_MEMBER_REQ(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER)        mSGsTRUCT##Req mSGmEMBER##Req;
-#define MAKE_HARDWARE_UNION_MEMBER_CNF(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER)        mSGsTRUCT##Cnf mSGmEMBER##Cnf;
+#define MAKE_HARDWARE_UNION_MEMBER_REQ(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT)        mSGsTRUCT##Req mSGmEMBER##Req;
+#define MAKE_HARDWARE_UNION_MEMBER_CNF(mSGtYPE, mSGsTRUCT, mSGmEMBER, rEQmSGmEMBER, cNFmSGmEMBER, cONCURRENT)        mSGsTRUCT##Cnf mSGmEMBER##Cnf;
 
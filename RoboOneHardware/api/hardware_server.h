@@ -73,6 +73,46 @@ typedef struct HardwareChargeStateTag
     ChargeState state[NUM_CHARGERS];
 } HardwareChargeState;
 
+/*
+ * TYPES FOR PUBLISHED TOPICS
+ */
+
+/* The topics that the hardware server publishes, each read
+ * regularly while it has subscribers, see hardwareServerSubscribe().
+ * The battery topics are in the same order as the chargers */
+typedef enum HardwareTopicTag
+{
+    HARDWARE_TOPIC_RIO_BATT = 0,         /* HardwareBattTelemetry */
+    HARDWARE_TOPIC_O1_BATT = 1,          /* HardwareBattTelemetry */
+    HARDWARE_TOPIC_O2_BATT = 2,          /* HardwareBattTelemetry */
+    HARDWARE_TOPIC_O3_BATT = 3,          /* HardwareBattTelemetry */
+    HARDWARE_TOPIC_RELAYS = 4,           /* HardwareRelayState */
+    HARDWARE_TOPIC_CHARGER_STATE = 5,    /* HardwareChargeState, only published when flash detection was possible */
+    HARDWARE_TOPIC_MAINS_12V = 6,        /* Bool, true if mains 12V is present */
+    NUM_HARDWARE_TOPICS
+} HardwareTopic;
+
+/* What is known of a battery */
+typedef struct HardwareBattTelemetryTag
+{
+    SInt16 current;
+    UInt16 voltage;
+    UInt16 remainingCapacity;
+    HardwareChargeDischarge chargeDischarge;
+    double temperature;
+} HardwareBattTelemetry;
+
+/* The state of the relays that switch power to the Pi/RIO and the Hindbrain */
+typedef struct HardwareRelayStateTag
+{
+    Bool onPCBRelaysEnabled;
+    Bool rioPwr12V;
+    Bool rioPwrBatt;
+    Bool externalRelaysEnabled;
+    Bool oPwr12V;
+    Bool oPwrBatt;
+} HardwareRelayState;
+
 typedef struct OResponseStringTag
 {
     Char   string[MAX_O_STRING_LENGTH];
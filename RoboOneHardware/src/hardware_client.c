@@ -5,12 +5,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#define DEBUG_MODULE DEBUG_MODULE_CLIENT /* Before rob_system.h */
 #include <rob_system.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
 #include <hardware_types.h>
 #include <hardware_server.h>
 #include <hardware_msg_auto.h>
+#include <hardware_client.h>
 
 /*
  * MANIFEST CONSTANTS
@@ -25,6 +27,102 @@ extern Char *pgHardwareMessageNames[];
  * STATIC FUNCTIONS
  */
 
+/*
+ * Put together a message for the Hardware Server.
+ *
+ * msgType           the message type to send.
+ * pSendMsgBody      pointer to the body of the
+ *                   REQuest message to send.
+ *                   May be PNULL.
+ * sendMsgBodyLength the length of the data that
+ *                   pSendMsgBody points to.
+ * pSendMsg          a place to put the message.
+ */
+static void buildMsg (HardwareMsgType msgType, void *pSendMsgBody, UInt16 sendMsgBodyLength, Msg *pSendMsg)
+{
+    ASSERT_PARAM (msgType < MAX_NUM_HARDWARE_MSGS, msgType);
+    ASSERT_PARAM (sendMsgBodyLength <= MAX_MSG_BODY_LENGTH, sendMsgBodyLength);
+
+    /* Put in the bit before the body */
+    pSendMsg->msgLength = 0;
+    pSendMsg->msgType = msgType;
+    pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+
+    /* Put any stuff to send */
+    if (pSendMsgBody != PNULL)
+    {
+        memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
+    }
+    pSendMsg->msgLength += sendMsgBodyLength;
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: sending message %s, length %d, hex dump:\n", pgHardwareMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
+    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pSendMsg, pSendMsg->msgLength + 1);
+}
+
+/*
+ * Check the response from the Hardware Server
+ * and pass back what is in it.
+ *
+ * pReceivedMsg          the response.
+ * pReceivedMsgSpecifics pointer to the part of the
+ *                       received CNF message after the
+ *                       generic 'success' part.  May be
+ *                       PNULL.
+ *
+ * @return           true if the response message
+ *                   indicates success, otherwise false.
+ */
+static Bool takeResponse (Msg *pReceivedMsg, void *pReceivedMsgSpecifics)
+{
+    Bool success = false;
+    UInt16 receivedMsgBodyLength = 0;
+
+    /* This code makes assumptions about packing (i.e. that it's '1' and that the
+     * Bool 'success' is at the start of the body) so be careful */
+    if (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType))
+    {
+        /* Check the Bool 'success' at the start of the message body */
+        receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
+        DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pReceivedMsg, pReceivedMsg->msgLength + 1);
+        if (receivedMsgBodyLength >= sizeof (Bool))
+        {
+            DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
+            if ((Bool) pReceivedMsg->msgBody[0])
+            {
+                success = true;
+                if (pReceivedMsgSpecifics != PNULL)
+                {
+                    /* Copy out the bits beyond the success field for passing back */
+                    memcpy (pReceivedMsgSpecifics, &pReceivedMsg->msgBody[0] + sizeof (Bool), receivedMsgBodyLength - sizeof (Bool));
+                }
+            }
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Called with the response to a message sent with
+ * hardwareServerSendAsync().
+ *
+ * returnCode    how the exchange with the Hardware
+ *               Server went.
+ * pReceivedMsg  the response.
+ * pContext      the message type that was sent.
+ */
+static void asyncCallback (ClientReturnCode returnCode, Msg *pReceivedMsg, void *pContext)
+{
+    HardwareMsgType msgType = (HardwareMsgType) (unsigned long) pContext;
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: message system returnCode for message %s sent without waiting: %d\n", pgHardwareMessageNames[msgType], returnCode);
+    if ((returnCode != CLIENT_SUCCESS) || !takeResponse (pReceivedMsg, PNULL))
+    {
+        DEBUG_PRINT (DEBUG_LEVEL_ERROR, "HW Client: message %s sent without waiting failed.\n", pgHardwareMessageNames[msgType]);
+    }
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
@@ -53,66 +151,157 @@ Bool hardwareServerSendReceive (HardwareMsgType msgType, void *pSendMsgBody, UIn
 {
     ClientReturnCode returnCode;
     Bool success = false;
+    MessagingClientMsgs *pMsgs;
     Msg *pSendMsg;
     Msg *pReceivedMsg;
-    UInt16 receivedMsgBodyLength = 0;
 
-    ASSERT_PARAM (msgType < MAX_NUM_HARDWARE_MSGS, msgType);
-    ASSERT_PARAM (sendMsgBodyLength <= MAX_MSG_BODY_LENGTH, sendMsgBodyLength);
-
-    pSendMsg = malloc (sizeof (*pSendMsg));
+    pMsgs = getMessagingClientMsgs();
+    pSendMsg = &(pMsgs->sendMsg);
+    pReceivedMsg = &(pMsgs->receivedMsg);
     
-    if (pSendMsg != PNULL)
+    buildMsg (msgType, pSendMsgBody, sendMsgBodyLength, pSendMsg);
+    pReceivedMsg->msgLength = 0;
+
+    returnCode = runMessagingClient ((SInt32) atoi (HARDWARE_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: message system returnCode: %d\n", returnCode);
+    if (returnCode == CLIENT_SUCCESS)
     {
-        pReceivedMsg = malloc (sizeof (*pReceivedMsg));
-        
-        if (pReceivedMsg != PNULL)
+        success = takeResponse (pReceivedMsg, pReceivedMsgSpecifics);
+    }
+
+    return success;
+}
+
+/*
+ * Send a batch of messages to the Hardware Server
+ * in one go, rather than waiting for the response
+ * to each before sending the next, and get the
+ * responses back.
+ *
+ * pRequests    the messages to send and where to put
+ *              what comes back from each, as for
+ *              hardwareServerSendReceive().
+ * numRequests  the number of entries in pRequests, at
+ *              most HARDWARE_CLIENT_MAX_BATCH_SIZE.
+ *
+ * @return      true if all the messages were sent
+ *              and received and all the responses
+ *              indicate success, otherwise false.
+ */
+Bool hardwareServerSendReceiveBatch (HardwareServerRequest *pRequests, UInt32 numRequests)
+{
+    ClientReturnCode returnCode;
+    Bool success = false;
+    Msg sendMsg[HARDWARE_CLIENT_MAX_BATCH_SIZE];
+    Msg receivedMsg[HARDWARE_CLIENT_MAX_BATCH_SIZE];
+    MessagingClientExchange exchanges[HARDWARE_CLIENT_MAX_BATCH_SIZE];
+    UInt32 x;
+
+    ASSERT_PARAM (numRequests <= HARDWARE_CLIENT_MAX_BATCH_SIZE, numRequests);
+
+    for (x = 0; x < numRequests; x++)
+    {
+        buildMsg (pRequests[x].msgType, pRequests[x].pSendMsgBody, pRequests[x].sendMsgBodyLength, &(sendMsg[x]));
+        receivedMsg[x].msgLength = 0;
+        exchanges[x].pSendMsg = &(sendMsg[x]);
+        exchanges[x].pReceivedMsg = &(receivedMsg[x]);
+    }
+
+    returnCode = runMessagingClientBatch ((SInt32) atoi (HARDWARE_SERVER_PORT_STRING), PNULL, exchanges, numRequests);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: message system returnCode for batch of %ld: %d\n", numRequests, returnCode);
+    if (returnCode == CLIENT_SUCCESS)
+    {
+        success = true;
+        for (x = 0; (x < numRequests) && success; x++)
         {
-            /* Put in the bit before the body */
-            pSendMsg->msgLength = 0;
-            pSendMsg->msgType = msgType;
-            pSendMsg->msgLength += sizeof (pSendMsg->msgType);
-                        
-            /* Put any stuff to send */
-            if (pSendMsgBody != PNULL)
-            {
-                memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
-            }
-            pSendMsg->msgLength += sendMsgBodyLength;
-            
-            pReceivedMsg->msgLength = 0;
-    
-            printDebug ("HW Client: sending message %s, length %d, hex dump:\n", pgHardwareMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
-            printHexDump (pSendMsg, pSendMsg->msgLength + 1);
-            returnCode = runMessagingClient ((SInt32) atoi (HARDWARE_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
-                    
-            printDebug ("HW Client: message system returnCode: %d\n", returnCode);
-            /* This code makes assumptions about packing (i.e. that it's '1' and that the
-             * Bool 'success' is at the start of the body) so be careful */
-            if (returnCode == CLIENT_SUCCESS && (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType)))
-            { 
-                /* Check the Bool 'success' at the start of the message body */
-                receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
-                printDebug ("HW Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
-                printHexDump (pReceivedMsg, pReceivedMsg->msgLength + 1);
-                if (receivedMsgBodyLength >= sizeof (Bool))
-                {
-                    printDebug ("HW Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
-                    if ((Bool) pReceivedMsg->msgBody[0])
-                    {
-                        success = true;
-                        if (pReceivedMsgSpecifics != PNULL)
-                        {
-                            /* Copy out the bits beyond the success field for passing back */
-                            memcpy (pReceivedMsgSpecifics, &pReceivedMsg->msgBody[0] + sizeof (Bool), receivedMsgBodyLength - sizeof (Bool));
-                        }
-                    }
-                }
-            }
-            free (pReceivedMsg);
+            success = takeResponse (&(receivedMsg[x]), pRequests[x].pReceivedMsgSpecifics);
         }
-        free (pSendMsg);
     }
 
     return success;
-}
\ No newline at end of file
+}
+
+/*
+ * Send a message to the Hardware Server without
+ * waiting for the response, for when all that
+ * matters is that it gets there: if the response
+ * indicates failure that is only logged.  The
+ * response is dealt with by
+ * pollMessagingClientRequests(), which the caller
+ * must arrange to call, e.g. from its server's
+ * event loop, see getMessagingClientPollFd().
+ *
+ * msgType           the message type to send.
+ * pSendMsgBody      pointer to the body of the
+ *                   REQuest message to send.
+ *                   May be PNULL.
+ * sendMsgBodyLength the length of the data that
+ *                   pSendMsgBody points to.
+ *
+ * @return           true if the message was sent,
+ *                   otherwise false.
+ */
+Bool hardwareServerSendAsync (HardwareMsgType msgType, void *pSendMsgBody, UInt16 sendMsgBodyLength)
+{
+    ClientReturnCode returnCode;
+    Msg sendMsg;
+
+    buildMsg (msgType, pSendMsgBody, sendMsgBodyLength, &sendMsg);
+
+    returnCode = startMessagingClientRequest ((SInt32) atoi (HARDWARE_SERVER_PORT_STRING), PNULL, &sendMsg, asyncCallback, (void *) (unsigned long) msgType);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: message system returnCode for message sent without waiting: %d\n", returnCode);
+
+    return (returnCode == CLIENT_SUCCESS);
+}
+
+/*
+ * Ask the Hardware Server to send updates of a
+ * topic to the server on subscriberPort, which
+ * must be on this machine and will receive them in
+ * its MessagingServerPublicationHandler, instead of
+ * reading the things in the topic over and over.
+ * See subscribeMessagingServerTopic() for how often
+ * they are sent.
+ *
+ * topic           the topic.
+ * subscriberPort  the port number of the subscriber.
+ * minIntervalMs   the shortest time between updates.
+ * maxIntervalMs   the longest time between updates,
+ *                 0 for no updates without a change.
+ *
+ * @return         true if the subscription was made,
+ *                 otherwise false.
+ */
+Bool hardwareServerSubscribe (HardwareTopic topic, UInt16 subscriberPort, UInt32 minIntervalMs, UInt32 maxIntervalMs)
+{
+    ClientReturnCode returnCode;
+
+    returnCode = subscribeMessagingServerTopic ((SInt32) atoi (HARDWARE_SERVER_PORT_STRING), PNULL, (MessagingTopic) topic, subscriberPort, minIntervalMs, maxIntervalMs);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: message system returnCode for subscription to topic %d: %d\n", topic, returnCode);
+
+    return (returnCode == CLIENT_SUCCESS);
+}
+
+/*
+ * Ask the Hardware Server to stop sending updates
+ * of a topic to the server on subscriberPort.
+ *
+ * topic           the topic.
+ * subscriberPort  the port number of the subscriber.
+ *
+ * @return         true if successful, otherwise false.
+ */
+Bool hardwareServerUnsubscribe (HardwareTopic topic, UInt16 subscriberPort)
+{
+    ClientReturnCode returnCode;
+
+    returnCode = unsubscribeMessagingServerTopic ((SInt32) atoi (HARDWARE_SERVER_PORT_STRING), PNULL, (MessagingTopic) topic, subscriberPort);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "HW Client: message system returnCode for unsubscription from topic %d: %d\n", topic, returnCode);
+
+    return (returnCode == CLIENT_SUCCESS);
+}
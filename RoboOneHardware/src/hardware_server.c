@@ -6,6 +6,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <rob_system.h>
 #include <one_wire.h>
 #include <messaging_server.h>
@@ -20,10 +23,32 @@
  * MANIFEST CONSTANTS
  */
 
+/* How often the topics that have subscribers are read */
+#define TELEMETRY_INTERVAL_MS 250
+
+/* The remaining capacity, lifetime charge/discharge and
+ * temperature of a battery change slowly, so are only read
+ * every this many times that the current and voltage are */
+#define TELEMETRY_SLOW_BACKOFF 10
+
+/* The charger state must be read no less than one second
+ * apart to detect flashing, so is read every this many times */
+#define TELEMETRY_CHARGER_STATE_BACKOFF 4
+
 /*
  * TYPES
  */
 
+/* The functions that read the things about one battery */
+typedef struct BattReadFunctionsTag
+{
+    Bool (*pReadCurrent) (SInt16 *pCurrent);
+    Bool (*pReadVoltage) (UInt16 *pVoltage);
+    Bool (*pReadRemainingCapacity) (UInt16 *pRemainingCapacity);
+    Bool (*pReadChargeDischarge) (UInt32 *pCharge, UInt32 *pDischarge);
+    Bool (*pReadTemperature) (double *pTemperature);
+} BattReadFunctions;
+
 /*
  * EXTERNS
  */
@@ -33,10 +58,286 @@ extern Char *pgHardwareMessageNames[];
  * GLOBALS - prefixed with g
  */
 
+/* Whether each message may be handled at the same time as the others */
+const Bool gHardwareMsgIsConcurrent[] =
+{
+#undef HARDWARE_MSG_DEF
+#define HARDWARE_MSG_DEF HARDWARE_MSG_DEF_CONCURRENT
+#include <hardware_msgs.h>
+};
+
+/* The functions for each battery, in the same order as the chargers */
+static const BattReadFunctions gBattReadFunctions[NUM_CHARGERS] =
+{
+    {readRioBattCurrent, readRioBattVoltage, readRioRemainingCapacity, readRioBattLifetimeChargeDischarge, readRioBattTemperature},
+    {readO1BattCurrent, readO1BattVoltage, readO1RemainingCapacity, readO1BattLifetimeChargeDischarge, readO1BattTemperature},
+    {readO2BattCurrent, readO2BattVoltage, readO2RemainingCapacity, readO2BattLifetimeChargeDischarge, readO2BattTemperature},
+    {readO3BattCurrent, readO3BattVoltage, readO3RemainingCapacity, readO3BattLifetimeChargeDischarge, readO3BattTemperature}
+};
+
+/* Held while the OneWire bus is in use, by a HARDWARE_SERIAL
+ * message or by the telemetry thread */
+static pthread_mutex_t gOneWireLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The thread that reads the topics that have subscribers and
+ * publishes them, and what tells it to stop, protected by
+ * gTelemetryLock */
+static pthread_t gTelemetryThread;
+static Bool gTelemetryThreadIsRunning = false;
+static Bool gTelemetryThreadExiting = false;
+static pthread_mutex_t gTelemetryLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gTelemetryExit;
+
+/* The last charger state read by the telemetry thread and
+ * whether reading it was successful, protected by gTelemetryLock.
+ * readChargerState() detects flashing from one call to the next
+ * so, while the thread is running, a HARDWARE_READ_CHARGER_STATE
+ * message gets this rather than calling it as well */
+static HardwareChargeState gChargerState;
+static Bool gChargerStateSuccess = false;
+static Bool gChargerStateIsRead = false;
+
 /*
  * STATIC FUNCTIONS
  */
 
+/*
+ * Read the things about one battery and publish
+ * them.  The slower changing things are only read
+ * on some occasions, the last values read being
+ * published with the current and voltage otherwise.
+ *
+ * charger         the charger of the battery.
+ * pTelemetry      the last values published.
+ * readSlowThings  true to read the slower changing
+ *                 things.
+ */
+static void publishBattTelemetry (Charger charger, HardwareBattTelemetry *pTelemetry, Bool readSlowThings)
+{
+    const BattReadFunctions *pFunctions = &(gBattReadFunctions[charger]);
+    HardwareBattTelemetry telemetry;
+    Bool success;
+
+    memcpy (&telemetry, pTelemetry, sizeof (telemetry));
+
+    pthread_mutex_lock (&gOneWireLock);
+    success = pFunctions->pReadCurrent (&telemetry.current) && pFunctions->pReadVoltage (&telemetry.voltage);
+    if (success && readSlowThings)
+    {
+        success = pFunctions->pReadRemainingCapacity (&telemetry.remainingCapacity) &&
+                  pFunctions->pReadChargeDischarge (&telemetry.chargeDischarge.charge, &telemetry.chargeDischarge.discharge) &&
+                  pFunctions->pReadTemperature (&telemetry.temperature);
+    }
+    pthread_mutex_unlock (&gOneWireLock);
+
+    if (success)
+    {
+        memcpy (pTelemetry, &telemetry, sizeof (*pTelemetry));
+        publishMessagingServerTopic ((MessagingTopic) (HARDWARE_TOPIC_RIO_BATT + charger), pTelemetry, sizeof (*pTelemetry));
+    }
+}
+
+/*
+ * Read the state of the relays and publish it.
+ */
+static void publishRelayState (void)
+{
+    HardwareRelayState relayState;
+    Bool success;
+
+    memset (&relayState, false, sizeof (relayState));
+
+    pthread_mutex_lock (&gOneWireLock);
+    success = readOnPCBRelaysEnabled (&relayState.onPCBRelaysEnabled) && readRioPwr12V (&relayState.rioPwr12V) &&
+              readRioPwrBatt (&relayState.rioPwrBatt) && readExternalRelaysEnabled (&relayState.externalRelaysEnabled) &&
+              readOPwr12V (&relayState.oPwr12V) && readOPwrBatt (&relayState.oPwrBatt);
+    pthread_mutex_unlock (&gOneWireLock);
+
+    if (success)
+    {
+        publishMessagingServerTopic (HARDWARE_TOPIC_RELAYS, &relayState, sizeof (relayState));
+    }
+}
+
+/*
+ * Read the state of the chargers, keeping it for
+ * HARDWARE_READ_CHARGER_STATE, and publish it if
+ * there are subscribers, but only if it was possible
+ * to detect flashing, otherwise the state isn't
+ * complete.
+ */
+static void publishChargerState (void)
+{
+    HardwareChargeState chargeState;
+    Bool success;
+
+    chargeState.flashDetectPossible = false;
+    memset (&chargeState.state, 0, sizeof (chargeState.state));
+
+    pthread_mutex_lock (&gOneWireLock);
+    success = readChargerState (&(chargeState.state[0]), &chargeState.flashDetectPossible);
+    pthread_mutex_unlock (&gOneWireLock);
+
+    pthread_mutex_lock (&gTelemetryLock);
+    memcpy (&gChargerState, &chargeState, sizeof (gChargerState));
+    gChargerStateSuccess = success;
+    gChargerStateIsRead = true;
+    pthread_mutex_unlock (&gTelemetryLock);
+
+    if (success && chargeState.flashDetectPossible && isMessagingServerTopicSubscribed (HARDWARE_TOPIC_CHARGER_STATE))
+    {
+        publishMessagingServerTopic (HARDWARE_TOPIC_CHARGER_STATE, &chargeState, sizeof (chargeState));
+    }
+}
+
+/*
+ * Read whether mains 12V is present and publish it.
+ */
+static void publishMains12V (void)
+{
+    Bool mains12VIsPresent = false;
+    Bool success;
+
+    pthread_mutex_lock (&gOneWireLock);
+    success = readMains12VPin (&mains12VIsPresent);
+    pthread_mutex_unlock (&gOneWireLock);
+
+    if (success)
+    {
+        publishMessagingServerTopic (HARDWARE_TOPIC_MAINS_12V, &mains12VIsPresent, sizeof (mains12VIsPresent));
+    }
+}
+
+/*
+ * The telemetry thread: every TELEMETRY_INTERVAL_MS
+ * read the topics that have subscribers and publish
+ * them, so that the subscribers don't each have to
+ * keep asking for the same things, until told to stop.
+ * The charger state is read whether it has subscribers
+ * or not, see gChargerState.
+ * The OneWire bus is only held while reading, so the
+ * HARDWARE_SERIAL messages are held up no more than
+ * they would be by a message that reads the same.
+ *
+ * pParam  not used.
+ *
+ * @return PNULL.
+ */
+static void *telemetryThread (void *pParam)
+{
+    HardwareBattTelemetry battTelemetry[NUM_CHARGERS];
+    struct timespec wakeTime;
+    UInt32 count;
+    UInt32 x;
+
+    memset (&(battTelemetry[0]), 0, sizeof (battTelemetry));
+    clock_gettime (CLOCK_MONOTONIC, &wakeTime);
+
+    pthread_mutex_lock (&gTelemetryLock);
+    for (count = 0; !gTelemetryThreadExiting; count++)
+    {
+        pthread_mutex_unlock (&gTelemetryLock);
+
+        for (x = 0; x < NUM_CHARGERS; x++)
+        {
+            if (isMessagingServerTopicSubscribed ((MessagingTopic) (HARDWARE_TOPIC_RIO_BATT + x)))
+            {
+                publishBattTelemetry ((Charger) x, &(battTelemetry[x]), (count % TELEMETRY_SLOW_BACKOFF) == 0);
+            }
+        }
+        if (isMessagingServerTopicSubscribed (HARDWARE_TOPIC_RELAYS))
+        {
+            publishRelayState();
+        }
+        if ((count % TELEMETRY_CHARGER_STATE_BACKOFF) == 0)
+        {
+            publishChargerState();
+        }
+        if (isMessagingServerTopicSubscribed (HARDWARE_TOPIC_MAINS_12V))
+        {
+            publishMains12V();
+        }
+
+        /* Wait until the next time, or until told to stop */
+        wakeTime.tv_nsec += TELEMETRY_INTERVAL_MS * 1000000L;
+        if (wakeTime.tv_nsec >= 1000000000L)
+        {
+            wakeTime.tv_sec++;
+            wakeTime.tv_nsec -= 1000000000L;
+        }
+        pthread_mutex_lock (&gTelemetryLock);
+        while (!gTelemetryThreadExiting && (pthread_cond_timedwait (&gTelemetryExit, &gTelemetryLock, &wakeTime) != ETIMEDOUT))
+        {
+        }
+    }
+    pthread_mutex_unlock (&gTelemetryLock);
+
+    return PNULL;
+}
+
+/*
+ * Start the telemetry thread, if it isn't running.
+ *
+ * @return  true if it is running, otherwise false.
+ */
+static Bool startTelemetryThread (void)
+{
+    pthread_condattr_t condAttr;
+
+    pthread_mutex_lock (&gTelemetryLock);
+    if (!gTelemetryThreadIsRunning)
+    {
+        /* Wait on the same clock as the thread counts time with */
+        pthread_condattr_init (&condAttr);
+        pthread_condattr_setclock (&condAttr, CLOCK_MONOTONIC);
+        pthread_cond_init (&gTelemetryExit, &condAttr);
+        pthread_condattr_destroy (&condAttr);
+        gTelemetryThreadExiting = false;
+        gChargerStateIsRead = false;
+        if (pthread_create (&gTelemetryThread, PNULL, telemetryThread, PNULL) == 0)
+        {
+            gTelemetryThreadIsRunning = true;
+        }
+        else
+        {
+            pthread_cond_destroy (&gTelemetryExit);
+            printDebug ("HW Server: couldn't start telemetry thread, err: %s.\n", strerror (errno));
+        }
+    }
+    pthread_mutex_unlock (&gTelemetryLock);
+
+    return gTelemetryThreadIsRunning;
+}
+
+/*
+ * Stop the telemetry thread, if it is running, and
+ * wait for it to finish.  Must not be called with
+ * gOneWireLock held.
+ */
+static void stopTelemetryThread (void)
+{
+    Bool isRunning;
+
+    pthread_mutex_lock (&gTelemetryLock);
+    isRunning = gTelemetryThreadIsRunning;
+    gTelemetryThreadExiting = true;
+    if (isRunning)
+    {
+        pthread_cond_signal (&gTelemetryExit);
+    }
+    pthread_mutex_unlock (&gTelemetryLock);
+
+    if (isRunning)
+    {
+        pthread_join (gTelemetryThread, PNULL);
+        pthread_cond_destroy (&gTelemetryExit);
+        pthread_mutex_lock (&gTelemetryLock);
+        gTelemetryThreadIsRunning = false;
+        gChargerStateIsRead = false;
+        pthread_mutex_unlock (&gTelemetryLock);
+    }
+}
+
 /*
  * Handle a message that will cause us to start.
  * 
@@ -72,6 +373,12 @@ static UInt16 actionHardwareServerStart (Bool batteriesOnly, HardwareServerStart
             findAllDevices();
         }
     }
+
+    /* Read and publish the topics that get subscribers from now on */
+    if (success)
+    {
+        success = startTelemetryThread();
+    }
     
     pSendMsgBody->success = success;
     sendMsgBodyLength += sizeof (pSendMsgBody->success);
@@ -138,7 +445,9 @@ static UInt16 actionReadChargerStatePins (HardwareReadChargerStatePinsCnf *pSend
 }
 
 /*
- * Handle a message that reads the charge state.
+ * Handle a message that reads the charge state,
+ * which is the last one the telemetry thread read
+ * if it is running.
  * 
  * pSendMsgBody  pointer to the relevant message
  *               type to fill in with a response,
@@ -150,7 +459,8 @@ static UInt16 actionReadChargerStatePins (HardwareReadChargerStatePinsCnf *pSend
  */
 static UInt16 actionReadChargerState (HardwareReadChargerStateCnf *pSendMsgBody)
 {
-    Bool success;
+    Bool success = false;
+    Bool telemetryThreadIsRunning;
     UInt16 sendMsgBodyLength = 0;
     HardwareChargeState chargeState;
     
@@ -159,7 +469,19 @@ static UInt16 actionReadChargerState (HardwareReadChargerStateCnf *pSendMsgBody)
     
     ASSERT_PARAM (pSendMsgBody != PNULL, (unsigned long) pSendMsgBody);
     
-    success = readChargerState (&(chargeState.state[0]), &chargeState.flashDetectPossible);
+    pthread_mutex_lock (&gTelemetryLock);
+    telemetryThreadIsRunning = gTelemetryThreadIsRunning;
+    if (telemetryThreadIsRunning && gChargerStateIsRead)
+    {
+        memcpy (&chargeState, &gChargerState, sizeof (chargeState));
+        success = gChargerStateSuccess;
+    }
+    pthread_mutex_unlock (&gTelemetryLock);
+    
+    if (!telemetryThreadIsRunning)
+    {
+        success = readChargerState (&(chargeState.state[0]), &chargeState.flashDetectPossible);
+    }
     pSendMsgBody->success = success;
     sendMsgBodyLength += sizeof (pSendMsgBody->success);
     memcpy (&(pSendMsgBody->chargeState), &chargeState, sizeof (pSendMsgBody->chargeState));
@@ -1202,6 +1524,7 @@ static ServerReturnCode doAction (HardwareMsgType receivedMsgType, UInt8 * pRece
 ServerReturnCode serverHandleMsg (Msg *pReceivedMsg, Msg *pSendMsg)
 {
     ServerReturnCode returnCode;
+    TraceSpan span;
     
     ASSERT_PARAM (pReceivedMsg != PNULL, (unsigned long) pReceivedMsg);
     ASSERT_PARAM (pSendMsg != PNULL, (unsigned long) pSendMsg);
@@ -1211,8 +1534,26 @@ ServerReturnCode serverHandleMsg (Msg *pReceivedMsg, Msg *pSendMsg)
     
     printDebug ("HW Server received message %s, length %d.\n", pgHardwareMessageNames[pReceivedMsg->msgType], pReceivedMsg->msgLength);
     printHexDump (pReceivedMsg, pReceivedMsg->msgLength + 1);
-    /* Do the thang */
+    /* Stop publishing before the OneWire bus goes: the
+     * telemetry thread can't be waited for with it held */
+    if (pReceivedMsg->msgType == HARDWARE_SERVER_STOP)
+    {
+        stopTelemetryThread();
+    }
+
+    /* Do the thang, the messages that aren't concurrent
+     * sharing the OneWire bus with the telemetry thread */
+    TRACE_SPAN_BEGIN (&span, pgHardwareMessageNames[pReceivedMsg->msgType], pReceivedMsg->msgType);
+    if (!gHardwareMsgIsConcurrent[pReceivedMsg->msgType])
+    {
+        pthread_mutex_lock (&gOneWireLock);
+    }
     returnCode = doAction ((HardwareMsgType) pReceivedMsg->msgType, pReceivedMsg->msgBody, pSendMsg);
+    if (!gHardwareMsgIsConcurrent[pReceivedMsg->msgType])
+    {
+        pthread_mutex_unlock (&gOneWireLock);
+    }
+    TRACE_SPAN_END (&span);
     printDebug ("HW Server responding with message %s, length %d.\n", pgHardwareMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
         
     return returnCode;
@@ -14,6 +14,28 @@
 #include <hardware_client.h>
 #include <orangutan.h>
 
+/*
+ * MANIFEST CONSTANTS
+ */
+
+/* The number of worker threads for the messages that may be handled concurrently */
+#define NUM_HARDWARE_WORKER_THREADS 2
+
+/*
+ * EXTERN
+ */
+
+/* The names of the messages, for the stats the server keeps */
+extern Char *pgHardwareMessageNames[];
+
+/* Whether each message may be handled at the same time as
+ * the others, kept with the handlers in hardware_server.c */
+extern const Bool gHardwareMsgIsConcurrent[];
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
 /*
  * STATIC FUNCTIONS
  */
@@ -32,6 +54,7 @@ int main (int argc, char **argv)
     UInt16 hardwareServerPort;
 
     setDebugPrintsOnToFile ("roboonehardware.log");
+    setFlightRecorderOn ("roboonehardware.flt", FLIGHT_RECORDER_DEFAULT_NUM_RECORDS);
     setProgressPrintsOn();
 
     if (argc == 2)
@@ -40,6 +63,10 @@ int main (int argc, char **argv)
         hardwareServerPort = atoi (argv[1]);
         printProgress ("Hardware server listening on port %d.\n", hardwareServerPort);
 
+        /* Handle messages on worker threads so that a slow one,
+         * e.g. waiting for the Orangutan, doesn't hold up the others */
+        setMessagingServerWorkerThreads (NUM_HARDWARE_WORKER_THREADS, gHardwareMsgIsConcurrent, MAX_NUM_HARDWARE_MSGS);
+        setMessagingServerMsgNames (pgHardwareMessageNames, MAX_NUM_HARDWARE_MSGS);
         returnCode = runMessagingServer (hardwareServerPort);
         
         if (returnCode == SERVER_EXIT_NORMALLY)
@@ -11,6 +11,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <pthread.h>
 #include <rob_system.h>
 #include <orangutan.h>
 
@@ -30,10 +31,96 @@
 static struct termios gSavedSettings;
 static SInt32 gFd = -1;
 
+/* Protects the port, since HARDWARE_SEND_O_STRING is
+ * handled at the same time as the other messages */
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * STATIC FUNCTIONS
  */
 
+/*
+ * Read a string from the Orangutan, the lock must
+ * be held.
+ * 
+ * pReceiveString       pointer to a location where the
+ *                      response can be placed.  A null
+ *                      terminator will be included.
+ * pReceiveStringLength pointer to the length of the received
+ *                      string.  This should be set by the
+ *                      caller to the maximum received string
+ *                      that can be stored (including a null
+ *                      terminator).  It will be set by this
+ *                      function to the length of the received
+ *                      string (with guaranteed null terminator).
+ * 
+ * @return              true if successful, otherwise false.
+ */
+static Bool readString (Char *pReceiveString, UInt32 *pReceiveStringLength)
+{
+    Bool success = false;
+    Bool done = false;
+    SInt32 bytesReceived;
+    Char buffer[ORANGUTAN_BUFFER_SIZE];
+    UInt8 i;
+    
+    ASSERT_PARAM (pReceiveString != PNULL, (unsigned long) pReceiveString);
+    ASSERT_PARAM (pReceiveStringLength != PNULL, (unsigned long) pReceiveStringLength);
+
+    if (gFd >= 0)
+    {
+        /* Read the Orangutan's string */
+        if (*pReceiveStringLength > 0)
+        {
+            UInt32 maxBytesToReceive;
+
+            /* Store the maximum length and replace it with zero */
+            maxBytesToReceive = *pReceiveStringLength;
+            *pReceiveStringLength = 0;
+            
+            while (!done)
+            {
+                bytesReceived = read (gFd, &buffer[0], sizeof (buffer));
+                
+                if (bytesReceived > 0)
+                {
+                    for (i = 0; (i < bytesReceived) && !done; i++)
+                    {
+                        if (buffer[i] == ORANGUTAN_RESPONSE_TERMINATOR)
+                        {
+                            done = true;
+                            bytesReceived = i + 1; /* Chop off at the terminator */
+                        }
+                    }
+                    
+                    /* Stop overruns */
+                    if (*pReceiveStringLength + bytesReceived > maxBytesToReceive - 1) /* -1 to leave room for adding a terminator */
+                    {
+                        bytesReceived = maxBytesToReceive - *pReceiveStringLength - 1;
+                    }
+                    
+                    /* Copy to the output and set the length */
+                    memcpy (pReceiveString + *pReceiveStringLength, &buffer[0], bytesReceived);                        
+                    *pReceiveStringLength += bytesReceived;                            
+                }
+                else
+                {
+                    done = true;
+                }
+            }
+            
+            /* Add a null terminator if we're done */
+            if (maxBytesToReceive > 0)
+            {
+                *(pReceiveString + *pReceiveStringLength) = 0;
+                (*pReceiveStringLength)++;
+            }
+        }
+    }
+    
+    return success;
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
@@ -47,7 +134,9 @@ static SInt32 gFd = -1;
 SInt32 openOrangutan (void)
 {
     struct termios newSettings;
+    SInt32 fd;
     
+    pthread_mutex_lock (&gLock);
     gFd = open (ORANGUTAN_PORT_STRING, O_RDWR | O_NOCTTY); 
   
     if (gFd >= 0)
@@ -66,8 +155,10 @@ SInt32 openOrangutan (void)
         tcflush (gFd, TCIOFLUSH);
         tcsetattr (gFd, TCSANOW, &newSettings);
     }
+    fd = gFd;
+    pthread_mutex_unlock (&gLock);
     
-    return gFd;
+    return fd;
 }
 
 /*
@@ -75,6 +166,7 @@ SInt32 openOrangutan (void)
  */
 void closeOrangutan (void)
 {
+    pthread_mutex_lock (&gLock);
     if (gFd >=0)
     {
         /* Restore terminal settings */
@@ -82,6 +174,7 @@ void closeOrangutan (void)
         close (gFd);
         gFd = -1;
     }
+    pthread_mutex_unlock (&gLock);
 }
 
 /*
@@ -114,6 +207,7 @@ Bool sendStringToOrangutan (Char *pSendString, Char *pReceiveString, UInt32 *pRe
     
     ASSERT_PARAM (pSendString != PNULL, (unsigned long) pSendString);
 
+    pthread_mutex_lock (&gLock);
     if (gFd >= 0)
     {
         /* Stop overruns */
@@ -131,10 +225,11 @@ Bool sendStringToOrangutan (Char *pSendString, Char *pReceiveString, UInt32 *pRe
             /* Wait for a response if requested */
             if ((pReceiveString != NULL) && (pReceiveStringLength != NULL))
             {
-                readStringFromOrangutan (pReceiveString, pReceiveStringLength);
+                readString (pReceiveString, pReceiveStringLength);
             }
         }
     }
+    pthread_mutex_unlock (&gLock);
     
     return success;
 }
@@ -157,65 +252,11 @@ Bool sendStringToOrangutan (Char *pSendString, Char *pReceiveString, UInt32 *pRe
  */
 Bool readStringFromOrangutan (Char *pReceiveString, UInt32 *pReceiveStringLength)
 {
-    Bool success = false;
-    Bool done = false;
-    SInt32 bytesReceived;
-    Char buffer[ORANGUTAN_BUFFER_SIZE];
-    UInt8 i;
-    
-    ASSERT_PARAM (pReceiveString != PNULL, (unsigned long) pReceiveString);
-    ASSERT_PARAM (pReceiveStringLength != PNULL, (unsigned long) pReceiveStringLength);
+    Bool success;
 
-    if (gFd >= 0)
-    {
-        /* Read the Orangutan's string */
-        if (*pReceiveStringLength > 0)
-        {
-            UInt32 maxBytesToReceive;
+    pthread_mutex_lock (&gLock);
+    success = readString (pReceiveString, pReceiveStringLength);
+    pthread_mutex_unlock (&gLock);
 
-            /* Store the maximum length and replace it with zero */
-            maxBytesToReceive = *pReceiveStringLength;
-            *pReceiveStringLength = 0;
-            
-            while (!done)
-            {
-                bytesReceived = read (gFd, &buffer[0], sizeof (buffer));
-                
-                if (bytesReceived > 0)
-                {
-                    for (i = 0; (i < bytesReceived) && !done; i++)
-                    {
-                        if (buffer[i] == ORANGUTAN_RESPONSE_TERMINATOR)
-                        {
-                            done = true;
-                            bytesReceived = i + 1; /* Chop off at the terminator */
-                        }
-                    }
-                    
-                    /* Stop overruns */
-                    if (*pReceiveStringLength + bytesReceived > maxBytesToReceive - 1) /* -1 to leave room for adding a terminator */
-                    {
-                        bytesReceived = maxBytesToReceive - *pReceiveStringLength - 1;
-                    }
-                    
-                    /* Copy to the output and set the length */
-                    memcpy (pReceiveString + *pReceiveStringLength, &buffer[0], bytesReceived);                        
-                    *pReceiveStringLength += bytesReceived;                            
-                }
-                else
-                {
-                    done = true;
-                }
-            }
-            
-            /* Add a null terminator if we're done */
-            if (maxBytesToReceive > 0)
-            {
-                *(pReceiveString + *pReceiveStringLength) = 0;
-                (*pReceiveStringLength)++;
-            }
-        }
-    }
-    
     return success;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#define DEBUG_MODULE DEBUG_MODULE_ONE_WIRE /* Before rob_system.h */
 #include <rob_system.h>
 #include <one_wire.h>
 #include <messaging_server.h>
@@ -34,6 +35,7 @@
 #define TOGGLE_DELAY_US         500000L   /* How long to toggle a set of pins from current state to opposite and back again */
 #define SERIAL_NUM_BUFFER_SIZE (NUM_BYTES_IN_SERIAL_NUM * 2) + 3 /* string representation of serial num with 0x in front and terminator on the end */
 #define WAIT_BEFORE_ORANGUTAN_OPEN_AFTER_TOGGLE_US 100000
+#define CHARGER_FLASH_DETECT_INTERVAL_NS 1000000000ULL /* How long to collect rising edges for before deciding if a charger LED is flashing */
 
 /* The maximum number of devices that oneWireFindAllDevices() can report */
 #define MAX_DEVICES_TO_FIND         10
@@ -336,14 +338,17 @@ static OwDeviceType getDeviceType (const UInt8 *pAddress)
 static Bool readPins (OwDeviceName deviceName, UInt8 *pPinsState)
 {
     Bool  success;
+    TraceSpan span;
     
+    TRACE_SPAN_BEGIN (&span, "OneWire readPins", deviceName);
     /* Read the last state of the pins */
-    printDebug ("Reading from %s.\n", deviceNameList[deviceName]);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Reading from %s.\n", deviceNameList[deviceName]);
     success = readPIOLogicStateDS2408 (gPortNumber, &gDeviceStaticConfigList[deviceName].address.value[0], pPinsState);
     if (!success)
     {
-        printDebug ("Read failed.\n");
+        DEBUG_PRINT (DEBUG_LEVEL_ERROR, "Read failed.\n");
     }
+    TRACE_SPAN_END (&span);
 
     debugPrintPinsState();
         
@@ -361,9 +366,11 @@ static Bool readPins (OwDeviceName deviceName, UInt8 *pPinsState)
 static Bool readAndResetRisingEdgePins (OwDeviceName deviceName, UInt8 *pPinsState)
 {
     Bool  success;
+    TraceSpan span;
     
+    TRACE_SPAN_BEGIN (&span, "OneWire readAndResetRisingEdgePins", deviceName);
     /* Read the activity state of the pins and then reset it for the next time */
-    printDebug ("Reading latch register from %s.\n", deviceNameList[deviceName]);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Reading latch register from %s.\n", deviceNameList[deviceName]);
     success = readPIOActivityLatchStateRegisterDS2408 (gPortNumber, &gDeviceStaticConfigList[deviceName].address.value[0], pPinsState);
 
     if (success)
@@ -371,13 +378,14 @@ static Bool readAndResetRisingEdgePins (OwDeviceName deviceName, UInt8 *pPinsSta
         success = resetActivityLatchesDS2408  (gPortNumber, &gDeviceStaticConfigList[deviceName].address.value[0]);
         if (!success)
         {
-            printDebug ("Latch reset failed.\n");
+            DEBUG_PRINT (DEBUG_LEVEL_ERROR, "Latch reset failed.\n");
         }
     }
     else
     {
-        printDebug ("Read failed.\n");        
+        DEBUG_PRINT (DEBUG_LEVEL_ERROR, "Read failed.\n");
     }
+    TRACE_SPAN_END (&span);
     
     debugPrintPinsState();
 
@@ -433,7 +441,7 @@ static Bool readPinsWithShadow (OwDeviceName deviceName, UInt8 *pPinsState)
     Bool success;
     
     /* Read the last state of the pins */
-    printDebug ("Reading from %s.\n", deviceNameList[deviceName]);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Reading from %s.\n", deviceNameList[deviceName]);
     success = readPIOLogicStateDS2408 (gPortNumber, &gDeviceStaticConfigList[deviceName].address.value[0], pPinsState);
     if (success)
     {
@@ -442,7 +450,7 @@ static Bool readPinsWithShadow (OwDeviceName deviceName, UInt8 *pPinsState)
     }
     else
     {
-        printDebug ("Read failed.\n");        
+        DEBUG_PRINT (DEBUG_LEVEL_ERROR, "Read failed.\n");
     }
 
     debugPrintPinsState();
@@ -468,7 +476,9 @@ static Bool setPinsWithShadow (OwDeviceName deviceName, UInt8 pinsMask, Bool set
     UInt8 pinsState;
     UInt8 pinsStateToWrite;
     Char buffer[BINARY_STRING_BUFFER_SIZE];
+    TraceSpan span;
     
+    TRACE_SPAN_BEGIN (&span, "OneWire setPinsWithShadow", deviceName);
     /* Read the last state of the pins, taking shadow state into account */
     success = readPinsWithShadow (deviceName, &pinsState);
     
@@ -486,7 +496,7 @@ static Bool setPinsWithShadow (OwDeviceName deviceName, UInt8 pinsMask, Bool set
     /* Take a copy of the new intended state 'cos channelAccessWriteDS2408 will read back the written
      * state which might not be what we want since we may be shadowing some pins */
     pinsStateToWrite = pinsState;
-    printDebug ("Writing %s to %s.\n", binaryString (pinsStateToWrite, &(buffer[0])), deviceNameList[deviceName]);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Writing %s to %s.\n", binaryString (pinsStateToWrite, &(buffer[0])), deviceNameList[deviceName]);
     success = channelAccessWriteDS2408 (gPortNumber, &gDeviceStaticConfigList[deviceName].address.value[0], &pinsStateToWrite);
     
     /* If it worked, setup the shadow to match the result */
@@ -496,8 +506,9 @@ static Bool setPinsWithShadow (OwDeviceName deviceName, UInt8 pinsMask, Bool set
     }
     else
     {
-        printDebug ("Write failed.\n");            
+        DEBUG_PRINT (DEBUG_LEVEL_ERROR, "Write failed.\n");
     }
+    TRACE_SPAN_END (&span);
 
     debugPrintPinsState();
     
@@ -522,7 +533,9 @@ static Bool togglePinsWithShadow (OwDeviceName deviceName, UInt8 pinsMask)
     UInt8 pinsStateToWrite;
     UInt8 i;
     Char buffer[BINARY_STRING_BUFFER_SIZE];
+    TraceSpan span;
 
+    TRACE_SPAN_BEGIN (&span, "OneWire togglePinsWithShadow", deviceName);
     /* Read the last state of the pins, taking shadow state into account */
     success = readPinsWithShadow (deviceName, &pinsState);
         
@@ -544,7 +557,7 @@ static Bool togglePinsWithShadow (OwDeviceName deviceName, UInt8 pinsMask)
         /* Take a copy of the new intended state 'cos channelAccessWriteDS2408 will read back the written
          * state which might not be what we want since we may be shadowing some pins */
         pinsStateToWrite = pinsState;
-        printDebug ("Writing %s to %s.\n", binaryString (pinsStateToWrite, &(buffer[0])), deviceNameList[deviceName]);
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Writing %s to %s.\n", binaryString (pinsStateToWrite, &(buffer[0])), deviceNameList[deviceName]);
         success = channelAccessWriteDS2408 (gPortNumber, &gDeviceStaticConfigList[deviceName].address.value[0], &pinsStateToWrite);
 
         /* If it worked, setup the shadow to match the result */
@@ -554,14 +567,14 @@ static Bool togglePinsWithShadow (OwDeviceName deviceName, UInt8 pinsMask)
         }
         else
         {
-            printDebug ("Write failed.\n");            
+            DEBUG_PRINT (DEBUG_LEVEL_ERROR, "Write failed.\n");
         }
 
         debugPrintPinsState();
         
         usleep (TOGGLE_DELAY_US);
     }
-    
+    TRACE_SPAN_END (&span);
 
     return success;
 }
@@ -580,28 +593,28 @@ static void debugPrintPinsState (void)
     {
         /* Now check against the shadow mask and for those pins use pinsState instead of the read-back state */
         pinsState = accountForShadow (OW_NAME_CHARGER_STATE_PIO, pinsState);
-        printDebug ("  CHARGER_STATE_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "  CHARGER_STATE_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
     }
     success = readPIOLogicStateDS2408 (gPortNumber, &gDeviceStaticConfigList[OW_NAME_DARLINGTON_PIO].address.value[0], &pinsState);
     if (success)
     {
         /* Now check against the shadow mask and for those pins use pinsState instead of the read-back state */
         pinsState = accountForShadow (OW_NAME_DARLINGTON_PIO, pinsState);
-        printDebug ("     DARLINGTON_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "     DARLINGTON_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
     }
     success = readPIOLogicStateDS2408 (gPortNumber, &gDeviceStaticConfigList[OW_NAME_RELAY_PIO].address.value[0], &pinsState);
     if (success)
     {
         /* Now check against the shadow mask and for those pins use pinsState instead of the read-back state */
         pinsState = accountForShadow (OW_NAME_RELAY_PIO, pinsState);
-        printDebug ("          RELAY_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "          RELAY_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
     }
     success = readPIOLogicStateDS2408 (gPortNumber, &gDeviceStaticConfigList[OW_NAME_GENERAL_PURPOSE_PIO].address.value[0], &pinsState);
     if (success)
     {
         /* Now check against the shadow mask and for those pins use pinsState instead of the read-back state */
         pinsState = accountForShadow (OW_NAME_GENERAL_PURPOSE_PIO, pinsState);
-        printDebug ("GENERAL_PURPOSE_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "GENERAL_PURPOSE_PIO: %s.\n", binaryString (pinsState, &(buffer[0])));
     }
 }
 
@@ -824,7 +837,7 @@ Bool setupDevices (Bool batteriesOnly)
         if (found[i])
         {
             printProgress ("Found %d [%s]: %s, setting it up...", i + 1, deviceNameList[i], printAddress (pAddress, &(serialNumBuffer[0])));
-            printDebug ("\n");
+            DEBUG_PRINT (DEBUG_LEVEL_INFO, "\n");
             switch (getDeviceType (pAddress))
             {
                 case OW_TYPE_DS2438_BATTERY_MONITOR:
@@ -833,19 +846,19 @@ Bool setupDevices (Bool batteriesOnly)
                     UInt32 elapsedTime;
 
                     /* Write the config register and the threshold register */
-                    printDebug ("Writing config 0x%.2x, threshold %d to DS2438.\n", gDeviceStaticConfigList[i].specifics.ds2438.config, threshold);
+                    DEBUG_PRINT (DEBUG_LEVEL_INFO, "Writing config 0x%.2x, threshold %d to DS2438.\n", gDeviceStaticConfigList[i].specifics.ds2438.config, threshold);
                     success = writeNVConfigThresholdDS2438 (gPortNumber, pAddress, &(gDeviceStaticConfigList[i].specifics.ds2438.config), &threshold);
                     if (success)
                     {
                         /* Initialise the remaining capacity and time which are otherwise volatile fields*/
-                        printDebug ("Initialising time and remaining capacity in DS2438.\n");
+                        DEBUG_PRINT (DEBUG_LEVEL_INFO, "Initialising time and remaining capacity in DS2438.\n");
                         success = initTimeCapacityDS2438 (gPortNumber, pAddress);                        
 
                         if (success)
                         {
                             /* Set time */
                             elapsedTime = getSystemTicks ();
-                            printDebug ("Writing time %d to DS2438.\n", elapsedTime);
+                            DEBUG_PRINT (DEBUG_LEVEL_INFO, "Writing time %d to DS2438.\n", elapsedTime);
                             success = writeTimeCapacityDS2438 (gPortNumber, pAddress, &elapsedTime, PNULL, true);
                         }
                     }
@@ -858,19 +871,19 @@ Bool setupDevices (Bool batteriesOnly)
                      * the pin configuration, using an intermediate variable for the latter
                      * as the write function also reads the result back and I'd rather avoid
                      * my global data structure being modified */
-                    printDebug ("Disabling Test Mode to DS2408.\n");
+                    DEBUG_PRINT (DEBUG_LEVEL_INFO, "Disabling Test Mode to DS2408.\n");
                     success = disableTestModeDS2408 (gPortNumber, pAddress);
                     debugPrintPinsState();
                     if (success)
                     {
-                        printDebug ("Writing 0x%.2x to DS2408 control register.\n", gDeviceStaticConfigList[i].specifics.ds2408.config);
+                        DEBUG_PRINT (DEBUG_LEVEL_INFO, "Writing 0x%.2x to DS2408 control register.\n", gDeviceStaticConfigList[i].specifics.ds2408.config);
                         success = writeControlRegisterDS2408 (gPortNumber, pAddress, gDeviceStaticConfigList[i].specifics.ds2408.config);
                         debugPrintPinsState();
                         if (success)
                         {
                             pinsState = gDeviceStaticConfigList[i].specifics.ds2408.pinsState;
                             pinsState |= gDeviceStaticConfigList[i].specifics.ds2408.inputMask; /* Write 1's to input pins */
-                            printDebug ("Writing 0x%.2x to DS2408 pins.\n", pinsState);
+                            DEBUG_PRINT (DEBUG_LEVEL_INFO, "Writing 0x%.2x to DS2408 pins.\n", pinsState);
                             success = channelAccessWriteDS2408 (gPortNumber, pAddress, &pinsState);
                         }
                         debugPrintPinsState();
@@ -969,11 +982,12 @@ Bool readChargerStatePins (UInt8 *pPinsState)
 Bool readChargerState (ChargeState *pState, Bool *pFlashDetectPossible)
 {
     Bool success = true;
-    static UInt32 ticksAtLastRead = 0;
+    static Bool isFirstRead = true;
+    static uint64_t timeAtLastReadNs;
     static UInt8 lastPinsEdgeState;
     UInt8 pinsState;
     UInt8 pinsEdgeState;
-    UInt32 ticksNow;
+    uint64_t timeNowNs;
     Bool chargerPowered;
     Bool relaysPowered;
     
@@ -981,16 +995,17 @@ Bool readChargerState (ChargeState *pState, Bool *pFlashDetectPossible)
     ASSERT_PARAM (pFlashDetectPossible != PNULL, (unsigned long) pFlashDetectPossible);
     
     /* Setup the statics and reset the edge latch if this is the first call */
-    if (ticksAtLastRead == 0)
+    if (isFirstRead)
     {
         success = readAndResetRisingEdgePins (OW_NAME_CHARGER_STATE_PIO, &lastPinsEdgeState); 
-        ticksAtLastRead = getSystemTicks();
+        timeAtLastReadNs = getMonotonicNs();
+        isFirstRead = !success;
     }
     
     if (success)
     {
         /* Get the time */
-        ticksNow = getSystemTicks();
+        timeNowNs = getMonotonicNs();
         
         /* Read the current state */
         success = readPins (OW_NAME_CHARGER_STATE_PIO, &pinsState);
@@ -1016,7 +1031,7 @@ Bool readChargerState (ChargeState *pState, Bool *pFlashDetectPossible)
                 *(pState + CHARGER_O3) = getChargeState (success, !(relaysPowered && !chargerPowered), pinsState, CHARGER_O3_GREEN, CHARGER_O3_RED);
                 
                 /* Setup the flashing results if it's been long enough since the last reading to tell */
-                if ((ticksAtLastRead - ticksNow) > 1)
+                if (timeNowNs - timeAtLastReadNs >= CHARGER_FLASH_DETECT_INTERVAL_NS)
                 {
                     success = readAndResetRisingEdgePins (OW_NAME_CHARGER_STATE_PIO, &pinsEdgeState); 
                     if (success)
@@ -1027,7 +1042,7 @@ Bool readChargerState (ChargeState *pState, Bool *pFlashDetectPossible)
                         *(pState + CHARGER_O2) = getChargeFlashingState (*(pState + CHARGER_O2), lastPinsEdgeState, pinsEdgeState, CHARGER_O2_GREEN, CHARGER_O2_RED);
                         *(pState + CHARGER_O3) = getChargeFlashingState (*(pState + CHARGER_O3), lastPinsEdgeState, pinsEdgeState, CHARGER_O3_GREEN, CHARGER_O3_RED);
                         lastPinsEdgeState = pinsEdgeState;
-                        ticksAtLastRead = ticksNow;
+                        timeAtLastReadNs = timeNowNs;
                     }
                 }
             }
@@ -75,65 +75,53 @@ int main (int argc, char **argv)
 {
     Bool   success = false;
     UInt16 remainingCapacity;
-    pid_t  hwServerPID;
+    SInt32 hwServerPID;
+    SInt32 readyFd;
     
     setDebugPrintsOnToFile ("robooneremainingcapacitysync.log");
     setProgressPrintsOn();
 
     printProgress ("Synchronising remaining battery capacity values...\n");
-    /* Spawn a child that will become the Hardware server. */
-    hwServerPID = fork();
-    if (hwServerPID == 0)
+    /* Launch the Hardware Server. */
+    hwServerPID = spawnMessagingServer (HARDWARE_SERVER_EXE, HARDWARE_SERVER_PORT_STRING, &readyFd);
+    if (hwServerPID < 0)
     {
-        /* Start Hardware Server process on a given port */
-        static char *argv1[] = {HARDWARE_SERVER_EXE, HARDWARE_SERVER_PORT_STRING, PNULL};
-        
-        execv (HARDWARE_SERVER_EXE, argv1);
         printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", HARDWARE_SERVER_EXE, strerror (errno));
     }
     else
     {
-        if (hwServerPID < 0)
-        {
-            printDebug ("!!! Couldn't fork to launch %s, err: %s. !!!\n", HARDWARE_SERVER_EXE, strerror (errno));
-        }
-        else
-        {   /* Parent process */
-            /* Wait for the server to start */
-            usleep (HARDWARE_SERVER_START_DELAY_PI_US);
-            /* Now setup the Hardware Server, batteries
-             * only on this occasion. This will restore
-             * the remaining battery capacity from
-             * non-volatile storage if it is out of date,
-             * which would be the case at power-on. */
-            success = startHardwareServer (true);
+        /* Wait for the server to be ready, then setup the
+         * Hardware Server, batteries only on this occasion.
+         * This will restore the remaining battery capacity
+         * from non-volatile storage if it is out of date,
+         * which would be the case at power-on. */
+        success = waitMessagingServersReady (&readyFd, 1, MESSAGING_SERVER_READY_TIMEOUT_MS) && startHardwareServer (true);
 
-            if (success)
+        if (success)
+        {
+            /* Now do a remaining capacity reading to complete the sync back to
+             * non-volatile storage in case we are about to power off */
+            if (hardwareServerSendReceive (HARDWARE_READ_RIO_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
             {
-                /* Now do a remaining capacity reading to complete the sync back to
-                 * non-volatile storage in case we are about to power off */
-                if (hardwareServerSendReceive (HARDWARE_READ_RIO_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
-                {
-                    printProgress ("Rio battery has %d mAh remaining.\n", remainingCapacity);
-                }
-                if (hardwareServerSendReceive (HARDWARE_READ_O1_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
-                {
-                    printProgress ("O1 battery has %d mAh remaining.\n", remainingCapacity);
-                }
-                if (hardwareServerSendReceive (HARDWARE_READ_O2_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
-                {
-                    printProgress ("O2 battery has %d mAh remaining.\n", remainingCapacity);
-                }
-                if (hardwareServerSendReceive (HARDWARE_READ_O3_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
-                {
-                    printProgress ("O3 battery has %d mAh remaining.\n", remainingCapacity);
-                }
+                printProgress ("Rio battery has %d mAh remaining.\n", remainingCapacity);
+            }
+            if (hardwareServerSendReceive (HARDWARE_READ_O1_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
+            {
+                printProgress ("O1 battery has %d mAh remaining.\n", remainingCapacity);
+            }
+            if (hardwareServerSendReceive (HARDWARE_READ_O2_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
+            {
+                printProgress ("O2 battery has %d mAh remaining.\n", remainingCapacity);
+            }
+            if (hardwareServerSendReceive (HARDWARE_READ_O3_REMAINING_CAPACITY, PNULL, 0, &remainingCapacity))
+            {
+                printProgress ("O3 battery has %d mAh remaining.\n", remainingCapacity);
             }
-
-            /* Shut the Hardware Server down gracefully */
-            stopHardwareServer();
-            waitpid (hwServerPID, 0, 0); /* wait for Hardware Server process to exit */
         }
+
+        /* Shut the Hardware Server down gracefully */
+        stopHardwareServer();
+        waitpid (hwServerPID, 0, 0); /* wait for Hardware Server process to exit */
     }
     
     setDebugPrintsOff();
@@ -94,48 +94,38 @@ Bool actionIsMains12VAvailable (void)
 Bool actionSwitchOnHindbrain (void)
 {
     Bool success = false;
-    OInputContainer *pInputContainer;
-    OResponseString *pResponseString;
+    OInputContainer inputContainer;
+    OResponseString responseString;
     UInt8 i;
     
-    pInputContainer = malloc (sizeof (*pInputContainer));
-    if (pInputContainer != PNULL)
+    memcpy (&(inputContainer.string[0]), PING_STRING, strlen (PING_STRING) + 1); /* +1 to copy the terminator */
+    inputContainer.waitForResponse = true;
+
+    responseString.stringLength = sizeof (responseString.string);
+    /* Do this twice in case the Hindbrain is already on and the first toggle switches it off */
+    for (i = 0; !success && (i < 2); i++)
     {
-        memcpy (&(pInputContainer->string[0]), PING_STRING, strlen (PING_STRING) + 1); /* +1 to copy the terminator */
-        pInputContainer->waitForResponse = true;
-        
-        pResponseString = malloc (sizeof (*pResponseString));
-        if (pResponseString != PNULL)
+        /* Toggle the power */
+        printDebug ("ACTION: toggling power to Hindbrain with the aim of switching ON.\n");
+        success = hardwareServerSendReceive (HARDWARE_TOGGLE_O_PWR, PNULL, 0, PNULL);
+        if (success)
         {
-            pResponseString->stringLength = sizeof (pResponseString->string);
-            /* Do this twice in case the Hindbrain is already on and the first toggle switches it off */
-            for (i = 0; !success && (i < 2); i++)
+            usleep (O_START_DELAY_US);
+            printDebug ("ACTION: Pinging Hindbrain.\n");
+            /* Send the ping string and check for an OK response */
+            success = hardwareServerSendReceive (HARDWARE_SEND_O_STRING, &inputContainer, sizeof (inputContainer), &responseString);
+            if (success)
             {
-                /* Toggle the power */
-                printDebug ("ACTION: toggling power to Hindbrain with the aim of switching ON.\n");
-                success = hardwareServerSendReceive (HARDWARE_TOGGLE_O_PWR, PNULL, 0, PNULL);
-                if (success)
-                {
-                    usleep (O_START_DELAY_US);
-                    printDebug ("ACTION: Pinging Hindbrain.\n");
-                    /* Send the ping string and check for an OK response */
-                    success = hardwareServerSendReceive (HARDWARE_SEND_O_STRING, pInputContainer, sizeof (*pInputContainer), pResponseString);
-                    if (success)
-                    {
-                       if (O_CHECK_OK_STRING (pResponseString))
-                       {
-                           /* TODO: Initialise sensors */
-                       }
-                       else
-                       {
-                           success = false;
-                       }
-                    }
-                }
+               if (O_CHECK_OK_STRING (&responseString))
+               {
+                   /* TODO: Initialise sensors */
+               }
+               else
+               {
+                   success = false;
+               }
             }
-            free (pResponseString);
         }
-        free (pInputContainer);
     }
     
     return success;
@@ -150,26 +140,21 @@ Bool actionSwitchOffHindbrain (void)
 {
     Bool success = false;
     Bool hindbrainOn = true;
-    OInputContainer *pInputContainer;
+    OInputContainer inputContainer;
     UInt8 i;
     
-    pInputContainer = malloc (sizeof (*pInputContainer));
-    if (pInputContainer != PNULL)
+    memcpy (&(inputContainer.string[0]), PING_STRING, strlen (PING_STRING) + 1); /* +1 to copy the terminator */
+    inputContainer.waitForResponse = false;
+
+    /* Do this twice in case the Hindbrain is already off and the first toggle switches it on */
+    for (i = 0; hindbrainOn && (i < 2); i++)
     {
-        memcpy (&(pInputContainer->string[0]), PING_STRING, strlen (PING_STRING) + 1); /* +1 to copy the terminator */
-        pInputContainer->waitForResponse = false;
-        
-        /* Do this twice in case the Hindbrain is already off and the first toggle switches it on */
-        for (i = 0; hindbrainOn && (i < 2); i++)
-        {
-            /* Toggle the power */
-            printDebug ("ACTION: toggling power to Hindbrain with the aim of switching OFF.\n");
-            hardwareServerSendReceive (HARDWARE_TOGGLE_O_PWR, PNULL, 0, PNULL); /* Deliberately ignore return value, rely on failure to ping */
-            printDebug ("ACTION: Pinging Hindbrain.\n");
-            /* Send the ping string - it should *fail* to send */
-            hindbrainOn = hardwareServerSendReceive (HARDWARE_SEND_O_STRING, pInputContainer, sizeof (*pInputContainer), PNULL);
-        }
-        free (pInputContainer);
+        /* Toggle the power */
+        printDebug ("ACTION: toggling power to Hindbrain with the aim of switching OFF.\n");
+        hardwareServerSendReceive (HARDWARE_TOGGLE_O_PWR, PNULL, 0, PNULL); /* Deliberately ignore return value, rely on failure to ping */
+        printDebug ("ACTION: Pinging Hindbrain.\n");
+        /* Send the ping string - it should *fail* to send */
+        hindbrainOn = hardwareServerSendReceive (HARDWARE_SEND_O_STRING, &inputContainer, sizeof (inputContainer), PNULL);
     }
     
     return success;
@@ -17,6 +17,13 @@
 #include <state_machine_msg_auto.h>
 #include <state_machine_client.h>
 
+/*
+ * EXTERN
+ */
+
+/* The names of the messages, for the stats the server keeps */
+extern Char *pgStateMachineMessageNames[];
+
 /*
  * STATIC FUNCTIONS
  */
@@ -35,6 +42,7 @@ int main (int argc, char **argv)
     UInt16 stateMachineServerPort;
 
     setDebugPrintsOnToFile ("roboonestatemachine.log");
+    setFlightRecorderOn ("roboonestatemachine.flt", FLIGHT_RECORDER_DEFAULT_NUM_RECORDS);
     setProgressPrintsOn();
 
     if (argc == 2)
@@ -42,6 +50,7 @@ int main (int argc, char **argv)
         stateMachineServerPort = atoi (argv[1]);
         printProgress ("State machine server listening on port %d.\n", stateMachineServerPort);
 
+        setMessagingServerMsgNames (pgStateMachineMessageNames, MAX_NUM_STATE_MACHINE_MSGS);
         returnCode = runMessagingServer (stateMachineServerPort);
             
         if (returnCode == SERVER_EXIT_NORMALLY)
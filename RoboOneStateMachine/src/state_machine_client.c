@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#define DEBUG_MODULE DEBUG_MODULE_CLIENT /* Before rob_system.h */
 #include <rob_system.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
@@ -66,6 +67,7 @@ Bool stateMachineServerSendReceive (StateMachineMsgType sendMsgType, void *pSend
 {
     ClientReturnCode returnCode;
     Bool success = false;
+    MessagingClientMsgs *pMsgs;
     Msg *pSendMsg;
     Msg *pReceivedMsg = PNULL;
     UInt16 receivedMsgBodyLength = 0;
@@ -73,74 +75,61 @@ Bool stateMachineServerSendReceive (StateMachineMsgType sendMsgType, void *pSend
     ASSERT_PARAM (sendMsgType < MAX_NUM_STATE_MACHINE_MSGS, sendMsgType);
     ASSERT_PARAM (sendMsgBodyLength <= MAX_MSG_BODY_LENGTH, sendMsgBodyLength);
 
-    pSendMsg = malloc (sizeof (*pSendMsg));
+    pMsgs = getMessagingClientMsgs();
+    pSendMsg = &(pMsgs->sendMsg);
+    if (pReceivedMsgType != PNULL)
+    {
+        /* The caller wants a reply so use the space for the message */
+        pReceivedMsg = &(pMsgs->receivedMsg);
+        pReceivedMsg->msgLength = 0;
+    }
     
-    if (pSendMsg != PNULL)
+    /* Put in the bit before the body */
+    pSendMsg->msgLength = 0;
+    pSendMsg->msgType = sendMsgType;
+    pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+
+    /* Put in the specifics */
+    if (pSendMsgBody != PNULL)
+    {
+        memcpy (&(pSendMsg->msgBody[0]), pSendMsgBody, sendMsgBodyLength);
+    }
+    pSendMsg->msgLength += sendMsgBodyLength;
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "SM Client: sending message %s, length %d, hex dump:\n",  pgStateMachineMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
+    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pSendMsg, pSendMsg->msgLength + 1);
+    returnCode = runMessagingClient ((SInt32) atoi (STATE_MACHINE_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "SM Client: message system returnCode: %d\n", returnCode);
+    /* This code makes assumptions about packing (i.e. that it's '1') so be careful */
+    if (returnCode == CLIENT_SUCCESS)
     {
-        if (pReceivedMsgType != PNULL)
+        if (pReceivedMsg != PNULL)
         {
-            /* The caller wants a reply so make space for the message */
-            pReceivedMsg = malloc (sizeof (*pReceivedMsg));
-            if (pReceivedMsg != PNULL)
+            if (pReceivedMsg->msgLength >= sizeof (pReceivedMsg->msgType))
             {
-                pReceivedMsg->msgLength = 0;
-            }
-        }
+                success = true;
+                /* Pass back the message type */
+                *pReceivedMsgType = pReceivedMsg->msgType;
+                /* Pass back the body of the message */
+                receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
+                DEBUG_PRINT (DEBUG_LEVEL_TRACE, "SM Client: received message %s, receivedMsgBodyLength: %d\n", pgStateMachineMessageNames[pReceivedMsg->msgType], receivedMsgBodyLength);
         
-        if ((pSendMsg != PNULL) && (pReceivedMsgType == PNULL || pReceivedMsg != PNULL))
-        {
-            /* Put in the bit before the body */
-            pSendMsg->msgLength = 0;
-            pSendMsg->msgType = sendMsgType;
-            pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+                ASSERT_PARAM (receivedMsgBodyLength <= MAX_MSG_BODY_LENGTH, receivedMsgBodyLength);
                         
-            /* Put in the specifics */
-            if (pSendMsgBody != PNULL)
-            {
-                memcpy (&(pSendMsg->msgBody[0]), pSendMsgBody, sendMsgBodyLength);
-            }
-            pSendMsg->msgLength += sendMsgBodyLength;
-            
-            printDebug ("SM Client: sending message %s, length %d, hex dump:\n",  pgStateMachineMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
-            printHexDump (pSendMsg, pSendMsg->msgLength + 1);
-            returnCode = runMessagingClient ((SInt32) atoi (STATE_MACHINE_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
-                    
-            printDebug ("SM Client: message system returnCode: %d\n", returnCode);
-            /* This code makes assumptions about packing (i.e. that it's '1') so be careful */
-            if (returnCode == CLIENT_SUCCESS)
-            {
-                if (pReceivedMsg != PNULL)
+                if ((pReceivedMsgBody != PNULL) && (receivedMsgBodyLength > 0))
                 {
-                    if (pReceivedMsg->msgLength >= sizeof (pReceivedMsg->msgType))
-                    { 
-                        success = true;
-                        /* Pass back the message type */
-                        *pReceivedMsgType = pReceivedMsg->msgType;
-                        /* Pass back the body of the message */
-                        receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
-                        printDebug ("SM Client: received message %s, receivedMsgBodyLength: %d\n", pgStateMachineMessageNames[pReceivedMsg->msgType], receivedMsgBodyLength);
-                        
-                        ASSERT_PARAM (receivedMsgBodyLength <= MAX_MSG_BODY_LENGTH, receivedMsgBodyLength);
-                        
-                        if ((pReceivedMsgBody != PNULL) && (receivedMsgBodyLength > 0))
-                        {
-                            /* Copy out the body */
-                            memcpy (pReceivedMsgBody, &(pReceivedMsg->msgBody[0]), receivedMsgBodyLength);
-                            printHexDump (pReceivedMsg, pReceivedMsg->msgLength + 1);        
-                        }
-                    }
-                    /* Free the space for the received message */
-                    free (pReceivedMsg);
-                }
-                else
-                {
-                    success = true;
-                    printDebug ("SM Client not bothering to wait for a reply.\n");                
+                    /* Copy out the body */
+                    memcpy (pReceivedMsgBody, &(pReceivedMsg->msgBody[0]), receivedMsgBodyLength);
+                    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pReceivedMsg, pReceivedMsg->msgLength + 1);
                 }
             }
         }
-        /* Free the space for the sent message */
-        free (pSendMsg);
+        else
+        {
+            success = true;
+            DEBUG_PRINT (DEBUG_LEVEL_TRACE, "SM Client not bothering to wait for a reply.\n");
+        }
     }
 
     return success;
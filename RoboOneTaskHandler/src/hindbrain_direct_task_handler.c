@@ -38,9 +38,10 @@
  */
 RoboOneHDResult handleHDTaskReq (RoboOneHDTaskReq *pHDTaskReq, RoboOneHDTaskInd *pHDTaskInd)
 {
-    RoboOneHDResult result = HD_RESULT_GENERAL_FAILURE;
-    OInputContainer *pInputContainer;
-    OResponseString *pResponseString;
+    RoboOneHDResult result = HD_RESULT_SEND_FAILURE;
+    OInputContainer inputContainer;
+    OResponseString responseString;
+    UInt32 lengthInputString = 0;
     Char displayBuffer[MAX_O_STRING_LENGTH];
 
     ASSERT_PARAM (pHDTaskReq != PNULL, (unsigned long) pHDTaskReq);
@@ -49,51 +50,38 @@ RoboOneHDResult handleHDTaskReq (RoboOneHDTaskReq *pHDTaskReq, RoboOneHDTaskInd
     pHDTaskInd->string[0] = 0; /* Put in a terminator just in case we fail */
 
     printDebug ("Task Handler: HD Protocol Task received '%s', sending to Hindbrain.\n", removeCtrlCharacters (&(pHDTaskReq->string[0]), &(displayBuffer[0])));
-    pInputContainer = malloc (sizeof (*pInputContainer));
-    if (pInputContainer != PNULL)
+    inputContainer.waitForResponse = true;
+
+    /* Stop overruns as we're using different buffer lengths here */
+    lengthInputString = strlen (&(pHDTaskReq->string[0])) + 1; /* +1 for terminator */
+    if (lengthInputString > sizeof (inputContainer.string))
     {
-        UInt32 lengthInputString = 0;
-        pInputContainer->waitForResponse = true;
+        lengthInputString = sizeof (inputContainer.string) - 1;
+        inputContainer.string[lengthInputString] = 0; /* Make sure that a terminator gets on the end as it would otherwise be chopped off */
+    }
         
-        /* Stop overruns as we're using different buffer lengths here */
-        lengthInputString = strlen (&(pHDTaskReq->string[0])) + 1; /* +1 for terminator */
-        if (lengthInputString > sizeof (pInputContainer->string))
+    memcpy (&(inputContainer.string[0]), &(pHDTaskReq->string[0]), lengthInputString);
+
+    /* Go send the string and wait for an answer */
+    responseString.stringLength = sizeof (responseString.string);
+    if (hardwareServerSendReceive (HARDWARE_SEND_O_STRING, &inputContainer, sizeof (inputContainer), &responseString))
+    {
+        /* Prevent overruns */
+        if (responseString.stringLength > sizeof (pHDTaskInd->string))
         {
-            lengthInputString = sizeof (pInputContainer->string) - 1;
-            pInputContainer->string[lengthInputString] = 0; /* Make sure that a terminator gets on the end as it would otherwise be chopped off */
+            responseString.stringLength = sizeof (pHDTaskInd->string) - 1; /* - 1 to ensure a terminator */
+            responseString.string[responseString.stringLength] = 0;
         }
         
-        memcpy (&(pInputContainer->string[0]), &(pHDTaskReq->string[0]), lengthInputString);
-        
-        /* Go send the string and wait for an answer */
-        pResponseString = malloc (sizeof (*pResponseString));
-        if (pResponseString != PNULL)
-        {
-            pResponseString->stringLength = sizeof (pResponseString->string);
-            result = HD_RESULT_SEND_FAILURE;
-            
-            if (hardwareServerSendReceive (HARDWARE_SEND_O_STRING, pInputContainer, sizeof (*pInputContainer), pResponseString))
-            {
-                /* Prevent overruns */
-                if (pResponseString->stringLength > sizeof (pHDTaskInd->string))
-                {
-                    pResponseString->stringLength = sizeof (pHDTaskInd->string) - 1; /* - 1 to ensure a terminator */
-                    pResponseString->string[pResponseString->stringLength] = 0;
-                }
-                
-                /* Copy the answer into the indication to send back */
-                memcpy (&(pHDTaskInd->string[0]), &(pResponseString->string[0]), pResponseString->stringLength);
-                pHDTaskInd->stringLength = pResponseString->stringLength;
-                result = HD_RESULT_SUCCESS;
-                printDebug ("Task Handler: '%s' response from Hindbrain.\n", removeCtrlCharacters (&(pResponseString->string[0]), &(displayBuffer[0])));
-            }
-            else
-            {            
-                printDebug ("Task Handler: send failed.\n");
-            }
-            free (pResponseString);
-        }
-        free (pInputContainer);
+        /* Copy the answer into the indication to send back */
+        memcpy (&(pHDTaskInd->string[0]), &(responseString.string[0]), responseString.stringLength);
+        pHDTaskInd->stringLength = responseString.stringLength;
+        result = HD_RESULT_SUCCESS;
+        printDebug ("Task Handler: '%s' response from Hindbrain.\n", removeCtrlCharacters (&(responseString.string[0]), &(displayBuffer[0])));
+    }
+    else
+    {
+        printDebug ("Task Handler: send failed.\n");
     }
     
     return result;
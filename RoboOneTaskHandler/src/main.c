@@ -12,11 +12,19 @@
 #include <netinet/in.h>
 #include <rob_system.h>
 #include <messaging_server.h>
+#include <messaging_client.h>
 #include <task_handler_types.h>
 #include <task_handler_server.h>
 #include <task_handler_msg_auto.h>
 #include <task_handler_client.h>
 
+/*
+ * EXTERN
+ */
+
+/* The names of the messages, for the stats the server keeps */
+extern Char *pgTaskHandlerMessageNames[];
+
 /*
  * STATIC FUNCTIONS
  */
@@ -35,6 +43,7 @@ int main (int argc, char **argv)
     UInt16 taskHandlerServerPort;
 
     setDebugPrintsOnToFile ("roboonetaskhandler.log");
+    setFlightRecorderOn ("roboonetaskhandler.flt", FLIGHT_RECORDER_DEFAULT_NUM_RECORDS);
     setProgressPrintsOn();
 
     if (argc == 2)
@@ -42,6 +51,10 @@ int main (int argc, char **argv)
         taskHandlerServerPort = atoi (argv[1]);
         printProgress ("Task handler server listening on port %d.\n", taskHandlerServerPort);
 
+        /* Strings go to the hardware server at a high rate, carry them in shared memory */
+        setMessagingClientLocalTransport (MESSAGING_LOCAL_TRANSPORT_SHARED_MEMORY);
+
+        setMessagingServerMsgNames (pgTaskHandlerMessageNames, MAX_NUM_TASK_HANDLER_MSGS);
         returnCode = runMessagingServer (taskHandlerServerPort);
             
         if (returnCode == SERVER_EXIT_NORMALLY)
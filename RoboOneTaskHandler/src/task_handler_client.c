@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#define DEBUG_MODULE DEBUG_MODULE_CLIENT /* Before rob_system.h */
 #include <rob_system.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
@@ -60,6 +61,7 @@ Bool taskHandlerServerSendReceive (TaskHandlerMsgType msgType, void *pSendMsgBod
 {
     ClientReturnCode returnCode;
     Bool success = false;
+    MessagingClientMsgs *pMsgs;
     Msg *pSendMsg;
     Msg *pReceivedMsg;
     UInt16 receivedMsgBodyLength = 0;
@@ -67,50 +69,42 @@ Bool taskHandlerServerSendReceive (TaskHandlerMsgType msgType, void *pSendMsgBod
     ASSERT_PARAM (msgType < MAX_NUM_TASK_HANDLER_MSGS, msgType);
     ASSERT_PARAM (sendMsgBodyLength <= MAX_MSG_BODY_LENGTH, sendMsgBodyLength);
 
-    pSendMsg = malloc (sizeof (*pSendMsg));
+    pMsgs = getMessagingClientMsgs();
+    pSendMsg = &(pMsgs->sendMsg);
+    pReceivedMsg = &(pMsgs->receivedMsg);
     
-    if (pSendMsg != PNULL)
+    /* Put in the bit before the body */
+    pSendMsg->msgLength = 0;
+    pSendMsg->msgType = msgType;
+    pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+
+    /* Put any stuff to send */
+    if (pSendMsgBody != PNULL)
     {
-        pReceivedMsg = malloc (sizeof (*pReceivedMsg));
+        memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
+    }
+    pSendMsg->msgLength += sendMsgBodyLength;
         
-        if (pReceivedMsg != PNULL)
+    pReceivedMsg->msgLength = 0;
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "TH Client: sending message %s, length %d, hex dump:\n", pgTaskHandlerMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
+    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pSendMsg, pSendMsg->msgLength + 1);
+    returnCode = runMessagingClient ((SInt32) atoi (TASK_HANDLER_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "TH Client: message system returnCode: %d\n", returnCode);
+    /* This code makes assumptions about packing (i.e. that it's '1' and that the
+     * Bool 'success' is at the start of the body) so be careful */
+    if (returnCode == CLIENT_SUCCESS && (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType)))
+    {
+        /* Check the Bool 'success' at the start of the message body */
+        receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "TH Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
+        DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pReceivedMsg, pReceivedMsg->msgLength + 1);
+        if (receivedMsgBodyLength >= sizeof (Bool))
         {
-            /* Put in the bit before the body */
-            pSendMsg->msgLength = 0;
-            pSendMsg->msgType = msgType;
-            pSendMsg->msgLength += sizeof (pSendMsg->msgType);
-                        
-            /* Put any stuff to send */
-            if (pSendMsgBody != PNULL)
-            {
-                memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
-            }
-            pSendMsg->msgLength += sendMsgBodyLength;
-            
-            pReceivedMsg->msgLength = 0;
-    
-            printDebug ("TH Client: sending message %s, length %d, hex dump:\n", pgTaskHandlerMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
-            printHexDump (pSendMsg, pSendMsg->msgLength + 1);
-            returnCode = runMessagingClient ((SInt32) atoi (TASK_HANDLER_SERVER_PORT_STRING), PNULL, pSendMsg, pReceivedMsg);
-                    
-            printDebug ("TH Client: message system returnCode: %d\n", returnCode);
-            /* This code makes assumptions about packing (i.e. that it's '1' and that the
-             * Bool 'success' is at the start of the body) so be careful */
-            if (returnCode == CLIENT_SUCCESS && (pReceivedMsg->msgLength > sizeof (pReceivedMsg->msgType)))
-            { 
-                /* Check the Bool 'success' at the start of the message body */
-                receivedMsgBodyLength = pReceivedMsg->msgLength - sizeof (pReceivedMsg->msgType);
-                printDebug ("TH Client: receivedMsgBodyLength: %d\n", receivedMsgBodyLength);
-                printHexDump (pReceivedMsg, pReceivedMsg->msgLength + 1);
-                if (receivedMsgBodyLength >= sizeof (Bool))
-                {
-                    printDebug ("TH Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
-                    success = (Bool) pReceivedMsg->msgBody[0];
-                }
-            }
-            free (pReceivedMsg);
+            DEBUG_PRINT (DEBUG_LEVEL_TRACE, "TH Client: success field: %d\n", (Bool) pReceivedMsg->msgBody[0]);
+            success = (Bool) pReceivedMsg->msgBody[0];
         }
-        free (pSendMsg);
     }
 
     return success;
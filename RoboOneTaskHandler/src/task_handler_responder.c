@@ -65,37 +65,33 @@ Bool taskHandlerResponder (RoboOneTaskReqHeader *pHeader, TaskHandlerMsgType msg
     ASSERT_PARAM (msgType < MAX_NUM_TASK_HANDLER_MSGS, msgType);
     ASSERT_PARAM (sendMsgBodyLength <= MAX_MSG_BODY_LENGTH, sendMsgBodyLength);
 
-    pSendMsg = malloc (sizeof (*pSendMsg));
+    pSendMsg = &(getMessagingClientMsgs()->sendMsg);
     
-    if (pSendMsg != PNULL)
+    if (pHeader->sourceServerIpAddressStringPresent)
     {
-        if (pHeader->sourceServerIpAddressStringPresent)
-        {
-            pIpAddress = &(pHeader->sourceServerIpAddressString[0]);
-        }
+        pIpAddress = &(pHeader->sourceServerIpAddressString[0]);
+    }
 
-        /* Put in the bit before the body */
-        pSendMsg->msgLength = 0;
-        pSendMsg->msgType = msgType;
-        pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+    /* Put in the bit before the body */
+    pSendMsg->msgLength = 0;
+    pSendMsg->msgType = msgType;
+    pSendMsg->msgLength += sizeof (pSendMsg->msgType);
                     
-        /* Put in any body to send */
-        if (pSendMsgBody != PNULL)
-        {
-            memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
-        }
-        pSendMsg->msgLength += sendMsgBodyLength;
+    /* Put in any body to send */
+    if (pSendMsgBody != PNULL)
+    {
+        memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
+    }
+    pSendMsg->msgLength += sendMsgBodyLength;
         
-        printDebug ("TH Responder: sending message %s, length %d, to port %d, IP address %s, hex dump:\n", pgTaskHandlerMessageNames[pSendMsg->msgType], pSendMsg->msgLength, pHeader->sourceServerPort, pIpAddress);
-        printHexDump (pSendMsg, pSendMsg->msgLength + 1);
-        returnCode = runMessagingClient (pHeader->sourceServerPort, pIpAddress, pSendMsg, PNULL);                
-        printDebug ("TH Responder: message system returnCode: %d\n", returnCode);
-        if (returnCode == CLIENT_SUCCESS)
-        {
-            success = true;
-        }
-
-        free (pSendMsg);
+    printDebug ("TH Responder: sending message %s, length %d, to port %d, IP address %s, hex dump:\n", pgTaskHandlerMessageNames[pSendMsg->msgType], pSendMsg->msgLength, pHeader->sourceServerPort, pIpAddress);
+    printHexDump (pSendMsg, pSendMsg->msgLength + 1);
+    /* No response is needed so it goes as a datagram, if the client is on this machine */
+    returnCode = sendMessagingClientDatagram (pHeader->sourceServerPort, pIpAddress, pSendMsg);
+    printDebug ("TH Responder: message system returnCode: %d\n", returnCode);
+    if (returnCode == CLIENT_SUCCESS)
+    {
+        success = true;
     }
 
     return success;
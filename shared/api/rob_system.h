@@ -3,6 +3,7 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef bool Bool;
 typedef char Char;
@@ -25,13 +26,154 @@ typedef unsigned long UInt32;
 #define BINARY_STRING_BUFFER_SIZE 9
 #define UNUSED(x) (void)(x)
 
+/* Debug levels: DEBUG_PRINT() and DEBUG_HEX_DUMP() take one
+ * and do nothing, not even evaluate their arguments, unless
+ * the level is at or below both DEBUG_LEVEL_MAX, fixed when
+ * compiling, and the run-time level of the module of the
+ * file, which is DEBUG_MODULE if the file defines it before
+ * including this, else DEBUG_MODULE_GENERAL */
+#define DEBUG_LEVEL_NONE 0
+#define DEBUG_LEVEL_ERROR 1
+#define DEBUG_LEVEL_INFO 2
+#define DEBUG_LEVEL_TRACE 3
+#ifndef DEBUG_LEVEL_MAX
+#define DEBUG_LEVEL_MAX DEBUG_LEVEL_TRACE  /* e.g. compile with -DDEBUG_LEVEL_MAX=1 for only the errors */
+#endif
+#ifndef DEBUG_MODULE
+#define DEBUG_MODULE DEBUG_MODULE_GENERAL
+#endif
+/* Set this in the environment to set the run-time level of each
+ * module, one digit per DebugModule in order, e.g. "3103" */
+#define DEBUG_LEVELS_ENV "ROB_DEBUG_LEVELS"
+#define DEBUG_IS_ON(lEVEL) (((lEVEL) <= DEBUG_LEVEL_MAX) && ((lEVEL) <= gDebugModuleLevel[DEBUG_MODULE]) && (gDebugPrintsAreOn || gFlightRecorderIsOn) && !gSuspendDebug)
+#define DEBUG_PRINT(lEVEL, ...) do {if (DEBUG_IS_ON (lEVEL)) {printDebug (__VA_ARGS__);}} while (0)
+#define DEBUG_HEX_DUMP(lEVEL,pMEMORY,sIZE) do {if (DEBUG_IS_ON (lEVEL)) {printHexDump ((pMEMORY), (sIZE));}} while (0)
+
+typedef enum DebugModuleTag
+{
+    DEBUG_MODULE_GENERAL,
+    DEBUG_MODULE_ONE_WIRE,
+    DEBUG_MODULE_CLIENT,    /* The *ServerSendReceive() of the clients of each server */
+    DEBUG_MODULE_TIMER,
+    NUM_DEBUG_MODULES
+} DebugModule;
+
+/* Binary debug logs, see setDebugPrintsOnToBinaryFile() and
+ * LogDecoder: a file header then records, each a header
+ * followed by length bytes.  A print record carries the ID
+ * of its format, given earlier in a format record, and its
+ * arguments: integers, doubles and pointers as eight bytes,
+ * strings as a UInt16 length then the characters */
+#define BINARY_LOG_MAGIC "RobLog01"
+#define BINARY_LOG_MAX_ARGS 16
+/* Set this in the environment to make setDebugPrintsOnToFile() binary */
+#define DEBUG_PRINTS_BINARY_ENV "ROB_DEBUG_PRINTS_BINARY"
+
+typedef enum BinaryLogRecordTypeTag
+{
+    BINARY_LOG_FORMAT = 'F',   /* UInt8 numArgs, UInt8 argType[numArgs], the format string */
+    BINARY_LOG_PRINT = 'P',    /* The arguments */
+    BINARY_LOG_TEXT = 'T',     /* Text, for prints whose format can't be binary */
+    BINARY_LOG_HEX_DUMP = 'H'  /* uint64_t address, UInt16 size, the bytes kept */
+} BinaryLogRecordType;
+
+typedef enum BinaryLogArgTypeTag
+{
+    BINARY_LOG_ARG_INT,
+    BINARY_LOG_ARG_UNSIGNED_INT,
+    BINARY_LOG_ARG_LONG,
+    BINARY_LOG_ARG_UNSIGNED_LONG,
+    BINARY_LOG_ARG_LONG_LONG,
+    BINARY_LOG_ARG_DOUBLE,
+    BINARY_LOG_ARG_POINTER,
+    BINARY_LOG_ARG_STRING
+} BinaryLogArgType;
+
+/* Flight recorder, see setFlightRecorderOn() and FlightDump:
+ * a file header then a ring of fixed-length records, the
+ * whole file mapped into memory so that the last debug prints
+ * and hex dumps are in it even if the process dies.  A record
+ * that has been written holds one more than its sequence
+ * number, so the dump can put the ring back in order */
+#define FLIGHT_RECORDER_MAGIC "RobFlt01"
+#define FLIGHT_RECORDER_RECORD_LENGTH 128
+#define FLIGHT_RECORDER_DEFAULT_NUM_RECORDS 8192  /* A Mbyte */
+
+/* Tracing: a span is begun and ended around a piece of work
+ * and, while tracing is on, kept as a Chrome trace event, see
+ * chrome://tracing or ui.perfetto.dev.  The processes of a run
+ * all append to the file named by TRACE_FILE_ENV, if it is set
+ * when they turn debug prints on, and the times are all from
+ * the monotonic clock, so the run is seen across processes.
+ * The name of a span must last and need no JSON escaping */
+#define TRACE_FILE_ENV "ROB_TRACE_FILE"
+#define TRACE_SPAN_BEGIN(pSPAN,nAME,aRG) do {(pSPAN)->startNs = 0; if (gTraceIsOn) {traceSpanBegin ((pSPAN), (nAME), (aRG));}} while (0)
+#define TRACE_SPAN_END(pSPAN) do {if ((pSPAN)->startNs != 0) {traceSpanEnd (pSPAN);}} while (0)
+
+typedef struct TraceSpanTag
+{
+    const Char *pName;
+    SInt32 arg;                 /* Shown with the span, e.g. a message type */
+    uint64_t startNs;           /* Zero if tracing was off when the span began */
+} TraceSpan;
+
+typedef struct BinaryLogFileHeaderTag
+{
+    Char magic[8];              /* BINARY_LOG_MAGIC, without the terminator */
+    uint64_t realTimeNs;        /* CLOCK_REALTIME when the file was opened */
+    uint64_t monotonicTimeNs;   /* CLOCK_MONOTONIC at the same moment */
+} BinaryLogFileHeader;
+
+typedef struct BinaryLogRecordHeaderTag
+{
+    UInt8 type;                 /* A BinaryLogRecordType */
+    UInt8 spare;
+    UInt16 formatId;            /* For format and print records */
+    UInt16 length;              /* Of what follows the header */
+    UInt16 spare2;
+    uint64_t timeNs;            /* CLOCK_MONOTONIC when the print was made */
+} BinaryLogRecordHeader;
+
+typedef struct FlightRecorderHeaderTag
+{
+    Char magic[8];              /* FLIGHT_RECORDER_MAGIC, without the terminator */
+    uint32_t numRecords;
+    uint32_t recordLength;      /* FLIGHT_RECORDER_RECORD_LENGTH */
+    uint64_t realTimeNs;        /* CLOCK_REALTIME when the file was opened */
+    uint64_t monotonicTimeNs;   /* CLOCK_MONOTONIC at the same moment */
+    uint64_t nextSequence;      /* The number of records ever taken */
+} FlightRecorderHeader;
+
+typedef struct FlightRecordTag
+{
+    uint64_t sequence;          /* One more than the sequence number, zero while being written */
+    uint64_t timeNs;            /* CLOCK_MONOTONIC when the print was made */
+    UInt8 type;                 /* BINARY_LOG_TEXT or BINARY_LOG_HEX_DUMP */
+    UInt8 spare;
+    UInt16 length;              /* Of data */
+    UInt16 size;                /* Of the memory, for a hex dump */
+    UInt16 spare2;
+    Char data[FLIGHT_RECORDER_RECORD_LENGTH - 24];
+} FlightRecord;
+
+/* Only for the debug level and trace macros, use the functions below */
+extern Bool gDebugPrintsAreOn;
+extern Bool gFlightRecorderIsOn;
+extern __thread Bool gSuspendDebug;
+extern UInt8 gDebugModuleLevel[NUM_DEBUG_MODULES];
+extern Bool gTraceIsOn;
+
 bool assertFunc (const Char * pPlace, UInt32 line, const Char * pText, Bool paramPresent, UInt32 param1, UInt32 param2, UInt32 param3);
 void setProgressPrintsOn (void);
 void setProgressPrintsOff (void);
 void setDebugPrintsOn (void);
 void setDebugPrintsOnToFile (Char * pFilename);
+void setDebugPrintsOnToBinaryFile (Char * pFilename);
 void setDebugPrintsOnToSyslog (void);
 void setDebugPrintsOff (void);
+void setFlightRecorderOn (Char * pFilename, UInt32 numRecords);
+void setFlightRecorderOff (void);
+void setDebugModuleLevel (DebugModule module, UInt8 level);
 void hexDumpsToSyslogOn (void);
 void hexDumpsToSyslogOff (void);
 void suspendDebug (void);
@@ -42,3 +184,8 @@ void printHexDump (const void * pMemory, UInt16 size);
 Char * binaryString (UInt8 value, Char *pString);
 Char * removeCtrlCharacters (const Char *pInput, Char *pOutput);
 UInt32 getSystemTicks (void);
+uint64_t getMonotonicNs (void);
+void setTraceOn (const Char *pFilename);
+void setTraceOff (void);
+void traceSpanBegin (TraceSpan *pSpan, const Char *pName, SInt32 arg);
+void traceSpanEnd (TraceSpan *pSpan);
@@ -9,22 +9,1131 @@
 #include <string.h>
 #include <ctype.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <signal.h>
 #include <pthread.h>
+#include <semaphore.h>
 #include <syslog.h>
 #include <rob_system.h>
 
+/*
+ * MANIFEST CONSTANTS
+ */
+
+/* The number of records in the log ring, must be a power of two */
+#define LOG_RING_NUM_SLOTS 1024
+
+/* The longest debug print that is kept whole, longer ones are cut short */
+#define LOG_RECORD_MAX_LENGTH 224
+
+/* How long the log writer waits when there's nothing to write */
+#define LOG_WRITER_IDLE_US 20000
+
+/* The log writer is woken early each time this many records
+ * have been put into the ring, so that it doesn't fill while
+ * the writer waits; must be a power of two */
+#define LOG_WRITER_WAKE_INTERVAL (LOG_RING_NUM_SLOTS / 4)
+
+/* The number of bytes on each line of a hex dump */
+#define HEX_DUMP_BYTES_PER_LINE 8
+
+/* The number of different formats that debug prints can use
+ * in a binary log, must be a power of two; prints with any
+ * more are kept as text */
+#define LOG_FORMAT_TABLE_SIZE 2048
+
+/* The number of ended spans kept before they are written
+ * to the trace file in one go */
+#define TRACE_BUFFER_NUM_EVENTS 256
+
+/* Ended spans are written to the trace file at least this
+ * often, so that not much is lost if the process is killed */
+#define TRACE_FLUSH_INTERVAL_NS 1000000000ULL
+
+/* The most that one event takes up in the trace file */
+#define TRACE_EVENT_MAX_LENGTH 192
+
+/*
+ * TYPES
+ */
+
+/* What a log record holds */
+typedef enum LogRecordTypeTag
+{
+    LOG_RECORD_TEXT,
+    LOG_RECORD_HEX_DUMP,
+    LOG_RECORD_BINARY        /* A format ID and the arguments, for a binary log */
+} LogRecordType;
+
+/* A debug print or hex dump, captured by the caller and
+ * formatted and written later by the log writer thread */
+typedef struct LogRecordTag
+{
+    UInt32 sequence;         /* Which lap of the ring the record is ready for */
+    LogRecordType type;
+    Bool toSyslog;
+    uint64_t timeNs;         /* CLOCK_REALTIME, CLOCK_MONOTONIC in a binary log */
+    UInt16 formatId;         /* For a binary record */
+    unsigned long address;   /* Of the memory, for a hex dump */
+    UInt16 size;             /* Of the memory, for a hex dump */
+    UInt16 length;           /* Of data */
+    Char data[LOG_RECORD_MAX_LENGTH];
+} LogRecord;
+
+/* A lock-free ring of log records: any number of threads
+ * put records in, only the log writer takes them out */
+typedef struct LogRingTag
+{
+    UInt32 tail;             /* The next to put in, shared by all the threads */
+    UInt32 head;             /* The next to take out */
+    UInt32 numDropped;       /* Records dropped because the ring was full */
+    LogRecord record[LOG_RING_NUM_SLOTS];
+} LogRing;
+
+/* A debug print format, registered the first time that it
+ * is used in a binary log; its ID is where it is in the
+ * table.  The format string is written to the log once,
+ * after which prints carry only the ID and the arguments */
+typedef struct LogFormatTag
+{
+    const Char *pFormat;     /* PNULL if the entry is free */
+    Bool isBinary;           /* false if prints with it have to be kept as text */
+    Bool isWritten;          /* true once it is in the log, only used by the log writer */
+    UInt8 numArgs;
+    UInt16 fixedLength;      /* Of the arguments, not counting the characters of strings */
+    UInt8 argType[BINARY_LOG_MAX_ARGS];
+} LogFormat;
+
+/* An ended span, waiting to be written to the trace file */
+typedef struct TraceEventTag
+{
+    const Char *pName;
+    SInt32 arg;
+    SInt32 threadId;
+    uint64_t startNs;
+    uint64_t durationNs;
+} TraceEvent;
+
 /*
  * GLOBALS - prefixed with g
  */
 
-static Bool gDebugPrintsAreOn = false;
-static Bool gDebugPrintsToSyslogAreOn = false;
-static Bool gHexDumpsToSyslogAreOn = false;
-static FILE *pgDefaultStream = PNULL;
-static FILE *pgDebugPrintsStream = PNULL;
-static Bool gProgressPrintsAreOn = true;
-static Bool gSuspendDebug = false;
+Bool gDebugPrintsAreOn = false;
+static Bool gDebugPrintsToSyslogAreOn = false;
+static Bool gHexDumpsToSyslogAreOn = false;
+static FILE *pgDefaultStream = PNULL;
+static FILE *pgDebugPrintsStream = PNULL;
+static Bool gProgressPrintsAreOn = true;
+__thread Bool gSuspendDebug = false; /* Per thread so that suspending one doesn't silence the others */
+UInt8 gDebugModuleLevel[NUM_DEBUG_MODULES] = {DEBUG_LEVEL_TRACE, DEBUG_LEVEL_TRACE, DEBUG_LEVEL_TRACE, DEBUG_LEVEL_TRACE};
+static Bool gDebugPrintsAreBinary = false;
+
+/* Debug prints and hex dumps go through the ring to the
+ * log writer thread, so that the caller doesn't wait for
+ * them to be formatted and written out; while the writer
+ * isn't running they are written by the caller instead */
+static LogRing gLogRing;
+static Bool gLogWriterIsRunning = false;
+static Bool gLogWriterExiting = false;
+static Bool gLogIsInitialised = false;
+static pthread_t gLogWriterThread;
+static sem_t gLogWriterWake;
+static pthread_mutex_t gLogWriterLock = PTHREAD_MUTEX_INITIALIZER;  /* Held while starting or stopping the writer */
+static pthread_mutex_t gLogOutputLock = PTHREAD_MUTEX_INITIALIZER;  /* Held while taking records out and writing them */
+static const int gLogCrashSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+static LogFormat gLogFormat[LOG_FORMAT_TABLE_SIZE];
+static pthread_mutex_t gLogFormatLock = PTHREAD_MUTEX_INITIALIZER;  /* Held while registering a format */
+
+/* The flight recorder: the file header, mapped into
+ * memory, followed by the records */
+Bool gFlightRecorderIsOn = false;
+static FlightRecorderHeader *pgFlightRecorder = PNULL;
+static FlightRecord *pgFlightRecords = PNULL;
+
+/* Spans are kept here as they end and written to the trace
+ * file, which all the processes share, a buffer-full at a time */
+Bool gTraceIsOn = false;
+static SInt32 gTraceFd = -1;
+static Bool gTraceIsInitialised = false;
+static TraceEvent gTraceEvent[TRACE_BUFFER_NUM_EVENTS];
+static UInt32 gTraceNumEvents = 0;
+static Char gTraceText[TRACE_BUFFER_NUM_EVENTS * TRACE_EVENT_MAX_LENGTH];
+static pthread_mutex_t gTraceLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread SInt32 gTraceThreadId = 0;
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Get the time from a clock in nanoseconds.
+ *
+ * clockId  the clock, e.g. CLOCK_MONOTONIC.
+ *
+ * @return  the time, zero if the call fails.
+ */
+static uint64_t getClockNs (clockid_t clockId)
+{
+    struct timespec time;
+    uint64_t timeNs = 0;
+
+    if (clock_gettime (clockId, &time) == 0)
+    {
+        timeNs = ((uint64_t) time.tv_sec * 1000000000ULL) + time.tv_nsec;
+    }
+
+    return timeNs;
+}
+
+/*
+ * Get the time for a log record: the time of
+ * day or, in a binary log, the monotonic time,
+ * from which the decoder works out the time of
+ * day.
+ *
+ * @return  the time in nanoseconds.
+ */
+static uint64_t getLogTimeNs (void)
+{
+    uint64_t timeNs;
+
+    if (gDebugPrintsAreBinary)
+    {
+        timeNs = getMonotonicNs();
+    }
+    else
+    {
+        timeNs = getClockNs (CLOCK_REALTIME);
+    }
+
+    return timeNs;
+}
+
+/*
+ * Print the time of a log record at the start
+ * of a line of a text log, to the microsecond.
+ *
+ * pStream  the stream.
+ * timeNs   the time in nanoseconds.
+ */
+static void printLogTime (FILE *pStream, uint64_t timeNs)
+{
+    fprintf (pStream, "%.10lu.%.6lu: ", (unsigned long) (timeNs / 1000000000ULL), (unsigned long) ((timeNs / 1000) % 1000000));
+}
+
+/*
+ * Write out the ended spans as Chrome trace
+ * events, in one go so that they don't get
+ * mixed up with those of other processes.
+ * Called with gTraceLock held.
+ */
+static void flushTraceEvents (void)
+{
+    TraceEvent *pEvent;
+    UInt32 length = 0;
+    SInt32 eventLength;
+    SInt32 processId = getpid();
+    UInt32 x;
+
+    for (x = 0; x < gTraceNumEvents; x++)
+    {
+        pEvent = &(gTraceEvent[x]);
+        eventLength = snprintf (gTraceText + length, sizeof (gTraceText) - length,
+                                "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%ld,\"ts\":%llu.%.3llu,\"dur\":%llu.%.3llu,\"args\":{\"arg\":%ld}},\n",
+                                pEvent->pName,
+                                processId,
+                                pEvent->threadId,
+                                (unsigned long long) (pEvent->startNs / 1000), (unsigned long long) (pEvent->startNs % 1000),
+                                (unsigned long long) (pEvent->durationNs / 1000), (unsigned long long) (pEvent->durationNs % 1000),
+                                pEvent->arg);
+        if ((eventLength > 0) && (eventLength < (SInt32) (sizeof (gTraceText) - length)))
+        {
+            length += eventLength;
+        }
+    }
+
+    if ((length > 0) && (write (gTraceFd, gTraceText, length) != (SInt32) length))
+    {
+        fprintf (stderr, "Couldn't write to the trace file, error: %s.\n", strerror (errno));
+    }
+    gTraceNumEvents = 0;
+}
+
+/*
+ * Set the run-time debug level of each module
+ * from DEBUG_LEVELS_ENV and turn tracing on
+ * if TRACE_FILE_ENV is set.
+ */
+static void readDebugEnv (void)
+{
+    const Char *pLevels = getenv (DEBUG_LEVELS_ENV);
+    const Char *pTraceFile = getenv (TRACE_FILE_ENV);
+    UInt32 x;
+
+    if (pLevels != PNULL)
+    {
+        for (x = 0; (x < NUM_DEBUG_MODULES) && (pLevels[x] != 0); x++)
+        {
+            if (isdigit ((int) pLevels[x]))
+            {
+                gDebugModuleLevel[x] = pLevels[x] - '0';
+            }
+        }
+    }
+
+    if (pTraceFile != PNULL)
+    {
+        setTraceOn (pTraceFile);
+    }
+}
+
+/*
+ * Work out the types of the arguments a debug
+ * print format takes.  Only the conversions that
+ * can be decoded on another machine are allowed:
+ * no '*' widths, no wide characters and nothing
+ * longer than a long long or a double.
+ *
+ * pFormat  the printf() style format.
+ * pEntry   the entry to fill in with the types.
+ *
+ * @return  true if prints with the format can
+ *          be binary, otherwise false.
+ */
+static Bool parseLogFormat (const Char *pFormat, LogFormat *pEntry)
+{
+    static const BinaryLogArgType signedType[] = {BINARY_LOG_ARG_INT, BINARY_LOG_ARG_LONG, BINARY_LOG_ARG_LONG_LONG};
+    static const BinaryLogArgType unsignedType[] = {BINARY_LOG_ARG_UNSIGNED_INT, BINARY_LOG_ARG_UNSIGNED_LONG, BINARY_LOG_ARG_LONG_LONG};
+    const Char *pChar = pFormat;
+    BinaryLogArgType argType = BINARY_LOG_ARG_INT;
+    UInt32 numLongs;
+    Bool hasArg;
+    Bool isBinary = true;
+
+    pEntry->numArgs = 0;
+    pEntry->fixedLength = 0;
+    while (isBinary && (*pChar != 0))
+    {
+        if (*pChar == '%')
+        {
+            pChar++;
+            numLongs = 0;
+            hasArg = true;
+            pChar += strspn (pChar, "-+ #0");
+            pChar += strspn (pChar, "0123456789");
+            if (*pChar == '.')
+            {
+                pChar++;
+                pChar += strspn (pChar, "0123456789");
+            }
+            if (*pChar == 'h')
+            {
+                /* Passed as an int anyway */
+                pChar++;
+                if (*pChar == 'h')
+                {
+                    pChar++;
+                }
+            }
+            else if (*pChar == 'z')
+            {
+                /* A size_t is the same size as a long */
+                numLongs = 1;
+                pChar++;
+            }
+            else
+            {
+                while ((*pChar == 'l') && (numLongs < 2))
+                {
+                    numLongs++;
+                    pChar++;
+                }
+            }
+
+            switch (*pChar)
+            {
+                case 'd':
+                case 'i':
+                {
+                    argType = signedType[numLongs];
+                }
+                break;
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                {
+                    argType = unsignedType[numLongs];
+                }
+                break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                {
+                    argType = BINARY_LOG_ARG_DOUBLE;
+                }
+                break;
+                case 'c':
+                case 's':
+                {
+                    argType = (*pChar == 'c') ? BINARY_LOG_ARG_INT : BINARY_LOG_ARG_STRING;
+                    isBinary = (numLongs == 0);
+                }
+                break;
+                case 'p':
+                {
+                    argType = BINARY_LOG_ARG_POINTER;
+                }
+                break;
+                case '%':
+                {
+                    hasArg = false;
+                }
+                break;
+                default:
+                {
+                    isBinary = false;
+                }
+                break;
+            }
+
+            if (isBinary)
+            {
+                if (hasArg)
+                {
+                    if (pEntry->numArgs < BINARY_LOG_MAX_ARGS)
+                    {
+                        pEntry->argType[pEntry->numArgs] = (UInt8) argType;
+                        pEntry->numArgs++;
+                        pEntry->fixedLength += (argType == BINARY_LOG_ARG_STRING) ? sizeof (UInt16) : sizeof (uint64_t);
+                    }
+                    else
+                    {
+                        isBinary = false;
+                    }
+                }
+                pChar++;
+            }
+        }
+        else
+        {
+            pChar++;
+        }
+    }
+
+    return isBinary;
+}
+
+/*
+ * Find the entry for a debug print format in
+ * the format table, registering it if it isn't
+ * there yet.  Formats are told apart by where
+ * they are, which is the same for every print
+ * made from the same place.
+ *
+ * pFormat  the printf() style format.
+ *
+ * @return  the entry or PNULL if the table is
+ *          full.
+ */
+static LogFormat *getLogFormat (const Char *pFormat)
+{
+    LogFormat *pEntry = PNULL;
+    LogFormat *pCandidate;
+    const Char *pEntryFormat;
+    UInt32 index;
+    UInt32 i;
+    Bool isLocked = false;
+
+    index = (UInt32) ((((uintptr_t) pFormat) * 2654435761U) >> 16);
+    for (i = 0; (pEntry == PNULL) && (i < LOG_FORMAT_TABLE_SIZE); i++)
+    {
+        pCandidate = &(gLogFormat[(index + i) & (LOG_FORMAT_TABLE_SIZE - 1)]);
+        pEntryFormat = __atomic_load_n (&(pCandidate->pFormat), __ATOMIC_ACQUIRE);
+        if ((pEntryFormat == PNULL) && !isLocked)
+        {
+            /* Only one thread registers formats at a time,
+             * so look again in case another has just used
+             * this entry */
+            pthread_mutex_lock (&gLogFormatLock);
+            isLocked = true;
+            pEntryFormat = pCandidate->pFormat;
+        }
+        if (pEntryFormat == pFormat)
+        {
+            pEntry = pCandidate;
+        }
+        else if (pEntryFormat == PNULL)
+        {
+            pCandidate->isBinary = parseLogFormat (pFormat, pCandidate);
+            pCandidate->isWritten = false;
+            __atomic_store_n (&(pCandidate->pFormat), pFormat, __ATOMIC_RELEASE);
+            pEntry = pCandidate;
+        }
+    }
+
+    if (isLocked)
+    {
+        pthread_mutex_unlock (&gLogFormatLock);
+    }
+
+    return pEntry;
+}
+
+/*
+ * Fill in a log record for a binary log with the
+ * arguments of a debug print, no formatting.
+ * Strings are cut short if they don't all fit.
+ *
+ * pRecord  the record.
+ * pEntry   the entry for the format of the print.
+ * args     the arguments.
+ */
+static void packLogArgs (LogRecord *pRecord, const LogFormat *pEntry, va_list args)
+{
+    UInt8 *pData = (UInt8 *) pRecord->data;
+    UInt32 spare = sizeof (pRecord->data) - pEntry->fixedLength;
+    uint64_t value = 0;
+    double real;
+    const Char *pString;
+    UInt16 length;
+    UInt32 i;
+
+    pRecord->type = LOG_RECORD_BINARY;
+    pRecord->formatId = (UInt16) (pEntry - gLogFormat);
+    for (i = 0; i < pEntry->numArgs; i++)
+    {
+        if (pEntry->argType[i] == BINARY_LOG_ARG_STRING)
+        {
+            pString = va_arg (args, const Char *);
+            if (pString == PNULL)
+            {
+                pString = "(null)";
+            }
+            length = (UInt16) strnlen (pString, spare);
+            spare -= length;
+            memcpy (pData, &length, sizeof (length));
+            pData += sizeof (length);
+            memcpy (pData, pString, length);
+            pData += length;
+        }
+        else
+        {
+            switch (pEntry->argType[i])
+            {
+                case BINARY_LOG_ARG_INT:
+                {
+                    value = (uint64_t) (int64_t) va_arg (args, int);
+                }
+                break;
+                case BINARY_LOG_ARG_UNSIGNED_INT:
+                {
+                    value = va_arg (args, unsigned int);
+                }
+                break;
+                case BINARY_LOG_ARG_LONG:
+                {
+                    value = (uint64_t) (int64_t) va_arg (args, long);
+                }
+                break;
+                case BINARY_LOG_ARG_UNSIGNED_LONG:
+                {
+                    value = va_arg (args, unsigned long);
+                }
+                break;
+                case BINARY_LOG_ARG_LONG_LONG:
+                {
+                    value = va_arg (args, unsigned long long);
+                }
+                break;
+                case BINARY_LOG_ARG_DOUBLE:
+                {
+                    real = va_arg (args, double);
+                    memcpy (&value, &real, sizeof (value));
+                }
+                break;
+                default:
+                {
+                    value = (uintptr_t) va_arg (args, void *);
+                }
+                break;
+            }
+            memcpy (pData, &value, sizeof (value));
+            pData += sizeof (value);
+        }
+    }
+
+    pRecord->length = (UInt16) (pData - (UInt8 *) pRecord->data);
+}
+
+/*
+ * Write a record to a binary log, preceded by
+ * its format the first time the format is used.
+ * Called with gLogOutputLock held.
+ *
+ * pRecord  the record.
+ */
+static void writeBinaryLogRecord (const LogRecord *pRecord)
+{
+    BinaryLogRecordHeader header;
+    LogFormat *pEntry;
+    uint64_t address;
+    UInt16 length;
+
+    memset (&header, 0, sizeof (header));
+    header.timeNs = pRecord->timeNs;
+    switch (pRecord->type)
+    {
+        case LOG_RECORD_BINARY:
+        {
+            pEntry = &(gLogFormat[pRecord->formatId]);
+            header.formatId = pRecord->formatId;
+            if (!pEntry->isWritten)
+            {
+                length = (UInt16) strlen (pEntry->pFormat);
+                header.type = BINARY_LOG_FORMAT;
+                header.length = sizeof (pEntry->numArgs) + pEntry->numArgs + length;
+                fwrite (&header, sizeof (header), 1, pgDebugPrintsStream);
+                fwrite (&(pEntry->numArgs), sizeof (pEntry->numArgs), 1, pgDebugPrintsStream);
+                fwrite (pEntry->argType, 1, pEntry->numArgs, pgDebugPrintsStream);
+                fwrite (pEntry->pFormat, 1, length, pgDebugPrintsStream);
+                pEntry->isWritten = true;
+            }
+            header.type = BINARY_LOG_PRINT;
+            header.length = pRecord->length;
+            fwrite (&header, sizeof (header), 1, pgDebugPrintsStream);
+            fwrite (pRecord->data, 1, pRecord->length, pgDebugPrintsStream);
+        }
+        break;
+        case LOG_RECORD_TEXT:
+        {
+            header.type = BINARY_LOG_TEXT;
+            header.length = pRecord->length;
+            fwrite (&header, sizeof (header), 1, pgDebugPrintsStream);
+            fwrite (pRecord->data, 1, pRecord->length, pgDebugPrintsStream);
+        }
+        break;
+        default:
+        {
+            /* Just the bytes of the memory, not the padding */
+            length = (pRecord->size < pRecord->length) ? pRecord->size : pRecord->length;
+            address = pRecord->address;
+            header.type = BINARY_LOG_HEX_DUMP;
+            header.length = sizeof (address) + sizeof (pRecord->size) + length;
+            fwrite (&header, sizeof (header), 1, pgDebugPrintsStream);
+            fwrite (&address, sizeof (address), 1, pgDebugPrintsStream);
+            fwrite (&(pRecord->size), sizeof (pRecord->size), 1, pgDebugPrintsStream);
+            fwrite (pRecord->data, 1, length, pgDebugPrintsStream);
+        }
+        break;
+    }
+}
+
+/*
+ * Print straight to the debug prints file, not
+ * through the log ring; in a binary log the print
+ * goes in as text.  Called with gLogOutputLock
+ * held or the log writer stopped.
+ *
+ * pFormat  the printf() style format.
+ * ...      the arguments for pFormat.
+ */
+static void printToLogFile (const Char *pFormat, ...)
+{
+    BinaryLogRecordHeader header;
+    Char text[LOG_RECORD_MAX_LENGTH];
+    SInt32 length;
+    va_list args;
+
+    va_start (args, pFormat);
+    if (gDebugPrintsAreBinary)
+    {
+        length = vsnprintf (text, sizeof (text), pFormat, args);
+        if (length < 0)
+        {
+            length = 0;
+        }
+        else if (length >= (SInt32) sizeof (text))
+        {
+            length = sizeof (text) - 1;
+        }
+        memset (&header, 0, sizeof (header));
+        header.type = BINARY_LOG_TEXT;
+        header.length = (UInt16) length;
+        header.timeNs = getMonotonicNs();
+        fwrite (&header, sizeof (header), 1, pgDebugPrintsStream);
+        fwrite (text, 1, length, pgDebugPrintsStream);
+    }
+    else
+    {
+        vfprintf (pgDebugPrintsStream, pFormat, args);
+    }
+    va_end (args);
+}
+
+/*
+ * Claim the next free record in the log ring.
+ *
+ * pPosition  a place to put the position of the
+ *            record, to be given to putLogRecord().
+ *
+ * @return    the record or PNULL if the ring is
+ *            full.
+ */
+static LogRecord *claimLogRecord (UInt32 *pPosition)
+{
+    LogRecord *pRecord = PNULL;
+    UInt32 position;
+    SInt32 difference;
+    Bool done = false;
+
+    position = __atomic_load_n (&(gLogRing.tail), __ATOMIC_RELAXED);
+    while (!done)
+    {
+        pRecord = &(gLogRing.record[position & (LOG_RING_NUM_SLOTS - 1)]);
+        difference = (SInt32) (__atomic_load_n (&(pRecord->sequence), __ATOMIC_ACQUIRE) - position);
+        if (difference == 0)
+        {
+            /* Free on this lap: take it, unless another thread gets there
+             * first, in which case position is updated to where it got to */
+            done = __atomic_compare_exchange_n (&(gLogRing.tail), &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        }
+        else if (difference < 0)
+        {
+            /* Still holding a record from the lap before: the ring is full */
+            pRecord = PNULL;
+            done = true;
+        }
+        else
+        {
+            /* Another thread has taken it, look further on */
+            position = __atomic_load_n (&(gLogRing.tail), __ATOMIC_RELAXED);
+        }
+    }
+
+    *pPosition = position;
+
+    return pRecord;
+}
+
+/*
+ * Hand a filled-in record claimed with
+ * claimLogRecord() to the log writer.
+ *
+ * pRecord   the record.
+ * position  the position from claimLogRecord().
+ */
+static void putLogRecord (LogRecord *pRecord, UInt32 position)
+{
+    __atomic_store_n (&(pRecord->sequence), position + 1, __ATOMIC_RELEASE);
+    if ((position & (LOG_WRITER_WAKE_INTERVAL - 1)) == 0)
+    {
+        sem_post (&gLogWriterWake);
+    }
+}
+
+/*
+ * Format a log record and write it out, or
+ * write it as it is to a binary log.
+ * Called with gLogOutputLock held.
+ *
+ * pRecord  the record.
+ */
+static void writeLogRecord (const LogRecord *pRecord)
+{
+    FILE *pStream = pgDefaultStream;
+    const UInt8 *pPrint;
+    UInt32 i;
+
+    if (pgDebugPrintsStream != PNULL)
+    {
+        pStream = pgDebugPrintsStream;
+    }
+
+    if (gDebugPrintsAreBinary)
+    {
+        if (pgDebugPrintsStream != PNULL)
+        {
+            writeBinaryLogRecord (pRecord);
+        }
+    }
+    else if (pRecord->type == LOG_RECORD_TEXT)
+    {
+        if (pStream != PNULL)
+        {
+            printLogTime (pStream, pRecord->timeNs);
+            fprintf (pStream, "%.*s", (int) pRecord->length, pRecord->data);
+        }
+        if (pRecord->toSyslog)
+        {
+            syslog (LOG_INFO, "%.*s", (int) pRecord->length, pRecord->data);
+        }
+    }
+    else if (pRecord->type == LOG_RECORD_HEX_DUMP)
+    {
+        if (pStream != PNULL)
+        {
+            printLogTime (pStream, pRecord->timeNs);
+            fprintf (pStream, "Printing at least %d bytes:\n", pRecord->size);
+        }
+        for (i = 0; i < pRecord->length; i += HEX_DUMP_BYTES_PER_LINE)
+        {
+            pPrint = (const UInt8 *) &(pRecord->data[i]);
+            if (pStream != PNULL)
+            {
+                printLogTime (pStream, pRecord->timeNs);
+                fprintf (pStream, "0x%.8lx: 0x%.2x 0x%.2x 0x%.2x 0x%.2x : 0x%.2x 0x%.2x 0x%.2x 0x%.2x\n", pRecord->address + i, *pPrint, *(pPrint + 1), *(pPrint + 2), *(pPrint + 3), *(pPrint + 4), *(pPrint + 5), *(pPrint + 6), *(pPrint + 7));
+            }
+            if (pRecord->toSyslog)
+            {
+                syslog (LOG_INFO, "0x%.8lx: 0x%.2x 0x%.2x 0x%.2x 0x%.2x : 0x%.2x 0x%.2x 0x%.2x 0x%.2x\n", pRecord->address + i, *pPrint, *(pPrint + 1), *(pPrint + 2), *(pPrint + 3), *(pPrint + 4), *(pPrint + 5), *(pPrint + 6), *(pPrint + 7));
+            }
+        }
+        if ((pStream != PNULL) && (pRecord->size > pRecord->length))
+        {
+            printLogTime (pStream, pRecord->timeNs);
+            fprintf (pStream, "(%d more bytes not kept)\n", pRecord->size - pRecord->length);
+        }
+    }
+}
+
+/*
+ * Take everything there is out of the log ring and
+ * write it out, in one go.  Called with gLogOutputLock
+ * held.
+ *
+ * @return  true if anything was written.
+ */
+static Bool drainLogRing (void)
+{
+    LogRecord *pRecord;
+    UInt32 numDropped;
+    Bool isWritten = false;
+
+    pRecord = &(gLogRing.record[gLogRing.head & (LOG_RING_NUM_SLOTS - 1)]);
+    while (__atomic_load_n (&(pRecord->sequence), __ATOMIC_ACQUIRE) == gLogRing.head + 1)
+    {
+        writeLogRecord (pRecord);
+        /* Free the record for the next lap */
+        __atomic_store_n (&(pRecord->sequence), gLogRing.head + LOG_RING_NUM_SLOTS, __ATOMIC_RELEASE);
+        gLogRing.head++;
+        isWritten = true;
+        pRecord = &(gLogRing.record[gLogRing.head & (LOG_RING_NUM_SLOTS - 1)]);
+    }
+
+    numDropped = __atomic_exchange_n (&(gLogRing.numDropped), 0, __ATOMIC_RELAXED);
+    if ((numDropped > 0) && (pgDebugPrintsStream != PNULL))
+    {
+        if (!gDebugPrintsAreBinary)
+        {
+            printLogTime (pgDebugPrintsStream, getLogTimeNs());
+        }
+        printToLogFile ("!!! %lu debug print(s) dropped, the log ring was full !!!\n", numDropped);
+        isWritten = true;
+    }
+
+    if (isWritten && (pgDebugPrintsStream != PNULL))
+    {
+        fflush (pgDebugPrintsStream);
+    }
+
+    return isWritten;
+}
+
+/*
+ * The log writer thread: write out what is put into
+ * the log ring, in batches, until told to stop, then
+ * write out what is left.
+ *
+ * pParam  not used.
+ *
+ * @return  PNULL.
+ */
+static void *logWriter (void *pParam)
+{
+    Bool isWritten;
+    struct timespec wakeTime;
+
+    while (!__atomic_load_n (&gLogWriterExiting, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock (&gLogOutputLock);
+        isWritten = drainLogRing();
+        pthread_mutex_unlock (&gLogOutputLock);
+        if (!isWritten)
+        {
+            /* Nothing to do: wait a while, or until woken */
+            clock_gettime (CLOCK_REALTIME, &wakeTime);
+            wakeTime.tv_nsec += LOG_WRITER_IDLE_US * 1000L;
+            if (wakeTime.tv_nsec >= 1000000000L)
+            {
+                wakeTime.tv_sec++;
+                wakeTime.tv_nsec -= 1000000000L;
+            }
+            sem_timedwait (&gLogWriterWake, &wakeTime);
+        }
+    }
+
+    pthread_mutex_lock (&gLogOutputLock);
+    drainLogRing();
+    pthread_mutex_unlock (&gLogOutputLock);
+
+    return PNULL;
+}
+
+/*
+ * Stop the log writer, if it is running, once it
+ * has written out what is in the log ring.  Debug
+ * prints are then written by the caller until it
+ * is started again.
+ */
+static void stopLogWriter (void)
+{
+    pthread_mutex_lock (&gLogWriterLock);
+    if (gLogWriterIsRunning)
+    {
+        __atomic_store_n (&gLogWriterIsRunning, false, __ATOMIC_RELEASE);
+        __atomic_store_n (&gLogWriterExiting, true, __ATOMIC_RELEASE);
+        sem_post (&gLogWriterWake);
+        pthread_join (gLogWriterThread, PNULL);
+    }
+    pthread_mutex_unlock (&gLogWriterLock);
+}
+
+/*
+ * Write out what is in the log ring when the process
+ * is about to die of a signal, then let it die.
+ * Nothing is written if the signal arrived while
+ * things were being written out.
+ *
+ * signalNumber  the signal.
+ */
+static void logCrashHandler (int signalNumber)
+{
+    if (pthread_mutex_trylock (&gLogOutputLock) == 0)
+    {
+        drainLogRing();
+        pthread_mutex_unlock (&gLogOutputLock);
+    }
+
+    signal (signalNumber, SIG_DFL);
+    raise (signalNumber);
+}
+
+/*
+ * Start the log writer, if it isn't running.
+ * The first time, set up the log ring and make
+ * sure that it is written out on exit and when
+ * the process crashes.
+ */
+static void startLogWriter (void)
+{
+    struct sigaction crashAction;
+    struct sigaction oldAction;
+    UInt32 x;
+
+    pthread_mutex_lock (&gLogWriterLock);
+    if (!gLogIsInitialised)
+    {
+        for (x = 0; x < LOG_RING_NUM_SLOTS; x++)
+        {
+            gLogRing.record[x].sequence = x;
+        }
+        sem_init (&gLogWriterWake, 0, 0);
+        atexit (stopLogWriter);
+        memset (&crashAction, 0, sizeof (crashAction));
+        crashAction.sa_handler = logCrashHandler;
+        sigemptyset (&crashAction.sa_mask);
+        for (x = 0; x < sizeof (gLogCrashSignals) / sizeof (gLogCrashSignals[0]); x++)
+        {
+            /* Leave alone any handler that is already there */
+            if ((sigaction (gLogCrashSignals[x], PNULL, &oldAction) == 0) && (oldAction.sa_handler == SIG_DFL))
+            {
+                sigaction (gLogCrashSignals[x], &crashAction, PNULL);
+            }
+        }
+        gLogIsInitialised = true;
+    }
+    if (!gLogWriterIsRunning)
+    {
+        __atomic_store_n (&gLogWriterExiting, false, __ATOMIC_RELEASE);
+        if (pthread_create (&gLogWriterThread, PNULL, logWriter, PNULL) == 0)
+        {
+            __atomic_store_n (&gLogWriterIsRunning, true, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock (&gLogWriterLock);
+}
+
+/*
+ * Log a debug print: to the log ring if the log
+ * writer is running, dropping it if the ring is
+ * full, otherwise write it out straight away.
+ * In a binary log the print isn't formatted, if
+ * its format allows.
+ *
+ * pFormat  the printf() style format.
+ * args     the arguments for pFormat.
+ */
+static void logText (const Char *pFormat, va_list args)
+{
+    LogRecord localRecord;
+    LogRecord *pRecord = &localRecord;
+    LogFormat *pEntry = PNULL;
+    UInt32 position = 0;
+    SInt32 length;
+    Bool isQueued = __atomic_load_n (&gLogWriterIsRunning, __ATOMIC_ACQUIRE);
+
+    if (isQueued)
+    {
+        pRecord = claimLogRecord (&position);
+    }
+
+    if (pRecord != PNULL)
+    {
+        pRecord->toSyslog = gDebugPrintsToSyslogAreOn;
+        pRecord->timeNs = getLogTimeNs();
+        if (gDebugPrintsAreBinary)
+        {
+            pEntry = getLogFormat (pFormat);
+        }
+
+        if ((pEntry != PNULL) && pEntry->isBinary)
+        {
+            packLogArgs (pRecord, pEntry, args);
+        }
+        else
+        {
+            pRecord->type = LOG_RECORD_TEXT;
+            length = vsnprintf (pRecord->data, sizeof (pRecord->data), pFormat, args);
+            if (length < 0)
+            {
+                length = 0;
+            }
+            else if (length >= (SInt32) sizeof (pRecord->data))
+            {
+                /* Cut short, but keep the line ending */
+                length = sizeof (pRecord->data) - 1;
+                pRecord->data[length - 1] = '\n';
+            }
+            pRecord->length = (UInt16) length;
+        }
+
+        if (isQueued)
+        {
+            putLogRecord (pRecord, position);
+        }
+        else
+        {
+            pthread_mutex_lock (&gLogOutputLock);
+            writeLogRecord (pRecord);
+            if (pgDebugPrintsStream != PNULL)
+            {
+                fflush (pgDebugPrintsStream);
+            }
+            pthread_mutex_unlock (&gLogOutputLock);
+        }
+    }
+    else
+    {
+        __atomic_add_fetch (&(gLogRing.numDropped), 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Take the next record of the flight recorder,
+ * overwriting the oldest.
+ *
+ * pSequence  a place to put the sequence number
+ *            of the record, to be given to
+ *            putFlightRecord().
+ *
+ * @return     the record.
+ */
+static FlightRecord *claimFlightRecord (uint64_t *pSequence)
+{
+    FlightRecord *pRecord;
+    uint64_t sequence;
+
+    sequence = __atomic_fetch_add (&(pgFlightRecorder->nextSequence), 1, __ATOMIC_RELAXED);
+    pRecord = &(pgFlightRecords[sequence % pgFlightRecorder->numRecords]);
+    __atomic_store_n (&(pRecord->sequence), 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_RELEASE);
+    pRecord->timeNs = getMonotonicNs();
+
+    *pSequence = sequence;
+
+    return pRecord;
+}
+
+/*
+ * Mark a flight recorder record, filled in
+ * after claimFlightRecord(), as written.
+ *
+ * pRecord   the record.
+ * sequence  the sequence number from
+ *           claimFlightRecord().
+ */
+static void putFlightRecord (FlightRecord *pRecord, uint64_t sequence)
+{
+    __atomic_store_n (&(pRecord->sequence), sequence + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Put a debug print in the flight recorder,
+ * cut short if it doesn't fit in a record.
+ *
+ * pFormat  the printf() style format.
+ * args     the arguments for pFormat.
+ */
+static void recordFlightText (const Char *pFormat, va_list args)
+{
+    FlightRecord *pRecord;
+    uint64_t sequence;
+    SInt32 length;
+
+    pRecord = claimFlightRecord (&sequence);
+    pRecord->type = BINARY_LOG_TEXT;
+    length = vsnprintf (pRecord->data, sizeof (pRecord->data), pFormat, args);
+    if (length < 0)
+    {
+        length = 0;
+    }
+    else if (length >= (SInt32) sizeof (pRecord->data))
+    {
+        /* Cut short, but keep the line ending */
+        length = sizeof (pRecord->data) - 1;
+        pRecord->data[length - 1] = '\n';
+    }
+    pRecord->length = (UInt16) length;
+    putFlightRecord (pRecord, sequence);
+}
+
+/*
+ * Put a print in the flight recorder.
+ *
+ * pFormat  the printf() style format.
+ */
+static void recordFlightPrint (const Char *pFormat, ...)
+{
+    va_list args;
+
+    va_start (args, pFormat);
+    recordFlightText (pFormat, args);
+    va_end (args);
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
 
 /*
  * Assert function for debugging (should be called via the macros in rob_system.c).
@@ -64,6 +1173,36 @@ Bool assertFunc (const Char * pPlace, UInt32 line, const Char * pText, Bool para
     	}
     }
     
+    /* Write out what was logged before the assert */
+    stopLogWriter();
+
+    /* Put the assert in the flight recorder, which is left for the dump */
+    if (gFlightRecorderIsOn)
+    {
+        if (pText)
+        {
+            if (paramPresent)
+            {
+                recordFlightPrint (pFormat + 1, pPlace, (int) line, pText, param1, param2, param3);
+            }
+            else
+            {
+                recordFlightPrint (pFormat + 1, pPlace, (int) line, pText);
+            }
+        }
+        else
+        {
+            if (paramPresent)
+            {
+                recordFlightPrint (pFormat + 1, pPlace, (int) line, param1, param2, param3);
+            }
+            else
+            {
+                recordFlightPrint (pFormat + 1, pPlace, (int) line);
+            }
+        }
+    }
+
     /* If debug is printing to file, put the assert there also */
     if (gDebugPrintsAreOn && (pgDebugPrintsStream != PNULL))
     {
@@ -72,32 +1211,36 @@ Bool assertFunc (const Char * pPlace, UInt32 line, const Char * pText, Bool para
         {
             pFormat++;
         }
-        fprintf (pgDebugPrintsStream, "%.10lu: ", getSystemTicks());
+        if (!gDebugPrintsAreBinary)
+        {
+            printLogTime (pgDebugPrintsStream, getLogTimeNs());
+        }
         
         if (pText)
         {
             if (paramPresent)
             {
-                fprintf (pgDebugPrintsStream, pFormat, pPlace, (int) line, pText, param1, param2, param3);
+                printToLogFile (pFormat, pPlace, (int) line, pText, param1, param2, param3);
             }
             else
             {
-                fprintf (pgDebugPrintsStream, pFormat, pPlace, (int) line, pText);
+                printToLogFile (pFormat, pPlace, (int) line, pText);
             }
         }
         else
         {
             if (paramPresent)
             {
-                fprintf (pgDebugPrintsStream, pFormat, pPlace, (int) line, param1, param2, param3);
+                printToLogFile (pFormat, pPlace, (int) line, param1, param2, param3);
             }
             else
             {
-                fprintf (pgDebugPrintsStream, pFormat, pPlace, (int) line);
+                printToLogFile (pFormat, pPlace, (int) line);
             }
         }
         fflush (pgDebugPrintsStream);
         fclose (pgDebugPrintsStream);        
+        pgDebugPrintsStream = PNULL;
     }
 
     fflush (stdout);
@@ -127,7 +1270,9 @@ void setProgressPrintsOff (void)
  */
 void setDebugPrintsOn (void)
 {
+    readDebugEnv();
     gDebugPrintsAreOn = true;
+    startLogWriter();
 }
 
 /*
@@ -140,10 +1285,12 @@ void setDebugPrintsOff (void)
     {
         time_t timeNow = time (NULL);
         printDebug ("Stopped debug prints on %s", asctime (localtime (&timeNow)));
+        stopLogWriter();
         fclose (pgDebugPrintsStream);
         pgDebugPrintsStream = PNULL;
     }
     gDebugPrintsToSyslogAreOn = false;
+    gDebugPrintsAreBinary = false;
 }
 
 /*
@@ -153,11 +1300,28 @@ void setDebugPrintsOnToSyslog (void)
 {
     time_t timeNow = time (NULL);
     
+    readDebugEnv();
     gDebugPrintsAreOn = true;
     gDebugPrintsToSyslogAreOn = true;
+    startLogWriter();
     printDebug ("Started debug prints to syslog on %s", asctime (localtime (&timeNow))); 
 }
 
+/*
+ * Set the run-time debug level of a module:
+ * DEBUG_PRINT()s and DEBUG_HEX_DUMP()s in it
+ * above the level then cost next to nothing.
+ *
+ * module  the module.
+ * level   the level, e.g. DEBUG_LEVEL_ERROR.
+ */
+void setDebugModuleLevel (DebugModule module, UInt8 level)
+{
+    ASSERT_PARAM (module < NUM_DEBUG_MODULES, module);
+
+    gDebugModuleLevel[module] = level;
+}
+
 /*
  * Hex dumps to syslog() from now on
  * Kept separate from the debug to syslog()
@@ -193,25 +1357,175 @@ void resumeDebug (void)
 }
 
 /*
- * Set debug prints on and to file
+ * Turn the flight recorder on: from now on debug
+ * prints and hex dumps also go to a ring of records
+ * in a file that is mapped into memory, so recording
+ * one is just a copy and, whatever happens to the
+ * process, the kernel writes the last of them to the
+ * file.  It works whether debug prints are on or
+ * not.  FlightDump prints out the file.  Any file
+ * from before is kept with ".old" on the end, so a
+ * restart doesn't lose what led up to a crash.
+ *
+ * pFilename   the file.
+ * numRecords  the number of records in the ring,
+ *             e.g. FLIGHT_RECORDER_DEFAULT_NUM_RECORDS;
+ *             ignored if the recorder has been on
+ *             before, in which case its file is
+ *             used again.
+ */
+void setFlightRecorderOn (Char * pFilename, UInt32 numRecords)
+{
+    Char *pOldFilename;
+    SInt32 fd;
+    UInt32 fileSize;
+    void *pMapping;
+
+    ASSERT_PARAM (pFilename != PNULL, (unsigned long) pFilename);
+    ASSERT_PARAM (numRecords > 0, numRecords);
+
+    if (pgFlightRecorder == PNULL)
+    {
+        pOldFilename = malloc (strlen (pFilename) + 5);
+        if (pOldFilename != PNULL)
+        {
+            sprintf (pOldFilename, "%s.old", pFilename);
+            rename (pFilename, pOldFilename);
+            free (pOldFilename);
+        }
+
+        fileSize = sizeof (FlightRecorderHeader) + numRecords * sizeof (FlightRecord);
+        fd = open (pFilename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if ((fd >= 0) && (ftruncate (fd, fileSize) == 0))
+        {
+            /* The mapping outlives the file descriptor */
+            pMapping = mmap (PNULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (pMapping != MAP_FAILED)
+            {
+                pgFlightRecorder = (FlightRecorderHeader *) pMapping;
+                pgFlightRecords = (FlightRecord *) (pgFlightRecorder + 1);
+                pgFlightRecorder->numRecords = numRecords;
+                pgFlightRecorder->recordLength = sizeof (FlightRecord);
+                pgFlightRecorder->realTimeNs = getClockNs (CLOCK_REALTIME);
+                pgFlightRecorder->monotonicTimeNs = getMonotonicNs();
+                pgFlightRecorder->nextSequence = 0;
+                memcpy (pgFlightRecorder->magic, FLIGHT_RECORDER_MAGIC, sizeof (pgFlightRecorder->magic));
+            }
+        }
+        if (pgFlightRecorder == PNULL)
+        {
+            fprintf (stderr, "Couldn't set up flight recorder file %s, error: %s.\n", pFilename, strerror (errno));
+        }
+        if (fd >= 0)
+        {
+            close (fd);
+        }
+    }
+
+    if (pgFlightRecorder != PNULL)
+    {
+        readDebugEnv();
+        gFlightRecorderIsOn = true;
+    }
+}
+
+/*
+ * Turn the flight recorder off and have what is
+ * in it written to the file.  The file stays
+ * mapped, since another thread may be part way
+ * through a record.
+ */
+void setFlightRecorderOff (void)
+{
+    gFlightRecorderIsOn = false;
+    if (pgFlightRecorder != PNULL)
+    {
+        msync (pgFlightRecorder, sizeof (FlightRecorderHeader) + pgFlightRecorder->numRecords * sizeof (FlightRecord), MS_SYNC);
+    }
+}
+
+/*
+ * Set debug prints on and to file, or to a
+ * binary file if DEBUG_PRINTS_BINARY_ENV is
+ * set in the environment
  */
 void setDebugPrintsOnToFile (Char * pFilename)
 {
     ASSERT_PARAM (pFilename != PNULL, (unsigned long) pFilename);
+
+    if (getenv (DEBUG_PRINTS_BINARY_ENV) != PNULL)
+    {
+        setDebugPrintsOnToBinaryFile (pFilename);
+    }
+    else
+    {
+        /* The log writer mustn't be using the old file */
+        stopLogWriter();
+        if (pgDebugPrintsStream != PNULL)
+        {
+            fclose (pgDebugPrintsStream);
+        }
+
+        gDebugPrintsAreBinary = false;
+        pgDebugPrintsStream = fopen (pFilename, "w");
+
+        if (pgDebugPrintsStream != PNULL)
+        {
+            time_t timeNow = time (NULL);
+
+            readDebugEnv();
+            gDebugPrintsAreOn = true;
+            startLogWriter();
+            printDebug ("Started debug prints on %s", asctime (localtime (&timeNow)));
+        }
+    }
+}
+
+/*
+ * Set debug prints on and to a binary file:
+ * prints aren't formatted, just their format
+ * ID, time and arguments are written, so they
+ * cost much less.  LogDecoder turns the file
+ * back into text.  Debug prints and hex dumps
+ * then go only to the file, not to syslog().
+ */
+void setDebugPrintsOnToBinaryFile (Char * pFilename)
+{
+    BinaryLogFileHeader header;
+    UInt32 x;
+
+    ASSERT_PARAM (pFilename != PNULL, (unsigned long) pFilename);
     
+    /* The log writer mustn't be using the old file */
+    stopLogWriter();
     if (pgDebugPrintsStream != PNULL)
     {
         fclose (pgDebugPrintsStream);        
     }
     
-    pgDebugPrintsStream = fopen (pFilename, "w"); 
+    gDebugPrintsAreBinary = false;
+    pgDebugPrintsStream = fopen (pFilename, "wb");
   
     if (pgDebugPrintsStream != PNULL)
     {
         time_t timeNow = time (NULL);
         
+        memcpy (header.magic, BINARY_LOG_MAGIC, sizeof (header.magic));
+        header.realTimeNs = getClockNs (CLOCK_REALTIME);
+        header.monotonicTimeNs = getMonotonicNs();
+        fwrite (&header, sizeof (header), 1, pgDebugPrintsStream);
+
+        /* Formats used in an earlier file have to be written again */
+        for (x = 0; x < LOG_FORMAT_TABLE_SIZE; x++)
+        {
+            gLogFormat[x].isWritten = false;
+        }
+
+        readDebugEnv();
+        gDebugPrintsAreBinary = true;
         gDebugPrintsAreOn = true;
-        printDebug ("Started debug prints on %s", asctime (localtime (&timeNow))); 
+        startLogWriter();
+        printDebug ("Started binary debug prints on %s", asctime (localtime (&timeNow)));
     }
 }
 
@@ -226,106 +1540,134 @@ void printProgress (const Char * pFormat, ...)
         
         va_start (args, pFormat);
         vprintf (pFormat, args);
+        va_end (args);
         
         /* If debug is printing to file/syslog, put the progress prints there also */
-        if (gDebugPrintsAreOn && !gSuspendDebug)
+        if ((gDebugPrintsAreOn || gFlightRecorderIsOn) && !gSuspendDebug)
         {
             /* But remove any initial line feeds for neatness */
             if (*pFormat == '\n')
             {
                 pFormat++;
             }
-            if (pgDebugPrintsStream != PNULL)
+            if (gFlightRecorderIsOn)
             {
-                fprintf (pgDebugPrintsStream, "%.10lu: ", getSystemTicks());
-                vfprintf (pgDebugPrintsStream, pFormat, args);                
+                va_start (args, pFormat);
+                recordFlightText (pFormat, args);
+                va_end (args);
             }
-            if (gDebugPrintsToSyslogAreOn)
+            if (gDebugPrintsAreOn)
             {
-                vsyslog (LOG_INFO, pFormat, args);
+                va_start (args, pFormat);
+                logText (pFormat, args);
+                va_end (args);
             }
         }
         
-        va_end (args);
         fflush (stdout);
     }
 }
 
 /*
- * Print debug
+ * Print debug: the print is captured here but
+ * written out later by the log writer thread.
+ * In a binary log only the format ID, the time
+ * and the arguments are captured.  It also goes
+ * to the flight recorder, if that is on, even
+ * if debug prints are off.
  */
 void printDebug (const Char * pFormat, ...)
 {
-    FILE *pStream = pgDefaultStream;
-    
-    if (gDebugPrintsAreOn && !gSuspendDebug)
-    {
-        va_list args;
+    va_list args;
 
-        if (pgDebugPrintsStream != PNULL)
-        {
-            pStream = pgDebugPrintsStream;
-        }
-        
-        va_start (args, pFormat);
-        if (pStream != PNULL)
-        {
-            fprintf (pStream, "%.10lu: ", getSystemTicks());
-            vfprintf (pStream, pFormat, args);
-        }        
-        if (gDebugPrintsToSyslogAreOn)
+    if (!gSuspendDebug)
+    {
+        if (gFlightRecorderIsOn)
         {
-            vsyslog (LOG_INFO, pFormat, args);
+            va_start (args, pFormat);
+            recordFlightText (pFormat, args);
+            va_end (args);
         }
-        va_end (args);
-        
-        if (pStream != PNULL)
+        if (gDebugPrintsAreOn)
         {
-            fflush (pStream);
+            va_start (args, pFormat);
+            logText (pFormat, args);
+            va_end (args);
         }
     }
 }
 
 /*
- * Dump hex from memory
+ * Dump hex from memory: the memory is copied
+ * here but formatted and written out later by
+ * the log writer thread, or written out as it
+ * is in a binary log.  Only as much as fits
+ * in a log record is kept.
  */
 void printHexDump (const void * pMemory, UInt16 size)
 {
-    UInt8 i;
-    UInt32 time;
-    FILE *pStream = pgDefaultStream;
-    const UInt8 *pPrint = pMemory;
+    LogRecord localRecord;
+    LogRecord *pRecord = &localRecord;
+    UInt32 position = 0;
+    UInt32 length;
+    Bool isQueued;
+    FlightRecord *pFlightRecord;
+    uint64_t sequence;
+
+    if (gFlightRecorderIsOn && !gSuspendDebug)
+    {
+        pFlightRecord = claimFlightRecord (&sequence);
+        length = (size < sizeof (pFlightRecord->data)) ? size : sizeof (pFlightRecord->data);
+        pFlightRecord->type = BINARY_LOG_HEX_DUMP;
+        pFlightRecord->size = size;
+        pFlightRecord->length = (UInt16) length;
+        memcpy (pFlightRecord->data, pMemory, length);
+        putFlightRecord (pFlightRecord, sequence);
+    }
     
     if (gDebugPrintsAreOn && !gSuspendDebug)
     {
-        time = getSystemTicks();
-        if (pgDebugPrintsStream != PNULL)
+        isQueued = __atomic_load_n (&gLogWriterIsRunning, __ATOMIC_ACQUIRE);
+        if (isQueued)
         {
-            pStream = pgDebugPrintsStream;
+            pRecord = claimLogRecord (&position);
         }
 
-        if (pStream != PNULL)
-        {
-            fprintf (pStream, "%.10lu: ", time);
-            fprintf (pStream, "Printing at least %d bytes:\n", size);
-        }
-        
-        for (i = 0; i < size; i +=8)
+        if (pRecord != PNULL)
         {
-            if (pStream != PNULL)
+            /* Whole lines, as many as fit */
+            length = ((size + HEX_DUMP_BYTES_PER_LINE - 1) / HEX_DUMP_BYTES_PER_LINE) * HEX_DUMP_BYTES_PER_LINE;
+            if (length > sizeof (pRecord->data))
+            {
+                length = sizeof (pRecord->data) - (sizeof (pRecord->data) % HEX_DUMP_BYTES_PER_LINE);
+            }
+            pRecord->type = LOG_RECORD_HEX_DUMP;
+            pRecord->toSyslog = gHexDumpsToSyslogAreOn;
+            pRecord->timeNs = getLogTimeNs();
+            pRecord->address = (unsigned long) pMemory;
+            pRecord->size = size;
+            pRecord->length = (UInt16) length;
+            memset (pRecord->data, 0, length);
+            memcpy (pRecord->data, pMemory, (size < length) ? size : length);
+
+            if (isQueued)
             {
-                fprintf (pStream, "%.10lu: 0x%.8lx: 0x%.2x 0x%.2x 0x%.2x 0x%.2x : 0x%.2x 0x%.2x 0x%.2x 0x%.2x\n", time, (unsigned long) pPrint, *pPrint, *(pPrint + 1), *(pPrint + 2), *(pPrint + 3), *(pPrint + 4), *(pPrint + 5), *(pPrint + 6), *(pPrint + 7));
+                putLogRecord (pRecord, position);
             }
-            if (gHexDumpsToSyslogAreOn)
+            else
             {
-                syslog (LOG_INFO, "%.10lu: 0x%.8lx: 0x%.2x 0x%.2x 0x%.2x 0x%.2x : 0x%.2x 0x%.2x 0x%.2x 0x%.2x\n", time, (unsigned long) pPrint, *pPrint, *(pPrint + 1), *(pPrint + 2), *(pPrint + 3), *(pPrint + 4), *(pPrint + 5), *(pPrint + 6), *(pPrint + 7));
+                pthread_mutex_lock (&gLogOutputLock);
+                writeLogRecord (pRecord);
+                if (pgDebugPrintsStream != PNULL)
+                {
+                    fflush (pgDebugPrintsStream);
+                }
+                pthread_mutex_unlock (&gLogOutputLock);
             }
-            pPrint +=8;
         }
-        
-        if (pStream != PNULL)
+        else
         {
-            fflush (pStream);
+            __atomic_add_fetch (&(gLogRing.numDropped), 1, __ATOMIC_RELAXED);
         }
     }
 }
@@ -422,3 +1764,145 @@ UInt32 getSystemTicks (void)
     
     return (UInt32) time.tv_sec;
 }
+
+/*
+ * Get the time from the monotonic clock, which
+ * is cheap to read and isn't moved by changes
+ * to the time of day.
+ *
+ * @return  the time in nanoseconds.
+ */
+uint64_t getMonotonicNs (void)
+{
+    return getClockNs (CLOCK_MONOTONIC);
+}
+
+/*
+ * Turn tracing on: spans are appended to a trace
+ * file that the processes of a run share, as
+ * Chrome trace events.  Whichever process creates
+ * the file starts it off, so delete it before a
+ * run.
+ *
+ * pFilename  the trace file.
+ */
+void setTraceOn (const Char *pFilename)
+{
+    Char text[TRACE_EVENT_MAX_LENGTH];
+    Char processName[32] = "?";
+    FILE *pComm;
+    SInt32 length;
+
+    ASSERT_PARAM (pFilename != PNULL, (unsigned long) pFilename);
+
+    pthread_mutex_lock (&gTraceLock);
+    if (gTraceFd < 0)
+    {
+        gTraceFd = open (pFilename, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0666);
+        if (gTraceFd >= 0)
+        {
+            /* A JSON array, which Chrome lets go unclosed */
+            length = write (gTraceFd, "[\n", 2);
+        }
+        else if (errno == EEXIST)
+        {
+            gTraceFd = open (pFilename, O_WRONLY | O_APPEND | O_CLOEXEC);
+        }
+
+        if (gTraceFd >= 0)
+        {
+            /* Name this process in the trace */
+            pComm = fopen ("/proc/self/comm", "r");
+            if (pComm != PNULL)
+            {
+                if (fgets (processName, sizeof (processName), pComm) != PNULL)
+                {
+                    processName[strcspn (processName, "\n")] = 0;
+                }
+                fclose (pComm);
+            }
+            length = snprintf (text, sizeof (text), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"args\":{\"name\":\"%s\"}},\n", (SInt32) getpid(), processName);
+            length = write (gTraceFd, text, length);
+            if (!gTraceIsInitialised)
+            {
+                atexit (setTraceOff);
+                gTraceIsInitialised = true;
+            }
+            gTraceIsOn = true;
+        }
+        else
+        {
+            fprintf (stderr, "Couldn't open trace file %s, error: %s.\n", pFilename, strerror (errno));
+        }
+    }
+    pthread_mutex_unlock (&gTraceLock);
+}
+
+/*
+ * Turn tracing off, writing out the spans that
+ * have ended.
+ */
+void setTraceOff (void)
+{
+    pthread_mutex_lock (&gTraceLock);
+    gTraceIsOn = false;
+    if (gTraceFd >= 0)
+    {
+        flushTraceEvents();
+        close (gTraceFd);
+        gTraceFd = -1;
+    }
+    pthread_mutex_unlock (&gTraceLock);
+}
+
+/*
+ * Begin a span, should be called through
+ * TRACE_SPAN_BEGIN().
+ *
+ * pSpan  the span.
+ * pName  its name, which must last, e.g.
+ *        a string literal.
+ * arg    a number shown with the span,
+ *        e.g. a message type.
+ */
+void traceSpanBegin (TraceSpan *pSpan, const Char *pName, SInt32 arg)
+{
+    pSpan->pName = pName;
+    pSpan->arg = arg;
+    pSpan->startNs = getMonotonicNs();
+}
+
+/*
+ * End a span, should be called through
+ * TRACE_SPAN_END().
+ *
+ * pSpan  the span.
+ */
+void traceSpanEnd (TraceSpan *pSpan)
+{
+    TraceEvent *pEvent;
+    uint64_t endNs = getMonotonicNs();
+
+    if (gTraceThreadId == 0)
+    {
+        gTraceThreadId = syscall (SYS_gettid);
+    }
+
+    pthread_mutex_lock (&gTraceLock);
+    if (gTraceFd >= 0)
+    {
+        pEvent = &(gTraceEvent[gTraceNumEvents]);
+        pEvent->pName = pSpan->pName;
+        pEvent->arg = pSpan->arg;
+        pEvent->threadId = gTraceThreadId;
+        pEvent->startNs = pSpan->startNs;
+        pEvent->durationNs = endNs - pSpan->startNs;
+        gTraceNumEvents++;
+        if ((gTraceNumEvents == TRACE_BUFFER_NUM_EVENTS) || (endNs - gTraceEvent[0].startNs > TRACE_FLUSH_INTERVAL_NS))
+        {
+            flushTraceEvents();
+        }
+    }
+    pthread_mutex_unlock (&gTraceLock);
+    pSpan->startNs = 0;
+}
@@ -6,9 +6,6 @@
  * MANIFEST CONSTANTS
  */
 
-/* Suggested 0.1s delay before the server is ready */
-#define TIMER_SERVER_START_DELAY_PI_US 100000L
-
 /*
  * TYPES
  */
@@ -19,4 +16,14 @@
 Bool timerServerSend (TimerMsgType msgType, void *pSendMsgBody, UInt16 sendMsgBodyLength);
 void createTimerExpiryMsg (ShortMsg *pExpiryMsg, MsgType msgType, void *pMsgBody, MsgLength msgBodyLength);
 Bool sendStartTimer (UInt32 expiryDeciSeconds, TimerId id, SInt32 sourcePort, ShortMsg *pExpiryMsg);
-Bool sendStopTimer (TimerId id, SInt32 sourcePort);
\ No newline at end of file
+Bool sendStartTimerUs (UInt32 expiryMicroSeconds, TimerId id, SInt32 sourcePort, ShortMsg *pExpiryMsg);
+Bool sendStartPeriodicTimer (UInt32 periodMicroSeconds, TimerId id, SInt32 sourcePort, ShortMsg *pExpiryMsg);
+Bool sendStopTimer (TimerId id, SInt32 sourcePort);
+
+/* Timers kept in this process instead, see local_timer.c */
+Bool startLocalTimers (void);
+void stopLocalTimers (void);
+Bool startLocalTimer (UInt32 expiryDeciSeconds, TimerId id, ShortMsg *pExpiryMsg);
+Bool startLocalTimerUs (UInt32 expiryMicroSeconds, TimerId id, ShortMsg *pExpiryMsg);
+Bool startLocalPeriodicTimer (UInt32 periodMicroSeconds, TimerId id, ShortMsg *pExpiryMsg);
+Bool stopLocalTimer (TimerId id);
\ No newline at end of file
@@ -24,4 +24,8 @@ TIMER_MSG_DEF (TIMER_SERVER_START_REQ, TimerServerStartReq, timerServerStartReq,
 TIMER_MSG_DEF (TIMER_SERVER_STOP_REQ, TimerServerStopReq, timerServerStopReq, TIMER_EMPTY)
 /* Note: the id field is only required to be filled-in if the timer might ever be stopped */
 TIMER_MSG_DEF (TIMER_START_REQ, TimerStartReq, timerStartReq, UInt32 expiryDeciSeconds; TimerId id; SInt32 sourcePort; ShortMsg expiryMsg)
-TIMER_MSG_DEF (TIMER_STOP_REQ, TimerStopReq, timerStopReq, TimerId id; SInt32 sourcePort)
\ No newline at end of file
+TIMER_MSG_DEF (TIMER_STOP_REQ, TimerStopReq, timerStopReq, TimerId id; SInt32 sourcePort)
+/* As TIMER_START_REQ but for finer timing, a timer started with either can be stopped with TIMER_STOP_REQ */
+TIMER_MSG_DEF (TIMER_START_US_REQ, TimerStartUsReq, timerStartUsReq, UInt32 expiryMicroSeconds; TimerId id; SInt32 sourcePort; ShortMsg expiryMsg)
+/* A timer that expires every periodMicroSeconds, the first time one period from now, until stopped with TIMER_STOP_REQ */
+TIMER_MSG_DEF (TIMER_START_PERIODIC_REQ, TimerStartPeriodicReq, timerStartPeriodicReq, UInt32 periodMicroSeconds; TimerId id; SInt32 sourcePort; ShortMsg expiryMsg)
\ No newline at end of file
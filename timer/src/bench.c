@@ -0,0 +1,194 @@
+/*
+ * bench.c
+ * Benchmark for the timer server's timer store: starts
+ * a number of timers, with expiries spread over an hour
+ * or so in random order, then stops them all, again in
+ * random order, and reports the time taken for each,
+ * checking that every timer was started and stopped.
+ * The requests are handed to serverHandleMsg() directly,
+ * in this process, so that what is measured is the
+ * keeping of the timers rather than the messaging.
+ * Needs no Pi hardware.
+ *
+ * Usage: timer_bench [-n timers]
+ *   -n  the number of timers (default DEFAULT_NUM_TIMERS).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <rob_system.h>
+#include <messaging_server.h>
+#include <timer_server.h>
+#include <timer_msg_auto.h>
+#include <timer_client.h>
+#include <timer_store.h>
+
+/*
+ * MANIFEST CONSTANTS
+ */
+
+#define DEFAULT_NUM_TIMERS 100000
+
+/* The ports that the timers appear to come from: a TimerId
+ * is a UInt8, so each port has up to 256 timers */
+#define BENCH_FIRST_SOURCE_PORT 20000
+
+/* Long enough that none expire during the run */
+#define BENCH_MIN_EXPIRY_DECISECONDS 36000
+#define BENCH_EXPIRY_SPREAD_DECISECONDS 36000
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Get the time from a monotonic clock.
+ *
+ * @return  the time in seconds.
+ */
+static double getTimeSeconds (void)
+{
+    return (double) getMonotonicNs() / 1000000000.0;
+}
+
+/*
+ * Send a message to the timer server code.
+ *
+ * msgType      the message type.
+ * pMsgBody     the body.
+ * msgBodyLength the length of the body.
+ */
+static void sendToTimerServer (TimerMsgType msgType, void *pMsgBody, UInt16 msgBodyLength)
+{
+    Msg msg;
+    Msg response;
+
+    msg.msgType = msgType;
+    msg.msgLength = sizeof (msg.msgType) + msgBodyLength;
+    if (pMsgBody != PNULL)
+    {
+        memcpy (msg.msgBody, pMsgBody, msgBodyLength);
+    }
+    serverHandleMsg (&msg, &response);
+}
+
+/*
+ * Shuffle an array of timer numbers.
+ *
+ * pOrder     the array.
+ * numTimers  the number of entries in it.
+ */
+static void shuffle (UInt32 *pOrder, UInt32 numTimers)
+{
+    UInt32 x;
+    UInt32 y;
+    UInt32 swap;
+
+    for (x = numTimers - 1; x > 0; x--)
+    {
+        y = rand() % (x + 1);
+        swap = pOrder[x];
+        pOrder[x] = pOrder[y];
+        pOrder[y] = swap;
+    }
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Entry point
+ */
+int main (int argc, char **argv)
+{
+    UInt32 numTimers = DEFAULT_NUM_TIMERS;
+    UInt32 *pOrder;
+    TimerStartReq startReq;
+    TimerStopReq stopReq;
+    double startTime;
+    double startDuration;
+    double stopDuration;
+    UInt32 numStarted;
+    UInt32 numStopped;
+    UInt32 x;
+    int option;
+    Bool success = false;
+
+    while ((option = getopt (argc, argv, "n:")) != -1)
+    {
+        switch (option)
+        {
+            case 'n':
+            {
+                numTimers = strtoul (optarg, PNULL, 10);
+            }
+            break;
+            default:
+            {
+                numTimers = 0;
+            }
+            break;
+        }
+    }
+
+    pOrder = (UInt32 *) malloc (numTimers * sizeof (*pOrder));
+    if ((numTimers == 0) || (pOrder == PNULL))
+    {
+        fprintf (stderr, "Usage: %s [-n timers]\n", argv[0]);
+    }
+    else
+    {
+        success = true;
+        srand (1);
+        sendToTimerServer (TIMER_SERVER_START_REQ, PNULL, 0);
+
+        memset (&startReq, 0, sizeof (startReq));
+        createTimerExpiryMsg (&(startReq.expiryMsg), 0, PNULL, 0);
+        for (x = 0; x < numTimers; x++)
+        {
+            pOrder[x] = x;
+        }
+        shuffle (pOrder, numTimers);
+
+        startTime = getTimeSeconds();
+        for (x = 0; x < numTimers; x++)
+        {
+            startReq.expiryDeciSeconds = BENCH_MIN_EXPIRY_DECISECONDS + (pOrder[x] % BENCH_EXPIRY_SPREAD_DECISECONDS);
+            startReq.id = (TimerId) pOrder[x];
+            startReq.sourcePort = BENCH_FIRST_SOURCE_PORT + (pOrder[x] >> 8);
+            sendToTimerServer (TIMER_START_REQ, &startReq, sizeof (startReq));
+        }
+        startDuration = getTimeSeconds() - startTime;
+        numStarted = getNumTimerServerTimers();
+
+        shuffle (pOrder, numTimers);
+        startTime = getTimeSeconds();
+        for (x = 0; x < numTimers; x++)
+        {
+            stopReq.id = (TimerId) pOrder[x];
+            stopReq.sourcePort = BENCH_FIRST_SOURCE_PORT + (pOrder[x] >> 8);
+            sendToTimerServer (TIMER_STOP_REQ, &stopReq, sizeof (stopReq));
+        }
+        stopDuration = getTimeSeconds() - startTime;
+        numStopped = numStarted - getNumTimerServerTimers();
+
+        printf ("%lu timers: start %.3f s (%.0f ns each), stop %.3f s (%.0f ns each).\n",
+                numTimers, startDuration, startDuration * 1000000000.0 / numTimers, stopDuration, stopDuration * 1000000000.0 / numTimers);
+        if ((numStarted != numTimers) || (numStopped != numTimers))
+        {
+            success = false;
+            fprintf (stderr, "%lu timer(s) started and %lu stopped, expected %lu.\n", numStarted, numStopped, numTimers);
+        }
+        ASSERT_PARAM (getNumTimerServerTimers() == 0, getNumTimerServerTimers());
+
+        sendToTimerServer (TIMER_SERVER_STOP_REQ, PNULL, 0);
+    }
+
+    free (pOrder);
+
+    return success ? 0 : -1;
+}
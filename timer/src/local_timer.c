@@ -0,0 +1,297 @@
+/*
+ * local_timer.c
+ * Timers kept in the process of the server that starts
+ * them, for a server that doesn't need the timer server:
+ * they are started and stopped as with sendStartTimer()
+ * and sendStopTimer(), by TimerId, but without a message,
+ * and the expiry message is handled by the server as
+ * though it had arrived in a datagram, from the server's
+ * own event loop.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#define DEBUG_MODULE DEBUG_MODULE_TIMER /* Before rob_system.h */
+#include <rob_system.h>
+#include <messaging_server.h>
+#include <timer_server.h>
+#include <timer_msg_auto.h>
+#include <timer_client.h>
+#include <timer_store.h>
+
+/*
+ * MANIFEST CONSTANTS
+ */
+
+#define NANOSECONDS_PER_DECISECOND 100000000ULL
+#define NANOSECONDS_PER_MICROSECOND 1000ULL
+/* Local timers all go back to this server, so
+ * the source port is the same for all of them */
+#define LOCAL_TIMER_SOURCE_PORT 0
+
+/*
+ * GLOBALS - prefixed with g
+ */
+
+/* The running local timers, the timerfd of which is one
+ * of the server's poll fds, and whether it is open */
+static TimerStore gLocalTimerStore;
+static Bool gLocalTimersStarted = false;
+/* Mutex to protect the store, as timers may be started and
+ * stopped by the server's worker threads */
+static pthread_mutex_t gLockLocalTimers = PTHREAD_MUTEX_INITIALIZER;
+/* An expiry that the server couldn't take, because as many
+ * messages as are allowed were with its worker threads, which
+ * goes before any other; only touched on the server thread */
+static Msg gHeldExpiryMsg;
+static Bool gExpiryIsHeld = false;
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Called from the server's event loop when the
+ * timerfd of the store has gone off: hand the
+ * expiry message of each timer that has expired
+ * to handleMessagingServerLocalMsg(), in the order
+ * they expired.  The lock isn't held while it is
+ * called, so that the server can start and stop
+ * local timers.  If the server can't take an expiry
+ * it is held and the timerfd left to go off again,
+ * which the server doesn't wait for until it can.
+ */
+static void localTimerPollHandler (void)
+{
+    Msg expiryMsg;
+    Timer * pTimer;
+    uint64_t numExpiries;
+    uint64_t nowNs;
+    Bool done = false;
+
+    pthread_mutex_lock (&gLockLocalTimers);
+    /* The timerfd is non-blocking, if it has been re-armed since it went off this does nothing */
+    if (read (gLocalTimerStore.timerFd, &numExpiries, sizeof (numExpiries)) == sizeof (numExpiries))
+    {
+        noteTimerStoreFdGoneOff (&gLocalTimerStore);
+    }
+    pthread_mutex_unlock (&gLockLocalTimers);
+
+    /* Only what has expired by now, so that a server busy with
+     * periodic timers still gets round to its sockets */
+    nowNs = getMonotonicNs();
+    if (gExpiryIsHeld)
+    {
+        gExpiryIsHeld = !handleMessagingServerLocalMsg (&gHeldExpiryMsg);
+    }
+    done = gExpiryIsHeld;
+    while (!done)
+    {
+        pthread_mutex_lock (&gLockLocalTimers);
+        pTimer = getExpiredTimer (&gLocalTimerStore, nowNs);
+        if (pTimer != PNULL)
+        {
+            memcpy (&expiryMsg, &(pTimer->expiryMsg), sizeof (expiryMsg));
+            finishExpiredTimer (&gLocalTimerStore, nowNs);
+        }
+        else
+        {
+            done = true;
+        }
+        pthread_mutex_unlock (&gLockLocalTimers);
+
+        if (!done)
+        {
+            DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Local timer: expiry msgType 0x%08x, length %d.\n", expiryMsg.msgType, expiryMsg.msgLength);
+            if (!handleMessagingServerLocalMsg (&expiryMsg))
+            {
+                memcpy (&gHeldExpiryMsg, &expiryMsg, sizeof (gHeldExpiryMsg));
+                gExpiryIsHeld = true;
+                done = true;
+            }
+        }
+    }
+
+    pthread_mutex_lock (&gLockLocalTimers);
+    if (gExpiryIsHeld)
+    {
+        /* Go off straight away, once the server is waiting on it again */
+        armTimerStoreFdAt (&gLocalTimerStore, 1);
+    }
+    else
+    {
+        armTimerStoreFd (&gLocalTimerStore);
+    }
+    pthread_mutex_unlock (&gLockLocalTimers);
+}
+
+/*
+ * Start a local timer.
+ *
+ * expiryTimeNs  when the timer expires, against
+ *               getMonotonicNs().
+ * periodNs      how often it expires after that,
+ *               0 if it doesn't.
+ * id            the id for the timer.
+ * pExpiryMsg    a pointer to the expiry message.
+ *
+ * @return       true if successful, otherwise false.
+ */
+static Bool startLocalTimerAt (uint64_t expiryTimeNs, uint64_t periodNs, TimerId id, ShortMsg *pExpiryMsg)
+{
+    Bool success = false;
+
+    ASSERT_PARAM (pExpiryMsg != PNULL, (unsigned long) pExpiryMsg);
+
+    pthread_mutex_lock (&gLockLocalTimers);
+    if (gLocalTimersStarted && (addTimer (&gLocalTimerStore, expiryTimeNs, periodNs, LOCAL_TIMER_SOURCE_PORT, id, pExpiryMsg) != PNULL))
+    {
+        success = true;
+    }
+    pthread_mutex_unlock (&gLockLocalTimers);
+
+    return success;
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Start local timers for the server in this process:
+ * the timerfd of the store becomes one of the server's
+ * poll fds, so this must be called before
+ * runMessagingServer().  Expiry messages are handled
+ * by the server as though they had arrived in datagrams,
+ * so on its worker threads if it has them and the
+ * message type may be handled concurrently, and any
+ * response is thrown away.
+ *
+ * @return  true if successful, otherwise false.
+ */
+Bool startLocalTimers (void)
+{
+    Bool success = false;
+
+    pthread_mutex_lock (&gLockLocalTimers);
+    if (!gLocalTimersStarted && openTimerStore (&gLocalTimerStore, true))
+    {
+        success = addMessagingServerPollFd (gLocalTimerStore.timerFd, localTimerPollHandler);
+        if (success)
+        {
+            gLocalTimersStarted = true;
+        }
+        else
+        {
+            closeTimerStore (&gLocalTimerStore);
+        }
+    }
+    pthread_mutex_unlock (&gLockLocalTimers);
+
+    return success;
+}
+
+/*
+ * Stop all local timers and free what they used,
+ * once runMessagingServer() has returned.
+ */
+void stopLocalTimers (void)
+{
+    pthread_mutex_lock (&gLockLocalTimers);
+    if (gLocalTimersStarted)
+    {
+        closeTimerStore (&gLocalTimerStore);
+        gLocalTimersStarted = false;
+        gExpiryIsHeld = false;
+    }
+    pthread_mutex_unlock (&gLockLocalTimers);
+}
+
+/*
+ * Start a local timer, as sendStartTimer() does
+ * but in this process.
+ *
+ * expiryDeciSeconds  the timer duration in
+ *                    tenths of a second.
+ * id                 an id for the timer.
+ * pExpiryMsg         a pointer to the expiry
+ *                    message, handled by the
+ *                    server when the timer
+ *                    expires.
+ *
+ * @return            true if successful,
+ *                    otherwise false.
+ */
+Bool startLocalTimer (UInt32 expiryDeciSeconds, TimerId id, ShortMsg *pExpiryMsg)
+{
+    return startLocalTimerAt (getMonotonicNs() + (expiryDeciSeconds * NANOSECONDS_PER_DECISECOND), 0, id, pExpiryMsg);
+}
+
+/*
+ * Start a local timer with a duration in
+ * microseconds, as sendStartTimerUs() does
+ * but in this process.
+ *
+ * expiryMicroSeconds  the timer duration in
+ *                     microseconds.
+ * id                  an id for the timer.
+ * pExpiryMsg          a pointer to the expiry
+ *                     message.
+ *
+ * @return             true if successful,
+ *                     otherwise false.
+ */
+Bool startLocalTimerUs (UInt32 expiryMicroSeconds, TimerId id, ShortMsg *pExpiryMsg)
+{
+    return startLocalTimerAt (getMonotonicNs() + (expiryMicroSeconds * NANOSECONDS_PER_MICROSECOND), 0, id, pExpiryMsg);
+}
+
+/*
+ * Start a local periodic timer, as
+ * sendStartPeriodicTimer() does but in
+ * this process.  It keeps going until
+ * stopLocalTimer() is called.
+ *
+ * periodMicroSeconds  the period in microseconds,
+ *                     must be greater than zero.
+ * id                  an id for the timer.
+ * pExpiryMsg          a pointer to the expiry
+ *                     message.
+ *
+ * @return             true if successful,
+ *                     otherwise false.
+ */
+Bool startLocalPeriodicTimer (UInt32 periodMicroSeconds, TimerId id, ShortMsg *pExpiryMsg)
+{
+    uint64_t periodNs = periodMicroSeconds * NANOSECONDS_PER_MICROSECOND;
+
+    ASSERT_PARAM (periodMicroSeconds > 0, periodMicroSeconds);
+
+    return startLocalTimerAt (getMonotonicNs() + periodNs, periodNs, id, pExpiryMsg);
+}
+
+/*
+ * Stop a local timer, as sendStopTimer() does
+ * but in this process.
+ *
+ * id       the id of the timer.
+ *
+ * @return  true if the timer was running,
+ *          otherwise false.
+ */
+Bool stopLocalTimer (TimerId id)
+{
+    Bool success = false;
+
+    pthread_mutex_lock (&gLockLocalTimers);
+    if (gLocalTimersStarted)
+    {
+        success = removeTimer (&gLocalTimerStore, LOCAL_TIMER_SOURCE_PORT, id);
+    }
+    pthread_mutex_unlock (&gLockLocalTimers);
+
+    return success;
+}
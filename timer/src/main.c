@@ -12,6 +12,13 @@
 #include <timer_msg_auto.h>
 #include <timer_client.h>
 
+/*
+ * EXTERN
+ */
+
+/* The names of the messages, for the stats the server keeps */
+extern Char *pgTimerMessageNames[];
+
 /*
  * STATIC FUNCTIONS
  */
@@ -39,6 +46,7 @@ int main (int argc, char **argv)
         timerServerPort = atoi (argv[1]);
         printProgress ("Timer server listening on port %d.\n", timerServerPort);
 
+        setMessagingServerMsgNames (pgTimerMessageNames, MAX_NUM_TIMER_MSGS);
         returnCode = runMessagingServer (timerServerPort);
         
         if (returnCode == SERVER_EXIT_NORMALLY)
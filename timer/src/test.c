@@ -3,6 +3,7 @@
  * Test main() for the timer_server.
  */
 
+#define _GNU_SOURCE /* for memfd_create() */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,8 +13,14 @@
 #include <sys/wait.h> /* for wait */
 #include <unistd.h> /* for fork */
 #include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <rob_system.h>
 #include <messaging_server.h>
+#include <messaging_client.h>
 #include <timer_server.h>
 #include <timer_msg_auto.h>
 #include <timer_client.h>
@@ -22,7 +29,44 @@
  * MANIFEST CONSTANTS
  */
 #define LOCAL_SERVER_PORT 5229
-#define MAX_NUM_TIMER_IDS_REMEMBERED 20
+#define MAX_NUM_TIMER_IDS_REMEMBERED 32
+/* The port of a client that never takes its expiries, the
+ * number of timers started for it and the number of timers,
+ * 100 ms apart, that should expire on time regardless */
+#define HUNG_CLIENT_PORT 5230
+#define NUM_HUNG_CLIENT_TIMERS 50
+#define NUM_JITTER_TIMERS 5
+#define MAX_JITTER_NANOSECONDS 50000000ULL
+/* The period of the periodic timer and how many times it is let expire */
+#define PERIODIC_TIMER_PERIOD_MICROSECONDS 200000L
+#define NUM_PERIODIC_TIMER_EXPIRIES 5
+/* For the benchmark: the number of clients and of timers each
+ * starts by default, the first port of the first client and how
+ * many ports each client has, the deadlines of the timers, how
+ * long to wait for them after the last should have expired, and
+ * where, among the ports of the client, the timers that are only
+ * there to be stopped go.  A TimerId only tells 256 timers from
+ * the same port apart, so each block of 256 timers has a port of
+ * its own, which limits the number of timers a client can start */
+#define BENCH_DEFAULT_NUM_CLIENTS 4
+#define BENCH_DEFAULT_NUM_TIMERS 1000
+#define BENCH_FIRST_CLIENT_PORT 5240
+#define BENCH_NUM_PORTS_PER_CLIENT 100
+#define BENCH_MIN_EXPIRY_MICROSECONDS 100000UL
+#define BENCH_EXPIRY_SPREAD_MICROSECONDS 2000000UL
+#define BENCH_EXPIRY_GRACE_NANOSECONDS 1000000000ULL
+#define BENCH_STOPPED_EXPIRY_DECISECONDS 6000
+#define BENCH_STOPPED_PORT_OFFSET 50
+#define BENCH_MAX_NUM_TIMERS (BENCH_STOPPED_PORT_OFFSET << 8)
+/* A benchmark client launches this program again, with the
+ * port as its only argument, to listen out for each block of
+ * its timers, and tells it in its environment which file
+ * descriptor holds the array of when each timer expired */
+#define BENCH_LISTENER_EXE "./timer_test"
+#define BENCH_EXPIRY_FD_ENV "TIMER_TEST_BENCH_EXPIRY_FD"
+/* The lateness histogram, the limits of which are in gBenchHistogramLimitMicroSeconds[] */
+#define BENCH_NUM_HISTOGRAM_BUCKETS 10
+#define BENCH_HISTOGRAM_BAR_LENGTH 40
 
 /*
  * TYPES
@@ -33,6 +77,7 @@
 typedef enum TimerTestMsgTypeTag
 {
     TIMER_TEST_EXPIRY_IND,
+    TIMER_TEST_BENCH_EXPIRY_IND,
     MAX_NUM_TIMER_TEST_MSGS
 } TimerTestMsgType;
 
@@ -42,8 +87,29 @@ typedef struct TimerTestExpiryIndMsgTag
     TimerId id;
 } TimerTestExpiryIndMsg;
 
+/* A benchmark timer expiry message */
+typedef struct TimerTestBenchExpiryIndMsgTag
+{
+    UInt32 index;
+} TimerTestBenchExpiryIndMsg;
+
 #pragma pack(pop) /* End of packing */
 
+/* What a benchmark client found */
+typedef struct BenchResultsTag
+{
+    UInt32 numStarted;
+    UInt32 numStopped;
+    UInt32 numExpired;
+    UInt32 numEarly;
+    UInt32 numMissing;
+    uint64_t totalLatenessNs;
+    uint64_t maxLatenessNs;
+    double startSeconds;
+    double stopSeconds;
+    UInt32 histogram[BENCH_NUM_HISTOGRAM_BUCKETS];
+} BenchResults;
+
 /*
  * EXTERNS
  */
@@ -57,6 +123,16 @@ extern Char *pgTimerMessageNames[];
 TimerId gId[MAX_NUM_TIMER_IDS_REMEMBERED];
 /* The number of entries in the array */
 UInt8 gNumIds = 0;
+/* When each of the expiries in gId[] arrived */
+uint64_t gExpiryTimeNs[MAX_NUM_TIMER_IDS_REMEMBERED];
+/* In a benchmark client, when each timer expired (0 if it
+ * hasn't), in memory shared with its listeners, and the
+ * number of timers */
+uint64_t *gBenchExpiryTimeNs = PNULL;
+UInt32 gBenchNumTimers = 0;
+/* The upper limits of the lateness histogram buckets, the last bucket has none */
+static const unsigned long gBenchHistogramLimitMicroSeconds[BENCH_NUM_HISTOGRAM_BUCKETS - 1] = {100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000};
+static const Char gBenchHistogramBar[BENCH_HISTOGRAM_BAR_LENGTH + 1] = "########################################";
 
 /*
  * STATIC FUNCTIONS
@@ -134,6 +210,38 @@ static Bool stopLocalServerThread (pthread_t *pLocalServerThread)
     return success;
 }
 
+/*
+ * Open the datagram socket of a client that never
+ * takes the expiries sent to it, so that once there
+ * are a few waiting no more will go.
+ *
+ * port     the port of the client.
+ *
+ * @return  the socket, -1 if it couldn't be opened.
+ */
+static SInt32 openHungClient (SInt32 port)
+{
+    SInt32 hungSocket;
+    struct sockaddr_un address;
+
+    hungSocket = socket (AF_UNIX, SOCK_DGRAM, 0);
+    if (hungSocket >= 0)
+    {
+        memset (&address, 0, sizeof (address));
+        address.sun_family = AF_UNIX;
+        /* sun_path[0] is left as zero, the name is in the abstract namespace */
+        snprintf (&(address.sun_path[1]), sizeof (address.sun_path) - 1, MESSAGING_DATAGRAM_SOCKET_NAME_FORMAT, (int) port);
+        if (bind (hungSocket, (struct sockaddr *) &address, sizeof (address)) != 0)
+        {
+            printDebug ("!!! Couldn't bind hung client socket, err: %s. !!!\n", strerror (errno));
+            close (hungSocket);
+            hungSocket = -1;
+        }
+    }
+
+    return hungSocket;
+}
+
 static void handleTimerTestExpiryInd (TimerTestExpiryIndMsg *pTimerTestExpiryIndMsg)
 {
     UInt32 x;
@@ -146,11 +254,13 @@ static void handleTimerTestExpiryInd (TimerTestExpiryIndMsg *pTimerTestExpiryInd
         for (x = 0; x < (MAX_NUM_TIMER_IDS_REMEMBERED - 1); x++)
         {
             gId[x] = gId[x + 1];
+            gExpiryTimeNs[x] = gExpiryTimeNs[x + 1];
         }
         gNumIds = MAX_NUM_TIMER_IDS_REMEMBERED - 1;
     }
     
     gId[gNumIds] = pTimerTestExpiryIndMsg->id;
+    gExpiryTimeNs[gNumIds] = getMonotonicNs();
     
     if (gNumIds < MAX_NUM_TIMER_IDS_REMEMBERED)
     {
@@ -160,6 +270,423 @@ static void handleTimerTestExpiryInd (TimerTestExpiryIndMsg *pTimerTestExpiryInd
     printDebug ("[%d timers expired].\n", gNumIds);
 }
 
+/*
+ * Handle the expiry of a benchmark timer: note
+ * when it arrived.  Called in one of the listener
+ * processes of the benchmark client while the
+ * client waits.
+ */
+static void handleTimerTestBenchExpiryInd (TimerTestBenchExpiryIndMsg *pTimerTestBenchExpiryIndMsg)
+{
+    UInt32 index = pTimerTestBenchExpiryIndMsg->index;
+
+    if ((index < gBenchNumTimers) && (gBenchExpiryTimeNs[index] == 0))
+    {
+        __atomic_store_n (&(gBenchExpiryTimeNs[index]), getMonotonicNs(), __ATOMIC_RELEASE);
+    }
+}
+
+/*
+ * Get the CPU time used by another process so far.
+ *
+ * pid      the process.
+ *
+ * @return  the CPU time, user plus system, in
+ *          seconds (with the resolution of a
+ *          clock tick).
+ */
+static double getProcessCpuSeconds (pid_t pid)
+{
+    double cpuSeconds = 0;
+    Char fileName[32];
+    FILE *pFile;
+    unsigned long userTicks;
+    unsigned long systemTicks;
+
+    snprintf (fileName, sizeof (fileName), "/proc/%d/stat", pid);
+    pFile = fopen (fileName, "r");
+    if (pFile != PNULL)
+    {
+        /* utime and stime are the 14th and 15th fields, after a command name that has no spaces in it here */
+        if (fscanf (pFile, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &userTicks, &systemTicks) == 2)
+        {
+            cpuSeconds = (double) (userTicks + systemTicks) / sysconf (_SC_CLK_TCK);
+        }
+        fclose (pFile);
+    }
+
+    return cpuSeconds;
+}
+
+/*
+ * Map the array of when each timer of a benchmark
+ * client expired, which the client shares with its
+ * listeners.
+ *
+ * fd       the memory file holding the array.
+ *
+ * @return  true if successful, otherwise false.
+ */
+static Bool mapBenchExpiryTimes (SInt32 fd)
+{
+    Bool success = false;
+    struct stat fileStat;
+
+    if ((fstat (fd, &fileStat) == 0) && (fileStat.st_size > 0))
+    {
+        gBenchExpiryTimeNs = (uint64_t *) mmap (PNULL, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (gBenchExpiryTimeNs != MAP_FAILED)
+        {
+            gBenchNumTimers = fileStat.st_size / sizeof (*gBenchExpiryTimeNs);
+            success = true;
+        }
+        else
+        {
+            gBenchExpiryTimeNs = PNULL;
+            printDebug ("!!! Couldn't map benchmark expiry times, err: %s. !!!\n", strerror (errno));
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Listen out for the expiries of a block of the
+ * timers of a benchmark client, which launched this
+ * process with spawnMessagingServer(), noting them
+ * in the array that it shares.  Runs until killed.
+ *
+ * port  the port to listen on.
+ */
+static void runBenchmarkListener (UInt16 port)
+{
+    Char *pExpiryFdString;
+
+    pExpiryFdString = getenv (BENCH_EXPIRY_FD_ENV);
+    if ((pExpiryFdString != PNULL) && mapBenchExpiryTimes (atoi (pExpiryFdString)))
+    {
+        runMessagingServer (port);
+    }
+}
+
+/*
+ * Run one client of the benchmark, in its own process:
+ * start timers with random deadlines for this client and
+ * time how long it takes, start and stop as many again
+ * that would never expire, timing the stops, then wait
+ * for the first lot to expire and work out how late each
+ * was.  The expiries of each block of 256 timers go to a
+ * port of their own, each listened on by a listener
+ * launched for it.  The results are written to resultsFd.
+ *
+ * clientPort  the first port of this client.
+ * numTimers   the number of timers to start, at most
+ *             BENCH_MAX_NUM_TIMERS.
+ * resultsFd   where to write the results.
+ */
+static void runBenchmarkClient (SInt32 clientPort, UInt32 numTimers, SInt32 resultsFd)
+{
+    BenchResults results;
+    MessagingMsgTypeStats stats;
+    UInt16 timerServerPort = (UInt16) atoi (TIMER_SERVER_PORT_STRING);
+    UInt32 numBlocks = (numTimers + 0xFF) >> 8;
+    UInt32 numListeners = 0;
+    pid_t *pListenerPIDs;
+    SInt32 *pReadyFds;
+    SInt32 expiryFd;
+    Char numberString[16];
+    Bool ready;
+    ShortMsg msg;
+    TimerTestBenchExpiryIndMsg timerTestBenchExpiryIndMsg;
+    uint64_t *pRequestedTimeNs;
+    uint64_t startTimeNs;
+    uint64_t latestTimeNs = 0;
+    uint64_t latenessNs;
+    UInt32 durationMicroSeconds;
+    UInt32 numExpired = 0;
+    UInt32 x;
+    UInt32 y;
+
+    ASSERT_PARAM (numTimers <= BENCH_MAX_NUM_TIMERS, numTimers);
+
+    memset (&results, 0, sizeof (results));
+
+    /* Connections to the timer server that came with the fork are the parent's */
+    closeMessagingClientConnections();
+    srand (clientPort);
+
+    pRequestedTimeNs = (uint64_t *) malloc (numTimers * sizeof (*pRequestedTimeNs));
+    pListenerPIDs = (pid_t *) malloc (numBlocks * sizeof (*pListenerPIDs));
+    pReadyFds = (SInt32 *) malloc (numBlocks * sizeof (*pReadyFds));
+    /* Zeroed, and written by the listeners, which inherit the
+     * file descriptor as it isn't closed on exec */
+    expiryFd = memfd_create ("timer_test.bench", 0);
+    snprintf (numberString, sizeof (numberString), "%ld", expiryFd);
+    if ((pRequestedTimeNs != PNULL) && (pListenerPIDs != PNULL) && (pReadyFds != PNULL) && (expiryFd >= 0) &&
+        (ftruncate (expiryFd, numTimers * sizeof (*gBenchExpiryTimeNs)) == 0) && mapBenchExpiryTimes (expiryFd) &&
+        (setenv (BENCH_EXPIRY_FD_ENV, numberString, true) == 0))
+    {
+        /* Start all of the listeners before waiting for any of them */
+        for (x = 0; (x < numBlocks) && (numListeners == x); x++)
+        {
+            snprintf (numberString, sizeof (numberString), "%ld", clientPort + x);
+            pListenerPIDs[x] = spawnMessagingServer (BENCH_LISTENER_EXE, numberString, &(pReadyFds[x]));
+            if (pListenerPIDs[x] > 0)
+            {
+                numListeners++;
+            }
+        }
+        ready = waitMessagingServersReady (pReadyFds, numListeners, MESSAGING_SERVER_READY_TIMEOUT_MS) && (numListeners == numBlocks);
+    }
+    else
+    {
+        ready = false;
+        printDebug ("!!! Couldn't set up benchmark client, err: %s. !!!\n", strerror (errno));
+    }
+
+    if (ready)
+    {
+        /* The timers that are measured */
+        startTimeNs = getMonotonicNs();
+        for (x = 0; x < numTimers; x++)
+        {
+            durationMicroSeconds = BENCH_MIN_EXPIRY_MICROSECONDS + (rand() % BENCH_EXPIRY_SPREAD_MICROSECONDS);
+            timerTestBenchExpiryIndMsg.index = x;
+            createTimerExpiryMsg (&msg, TIMER_TEST_BENCH_EXPIRY_IND, &timerTestBenchExpiryIndMsg, sizeof (timerTestBenchExpiryIndMsg));
+            pRequestedTimeNs[x] = getMonotonicNs() + (durationMicroSeconds * 1000ULL);
+            if (sendStartTimerUs (durationMicroSeconds, (TimerId) x, clientPort + (x >> 8), &msg))
+            {
+                results.numStarted++;
+                if (pRequestedTimeNs[x] > latestTimeNs)
+                {
+                    latestTimeNs = pRequestedTimeNs[x];
+                }
+            }
+            else
+            {
+                pRequestedTimeNs[x] = 0;
+            }
+        }
+        /* Nothing is sent back for a start, so end with a round trip on
+         * the same connection: the answer comes once the timer server has
+         * got through all that was sent before it */
+        getMessagingServerStats (timerServerPort, PNULL, TIMER_START_US_REQ, &stats);
+        results.startSeconds = (double) (getMonotonicNs() - startTimeNs) / 1000000000.0;
+
+        /* Timers that are only there to be stopped, for ports no-one listens on */
+        for (x = 0; x < numTimers; x++)
+        {
+            sendStartTimer (BENCH_STOPPED_EXPIRY_DECISECONDS, (TimerId) x, clientPort + BENCH_STOPPED_PORT_OFFSET + (x >> 8), &msg);
+        }
+        getMessagingServerStats (timerServerPort, PNULL, TIMER_START_REQ, &stats);
+        startTimeNs = getMonotonicNs();
+        for (x = 0; x < numTimers; x++)
+        {
+            if (sendStopTimer ((TimerId) x, clientPort + BENCH_STOPPED_PORT_OFFSET + (x >> 8)))
+            {
+                results.numStopped++;
+            }
+        }
+        getMessagingServerStats (timerServerPort, PNULL, TIMER_STOP_REQ, &stats);
+        results.stopSeconds = (double) (getMonotonicNs() - startTimeNs) / 1000000000.0;
+
+        /* Wait for the measured timers to expire */
+        while ((numExpired < results.numStarted) && (getMonotonicNs() < latestTimeNs + BENCH_EXPIRY_GRACE_NANOSECONDS))
+        {
+            usleep (10000);
+            numExpired = 0;
+            for (x = 0; x < numTimers; x++)
+            {
+                if (__atomic_load_n (&(gBenchExpiryTimeNs[x]), __ATOMIC_ACQUIRE) != 0)
+                {
+                    numExpired++;
+                }
+            }
+        }
+
+        for (x = 0; x < numTimers; x++)
+        {
+            if (pRequestedTimeNs[x] != 0)
+            {
+                if (gBenchExpiryTimeNs[x] == 0)
+                {
+                    results.numMissing++;
+                }
+                else if (gBenchExpiryTimeNs[x] < pRequestedTimeNs[x])
+                {
+                    results.numEarly++;
+                }
+                else
+                {
+                    latenessNs = gBenchExpiryTimeNs[x] - pRequestedTimeNs[x];
+                    results.numExpired++;
+                    results.totalLatenessNs += latenessNs;
+                    if (latenessNs > results.maxLatenessNs)
+                    {
+                        results.maxLatenessNs = latenessNs;
+                    }
+                    y = 0;
+                    while ((y < BENCH_NUM_HISTOGRAM_BUCKETS - 1) && (latenessNs >= gBenchHistogramLimitMicroSeconds[y] * 1000ULL))
+                    {
+                        y++;
+                    }
+                    results.histogram[y]++;
+                }
+            }
+        }
+    }
+
+    for (x = 0; x < numListeners; x++)
+    {
+        kill (pListenerPIDs[x], SIGTERM);
+        waitpid (pListenerPIDs[x], PNULL, 0);
+    }
+
+    /* Small enough that the write is atomic, whatever the other clients are doing */
+    if (write (resultsFd, &results, sizeof (results)) != sizeof (results))
+    {
+        printDebug ("!!! Couldn't write benchmark results, err: %s. !!!\n", strerror (errno));
+    }
+}
+
+/*
+ * Run the benchmark: start the clients, each in its own
+ * process, gather up their results and print them, with
+ * the CPU time the timer server used meanwhile.
+ *
+ * timerServerPID  the process ID of the timer server.
+ * numClients      the number of clients.
+ * numTimers       the number of timers each starts.
+ *
+ * @return         true if every timer expired, none
+ *                 of them early or later than
+ *                 MAX_JITTER_NANOSECONDS, otherwise
+ *                 false.
+ */
+static Bool runBenchmark (pid_t timerServerPID, UInt32 numClients, UInt32 numTimers)
+{
+    Bool success = false;
+    int resultsFds[2];
+    pid_t clientPID;
+    BenchResults results;
+    BenchResults total;
+    double maxStartSeconds = 0;
+    double maxStopSeconds = 0;
+    double cpuSeconds;
+    uint64_t startTimeNs;
+    double wallSeconds;
+    UInt32 numClientsStarted = 0;
+    UInt32 numResults = 0;
+    UInt32 x;
+    UInt32 y;
+
+    memset (&total, 0, sizeof (total));
+
+    printProgress ("------------------------------------------------------------------\n");
+    printProgress ("STARTING TIMER BENCHMARK: %lu client(s), each starting %lu timer(s)\nwith deadlines %lu to %lu ms away and stopping %lu more.\n",
+                   numClients, numTimers, BENCH_MIN_EXPIRY_MICROSECONDS / 1000, (BENCH_MIN_EXPIRY_MICROSECONDS + BENCH_EXPIRY_SPREAD_MICROSECONDS) / 1000, numTimers);
+
+    if (pipe (resultsFds) == 0)
+    {
+        cpuSeconds = getProcessCpuSeconds (timerServerPID);
+        startTimeNs = getMonotonicNs();
+
+        for (x = 0; x < numClients; x++)
+        {
+            clientPID = fork();
+            if (clientPID == 0)
+            {
+                close (resultsFds[0]);
+                runBenchmarkClient (BENCH_FIRST_CLIENT_PORT + (x * BENCH_NUM_PORTS_PER_CLIENT), numTimers, resultsFds[1]);
+                exit (0);
+            }
+            else if (clientPID > 0)
+            {
+                numClientsStarted++;
+            }
+            else
+            {
+                printDebug ("!!! Couldn't fork benchmark client, err: %s. !!!\n", strerror (errno));
+            }
+        }
+        close (resultsFds[1]);
+
+        while ((numResults < numClientsStarted) && (read (resultsFds[0], &results, sizeof (results)) == sizeof (results)))
+        {
+            numResults++;
+            total.numStarted += results.numStarted;
+            total.numStopped += results.numStopped;
+            total.numExpired += results.numExpired;
+            total.numEarly += results.numEarly;
+            total.numMissing += results.numMissing;
+            total.totalLatenessNs += results.totalLatenessNs;
+            if (results.maxLatenessNs > total.maxLatenessNs)
+            {
+                total.maxLatenessNs = results.maxLatenessNs;
+            }
+            for (y = 0; y < BENCH_NUM_HISTOGRAM_BUCKETS; y++)
+            {
+                total.histogram[y] += results.histogram[y];
+            }
+            /* The clients run side by side, so the slowest says how long it all took */
+            if (results.startSeconds > maxStartSeconds)
+            {
+                maxStartSeconds = results.startSeconds;
+            }
+            if (results.stopSeconds > maxStopSeconds)
+            {
+                maxStopSeconds = results.stopSeconds;
+            }
+        }
+        close (resultsFds[0]);
+        for (x = 0; x < numClientsStarted; x++)
+        {
+            wait (PNULL);
+        }
+
+        wallSeconds = (double) (getMonotonicNs() - startTimeNs) / 1000000000.0;
+        cpuSeconds = getProcessCpuSeconds (timerServerPID) - cpuSeconds;
+
+        printProgress ("- %lu of %lu client(s) reported.\n", numResults, numClients);
+        if (maxStartSeconds > 0)
+        {
+            printProgress ("- TIMER_START_US_REQ: %lu in %.3f s, %.0f per second.\n", total.numStarted, maxStartSeconds, total.numStarted / maxStartSeconds);
+        }
+        if (maxStopSeconds > 0)
+        {
+            printProgress ("- TIMER_STOP_REQ: %lu in %.3f s, %.0f per second.\n", total.numStopped, maxStopSeconds, total.numStopped / maxStopSeconds);
+        }
+        printProgress ("- Expiries: %lu on time or late, %lu early, %lu missing.\n", total.numExpired, total.numEarly, total.numMissing);
+        if (total.numExpired > 0)
+        {
+            printProgress ("- Lateness: mean %lu us, max %lu us, histogram:\n",
+                           (unsigned long) (total.totalLatenessNs / total.numExpired / 1000), (unsigned long) (total.maxLatenessNs / 1000));
+            for (y = 0; y < BENCH_NUM_HISTOGRAM_BUCKETS; y++)
+            {
+                if (y < BENCH_NUM_HISTOGRAM_BUCKETS - 1)
+                {
+                    printProgress ("  < %6lu us: %6lu %5.1f%% %.*s\n", gBenchHistogramLimitMicroSeconds[y], total.histogram[y],
+                                   100.0 * total.histogram[y] / total.numExpired, (int) (BENCH_HISTOGRAM_BAR_LENGTH * total.histogram[y] / total.numExpired), gBenchHistogramBar);
+                }
+                else
+                {
+                    printProgress (" >= %6lu us: %6lu %5.1f%% %.*s\n", gBenchHistogramLimitMicroSeconds[y - 1], total.histogram[y],
+                                   100.0 * total.histogram[y] / total.numExpired, (int) (BENCH_HISTOGRAM_BAR_LENGTH * total.histogram[y] / total.numExpired), gBenchHistogramBar);
+                }
+            }
+        }
+        printProgress ("- Timer server CPU: %.2f s in %.2f s (%.1f%%).\n", cpuSeconds, wallSeconds, 100.0 * cpuSeconds / wallSeconds);
+
+        success = (numResults == numClients) && (total.numStarted == numClients * numTimers) && (total.numExpired == total.numStarted) &&
+                  (total.maxLatenessNs < MAX_JITTER_NANOSECONDS);
+    }
+
+    printProgress ("BENCHMARK %s.\n", success ? "PASSED" : "FAILED");
+    printProgress ("------------------------------------------------------------------\n");
+
+    return success;
+}
+
 /*
  * PUBLIC FUNCTIONS
  */
@@ -194,6 +721,10 @@ ServerReturnCode serverHandleMsg (Msg *pReceivedMsg, Msg *pSendMsg)
         /* Do the thang */
         handleTimerTestExpiryInd ((TimerTestExpiryIndMsg *) pReceivedMsg->msgBody);
     }
+    else if ((TimerTestMsgType) pReceivedMsg->msgType == TIMER_TEST_BENCH_EXPIRY_IND)
+    {
+        handleTimerTestBenchExpiryInd ((TimerTestBenchExpiryIndMsg *) pReceivedMsg->msgBody);
+    }
     else
     {
         ASSERT_ALWAYS_PARAM (pReceivedMsg->msgType);
@@ -204,52 +735,102 @@ ServerReturnCode serverHandleMsg (Msg *pReceivedMsg, Msg *pSendMsg)
 
 /*
  * Entry point.
+ *
+ * Usage: timer_test [-b [-c clients] [-n timers]]
+ *   -b  run the benchmark instead of the tests.
+ *   -c  the number of benchmark clients, each a
+ *       process (default BENCH_DEFAULT_NUM_CLIENTS).
+ *   -n  the number of timers each benchmark client
+ *       starts (default BENCH_DEFAULT_NUM_TIMERS, at
+ *       most BENCH_MAX_NUM_TIMERS).
+ *
+ * Run as timer_test port by a benchmark client to
+ * listen out for a block of its timers.
  */
 int main (int argc, char **argv)
 {
     Bool   success = false;
     pid_t  tiServerPID;
+    SInt32 readyFd;
     pthread_t localServerThread;
     ShortMsg msg;
     TimerTestExpiryIndMsg timerTestExpiryIndMsg;
+    Bool benchmark = false;
+    UInt32 numBenchClients = BENCH_DEFAULT_NUM_CLIENTS;
+    UInt32 numBenchTimers = BENCH_DEFAULT_NUM_TIMERS;
+    int option;
 
     /*setDebugPrintsOnToFile ("timer_test.log");*/
     setProgressPrintsOn();
     /* setDebugPrintsOnToSyslog();*/ /* Don't switch debug on in here unless you have to, the load has a significant effect */
     
+    while ((option = getopt (argc, argv, "bc:n:")) != -1)
+    {
+        switch (option)
+        {
+            case 'b':
+            {
+                benchmark = true;
+            }
+            break;
+            case 'c':
+            {
+                numBenchClients = strtoul (optarg, PNULL, 10);
+            }
+            break;
+            case 'n':
+            {
+                numBenchTimers = strtoul (optarg, PNULL, 10);
+            }
+            break;
+            default:
+            {
+                numBenchClients = 0;
+            }
+            break;
+        }
+    }
+    if ((numBenchClients == 0) || (numBenchTimers == 0) || (numBenchTimers > BENCH_MAX_NUM_TIMERS))
+    {
+        printProgress ("Usage: %s [-b [-c clients] [-n timers]]\n", argv[0]);
+        exit (-1);
+    }
+    if (optind < argc)
+    {
+        runBenchmarkListener ((UInt16) atoi (argv[optind]));
+        exit (0);
+    }
     
-    /* Spawn a child that will become the Timer server. */
-    tiServerPID = fork();
-    if (tiServerPID == 0)
+    /* Spawn the Timer server and wait until it says it is ready */
+    tiServerPID = spawnMessagingServer (TIMER_SERVER_EXE, TIMER_SERVER_PORT_STRING, &readyFd);
+    if (tiServerPID < 0)
     {
-        /* Start Timer server process on a given port */
-        static char *argv1[] = {TIMER_SERVER_EXE, TIMER_SERVER_PORT_STRING, PNULL};
-        
-        execv (TIMER_SERVER_EXE, argv1);
-        printDebug ("!!! Couldn't launch %s, err: %s. !!!\n", TIMER_SERVER_EXE, strerror (errno));
+        printDebug ("!!! Couldn't launch %s. !!!\n", TIMER_SERVER_EXE);
     }
     else
     {
-        if (tiServerPID < 0)
+        if (waitMessagingServersReady (&readyFd, 1, MESSAGING_SERVER_READY_TIMEOUT_MS))
         {
-            printDebug ("!!! Couldn't fork to launch %s, err: %s. !!!\n", TIMER_SERVER_EXE, strerror (errno));
-        }
-        else
-        {   /* Parent process */
-            /* Wait for the server to start */
-            usleep (TIMER_SERVER_START_DELAY_PI_US);
             /* Now setup the Timer server */
             success = timerServerSend (TIMER_SERVER_START_REQ, PNULL, 0);
 
-            if (success)
+            if (success && benchmark)
+            {
+                success = runBenchmark (tiServerPID, numBenchClients, numBenchTimers);
+            }
+            else if (success)
             {
-                /* Start the local server that listens out for timer expiries */
-                success = startLocalServerThread (&localServerThread, LOCAL_SERVER_PORT);
+                /* Start the local server that listens out for timer expiries, with local timers of its own */
+                success = startLocalTimers() && startLocalServerThread (&localServerThread, LOCAL_SERVER_PORT);
                 
                 if (success)
                 {
                     UInt32 x;
                     UInt32 rememberId;
+                    SInt32 hungClientSocket;
+                    uint64_t startTimeNs[NUM_JITTER_TIMERS];
+                    uint64_t latenessNs;
+                    uint64_t maxLatenessNs = 0;
                     
                     timerTestExpiryIndMsg.id = 0;
                     createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));                    
@@ -259,8 +840,8 @@ int main (int argc, char **argv)
                      * otherwise be */
                     printProgress ("------------------------------------------------------------------\n");
                     printProgress ("STARTING TIMER TESTS.\n");
-                    printProgress ("- TEST 0: start a 40 second timer that should over-arch\n          these tests.\n");
-                    sendStartTimer (400, timerTestExpiryIndMsg.id, LOCAL_SERVER_PORT, &msg);
+                    printProgress ("- TEST 0: start a 45 second timer that should over-arch\n          these tests.\n");
+                    sendStartTimer (450, timerTestExpiryIndMsg.id, LOCAL_SERVER_PORT, &msg);
                     
                     printProgress ("- TEST 1: a 1 second timer which should expire.\n");
                     timerTestExpiryIndMsg.id++;
@@ -409,9 +990,105 @@ int main (int argc, char **argv)
                                    timerTestExpiryIndMsg.id,
                                    gNumIds);
 
-                    printProgress ("- TEST 8: wait for the over-arching timer to expire.\n");
+                    printProgress ("- TEST 8: start a 300 ms and then a 100 ms microsecond timer, they\n          should both expire, in the right order, inside 0.5 s.\n");
+                    timerTestExpiryIndMsg.id++;
+                    createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));
+                    sendStartTimerUs (300000, timerTestExpiryIndMsg.id, LOCAL_SERVER_PORT, &msg);
+                    timerTestExpiryIndMsg.id++;
+                    createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));
+                    sendStartTimerUs (100000, timerTestExpiryIndMsg.id, LOCAL_SERVER_PORT, &msg);
+                    usleep (500000);
+                    ASSERT_PARAM2 (gNumIds == 10, gNumIds, 10);
+                    ASSERT_PARAM3 (gId[gNumIds - 1] == timerTestExpiryIndMsg.id - 1,
+                                   gId[gNumIds - 1],
+                                   timerTestExpiryIndMsg.id - 1,
+                                   gNumIds);
+                    ASSERT_PARAM3 (gId[gNumIds - 2] == timerTestExpiryIndMsg.id,
+                                   gId[gNumIds - 2],
+                                   timerTestExpiryIndMsg.id,
+                                   gNumIds);
+
+                    printProgress ("- TEST 9: start %d 50 ms timers for a client that never takes its\n          expiries, then %d timers 100 ms apart for this one, which\n          should expire in order, each within %d ms of when it should.\n",
+                                   NUM_HUNG_CLIENT_TIMERS, NUM_JITTER_TIMERS, (int) (MAX_JITTER_NANOSECONDS / 1000000));
+                    hungClientSocket = openHungClient (HUNG_CLIENT_PORT);
+                    ASSERT_PARAM (hungClientSocket >= 0, hungClientSocket);
+                    for (x = 0; x < NUM_HUNG_CLIENT_TIMERS; x++)
+                    {
+                        sendStartTimerUs (50000, (TimerId) x, HUNG_CLIENT_PORT, &msg);
+                    }
+                    for (x = 0; x < NUM_JITTER_TIMERS; x++)
+                    {
+                        timerTestExpiryIndMsg.id++;
+                        createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));
+                        startTimeNs[x] = getMonotonicNs();
+                        sendStartTimerUs ((x + 1) * 100000, timerTestExpiryIndMsg.id, LOCAL_SERVER_PORT, &msg);
+                    }
+                    usleep ((NUM_JITTER_TIMERS + 2) * 100000);
+                    ASSERT_PARAM2 (gNumIds == 10 + NUM_JITTER_TIMERS, gNumIds, 10 + NUM_JITTER_TIMERS);
+                    for (x = 0; x < NUM_JITTER_TIMERS; x++)
+                    {
+                        rememberId = gNumIds - NUM_JITTER_TIMERS + x;
+                        ASSERT_PARAM3 (gId[rememberId] == timerTestExpiryIndMsg.id - NUM_JITTER_TIMERS + 1 + x,
+                                       gId[rememberId],
+                                       timerTestExpiryIndMsg.id - NUM_JITTER_TIMERS + 1 + x,
+                                       gNumIds);
+                        latenessNs = gExpiryTimeNs[rememberId] - startTimeNs[x] - ((x + 1) * 100000000ULL);
+                        ASSERT_PARAM2 (latenessNs < MAX_JITTER_NANOSECONDS, (unsigned long) latenessNs, x);
+                        if (latenessNs > maxLatenessNs)
+                        {
+                            maxLatenessNs = latenessNs;
+                        }
+                    }
+                    printProgress ("          (latest expiry was %lu microseconds late)\n", (unsigned long) (maxLatenessNs / 1000));
+                    close (hungClientSocket);
+
+                    printProgress ("- TEST 10: start a %d ms periodic timer, check that it expires %d times,\n          the last on time, then stop it and check that it stops.\n",
+                                   (int) (PERIODIC_TIMER_PERIOD_MICROSECONDS / 1000), NUM_PERIODIC_TIMER_EXPIRIES);
+                    timerTestExpiryIndMsg.id++;
+                    createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));
+                    startTimeNs[0] = getMonotonicNs();
+                    sendStartPeriodicTimer (PERIODIC_TIMER_PERIOD_MICROSECONDS, timerTestExpiryIndMsg.id, LOCAL_SERVER_PORT, &msg);
+                    usleep (PERIODIC_TIMER_PERIOD_MICROSECONDS * NUM_PERIODIC_TIMER_EXPIRIES + (PERIODIC_TIMER_PERIOD_MICROSECONDS / 2));
+                    sendStopTimer (timerTestExpiryIndMsg.id, LOCAL_SERVER_PORT);
+                    ASSERT_PARAM2 (gNumIds == 10 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES, gNumIds, 10 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES);
+                    for (x = 0; x < NUM_PERIODIC_TIMER_EXPIRIES; x++)
+                    {
+                        ASSERT_PARAM3 (gId[gNumIds - 1 - x] == timerTestExpiryIndMsg.id,
+                                       gId[gNumIds - 1 - x],
+                                       timerTestExpiryIndMsg.id,
+                                       gNumIds);
+                    }
+                    latenessNs = gExpiryTimeNs[gNumIds - 1] - startTimeNs[0] - (NUM_PERIODIC_TIMER_EXPIRIES * PERIODIC_TIMER_PERIOD_MICROSECONDS * 1000ULL);
+                    ASSERT_PARAM (latenessNs < MAX_JITTER_NANOSECONDS, (unsigned long) latenessNs);
+                    printProgress ("          (last expiry was %lu microseconds late)\n", (unsigned long) (latenessNs / 1000));
+                    usleep (PERIODIC_TIMER_PERIOD_MICROSECONDS * 2);
+                    ASSERT_PARAM2 (gNumIds == 10 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES, gNumIds, 10 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES);
+
+                    printProgress ("- TEST 11: start 300 ms, 200 ms and 100 ms local timers, stop the 200 ms\n          one, the other two should expire, in the right order, inside 0.5 s.\n");
+                    timerTestExpiryIndMsg.id++;
+                    createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));
+                    startLocalTimerUs (300000, timerTestExpiryIndMsg.id, &msg);
+                    timerTestExpiryIndMsg.id++;
+                    createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));
+                    startLocalTimerUs (200000, timerTestExpiryIndMsg.id, &msg);
+                    timerTestExpiryIndMsg.id++;
+                    createTimerExpiryMsg (&msg, TIMER_TEST_EXPIRY_IND, &timerTestExpiryIndMsg, sizeof (timerTestExpiryIndMsg));
+                    startLocalTimerUs (100000, timerTestExpiryIndMsg.id, &msg);
+                    stopLocalTimer (timerTestExpiryIndMsg.id - 1);
+                    usleep (500000);
+                    ASSERT_PARAM2 (gNumIds == 12 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES, gNumIds, 12 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES);
+                    ASSERT_PARAM3 (gId[gNumIds - 1] == timerTestExpiryIndMsg.id - 2,
+                                   gId[gNumIds - 1],
+                                   timerTestExpiryIndMsg.id - 2,
+                                   gNumIds);
+                    ASSERT_PARAM3 (gId[gNumIds - 2] == timerTestExpiryIndMsg.id,
+                                   gId[gNumIds - 2],
+                                   timerTestExpiryIndMsg.id,
+                                   gNumIds);
+
+                    printProgress ("- TEST 12: wait for the over-arching timer to expire.\n");
                     sleep (12);
-                    ASSERT_PARAM2 (gNumIds == 9, gNumIds, 9);
+                    ASSERT_PARAM2 (gNumIds == 13 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES, gNumIds, 13 + NUM_JITTER_TIMERS + NUM_PERIODIC_TIMER_EXPIRIES);
                     ASSERT_PARAM3 (gId[gNumIds - 1] == 0,
                                    gId[gNumIds - 1],
                                    0,
@@ -429,8 +1106,14 @@ int main (int argc, char **argv)
             
             /* When done, shut down the Timer server gracefully */
             timerServerSend (TIMER_SERVER_STOP_REQ, PNULL, 0);
-            waitpid (tiServerPID, 0, 0); /* wait for server to exit */
         }
+        else
+        {
+            /* It may not be serving at all, so won't take a stop */
+            printDebug ("!!! %s didn't become ready. !!!\n", TIMER_SERVER_EXE);
+            kill (tiServerPID, SIGTERM);
+        }
+        waitpid (tiServerPID, 0, 0); /* wait for server to exit */
     }
     
     setDebugPrintsOff();
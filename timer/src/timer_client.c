@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#define DEBUG_MODULE DEBUG_MODULE_CLIENT /* Before rob_system.h */
 #include <rob_system.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
@@ -52,32 +53,28 @@ Bool timerServerSend (TimerMsgType msgType, void *pSendMsgBody, UInt16 sendMsgBo
     ASSERT_PARAM (msgType < MAX_NUM_TIMER_MSGS, msgType);
     ASSERT_PARAM (sendMsgBodyLength <= MAX_MSG_BODY_LENGTH, sendMsgBodyLength);
 
-    pSendMsg = malloc (sizeof (*pSendMsg));
+    pSendMsg = &(getMessagingClientMsgs()->sendMsg);
     
-    if (pSendMsg != PNULL)
+    /* Put in the bit before the body */
+    pSendMsg->msgLength = 0;
+    pSendMsg->msgType = msgType;
+    pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+
+    /* Put any stuff to send */
+    if (pSendMsgBody != PNULL)
     {
-        /* Put in the bit before the body */
-        pSendMsg->msgLength = 0;
-        pSendMsg->msgType = msgType;
-        pSendMsg->msgLength += sizeof (pSendMsg->msgType);
+        memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
+    }
+    pSendMsg->msgLength += sendMsgBodyLength;
                     
-        /* Put any stuff to send */
-        if (pSendMsgBody != PNULL)
-        {
-            memcpy (&pSendMsg->msgBody[0], pSendMsgBody, sendMsgBodyLength);
-        }
-        pSendMsg->msgLength += sendMsgBodyLength;
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "T  Client: sending message %s, length %d, hex dump:\n", pgTimerMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
+    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pSendMsg, pSendMsg->msgLength + 1);
+    returnCode = runMessagingClient ((SInt32) atoi (TIMER_SERVER_PORT_STRING), PNULL, pSendMsg, PNULL);
             
-        printDebug ("T  Client: sending message %s, length %d, hex dump:\n", pgTimerMessageNames[pSendMsg->msgType], pSendMsg->msgLength);
-        printHexDump (pSendMsg, pSendMsg->msgLength + 1);
-        returnCode = runMessagingClient ((SInt32) atoi (TIMER_SERVER_PORT_STRING), PNULL, pSendMsg, PNULL);
-                    
-        printDebug ("T  Client: message system returnCode: %d\n", returnCode);
-        if (returnCode == CLIENT_SUCCESS)
-        { 
-            success = true;
-        }
-        free (pSendMsg);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "T  Client: message system returnCode: %d\n", returnCode);
+    if (returnCode == CLIENT_SUCCESS)
+    {
+        success = true;
     }
 
     return success;
@@ -146,10 +143,82 @@ Bool sendStartTimer (UInt32 expiryDeciSeconds, TimerId id, SInt32 sourcePort, Sh
     msg.sourcePort = sourcePort;
     memcpy (&(msg.expiryMsg), pExpiryMsg, sizeof (msg.expiryMsg));
     
-    printDebug ("Starting %d decisecond timer, id %d, sourcePort %d, msg.expiryMsg.msgType 0x%x.\n", expiryDeciSeconds, id, sourcePort, msg.expiryMsg.msgType);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Starting %d decisecond timer, id %d, sourcePort %d, msg.expiryMsg.msgType 0x%x.\n", expiryDeciSeconds, id, sourcePort, msg.expiryMsg.msgType);
     return timerServerSend (TIMER_START_REQ, &msg, sizeof (msg));
 }
 
+/*
+ * Send a Start Timer message to the Timer Server
+ * for a timer with a duration in microseconds,
+ * for when deciseconds are too coarse.
+ *
+ * expiryMicroSeconds the timer duration.
+ * id                 an id for the timer, only
+ *                    required if the timer is ever
+ *                    to be stopped.
+ * sourcePort         the port used by the sending
+ *                    task.
+ * pExpiryMsg         a pointer to the message
+ *                    that will be sent when the timer
+ *                    expires, as for sendStartTimer().
+ *
+ * @return            true if the message send is
+ *                    is successful and the response
+ *                    message indicates success,
+ *                    otherwise false.
+ */
+Bool sendStartTimerUs (UInt32 expiryMicroSeconds, TimerId id, SInt32 sourcePort, ShortMsg *pExpiryMsg)
+{
+    TimerStartUsReq msg;
+
+    ASSERT_PARAM (pExpiryMsg != PNULL, (unsigned long) pExpiryMsg);
+
+    msg.expiryMicroSeconds = expiryMicroSeconds;
+    msg.id = id;
+    msg.sourcePort = sourcePort;
+    memcpy (&(msg.expiryMsg), pExpiryMsg, sizeof (msg.expiryMsg));
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Starting %d microsecond timer, id %d, sourcePort %d, msg.expiryMsg.msgType 0x%x.\n", expiryMicroSeconds, id, sourcePort, msg.expiryMsg.msgType);
+    return timerServerSend (TIMER_START_US_REQ, &msg, sizeof (msg));
+}
+
+/*
+ * Send a Start Periodic Timer message to the Timer
+ * Server: the timer expires every period, each
+ * expiry being a whole number of periods after the
+ * start, however late the one before was, until it
+ * is stopped with sendStopTimer().
+ *
+ * periodMicroSeconds the period, must not be zero.
+ * id                 an id for the timer, to stop
+ *                    it with.
+ * sourcePort         the port used by the sending
+ *                    task.
+ * pExpiryMsg         a pointer to the message
+ *                    that will be sent each time the
+ *                    timer expires, as for sendStartTimer().
+ *
+ * @return            true if the message send is
+ *                    is successful and the response
+ *                    message indicates success,
+ *                    otherwise false.
+ */
+Bool sendStartPeriodicTimer (UInt32 periodMicroSeconds, TimerId id, SInt32 sourcePort, ShortMsg *pExpiryMsg)
+{
+    TimerStartPeriodicReq msg;
+
+    ASSERT_PARAM (periodMicroSeconds > 0, periodMicroSeconds);
+    ASSERT_PARAM (pExpiryMsg != PNULL, (unsigned long) pExpiryMsg);
+
+    msg.periodMicroSeconds = periodMicroSeconds;
+    msg.id = id;
+    msg.sourcePort = sourcePort;
+    memcpy (&(msg.expiryMsg), pExpiryMsg, sizeof (msg.expiryMsg));
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Starting %d microsecond periodic timer, id %d, sourcePort %d, msg.expiryMsg.msgType 0x%x.\n", periodMicroSeconds, id, sourcePort, msg.expiryMsg.msgType);
+    return timerServerSend (TIMER_START_PERIODIC_REQ, &msg, sizeof (msg));
+}
+
 /*
  * Send a Stopt Timer message to the Timer Server.
  * 
@@ -169,6 +238,6 @@ Bool sendStopTimer (TimerId id, SInt32 sourcePort)
     msg.id = id;
     msg.sourcePort = sourcePort;
     
-    printDebug ("Stopping timer id %d, sourcePort %d.\n", id, sourcePort);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Stopping timer id %d, sourcePort %d.\n", id, sourcePort);
     return timerServerSend (TIMER_STOP_REQ, &msg, sizeof (msg));
 }
\ No newline at end of file
@@ -7,45 +7,77 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <signal.h>
 #include <time.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sys/eventfd.h>
+#define DEBUG_MODULE DEBUG_MODULE_TIMER /* Before rob_system.h */
 #include <rob_system.h>
 #include <messaging_server.h>
 #include <messaging_client.h>
 #include <timer_server.h>
 #include <timer_msg_auto.h>
 #include <timer_client.h>
+#include <timer_store.h>
 
 /*
  * MANIFEST CONSTANTS
  */
 
-/* The number of timers that can be simultaneously active */
-#define MAX_NUM_TIMERS 30
-/* Timer tick frequency (100 ms) */
-#define TIMER_INTERVAL_NANOSECONDS 100000000L
+#define NANOSECONDS_PER_DECISECOND 100000000ULL
+#define NANOSECONDS_PER_MICROSECOND 1000ULL
+/* The number of expiries that can wait in the delivery queue,
+ * must be a power of two */
+#define DELIVERY_QUEUE_LENGTH 256
+/* The number of expiries that can be waiting for their
+ * destinations, which come from a fixed pool; while they are
+ * all in use expiries are left in the delivery queue */
+#define PENDING_EXPIRY_POOL_LENGTH (DELIVERY_QUEUE_LENGTH * 4)
+/* How long the expiry thread leaves it before trying again
+ * when the delivery queue is full, whatever timers are
+ * started meanwhile */
+#define DELIVERY_QUEUE_FULL_RETRY_NS 1000000ULL
+/* When an expiry can't be delivered, because its destination
+ * isn't taking them, it is tried again after the first of these
+ * and then after twice as long each time up to the second */
+#define DELIVERY_FIRST_RETRY_NS 1000000ULL
+#define DELIVERY_MAX_RETRY_NS 100000000ULL
+/* An expiry that hasn't been delivered this long after it was
+ * queued is thrown away */
+#define DELIVERY_TIMEOUT_NS 5000000000ULL
 
 /*
  * TYPES
  */
 
-/* A type to hold a timer */
-typedef struct TimerTag
+/* An expiry message and where it goes */
+typedef struct TimerExpiryTag
 {
-    UInt32 expiryTimeDeciSeconds;
-    TimerId id;
     SInt32 sourcePort;
     Msg expiryMsg;
-} Timer;
+} TimerExpiry;
 
-/* A linked list entry holding a timer */
-typedef struct TimerEntryTag
+/* An expiry waiting to be delivered to a destination,
+ * or in the free list of the pool if it isn't */
+typedef struct PendingExpiryTag
 {
-    Timer timer;
-    struct TimerEntryTag * pPrevEntry;
-    struct TimerEntryTag * pNextEntry;
-} TimerEntry;
+    TimerExpiry expiry;
+    uint64_t queuedTimeNs;
+    struct PendingExpiryTag * pNextPending;
+} PendingExpiry;
+
+/* A destination that expiries are delivered to, with the
+ * expiries waiting for it, oldest first; only the sender
+ * thread touches these */
+typedef struct ExpiryDestinationTag
+{
+    SInt32 port;
+    PendingExpiry * pFirstPending;
+    PendingExpiry * pLastPending;
+    uint64_t retryTimeNs;      /* When to try again, 0 if not waiting to */
+    uint64_t retryIntervalNs;
+    struct ExpiryDestinationTag * pNextDestination;
+} ExpiryDestination;
 
 /*
  * EXTERNS
@@ -56,16 +88,29 @@ extern Char *pgTimerMessageNames[];
  * GLOBALS - prefixed with g
  */
 
-/* Head of free timer linked list */
-static TimerEntry * pgFreeTimerListHead = PNULL;
-/* Pointer to head of used timer linked list */
-static TimerEntry * pgUsedTimerListHead = PNULL;
-/* Signal event, timer Id and frequency of expiry */
-static struct itimerspec gIts;
-static struct sigevent gSev;
-static timer_t gTimerId;
-/* Time counter in tenths of a second */
-static UInt32 gTimerTickDeciSeconds = 0;
+/* The running timers */
+static TimerStore gTimerStore;
+/* The thread that waits on the timerfd of the store */
+static pthread_t gExpiryThread;
+static Bool gExpiryThreadExiting = false;
+/* The delivery queue, a ring that the expiry thread puts expiries
+ * into and the sender thread takes them out of, so that neither
+ * waits for the other: only the expiry thread writes the head
+ * and only the sender thread the tail */
+static TimerExpiry gDeliveryQueue[DELIVERY_QUEUE_LENGTH];
+static UInt32 gDeliveryQueueHead = 0;
+static UInt32 gDeliveryQueueTail = 0;
+/* The eventfd the sender thread waits on, written to when
+ * there are expiries in the delivery queue, and the thread */
+static SInt32 gDeliveryEventFd = -1;
+static pthread_t gSenderThread;
+static Bool gSenderThreadExiting = false;
+/* The pool of expiries waiting for their destinations, and
+ * the free list of it; only the sender thread touches these */
+static PendingExpiry gPendingExpiryPool[PENDING_EXPIRY_POOL_LENGTH];
+static PendingExpiry * pgFreePendingExpiries = PNULL;
+/* The destinations that expiries have been delivered to */
+static ExpiryDestination * pgExpiryDestinations = PNULL;
 /* Mutex to protect linked list manipulation */
 pthread_mutex_t lockLinkedLists;
 
@@ -73,43 +118,6 @@ pthread_mutex_t lockLinkedLists;
  * STATIC FUNCTIONS
  */
 
-/*
- * Print the used timer list for debug purposes.
- * 
- * IMPORTANT: the lockLinkedLists mutex MUST be held
- * by the calling function!!!  It is not grabbed
- * here as this function is only called from places
- * where it is already held and recursive mutexes appear
- * to be only unreliably present in Linux.
- * 
- */
-void printDebugUsedTimerListUnprotected (void)
-{
-    UInt32 x;
-    TimerEntry * pEntry = pgUsedTimerListHead;
-
-    if (pgUsedTimerListHead == PNULL)
-    {
-        printDebug ("No timers running (pgUsedTimerListHead 0x%08x):\n", pgUsedTimerListHead);
-    }
-    else
-    {
-        printDebug ("Timers running (pgUsedTimerListHead 0x%08x):\n", pgUsedTimerListHead);
-        for (x = 0; (pEntry != PNULL) && (x < MAX_NUM_TIMERS); x++)
-        {
-            printDebug (" %d (0x%08x): expires %d, id %d/%d, expiryMsg.msgType 0x%08x, next 0x%08x.\n",
-                        x,
-                        &(pEntry->timer),
-                        pEntry->timer.expiryTimeDeciSeconds,
-                        pEntry->timer.sourcePort,
-                        pEntry->timer.id,
-                        pEntry->timer.expiryMsg.msgType,
-                        pEntry->pNextEntry);
-            pEntry = pEntry->pNextEntry;
-        }
-    }
-}
-
 /*
  * Get the process time in nanosecond resolution.
  * 
@@ -129,26 +137,31 @@ UInt32 getProcessTimeNanoSeconds (void)
 }
 
 /*
- * Send a timer expiry message.
+ * Send timer expiry messages to a destination,
+ * in one datagram, without waiting.
  * 
- * pTimer   the timer related to the
- *          expiry message to send.
+ * port     the destination.
+ * ppMsgs   the messages, oldest first.
+ * numMsgs  the number of them, at most
+ *          MESSAGING_MAX_MSGS_PER_DATAGRAM.
  * 
  * @return  true if the message send is
  *          is successful, otherwise false.
  */
-static Bool sendTimerExpiryMsg (Timer *pTimer)
+static Bool sendTimerExpiryMsgs (SInt32 port, Msg **ppMsgs, UInt32 numMsgs)
 {
     ClientReturnCode returnCode;
     Bool success = false;
 
-    ASSERT_PARAM (pTimer != PNULL, (unsigned long) pTimer); 
+    ASSERT_PARAM (ppMsgs != PNULL, (unsigned long) ppMsgs);
 
-    printDebug ("Timer Server: sending expiry message to port %d, msgType 0x%08x, length %d, hex dump:\n", pTimer->sourcePort, pTimer->expiryMsg.msgType, pTimer->expiryMsg.msgLength);
-    printHexDump (&(pTimer->expiryMsg), pTimer->expiryMsg.msgLength + 1);
-    returnCode = runMessagingClient (pTimer->sourcePort, PNULL, &(pTimer->expiryMsg), PNULL);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Timer Server: sending %d expiry message(s) to port %d, the first msgType 0x%08x, length %d, hex dump:\n", numMsgs, port, ppMsgs[0]->msgType, ppMsgs[0]->msgLength);
+    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, ppMsgs[0], ppMsgs[0]->msgLength + 1);
+    /* No response is needed so they go as a datagram, and if
+     * that can't be sent now the sender thread tries again later */
+    returnCode = trySendMessagingClientDatagram ((UInt16) port, ppMsgs, numMsgs);
                 
-    printDebug ("Timer Server: message system returnCode: %d\n", returnCode);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "Timer Server: message system returnCode: %d\n", returnCode);
     if (returnCode == CLIENT_SUCCESS)
     { 
         success = true;
@@ -158,317 +171,430 @@ static Bool sendTimerExpiryMsg (Timer *pTimer)
 }
 
 /*
- * Free a timer.  The timer must exist.
+ * Put the expiry of a timer into the delivery
+ * queue.  Only ever called by the expiry thread.
  *
- * IMPORTANT: the lockLinkedLists mutex MUST be held
- * by the calling function!!!  It is not grabbed
- * here as this function is only called from places
- * where it is already held and recursive mutexes appear
- * to be only unreliably present in Linux.
- * 
- * pTimer  a pointer to the timer.
+ * pTimer   the timer that has expired.
+ *
+ * @return  true if there was room, otherwise false.
  */
-static void freeTimerUnprotected (Timer *pTimer)
+static Bool queueTimerExpiry (Timer *pTimer)
 {
-    UInt32 x = 0;
-    TimerEntry * pEntry = pgUsedTimerListHead;
-    TimerEntry * pPrevEntry = PNULL;
+    UInt32 head = gDeliveryQueueHead;
+    TimerExpiry * pExpiry;
+    Bool success = false;
 
-    ASSERT_PARAM (pTimer != PNULL, (unsigned long) pTimer);
+    if (head - __atomic_load_n (&gDeliveryQueueTail, __ATOMIC_ACQUIRE) < DELIVERY_QUEUE_LENGTH)
+    {
+        pExpiry = &(gDeliveryQueue[head & (DELIVERY_QUEUE_LENGTH - 1)]);
+        pExpiry->sourcePort = pTimer->sourcePort;
+        memcpy (&(pExpiry->expiryMsg), &(pTimer->expiryMsg), sizeof (pExpiry->expiryMsg));
+        __atomic_store_n (&gDeliveryQueueHead, head + 1, __ATOMIC_RELEASE);
+        success = true;
+    }
+
+    return success;
+}
 
-    printDebug ("freeTimer: freeing the timer at 0x%08x...\n", pTimer);
+/*
+ * Wake up the sender thread.
+ */
+static void wakeSenderThread (void)
+{
+    uint64_t one = 1;
 
-    /* Find the entry in the list */
-    for (x = 0; (pEntry != PNULL) && (&(pEntry->timer) != pTimer) && (x < MAX_NUM_TIMERS); x++)
+    if (write (gDeliveryEventFd, &one, sizeof (one)) != sizeof (one))
     {
-        pEntry = pEntry->pNextEntry;
+        ASSERT_ALWAYS_STRING ("wakeSenderThread: failed write().");
     }
+}
 
-    if ((pEntry != PNULL) && (&(pEntry->timer) == pTimer))
-    {
-        TimerEntry * pWantedEntry = pEntry;
-        TimerEntry ** ppEntry = PNULL;
+/*
+ * Find the destination for a port, making it
+ * if there isn't one.  Only ever called by the
+ * sender thread.
+ *
+ * port     the port.
+ *
+ * @return  the destination, PNULL if there
+ *          isn't one and one couldn't be made.
+ */
+static ExpiryDestination * getExpiryDestination (SInt32 port)
+{
+    ExpiryDestination * pDestination = pgExpiryDestinations;
 
-        printDebug ("freeTimer: found the timer.\n");
-        /* Unlink it from the used list */
-        memset (&(pWantedEntry->timer), 0, sizeof (pWantedEntry->timer));
-        printDebug ("freeTimer: moving entry to free list.\n");
-        /* Link the previous entry's next entry pointer to the one ahead of this */
-        if (pWantedEntry->pPrevEntry != PNULL)
-        {
-            pWantedEntry->pPrevEntry->pNextEntry = pWantedEntry->pNextEntry;
-        }
-        /* If it is the first entry in the list that is expiring, move the head */
-        if (pWantedEntry == pgUsedTimerListHead)
-        {
-            pgUsedTimerListHead = pWantedEntry->pNextEntry;
-        }
-        /* Now link the next entry's previous entry pointer to the one before this */
-        if (pWantedEntry->pNextEntry != PNULL)
-        {
-            pWantedEntry->pNextEntry->pPrevEntry = pWantedEntry->pPrevEntry;
-        }
+    while ((pDestination != PNULL) && (pDestination->port != port))
+    {
+        pDestination = pDestination->pNextDestination;
+    }
 
-        /* Put it on the end of the free list. TODO putting it on the front would be quicker */
-        ppEntry = &pgFreeTimerListHead;
-        for (x = 0; (*ppEntry != PNULL) && (x < MAX_NUM_TIMERS); x++)
-        {
-            pPrevEntry = *ppEntry;
-            ppEntry = &((*ppEntry)->pNextEntry);
-        }
-        if (*ppEntry == PNULL)
-        {
-            *ppEntry = pWantedEntry;
-            pWantedEntry->pPrevEntry = pPrevEntry;
-            pWantedEntry->pNextEntry = PNULL;
-        }
-        else
+    if (pDestination == PNULL)
+    {
+        pDestination = (ExpiryDestination *) calloc (1, sizeof (ExpiryDestination));
+        if (pDestination != PNULL)
         {
-            ASSERT_ALWAYS_PARAM (x);   
+            pDestination->port = port;
+            pDestination->pNextDestination = pgExpiryDestinations;
+            pgExpiryDestinations = pDestination;
         }
     }
-    else
-    {
-        ASSERT_ALWAYS_PARAM ((UInt32) pTimer);
-    }
+
+    return pDestination;
 }
 
 /*
- * Handle a periodic timer callback from the OS.
- * Increment the deci-second counter and see if
- * any timers have expired.
+ * Take everything out of the delivery queue and
+ * put it on the end of the list for its destination,
+ * or as much as there is room for in the pool.
+ * Only ever called by the sender thread.
+ *
+ * nowNs  the time now.
  */
-static void tickHandlerCallback (sigval_t sv)
+static void takeFromDeliveryQueue (uint64_t nowNs)
 {
-    UInt32 x = 0;
-    TimerEntry * pEntry;
-    UInt32 tickProcessingStartNanoSeconds;
-    
-    UNUSED (sv);
-
-    tickProcessingStartNanoSeconds = getProcessTimeNanoSeconds();
+    UInt32 tail = gDeliveryQueueTail;
+    TimerExpiry * pExpiry;
+    ExpiryDestination * pDestination;
+    PendingExpiry * pPending;
 
-    gTimerTickDeciSeconds++;
-    
-    /* Wrap is several years so don't need to deal with it */
-
-    printDebug ("Tick %d.\n", gTimerTickDeciSeconds);
-    
-    if (pthread_mutex_trylock (&lockLinkedLists) == 0)
+    while ((tail != __atomic_load_n (&gDeliveryQueueHead, __ATOMIC_ACQUIRE)) && (pgFreePendingExpiries != PNULL))
     {
-        pEntry = pgUsedTimerListHead; /* Need to assign this here as it may have been changed by whoever held the lock */
-        for (x = 0; (pEntry != PNULL) && (x < (MAX_NUM_TIMERS)); x++)
+        pExpiry = &(gDeliveryQueue[tail & (DELIVERY_QUEUE_LENGTH - 1)]);
+        pDestination = getExpiryDestination (pExpiry->sourcePort);
+        if (pDestination != PNULL)
         {
-            if (pEntry->timer.expiryTimeDeciSeconds <= gTimerTickDeciSeconds)
+            pPending = pgFreePendingExpiries;
+            pgFreePendingExpiries = pPending->pNextPending;
+            memcpy (&(pPending->expiry), pExpiry, sizeof (pPending->expiry));
+            pPending->queuedTimeNs = nowNs;
+            pPending->pNextPending = PNULL;
+            if (pDestination->pLastPending != PNULL)
             {
-                Timer * pTimer = &(pEntry->timer);
-    
-                printDebug ("tickHandler: %d decisecond timer at 0x%08x expired.\n", pEntry->timer.expiryTimeDeciSeconds, &(pEntry->timer));
-                
-                /* Timer has expired, send a message back */
-                sendTimerExpiryMsg (pTimer);
-                
-                /* Move to the next entry and then free this timer entry */
-                pEntry = pEntry->pNextEntry;
-                freeTimerUnprotected (pTimer);
-                printDebugUsedTimerListUnprotected();
+                pDestination->pLastPending->pNextPending = pPending;
             }
             else
             {
-                pEntry = pEntry->pNextEntry;
+                pDestination->pFirstPending = pPending;
             }
+            pDestination->pLastPending = pPending;
         }
-        
-        pthread_mutex_unlock (&lockLinkedLists);
-        printDebug ("tickHandler: processing took %d microsecond(s).\n", (getProcessTimeNanoSeconds() - tickProcessingStartNanoSeconds) / 1000);
+        else
+        {
+            printProgress ("Timer server: no memory, expiry for port %d thrown away.\n", pExpiry->sourcePort);
+        }
+        tail++;
+        __atomic_store_n (&gDeliveryQueueTail, tail, __ATOMIC_RELEASE);
     }
-    else
+}
+
+/*
+ * Take the first expiry off the list of a destination
+ * and put it back in the pool.
+ *
+ * pDestination  the destination, which must have
+ *               an expiry waiting.
+ */
+static void freeFirstPendingExpiry (ExpiryDestination *pDestination)
+{
+    PendingExpiry * pPending = pDestination->pFirstPending;
+
+    pDestination->pFirstPending = pPending->pNextPending;
+    if (pDestination->pFirstPending == PNULL)
     {
-        printDebug ("tickHandler: lists locked, skipping at tick %d.\n", gTimerTickDeciSeconds);
+        pDestination->pLastPending = PNULL;
     }
+    pPending->pNextPending = pgFreePendingExpiries;
+    pgFreePendingExpiries = pPending;
 }
 
 /*
- * Sort the list of user timers so that the ones
- * going to expires soonest are at the start using
- * a simple bubble sort.
+ * Deliver what is waiting for a destination, in the
+ * order it expired, as many as will go in a datagram
+ * at a time, until it is all delivered or a datagram
+ * won't go, in which case another go is had later,
+ * leaving it longer each time.  Whatever has been
+ * waiting for longer than DELIVERY_TIMEOUT_NS is
+ * thrown away.  Only ever called by the sender thread.
  *
- * IMPORTANT: the lockLinkedLists mutex MUST be held
- * by the calling function!!!  It is not grabbed
- * here as this function is only called from places
- * where it is already held and recursive mutexes appear
- * to be only unreliably present in Linux.
+ * pDestination  the destination.
+ * nowNs         the time now.
  */
-static void sortUsedListUnprotected (void)
+static void deliverToDestination (ExpiryDestination *pDestination, uint64_t nowNs)
 {
-    UInt32 x = 0;
-    UInt32 i = 0;
-    UInt32 z = 0;
-    TimerEntry * pEntry = pgUsedTimerListHead;
-    UInt32 sortingStartNanoSeconds;
+    Msg * pMsgs[MESSAGING_MAX_MSGS_PER_DATAGRAM];
+    PendingExpiry * pPending;
+    UInt32 numMsgs;
+    UInt32 numThrownAway = 0;
+    Bool blocked = false;
 
-    sortingStartNanoSeconds = getProcessTimeNanoSeconds();
-
-    printDebug ("sortUsedList: starting...\n");
-    for (x = 0; (pEntry != PNULL) && (x < (MAX_NUM_TIMERS * MAX_NUM_TIMERS)); x++)
+    while ((pDestination->pFirstPending != PNULL) && !blocked)
     {
-        if ((pEntry->pNextEntry != PNULL) && (pEntry->timer.expiryTimeDeciSeconds > pEntry->pNextEntry->timer.expiryTimeDeciSeconds))
+        if (nowNs - pDestination->pFirstPending->queuedTimeNs >= DELIVERY_TIMEOUT_NS)
         {
-            TimerEntry * pThisEntry = pEntry;
-            TimerEntry * pNextEntry = pEntry->pNextEntry;
-
-            z++;
-            printDebug ("sortUsedList: swapping entry %d (%d, 0x%08x) with entry %d (%d, 0x%08x).\n", i, pEntry->timer.expiryTimeDeciSeconds, &(pEntry->timer), i + 1, pNextEntry->timer.expiryTimeDeciSeconds, &(pNextEntry->timer));
-            /* If this entry has a later expiry time than the next one, swap them */
-            if (pThisEntry->pPrevEntry != PNULL)
+            freeFirstPendingExpiry (pDestination);
+            numThrownAway++;
+        }
+        else
+        {
+            /* Everything that has expired for this destination goes in one */
+            numMsgs = 0;
+            for (pPending = pDestination->pFirstPending; (pPending != PNULL) && (numMsgs < MESSAGING_MAX_MSGS_PER_DATAGRAM); pPending = pPending->pNextPending)
             {
-                pThisEntry->pPrevEntry->pNextEntry = pNextEntry;
+                pMsgs[numMsgs] = &(pPending->expiry.expiryMsg);
+                numMsgs++;
             }
-            if (pNextEntry->pNextEntry != PNULL)
+            if (sendTimerExpiryMsgs (pDestination->port, pMsgs, numMsgs))
             {
-                pNextEntry->pNextEntry->pPrevEntry = pThisEntry;
+                while (numMsgs > 0)
+                {
+                    freeFirstPendingExpiry (pDestination);
+                    numMsgs--;
+                }
+                pDestination->retryIntervalNs = 0;
             }
-            pThisEntry->pNextEntry = pNextEntry->pNextEntry;
-            pNextEntry->pPrevEntry = pThisEntry->pPrevEntry;
-            pThisEntry->pPrevEntry = pNextEntry;
-            pNextEntry->pNextEntry = pThisEntry;            
-            
-            /* If we have just changed the head, swap it around too */
-            if (pThisEntry == pgUsedTimerListHead)
+            else
             {
-                pgUsedTimerListHead = pNextEntry;
+                blocked = true;
+                if (pDestination->retryIntervalNs == 0)
+                {
+                    pDestination->retryIntervalNs = DELIVERY_FIRST_RETRY_NS;
+                }
+                else if (pDestination->retryIntervalNs < DELIVERY_MAX_RETRY_NS)
+                {
+                    pDestination->retryIntervalNs *= 2;
+                }
+                pDestination->retryTimeNs = nowNs + pDestination->retryIntervalNs;
             }
-            
-            /* Restart the sort from the beginning */
-            pEntry = pgUsedTimerListHead;
-            i = 0;
-        }
-        else
-        {
-            pEntry = pEntry->pNextEntry;
-            i++;
         }
     }
-    
-    if (x == MAX_NUM_TIMERS * MAX_NUM_TIMERS)
+
+    if (!blocked)
     {
-        printDebug ("sortUsedList: WARNING, sorting the timer list hit the buffers (%d iteration(s) (%d swap(s)), %d microsecond(s)).\n", x, z, (getProcessTimeNanoSeconds() - sortingStartNanoSeconds) / 1000);
+        pDestination->retryTimeNs = 0;
     }
-    else
+
+    if (numThrownAway > 0)
     {
-        printDebug ("sortUsedList: sorting the timer list took %d iteration(s) (%d swap(s)), %d microsecond(s).\n", x, z, (getProcessTimeNanoSeconds() - sortingStartNanoSeconds) / 1000);        
+        printProgress ("Timer server: port %d not taking expiries, %d thrown away.\n", pDestination->port, numThrownAway);
     }
-    printDebugUsedTimerListUnprotected();
 }
 
 /*
- * Allocate a timer and re-sort the timer list.
- * 
- * periodDeciSeconds  the timer period in deciSeconds
- * sourcePort         the port to send the expiry message to
- * id                 the id for the timer
- * pExpiryMsg         a pointer to the expiry message to send
- * 
- * @return  a pointer to the timer or PNULL if
- *          unable to allocate one.
+ * The thread that delivers expiries, taking them out
+ * of the delivery queue and sending them, so that a
+ * destination that isn't taking them only holds up
+ * its own.  It waits on gDeliveryEventFd and, when
+ * there are expiries to try again, for the first
+ * of them to be due.
+ *
+ * pArg  not used.
+ *
+ * @return  PNULL.
  */
-static Timer * allocTimer (UInt32 periodDeciSeconds, SInt32 sourcePort, TimerId id, ShortMsg * pExpiryMsg)
+static void * senderThread (void *pArg)
 {
-    Timer * pAlloc = PNULL;
-    UInt32 x = 0;
-    TimerEntry * pEntry;
-    TimerEntry * pPrevEntry = PNULL;
+    struct pollfd pollFd;
+    uint64_t count;
+    uint64_t nowNs;
+    uint64_t retryTimeNs;
+    SInt32 timeoutMs;
+    ExpiryDestination * pDestination;
+    UInt32 x;
+    Bool exiting = false;
 
-    ASSERT_PARAM (pExpiryMsg != PNULL, (unsigned long) pExpiryMsg);
-    
-    pthread_mutex_lock (&lockLinkedLists);
-    pEntry = pgFreeTimerListHead; /* Assign this here in case it has been changed by whoever held the lock */
+    UNUSED (pArg);
 
-    printDebug ("allocTimer: finding entry in the free list...\n");
-    /* Find the entry at the end of the free list. TODO quicker to take it from the front */
-    for (x = 0; (pEntry != PNULL) && (x < MAX_NUM_TIMERS); x++)
+    pgFreePendingExpiries = PNULL;
+    for (x = 0; x < PENDING_EXPIRY_POOL_LENGTH; x++)
     {
-        pPrevEntry = pEntry;
-        pEntry = pEntry->pNextEntry;
+        gPendingExpiryPool[x].pNextPending = pgFreePendingExpiries;
+        pgFreePendingExpiries = &(gPendingExpiryPool[x]);
     }
 
-    /* If there is one, move it to the used list */
-    if (pPrevEntry != PNULL)
+    pollFd.fd = gDeliveryEventFd;
+    pollFd.events = POLLIN;
+    while (!exiting)
     {
-        TimerEntry * pWantedEntry = pPrevEntry;
-        TimerEntry ** ppEntry = PNULL;
+        /* Wait for ever unless something is to be tried again */
+        retryTimeNs = 0;
+        for (pDestination = pgExpiryDestinations; pDestination != PNULL; pDestination = pDestination->pNextDestination)
+        {
+            if ((pDestination->retryTimeNs != 0) && ((retryTimeNs == 0) || (pDestination->retryTimeNs < retryTimeNs)))
+            {
+                retryTimeNs = pDestination->retryTimeNs;
+            }
+        }
+        timeoutMs = -1;
+        if (retryTimeNs != 0)
+        {
+            nowNs = getMonotonicNs();
+            timeoutMs = 0;
+            if (retryTimeNs > nowNs)
+            {
+                timeoutMs = (SInt32) ((retryTimeNs - nowNs + 999999) / 1000000);
+            }
+        }
+        /* Don't wait if expiries were left in the delivery queue
+         * for want of room in the pool and now there is some */
+        if ((pgFreePendingExpiries != PNULL) && (gDeliveryQueueTail != __atomic_load_n (&gDeliveryQueueHead, __ATOMIC_ACQUIRE)))
+        {
+            timeoutMs = 0;
+        }
 
-        /* Unlink it from the end of the free list */
-        if (pWantedEntry->pPrevEntry != PNULL)
+        if ((poll (&pollFd, 1, timeoutMs) > 0) && (read (gDeliveryEventFd, &count, sizeof (count)) != sizeof (count)))
         {
-            pWantedEntry->pPrevEntry->pNextEntry = pWantedEntry->pNextEntry;
+            ASSERT_ALWAYS_STRING ("senderThread: failed read().");
         }
-        if (pWantedEntry == pgFreeTimerListHead) /* Deal with empty free list case */
+
+        exiting = __atomic_load_n (&gSenderThreadExiting, __ATOMIC_ACQUIRE);
+        if (!exiting)
         {
-            pgFreeTimerListHead = PNULL;
-        }        
+            nowNs = getMonotonicNs();
+            takeFromDeliveryQueue (nowNs);
+            for (pDestination = pgExpiryDestinations; pDestination != PNULL; pDestination = pDestination->pNextDestination)
+            {
+                if ((pDestination->pFirstPending != PNULL) && (pDestination->retryTimeNs <= nowNs))
+                {
+                    deliverToDestination (pDestination, nowNs);
+                }
+            }
+        }
+    }
 
-        /* Attach it to the end of the used list */
-        ppEntry = &pgUsedTimerListHead;
-        pPrevEntry = PNULL;
-        for (x = 0; (*ppEntry != PNULL) && (x < MAX_NUM_TIMERS); x++)
+    /* Throw away anything not delivered */
+    while (pgExpiryDestinations != PNULL)
+    {
+        pDestination = pgExpiryDestinations;
+        pgExpiryDestinations = pDestination->pNextDestination;
+        while (pDestination->pFirstPending != PNULL)
         {
-            pPrevEntry = *ppEntry; 
-            ppEntry = &((*ppEntry)->pNextEntry);
+            freeFirstPendingExpiry (pDestination);
         }
+        free (pDestination);
+    }
+
+    return PNULL;
+}
 
-        if (*ppEntry == PNULL)
+/*
+ * Put the expiries of all the timers that have expired
+ * into the delivery queue, for the sender thread to
+ * deliver, and be done with them.  If the delivery
+ * queue fills up those left are done a little later.
+ *
+ * IMPORTANT: the lockLinkedLists mutex MUST be held
+ * by the calling function!!!
+ */
+static void expireTimersUnprotected (void)
+{
+    Timer * pTimer;
+    UInt32 processingStartNanoSeconds = 0;
+    uint64_t nowNs = getMonotonicNs();
+    UInt32 numQueued = 0;
+    Bool queueIsFull = false;
+    TraceSpan span;
+
+    /* Only timed for debug */
+    if (DEBUG_IS_ON (DEBUG_LEVEL_TRACE))
+    {
+        processingStartNanoSeconds = getProcessTimeNanoSeconds();
+    }
+
+    TRACE_SPAN_BEGIN (&span, "timer expiry", gTimerStore.numTimers);
+    pTimer = getExpiredTimer (&gTimerStore, nowNs);
+    while ((pTimer != PNULL) && !queueIsFull)
+    {
+        /* Timer has expired, queue the message to go back */
+        if (queueTimerExpiry (pTimer))
         {
-            *ppEntry = pWantedEntry;
-            pWantedEntry->pPrevEntry = pPrevEntry;
-            pWantedEntry->pNextEntry = PNULL;
-            pAlloc = &(pWantedEntry->timer);
-            
-            /* Copy the data in */
-            pAlloc->expiryTimeDeciSeconds = gTimerTickDeciSeconds + periodDeciSeconds;
-            pAlloc->id = id;
-            pAlloc->sourcePort = sourcePort;
-            memcpy (&(pAlloc->expiryMsg), pExpiryMsg, sizeof (pAlloc->expiryMsg));
-
-            printDebug ("allocTimer: timer should expire at tick %d.\n", pAlloc->expiryTimeDeciSeconds);
-
-            /* Now sort the list */
-            sortUsedListUnprotected();
+            numQueued++;
+            finishExpiredTimer (&gTimerStore, nowNs);
+            pTimer = getExpiredTimer (&gTimerStore, nowNs);
         }
         else
         {
-            ASSERT_ALWAYS_PARAM (x);   
+            queueIsFull = true;
         }
     }
-    
-    pthread_mutex_unlock (&lockLinkedLists);
 
-    return pAlloc;
+    if (numQueued > 0)
+    {
+        wakeSenderThread();
+    }
+
+    if (queueIsFull)
+    {
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "expireTimers: delivery queue full, %d timer(s) left for later.\n", gTimerStore.numTimers);
+        setTimerStoreFdNotBefore (&gTimerStore, nowNs + DELIVERY_QUEUE_FULL_RETRY_NS);
+    }
+    else
+    {
+        setTimerStoreFdNotBefore (&gTimerStore, 0);
+    }
+    TRACE_SPAN_END (&span);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "expireTimers: processing took %d microsecond(s).\n", (getProcessTimeNanoSeconds() - processingStartNanoSeconds) / 1000);
 }
 
 /*
- * Empty the used timer list
+ * The thread that waits on the timerfd.  It only
+ * wakes up when the timer at the top of the heap
+ * is due, or when told to exit, so when no timers
+ * are running the timer server doesn't wake up at all.
+ *
+ * pArg  not used.
+ *
+ * @return  PNULL.
  */
-static void freeAllTimers (void)
+static void * expiryThread (void *pArg)
 {
-    UInt32 x;
-    TimerEntry * pEntry;
-    TimerEntry * pNextEntry = PNULL;
+    uint64_t numExpiries;
+    Bool exiting = false;
 
-    pthread_mutex_lock (&lockLinkedLists);
-    pEntry = pgUsedTimerListHead; /* Assign this here in case it has been changed by whoever held the lock */
+    UNUSED (pArg);
 
-    printDebug ("freeAllTimers: freeing all timers.\n");
-    
-    for (x = 0; (pEntry != PNULL) && (x < MAX_NUM_TIMERS); x++)
+    while (!exiting)
     {
-        pNextEntry = pEntry->pNextEntry;
-        freeTimerUnprotected (&(pEntry->timer));
-        pEntry = pNextEntry;
+        /* Blocks until the timerfd goes off, EINTR just goes round again */
+        if (read (gTimerStore.timerFd, &numExpiries, sizeof (numExpiries)) == sizeof (numExpiries))
+        {
+            pthread_mutex_lock (&lockLinkedLists);
+            noteTimerStoreFdGoneOff (&gTimerStore);
+            exiting = gExpiryThreadExiting;
+            if (!exiting)
+            {
+                expireTimersUnprotected();
+            }
+            pthread_mutex_unlock (&lockLinkedLists);
+        }
     }
-    pgUsedTimerListHead = PNULL;
 
+    return PNULL;
+}
+
+/*
+ * Allocate a timer and put it in the store.
+ * 
+ * expiryTimeNs  when the timer expires, against
+ *               getMonotonicNs()
+ * periodNs      how often it expires after that,
+ *               0 if it doesn't
+ * sourcePort    the port to send the expiry message to
+ * id            the id for the timer
+ * pExpiryMsg    a pointer to the expiry message to send
+ * 
+ * @return  a pointer to the timer or PNULL if
+ *          unable to allocate one.
+ */
+static Timer * allocTimer (uint64_t expiryTimeNs, uint64_t periodNs, SInt32 sourcePort, TimerId id, ShortMsg * pExpiryMsg)
+{
+    Timer * pAlloc;
+    
+    pthread_mutex_lock (&lockLinkedLists);
+    pAlloc = addTimer (&gTimerStore, expiryTimeNs, periodNs, sourcePort, id, pExpiryMsg);
     pthread_mutex_unlock (&lockLinkedLists);
+
+    return pAlloc;
 }
 
 /*
@@ -476,66 +602,35 @@ static void freeAllTimers (void)
  */
 static void actionTimerServerStart (void)
 {
-    UInt32 x;
-    TimerEntry ** ppEntry = &pgFreeTimerListHead;
-    TimerEntry * pPrevEntry = PNULL;
-
     /* Create the mutex */
     if (pthread_mutex_init (&lockLinkedLists, NULL) != 0)
     {
         ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed pthread_mutex_init().");
     }
     
-    /* Create a malloc()ed free list */
-    for (x = 0; x < MAX_NUM_TIMERS; x++)
+    /* Create the eventfd that the sender thread waits on, and the thread */
+    gDeliveryEventFd = eventfd (0, EFD_CLOEXEC);
+    if (gDeliveryEventFd < 0)
     {
-        *ppEntry = (TimerEntry *) malloc (sizeof (TimerEntry));
-        if (*ppEntry != PNULL)
-        {
-            memset (*ppEntry, 0, sizeof (**ppEntry));
-            /* Link it in */
-            (*ppEntry)->pPrevEntry = pPrevEntry;
-            (*ppEntry)->pNextEntry = PNULL;
-            if (pPrevEntry != PNULL)
-            {
-                pPrevEntry->pNextEntry = *ppEntry;
-            }
-            pPrevEntry = *ppEntry;
+        ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed eventfd().");
+    }
+    gSenderThreadExiting = false;
+    if (pthread_create (&gSenderThread, PNULL, senderThread, PNULL) != 0)
+    {
+        ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed pthread_create().");
+    }
 
-            /* Next */
-            ppEntry = &((*ppEntry)->pNextEntry);
-        }
-        else
-        {
-            ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed malloc().");
-        }
+    /* Open the store, the timerfd of which is armed as timers
+     * are started, and create the thread that waits on it */
+    if (!openTimerStore (&gTimerStore, false))
+    {
+        ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed openTimerStore().");
     }
-    
-    /* The following code is taken from the example at
-     * http://man7.org/linux/man-pages/man2/timer_create.2.html
-     * but modified to call a handler rather than send a signal
-     * 'cos we already use the signalling for our messaging */
-    
-    /* Create the tick event */
-    gSev.sigev_notify = SIGEV_THREAD;
-    gSev.sigev_value.sival_ptr = &gTimerId;
-    gSev.sigev_notify_function = tickHandlerCallback;
-    gSev.sigev_notify_attributes = PNULL;
-    if (timer_create (CLOCK_MONOTONIC, &gSev, &gTimerId) != 0)
+    gExpiryThreadExiting = false;
+    if (pthread_create (&gExpiryThread, PNULL, expiryThread, PNULL) != 0)
     {
-        ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed timer_create().");        
+        ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed pthread_create().");
     }
-    
-    /* Start the timer */
-     gIts.it_value.tv_sec = TIMER_INTERVAL_NANOSECONDS / 1000000000;
-     gIts.it_value.tv_nsec = TIMER_INTERVAL_NANOSECONDS % 1000000000;
-     gIts.it_interval.tv_sec = gIts.it_value.tv_sec;
-     gIts.it_interval.tv_nsec = gIts.it_value.tv_nsec;
-
-     if (timer_settime (gTimerId, 0, &gIts, PNULL) != 0)
-     {
-         ASSERT_ALWAYS_STRING ("actionTimerServerStart: failed timer_settime().");                 
-     }
 }
 
 /*
@@ -543,29 +638,28 @@ static void actionTimerServerStart (void)
  */
 static void actionTimerServerStop (void)
 {
-    UInt32 x = 0;
-    TimerEntry * pEntry;
-
-    /* Return used timers to the free list */
-    freeAllTimers ();
-
+    /* Return used timers to the free list, then wake the
+     * expiry thread up, by having the timerfd go off straight
+     * away, a time long gone, and wait for it to exit */
     pthread_mutex_lock (&lockLinkedLists);
-    pEntry = pgFreeTimerListHead; /* Assign this here in case it has been changed by whoever held the lock */
-    
-    /* Free the free list */
-    for (x = 0; (pEntry != PNULL) && (x < MAX_NUM_TIMERS); x++)
-    {
-        TimerEntry * pNextEntry = pEntry->pNextEntry;
-        free (pEntry);
-        pEntry = pNextEntry;
-    }
-    pgFreeTimerListHead = PNULL;
-    
-    if (timer_delete (gTimerId) != 0)
-    {
-        ASSERT_ALWAYS_STRING ("actionTimerServerStop: failed timer_delete().");                 
-    }
-
+    removeAllTimers (&gTimerStore);
+    gExpiryThreadExiting = true;
+    armTimerStoreFdAt (&gTimerStore, 1);
+    pthread_mutex_unlock (&lockLinkedLists);
+    pthread_join (gExpiryThread, PNULL);
+
+    /* Then the sender thread, which throws away anything it hasn't delivered */
+    __atomic_store_n (&gSenderThreadExiting, true, __ATOMIC_RELEASE);
+    wakeSenderThread();
+    pthread_join (gSenderThread, PNULL);
+    close (gDeliveryEventFd);
+    gDeliveryEventFd = -1;
+    gDeliveryQueueHead = 0;
+    gDeliveryQueueTail = 0;
+
+    /* Free the free list, the heap and the hash table and close the timerfd */
+    pthread_mutex_lock (&lockLinkedLists);
+    closeTimerStore (&gTimerStore);
     pthread_mutex_unlock (&lockLinkedLists);
     
     /* Destroy the mutex */
@@ -581,21 +675,77 @@ static void actionTimerStart (TimerStartReq *pTimerStartReq)
 {
     Timer * pTimer;
     
-    printDebug ("actionTimerStart: starting a timer of duration %d 10ths of a second (from port %d, id %d, expiryMsg.msgType 0x%08x).\n",
-                pTimerStartReq->expiryDeciSeconds,
-                pTimerStartReq->sourcePort,
-                pTimerStartReq->id,
-                pTimerStartReq->expiryMsg.msgType);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "actionTimerStart: starting a timer of duration %d 10ths of a second (from port %d, id %d, expiryMsg.msgType 0x%08x).\n",
+                                   pTimerStartReq->expiryDeciSeconds,
+                                   pTimerStartReq->sourcePort,
+                                   pTimerStartReq->id,
+                                   pTimerStartReq->expiryMsg.msgType);
 
     /* Allocate a timer and fill the data in */
-    pTimer = allocTimer (pTimerStartReq->expiryDeciSeconds, pTimerStartReq->sourcePort, pTimerStartReq->id, &(pTimerStartReq->expiryMsg));
+    pTimer = allocTimer (getMonotonicNs() + (pTimerStartReq->expiryDeciSeconds * NANOSECONDS_PER_DECISECOND), 0, pTimerStartReq->sourcePort, pTimerStartReq->id, &(pTimerStartReq->expiryMsg));
     if (pTimer != PNULL)
     {
-        printDebug ("actionTimerStart: allocated a timer at 0x%08x.\n", pTimer);
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "actionTimerStart: allocated a timer at 0x%08x.\n", pTimer);
     }
     else
     {
         ASSERT_ALWAYS_STRING ("actionTimerStart: unable to allocate a timer.");        
+    }
+}
+
+/*
+ * Handle a message that will start a timer
+ * with a duration in microseconds.
+ *
+ * pTimerStartUsReq  the timer start request message.
+ */
+static void actionTimerStartUs (TimerStartUsReq *pTimerStartUsReq)
+{
+    Timer * pTimer;
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "actionTimerStartUs: starting a timer of duration %d microseconds (from port %d, id %d, expiryMsg.msgType 0x%08x).\n",
+                                   pTimerStartUsReq->expiryMicroSeconds,
+                                   pTimerStartUsReq->sourcePort,
+                                   pTimerStartUsReq->id,
+                                   pTimerStartUsReq->expiryMsg.msgType);
+
+    /* Allocate a timer and fill the data in */
+    pTimer = allocTimer (getMonotonicNs() + (pTimerStartUsReq->expiryMicroSeconds * NANOSECONDS_PER_MICROSECOND), 0, pTimerStartUsReq->sourcePort, pTimerStartUsReq->id, &(pTimerStartUsReq->expiryMsg));
+    if (pTimer != PNULL)
+    {
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "actionTimerStartUs: allocated a timer at 0x%08x.\n", pTimer);
+    }
+    else
+    {
+        ASSERT_ALWAYS_STRING ("actionTimerStartUs: unable to allocate a timer.");
+    }
+}
+
+/*
+ * Handle a message that will start a periodic timer.
+ *
+ * pTimerStartPeriodicReq  the timer start request message.
+ */
+static void actionTimerStartPeriodic (TimerStartPeriodicReq *pTimerStartPeriodicReq)
+{
+    Timer * pTimer;
+    uint64_t periodNs = pTimerStartPeriodicReq->periodMicroSeconds * NANOSECONDS_PER_MICROSECOND;
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "actionTimerStartPeriodic: starting a timer of period %d microseconds (from port %d, id %d, expiryMsg.msgType 0x%08x).\n",
+                                   pTimerStartPeriodicReq->periodMicroSeconds,
+                                   pTimerStartPeriodicReq->sourcePort,
+                                   pTimerStartPeriodicReq->id,
+                                   pTimerStartPeriodicReq->expiryMsg.msgType);
+
+    /* A period of zero would never be done with, make it a timer that expires once */
+    pTimer = allocTimer (getMonotonicNs() + periodNs, periodNs, pTimerStartPeriodicReq->sourcePort, pTimerStartPeriodicReq->id, &(pTimerStartPeriodicReq->expiryMsg));
+    if (pTimer != PNULL)
+    {
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "actionTimerStartPeriodic: allocated a timer at 0x%08x.\n", pTimer);
+    }
+    else
+    {
+        ASSERT_ALWAYS_STRING ("actionTimerStartPeriodic: unable to allocate a timer.");
     }    
 }
 
@@ -606,28 +756,12 @@ static void actionTimerStart (TimerStartReq *pTimerStartReq)
  */
 static void actionTimerStop (TimerStopReq *pTimerStopReq)
 {
-    UInt32 x;
-    Bool found = false;
-    TimerEntry * pEntry;
-
-    printDebug ("actionTimerStop: stopping timer id %d from port %d.\n",
-                pTimerStopReq->id,
-                pTimerStopReq->sourcePort);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "actionTimerStop: stopping timer id %d from port %d.\n",
+                                   pTimerStopReq->id,
+                                   pTimerStopReq->sourcePort);
 
     pthread_mutex_lock (&lockLinkedLists);
-    pEntry = pgUsedTimerListHead; /* Assign this here in case it has been changed by whoever held the lock */
-    
-    for (x = 0; !found && (pEntry != PNULL) && (x < MAX_NUM_TIMERS); x++)
-    {
-        if ((pEntry->timer.id == pTimerStopReq->id) && (pEntry->timer.sourcePort == pTimerStopReq->sourcePort))
-        {
-            found = true;
-            
-            freeTimerUnprotected (&(pEntry->timer));
-        }
-        pEntry = pEntry->pNextEntry;
-    }
-    
+    removeTimer (&gTimerStore, pTimerStopReq->sourcePort, pTimerStopReq->id);
     pthread_mutex_unlock (&lockLinkedLists);
 }
 
@@ -667,6 +801,16 @@ static ServerReturnCode doAction (TimerMsgType receivedMsgType, UInt8 * pReceive
             actionTimerStart ((TimerStartReq *) pReceivedMsgBody);
         }
         break;
+        case TIMER_START_US_REQ:
+        {
+            actionTimerStartUs ((TimerStartUsReq *) pReceivedMsgBody);
+        }
+        break;
+        case TIMER_START_PERIODIC_REQ:
+        {
+            actionTimerStartPeriodic ((TimerStartPeriodicReq *) pReceivedMsgBody);
+        }
+        break;
         case TIMER_STOP_REQ:
         {
             actionTimerStop ((TimerStopReq *) pReceivedMsgBody);
@@ -686,6 +830,23 @@ static ServerReturnCode doAction (TimerMsgType receivedMsgType, UInt8 * pReceive
  * PUBLIC FUNCTIONS
  */
 
+/*
+ * Get the number of timers that the timer server
+ * has running, for timer_bench.
+ *
+ * @return  the number of timers.
+ */
+UInt32 getNumTimerServerTimers (void)
+{
+    UInt32 numTimers;
+
+    pthread_mutex_lock (&lockLinkedLists);
+    numTimers = gTimerStore.numTimers;
+    pthread_mutex_unlock (&lockLinkedLists);
+
+    return numTimers;
+}
+
 /*
  * Handle a whole message received from the client.
  * 
@@ -712,8 +873,8 @@ ServerReturnCode serverHandleMsg (Msg *pReceivedMsg, Msg *pSendMsg)
     /* Check the type */
     ASSERT_PARAM (pReceivedMsg->msgType < MAX_NUM_TIMER_MSGS, pReceivedMsg->msgType);
     
-    printDebug ("T  Server received message %s, length %d.\n", pgTimerMessageNames[pReceivedMsg->msgType], pReceivedMsg->msgLength);
-    printHexDump (pReceivedMsg, pReceivedMsg->msgLength + 1);
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "T  Server received message %s, length %d.\n", pgTimerMessageNames[pReceivedMsg->msgType], pReceivedMsg->msgLength);
+    DEBUG_HEX_DUMP (DEBUG_LEVEL_TRACE, pReceivedMsg, pReceivedMsg->msgLength + 1);
     /* Do the thang */
     returnCode = doAction ((TimerMsgType) pReceivedMsg->msgType, pReceivedMsg->msgBody);
         
@@ -0,0 +1,607 @@
+/*
+ * timer_store.c
+ * Keeps running timers for the timer server and for
+ * local timers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#define DEBUG_MODULE DEBUG_MODULE_TIMER /* Before rob_system.h */
+#include <rob_system.h>
+#include <messaging_server.h>
+#include <timer_server.h>
+#include <timer_store.h>
+
+/*
+ * MANIFEST CONSTANTS
+ */
+
+/* The number of timers there is room for to begin with: the
+ * room is doubled whenever it runs out */
+#define INITIAL_NUM_TIMERS 32
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+/*
+ * Whether one timer expires before another.
+ *
+ * pA  one timer.
+ * pB  the other.
+ *
+ * @return  true if pA expires first.
+ */
+static Bool timerIsBefore (const Timer *pA, const Timer *pB)
+{
+    return (pA->expiryTimeNs < pB->expiryTimeNs) ||
+           ((pA->expiryTimeNs == pB->expiryTimeNs) && ((SInt32) (pA->sequence - pB->sequence) < 0));
+}
+
+/*
+ * Put an entry at a place in the heap.
+ *
+ * pStore  the store.
+ * pEntry  the entry.
+ * index   where to put it.
+ */
+static void placeInHeap (TimerStore *pStore, TimerEntry *pEntry, UInt32 index)
+{
+    pStore->ppHeap[index] = pEntry;
+    pEntry->heapIndex = index;
+}
+
+/*
+ * Move an entry up the heap until it
+ * is in the right place.
+ *
+ * pStore  the store.
+ * pEntry  the entry, already in the heap.
+ */
+static void siftUp (TimerStore *pStore, TimerEntry *pEntry)
+{
+    UInt32 index = pEntry->heapIndex;
+    UInt32 parent;
+
+    while ((index > 0) && timerIsBefore (&(pEntry->timer), &(pStore->ppHeap[(index - 1) / 2]->timer)))
+    {
+        parent = (index - 1) / 2;
+        placeInHeap (pStore, pStore->ppHeap[parent], index);
+        index = parent;
+    }
+    placeInHeap (pStore, pEntry, index);
+}
+
+/*
+ * Move an entry down the heap until it
+ * is in the right place.
+ *
+ * pStore  the store.
+ * pEntry  the entry, already in the heap.
+ */
+static void siftDown (TimerStore *pStore, TimerEntry *pEntry)
+{
+    UInt32 index = pEntry->heapIndex;
+    UInt32 child;
+    Bool done = false;
+
+    while (!done)
+    {
+        child = (index * 2) + 1;
+        if ((child + 1 < pStore->numTimers) && timerIsBefore (&(pStore->ppHeap[child + 1]->timer), &(pStore->ppHeap[child]->timer)))
+        {
+            child++;
+        }
+        if ((child < pStore->numTimers) && timerIsBefore (&(pStore->ppHeap[child]->timer), &(pEntry->timer)))
+        {
+            placeInHeap (pStore, pStore->ppHeap[child], index);
+            index = child;
+        }
+        else
+        {
+            done = true;
+        }
+    }
+    placeInHeap (pStore, pEntry, index);
+}
+
+/*
+ * Find the hash bucket for a source port and ID.
+ *
+ * pStore      the store.
+ * sourcePort  the source port.
+ * id          the ID.
+ *
+ * @return     a pointer to the head of the bucket.
+ */
+static TimerEntry ** getHashBucket (TimerStore *pStore, SInt32 sourcePort, TimerId id)
+{
+    UInt32 hash = (((UInt32) sourcePort << 8) | id) * 2654435761UL;
+
+    return &(pStore->ppHash[(hash >> 8) & (pStore->numHashBuckets - 1)]);
+}
+
+/*
+ * Make room for twice as many timers: grow
+ * the heap and the hash table and put the
+ * running timers back in the hash table.
+ *
+ * pStore  the store.
+ *
+ * @return  true if successful, otherwise false.
+ */
+static Bool growTimers (TimerStore *pStore)
+{
+    TimerEntry ** ppHeap;
+    TimerEntry ** ppHash;
+    TimerEntry ** ppBucket;
+    UInt32 maxNumTimers = INITIAL_NUM_TIMERS;
+    UInt32 x;
+    Bool success = false;
+
+    if (pStore->maxNumTimers > 0)
+    {
+        maxNumTimers = pStore->maxNumTimers * 2;
+    }
+
+    ppHeap = (TimerEntry **) realloc (pStore->ppHeap, maxNumTimers * sizeof (*ppHeap));
+    if (ppHeap != PNULL)
+    {
+        pStore->ppHeap = ppHeap;
+        ppHash = (TimerEntry **) calloc (maxNumTimers * 2, sizeof (*ppHash));
+        if (ppHash != PNULL)
+        {
+            free (pStore->ppHash);
+            pStore->ppHash = ppHash;
+            pStore->numHashBuckets = maxNumTimers * 2;
+            pStore->maxNumTimers = maxNumTimers;
+            for (x = 0; x < pStore->numTimers; x++)
+            {
+                ppBucket = getHashBucket (pStore, pStore->ppHeap[x]->timer.sourcePort, pStore->ppHeap[x]->timer.id);
+                pStore->ppHeap[x]->pNextEntry = *ppBucket;
+                *ppBucket = pStore->ppHeap[x];
+            }
+            DEBUG_PRINT (DEBUG_LEVEL_INFO, "growTimers: room for %d timers now.\n", pStore->maxNumTimers);
+            success = true;
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Free a timer.  The timer must exist.
+ *
+ * pStore  the store.
+ * pEntry  a pointer to the entry of the timer.
+ */
+static void freeTimer (TimerStore *pStore, TimerEntry *pEntry)
+{
+    TimerEntry ** ppEntry;
+    TimerEntry * pLastEntry;
+
+    ASSERT_PARAM (pEntry != PNULL, (unsigned long) pEntry);
+    ASSERT_PARAM2 ((pEntry->heapIndex < pStore->numTimers) && (pStore->ppHeap[pEntry->heapIndex] == pEntry), pEntry->heapIndex, pStore->numTimers);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "freeTimer: freeing the timer at 0x%08x...\n", &(pEntry->timer));
+
+    /* Unlink it from its hash bucket */
+    ppEntry = getHashBucket (pStore, pEntry->timer.sourcePort, pEntry->timer.id);
+    while ((*ppEntry != PNULL) && (*ppEntry != pEntry))
+    {
+        ppEntry = &((*ppEntry)->pNextEntry);
+    }
+    ASSERT_PARAM (*ppEntry == pEntry, (unsigned long) pEntry);
+    *ppEntry = pEntry->pNextEntry;
+
+    /* Take it out of the heap, putting the last entry in its place */
+    pStore->numTimers--;
+    if (pEntry->heapIndex < pStore->numTimers)
+    {
+        pLastEntry = pStore->ppHeap[pStore->numTimers];
+        placeInHeap (pStore, pLastEntry, pEntry->heapIndex);
+        siftUp (pStore, pLastEntry);
+        siftDown (pStore, pLastEntry);
+    }
+
+    /* Put it on the front of the free list */
+    memset (&(pEntry->timer), 0, sizeof (pEntry->timer));
+    pEntry->pNextEntry = pStore->pFreeListHead;
+    pStore->pFreeListHead = pEntry;
+}
+
+/*
+ * PUBLIC FUNCTIONS
+ */
+
+/*
+ * Print the running timers for debug purposes.
+ *
+ * pStore  the store.
+ */
+void printDebugTimerStore (TimerStore *pStore)
+{
+    UInt32 x;
+    TimerEntry * pEntry;
+
+    if (pStore->numTimers == 0)
+    {
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "No timers running.\n");
+    }
+    else
+    {
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "%d timer(s) running, in heap order:\n", pStore->numTimers);
+        for (x = 0; x < pStore->numTimers; x++)
+        {
+            pEntry = pStore->ppHeap[x];
+            DEBUG_PRINT (DEBUG_LEVEL_TRACE, " %d (0x%08x): expires %llu, id %d/%d, expiryMsg.msgType 0x%08x.\n",
+                                           x,
+                                           &(pEntry->timer),
+                                           (unsigned long long) pEntry->timer.expiryTimeNs,
+                                           pEntry->timer.sourcePort,
+                                           pEntry->timer.id,
+                                           pEntry->timer.expiryMsg.msgType);
+        }
+    }
+}
+
+/*
+ * Open a store: make room for the first timers,
+ * more is made as it is needed, and create the
+ * timerfd, which is armed as timers are added.
+ *
+ * pStore       the store.
+ * nonBlocking  true if a read() of the timerfd
+ *              should return straight away when
+ *              it hasn't gone off, rather than
+ *              waiting for it to.
+ *
+ * @return      true if successful, otherwise false.
+ */
+Bool openTimerStore (TimerStore *pStore, Bool nonBlocking)
+{
+    Bool success = false;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    memset (pStore, 0, sizeof (*pStore));
+    pStore->timerFd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | (nonBlocking ? TFD_NONBLOCK : 0));
+    if (pStore->timerFd >= 0)
+    {
+        success = growTimers (pStore);
+        if (!success)
+        {
+            close (pStore->timerFd);
+            pStore->timerFd = -1;
+        }
+    }
+
+    return success;
+}
+
+/*
+ * Close a store: free the timers, the free list,
+ * the heap and the hash table and close the timerfd.
+ *
+ * pStore  the store.
+ */
+void closeTimerStore (TimerStore *pStore)
+{
+    TimerEntry * pEntry;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    removeAllTimers (pStore);
+    while (pStore->pFreeListHead != PNULL)
+    {
+        pEntry = pStore->pFreeListHead;
+        pStore->pFreeListHead = pEntry->pNextEntry;
+        free (pEntry);
+    }
+    free (pStore->ppHeap);
+    pStore->ppHeap = PNULL;
+    free (pStore->ppHash);
+    pStore->ppHash = PNULL;
+    pStore->maxNumTimers = 0;
+    pStore->numHashBuckets = 0;
+    if (pStore->timerFd >= 0)
+    {
+        close (pStore->timerFd);
+    }
+    pStore->timerFd = -1;
+    pStore->timerFdExpiryTimeNs = 0;
+    pStore->timerFdNotBeforeNs = 0;
+}
+
+/*
+ * Add a timer to a store and arm the timerfd
+ * if it is now the first to expire.
+ *
+ * pStore        the store.
+ * expiryTimeNs  when the timer expires, against
+ *               getMonotonicNs()
+ * periodNs      how often it expires after that,
+ *               0 if it doesn't
+ * sourcePort    the port to send the expiry message to
+ * id            the id for the timer
+ * pExpiryMsg    a pointer to the expiry message to send
+ *
+ * @return  a pointer to the timer or PNULL if
+ *          unable to allocate one.
+ */
+Timer * addTimer (TimerStore *pStore, uint64_t expiryTimeNs, uint64_t periodNs, SInt32 sourcePort, TimerId id, ShortMsg *pExpiryMsg)
+{
+    Timer * pAlloc = PNULL;
+    TimerEntry * pEntry;
+    TimerEntry ** ppBucket;
+    Bool success = true;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+    ASSERT_PARAM (pExpiryMsg != PNULL, (unsigned long) pExpiryMsg);
+
+    if (pStore->numTimers == pStore->maxNumTimers)
+    {
+        success = growTimers (pStore);
+    }
+
+    if (success)
+    {
+        /* Take an entry from the front of the free list, or make a new one */
+        pEntry = pStore->pFreeListHead;
+        if (pEntry != PNULL)
+        {
+            pStore->pFreeListHead = pEntry->pNextEntry;
+        }
+        else
+        {
+            pEntry = (TimerEntry *) malloc (sizeof (TimerEntry));
+        }
+
+        if (pEntry != PNULL)
+        {
+            pAlloc = &(pEntry->timer);
+
+            /* Copy the data in; a ShortMsg is laid out as the start of a Msg */
+            memset (pAlloc, 0, sizeof (*pAlloc));
+            pAlloc->expiryTimeNs = expiryTimeNs;
+            pAlloc->periodNs = periodNs;
+            pAlloc->sequence = pStore->sequence;
+            pStore->sequence++;
+            pAlloc->id = id;
+            pAlloc->sourcePort = sourcePort;
+            memcpy (&(pAlloc->expiryMsg), pExpiryMsg, sizeof (*pExpiryMsg));
+
+            DEBUG_PRINT (DEBUG_LEVEL_TRACE, "addTimer: timer should expire at %llu.\n", (unsigned long long) pAlloc->expiryTimeNs);
+
+            /* Put it in the hash table and in the heap */
+            ppBucket = getHashBucket (pStore, sourcePort, id);
+            pEntry->pNextEntry = *ppBucket;
+            *ppBucket = pEntry;
+            placeInHeap (pStore, pEntry, pStore->numTimers);
+            pStore->numTimers++;
+            siftUp (pStore, pEntry);
+            armTimerStoreFd (pStore);
+
+            if (DEBUG_IS_ON (DEBUG_LEVEL_TRACE))
+            {
+                printDebugTimerStore (pStore);
+            }
+        }
+    }
+
+    return pAlloc;
+}
+
+/*
+ * Remove a timer from a store, if it is
+ * running, and re-arm the timerfd.
+ *
+ * pStore      the store.
+ * sourcePort  the port the timer was started for.
+ * id          the id of the timer.
+ *
+ * @return     true if the timer was running,
+ *             otherwise false.
+ */
+Bool removeTimer (TimerStore *pStore, SInt32 sourcePort, TimerId id)
+{
+    TimerEntry * pEntry;
+    Bool found = false;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    /* Find it in its hash bucket */
+    pEntry = *getHashBucket (pStore, sourcePort, id);
+    while ((pEntry != PNULL) && ((pEntry->timer.id != id) || (pEntry->timer.sourcePort != sourcePort)))
+    {
+        pEntry = pEntry->pNextEntry;
+    }
+    if (pEntry != PNULL)
+    {
+        freeTimer (pStore, pEntry);
+        armTimerStoreFd (pStore);
+        found = true;
+    }
+
+    return found;
+}
+
+/*
+ * Remove all the timers from a store and
+ * disarm the timerfd.
+ *
+ * pStore  the store.
+ */
+void removeAllTimers (TimerStore *pStore)
+{
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    DEBUG_PRINT (DEBUG_LEVEL_TRACE, "removeAllTimers: freeing all timers.\n");
+
+    while (pStore->numTimers > 0)
+    {
+        freeTimer (pStore, pStore->ppHeap[pStore->numTimers - 1]);
+    }
+    armTimerStoreFd (pStore);
+}
+
+/*
+ * Get the timer that is first to expire, if
+ * it has.  Only the top of the heap need be
+ * looked at.
+ *
+ * pStore  the store.
+ * nowNs   the time now.
+ *
+ * @return the timer, PNULL if there are none
+ *         or the first hasn't expired yet.
+ */
+Timer * getExpiredTimer (TimerStore *pStore, uint64_t nowNs)
+{
+    Timer * pTimer = PNULL;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    if ((pStore->numTimers > 0) && (pStore->ppHeap[0]->timer.expiryTimeNs <= nowNs))
+    {
+        pTimer = &(pStore->ppHeap[0]->timer);
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "getExpiredTimer: timer at 0x%08x expired %llu ns late.\n", pTimer, (unsigned long long) (nowNs - pTimer->expiryTimeNs));
+    }
+
+    return pTimer;
+}
+
+/*
+ * Be done with the timer that getExpiredTimer()
+ * returned, its expiry having been dealt with:
+ * free it or, for a periodic timer, put it back
+ * in the heap for its next expiry.  The timerfd
+ * is left alone, armTimerStoreFd() is called
+ * once all the expiries have been dealt with.
+ *
+ * pStore  the store.
+ * nowNs   the time passed to getExpiredTimer().
+ */
+void finishExpiredTimer (TimerStore *pStore, uint64_t nowNs)
+{
+    TimerEntry * pEntry;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+    ASSERT_PARAM (pStore->numTimers > 0, pStore->numTimers);
+
+    pEntry = pStore->ppHeap[0];
+    if (pEntry->timer.periodNs > 0)
+    {
+        /* Next time is a whole number of periods on from the
+         * start, so there's no drift; any periods missed while
+         * behind are skipped rather than sent in a rush */
+        pEntry->timer.expiryTimeNs += pEntry->timer.periodNs;
+        if (pEntry->timer.expiryTimeNs <= nowNs)
+        {
+            pEntry->timer.expiryTimeNs += ((nowNs - pEntry->timer.expiryTimeNs) / pEntry->timer.periodNs + 1) * pEntry->timer.periodNs;
+        }
+        pEntry->timer.sequence = pStore->sequence;
+        pStore->sequence++;
+        siftDown (pStore, pEntry);
+    }
+    else
+    {
+        /* Then free this timer entry */
+        freeTimer (pStore, pEntry);
+    }
+
+    if (DEBUG_IS_ON (DEBUG_LEVEL_TRACE))
+    {
+        printDebugTimerStore (pStore);
+    }
+}
+
+/*
+ * Arm the timerfd of a store for a time.  Nothing
+ * is done if it is already armed for that time.
+ *
+ * pStore        the store.
+ * expiryTimeNs  the time, against getMonotonicNs(),
+ *               0 to disarm it.
+ */
+void armTimerStoreFdAt (TimerStore *pStore, uint64_t expiryTimeNs)
+{
+    struct itimerspec its;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    if (expiryTimeNs != pStore->timerFdExpiryTimeNs)
+    {
+        /* An it_value of zero disarms it */
+        memset (&its, 0, sizeof (its));
+        its.it_value.tv_sec = expiryTimeNs / 1000000000ULL;
+        its.it_value.tv_nsec = expiryTimeNs % 1000000000ULL;
+        if (timerfd_settime (pStore->timerFd, TFD_TIMER_ABSTIME, &its, PNULL) != 0)
+        {
+            ASSERT_ALWAYS_STRING ("armTimerStoreFdAt: failed timerfd_settime().");
+        }
+        pStore->timerFdExpiryTimeNs = expiryTimeNs;
+        DEBUG_PRINT (DEBUG_LEVEL_TRACE, "armTimerStoreFdAt: armed for %llu.\n", (unsigned long long) expiryTimeNs);
+    }
+}
+
+/*
+ * Arm the timerfd of a store for the expiry of
+ * the timer at the top of the heap, but not before
+ * the time set with setTimerStoreFdNotBefore(), or
+ * disarm it if there are no timers.
+ *
+ * pStore  the store.
+ */
+void armTimerStoreFd (TimerStore *pStore)
+{
+    uint64_t expiryTimeNs = 0;
+
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    if (pStore->numTimers > 0)
+    {
+        expiryTimeNs = pStore->ppHeap[0]->timer.expiryTimeNs;
+        if (expiryTimeNs < pStore->timerFdNotBeforeNs)
+        {
+            expiryTimeNs = pStore->timerFdNotBeforeNs;
+        }
+    }
+
+    armTimerStoreFdAt (pStore, expiryTimeNs);
+}
+
+/*
+ * Hold the timerfd of a store off until a time,
+ * however soon the timers that are added or
+ * removed meanwhile expire, and arm it.  Used to
+ * back off when the expiries can't be dealt with
+ * yet.
+ *
+ * pStore       the store.
+ * notBeforeNs  the time, against getMonotonicNs(),
+ *              0 to stop holding it off.
+ */
+void setTimerStoreFdNotBefore (TimerStore *pStore, uint64_t notBeforeNs)
+{
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    pStore->timerFdNotBeforeNs = notBeforeNs;
+    armTimerStoreFd (pStore);
+}
+
+/*
+ * Note that the timerfd of a store has gone off,
+ * having been read, and so is no longer armed.
+ *
+ * pStore  the store.
+ */
+void noteTimerStoreFdGoneOff (TimerStore *pStore)
+{
+    ASSERT_PARAM (pStore != PNULL, (unsigned long) pStore);
+
+    pStore->timerFdExpiryTimeNs = 0;
+}
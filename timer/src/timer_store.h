@@ -0,0 +1,78 @@
+/*
+ * timer_store.h
+ * The keeping of running timers, in soonest-first order,
+ * with a timerfd that goes off when the first of them
+ * expires; used by the timer server and by local timers.
+ * There's no locking in here: whoever has a store
+ * serialises the calls for it.
+ */
+
+/*
+ * TYPES
+ */
+
+/* A type to hold a timer */
+typedef struct TimerTag
+{
+    uint64_t expiryTimeNs;  /* Against getMonotonicNs() */
+    uint64_t periodNs;      /* 0 for a timer that only expires once */
+    UInt32 sequence;  /* Timers that expire at the same time do so in the order they were started */
+    TimerId id;
+    SInt32 sourcePort;
+    Msg expiryMsg;
+} Timer;
+
+/* An entry holding a timer: it is in the heap and in a
+ * hash bucket, or in the free list */
+typedef struct TimerEntryTag
+{
+    Timer timer;
+    UInt32 heapIndex;
+    struct TimerEntryTag * pNextEntry;  /* The next in the hash bucket or the free list */
+} TimerEntry;
+
+/* A store of timers */
+typedef struct TimerStoreTag
+{
+    /* Head of free timer linked list */
+    TimerEntry * pFreeListHead;
+    /* The running timers, a min-heap on expiry time so that the
+     * soonest to expire is at the top, and the room there is */
+    TimerEntry ** ppHeap;
+    UInt32 numTimers;
+    UInt32 maxNumTimers;
+    /* The running timers again, hashed on source port and ID for
+     * stopping them; there are twice as many buckets as there is
+     * room for timers, always a power of two */
+    TimerEntry ** ppHash;
+    UInt32 numHashBuckets;
+    /* The number of timers ever started */
+    UInt32 sequence;
+    /* The timerfd, armed for the expiry of the timer at the top
+     * of the heap and not at all when there are none, the
+     * expiry it is armed for (0 if it isn't) and the time it is
+     * never armed for earlier than by armTimerStoreFd() (0 if
+     * there is none) */
+    SInt32 timerFd;
+    uint64_t timerFdExpiryTimeNs;
+    uint64_t timerFdNotBeforeNs;
+} TimerStore;
+
+/*
+ * FUNCTION PROTOTYPES
+ */
+Bool openTimerStore (TimerStore *pStore, Bool nonBlocking);
+void closeTimerStore (TimerStore *pStore);
+Timer * addTimer (TimerStore *pStore, uint64_t expiryTimeNs, uint64_t periodNs, SInt32 sourcePort, TimerId id, ShortMsg *pExpiryMsg);
+Bool removeTimer (TimerStore *pStore, SInt32 sourcePort, TimerId id);
+void removeAllTimers (TimerStore *pStore);
+Timer * getExpiredTimer (TimerStore *pStore, uint64_t nowNs);
+void finishExpiredTimer (TimerStore *pStore, uint64_t nowNs);
+void armTimerStoreFdAt (TimerStore *pStore, uint64_t expiryTimeNs);
+void armTimerStoreFd (TimerStore *pStore);
+void setTimerStoreFdNotBefore (TimerStore *pStore, uint64_t notBeforeNs);
+void noteTimerStoreFdGoneOff (TimerStore *pStore);
+void printDebugTimerStore (TimerStore *pStore);
+
+/* The timer server's own store is in timer_server.c */
+UInt32 getNumTimerServerTimers (void);